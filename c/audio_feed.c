@@ -22,7 +22,6 @@
 #include <stdlib.h>
 #include <string.h>
 #include <jack/jack.h>
-#include <jack/ringbuffer.h>
 #include "sourceclient.h"
 #include "main.h"
 
@@ -30,70 +29,32 @@ typedef jack_default_audio_sample_t sample_t;
 
 static struct audio_feed *audio_feed;
 
+/* the capture ring is written once per period however many encoders and
+ * recorders are reading from it, so the cost here is constant
+ */
 int audio_feed_process_audio(jack_nframes_t n_frames, void *arg)
     {
     struct audio_feed *self = audio_feed;
-    struct threads_info *ti = self->threads_info;
-    struct encoder *e;
-    struct recorder *r;
     sample_t *input_port_buffer[2];
-    int i;
     
     input_port_buffer[0] = jack_port_get_buffer(g.port.output_in_l, n_frames);
     input_port_buffer[1] = jack_port_get_buffer(g.port.output_in_r, n_frames);
-    
-    /* feed pcm audio data to all encoders that request it */
-    for (i = 0; i < ti->n_encoders; i++)
-        {
-        e = ti->encoder[i];
-        switch (e->jack_dataflow_control)
-            {
-            case JD_OFF:
-                break;
-            case JD_ON:
-                while (jack_ringbuffer_write_space(e->input_rb[1]) < n_frames * sizeof (sample_t))
-                    nanosleep(&(struct timespec){0, 10000000}, NULL);
-                    
-                jack_ringbuffer_write(e->input_rb[0], (char *)input_port_buffer[0], n_frames * sizeof (sample_t));
-                jack_ringbuffer_write(e->input_rb[1], (char *)input_port_buffer[1], n_frames * sizeof (sample_t));
-                break;
-            case JD_FLUSH:
-                jack_ringbuffer_reset(e->input_rb[0]);
-                jack_ringbuffer_reset(e->input_rb[1]);
-                e->jack_dataflow_control = JD_OFF;
-                break;
-            default:
-                fprintf(stderr, "jack_process_callback: unhandled jack_dataflow_control parameter\n");
-            }
-        }
-        
-    for (i = 0; i < ti->n_recorders; i++)
-        {
-        r = ti->recorder[i];
-        switch (r->jack_dataflow_control)
-            {
-            case JD_OFF:
-                break;
-            case JD_ON:
-                while (jack_ringbuffer_write_space(r->input_rb[1]) < n_frames * sizeof (sample_t))
-                    nanosleep(&(struct timespec){0, 10000000}, NULL);                
-
-                jack_ringbuffer_write(r->input_rb[0], (char *)input_port_buffer[0], n_frames * sizeof (sample_t));
-                jack_ringbuffer_write(r->input_rb[1], (char *)input_port_buffer[1], n_frames * sizeof (sample_t));
-                break;
-            case JD_FLUSH:
-                jack_ringbuffer_reset(r->input_rb[0]);
-                jack_ringbuffer_reset(r->input_rb[1]);
-                r->jack_dataflow_control = JD_OFF;
-                break;
-            default:
-                fprintf(stderr, "jack_process_callback: unhandled jack_dataflow_control parameter\n");
-            }   
-        }
-      
+    capture_ring_write(self->capture_ring, input_port_buffer, n_frames);
     return 0;
     }
 
+/* audio_feed_backlog: how far behind the slowest encoder or recorder is */
+size_t audio_feed_backlog()
+    {
+    return capture_ring_max_lag(audio_feed->capture_ring);
+    }
+
+/* audio_feed_render_ready: true when writing n_frames would overtake no reader, offline rendering only */
+int audio_feed_render_ready(jack_nframes_t n_frames)
+    {
+    return audio_feed_backlog() + n_frames <= audio_feed->capture_ring->size >> 1;
+    }
+
 int audio_feed_jack_samplerate_request(struct threads_info *ti, struct universal_vars *uv, void *param)
     {
     fprintf(g.out, "idjcsc: sample_rate=%ld\n", (long)ti->audio_feed->sample_rate);
@@ -106,6 +67,7 @@ int audio_feed_jack_samplerate_request(struct threads_info *ti, struct universal
 struct audio_feed *audio_feed_init(struct threads_info *ti)
     {
     struct audio_feed *self;
+    char *policy;
 
     if (!(self = audio_feed = calloc(1, sizeof (struct audio_feed))))
         {
@@ -115,6 +77,24 @@ struct audio_feed *audio_feed_init(struct threads_info *ti)
 
     self->threads_info = ti;      
     self->sample_rate = jack_get_sample_rate(g.client);
+
+    /* enough for two seconds of audio */
+    if (!(self->capture_ring = capture_ring_create(self->sample_rate * 2)))
+        {
+        free(self);
+        return audio_feed = NULL;
+        }
+    self->capture_ring->backpressure = atoi(getenv("offline_render"));
+
+    policy = getenv("audio_feed_overflow");
+    if (policy && !strcmp(policy, "fold"))
+        self->overflow_policy = CR_FOLD;
+    else
+        {
+        if (policy && strcmp(policy, "drop"))
+            fprintf(stderr, "audio_feed_init: unknown overflow policy %s, using drop\n", policy);
+        self->overflow_policy = CR_DROP;
+        }
     return self;
     }
 
@@ -122,5 +102,6 @@ struct audio_feed *audio_feed_init(struct threads_info *ti)
 void audio_feed_destroy(struct audio_feed *self)
     {
     self->threads_info->audio_feed = NULL;
+    capture_ring_destroy(self->capture_ring);
     free(self);
     }
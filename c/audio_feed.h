@@ -22,11 +22,14 @@
 
 #include <jack/jack.h>
 #include "sourceclient.h"
+#include "capture_ring.h"
 
 struct audio_feed
     {
     struct threads_info *threads_info;
     jack_nframes_t sample_rate;
+    struct capture_ring *capture_ring;   /* shared by all the encoders and recorders */
+    enum capture_overflow_policy overflow_policy;
     };
 
 struct audio_feed *audio_feed_init(struct threads_info *ti);
@@ -34,5 +37,7 @@ void audio_feed_deactivate(struct audio_feed *self);
 void audio_feed_destroy(struct audio_feed *self);
 int audio_feed_jack_samplerate_request(struct threads_info *ti, struct universal_vars *uv, void *param);
 int audio_feed_process_audio(jack_nframes_t n_frames, void *arg);
+size_t audio_feed_backlog();
+int audio_feed_render_ready(jack_nframes_t n_frames);
 
 #endif
@@ -30,7 +30,6 @@
 
 #define BYTE_ALIGNMENT (8)
 
-static const struct timespec time_delay = { .tv_nsec = 10 };
 
 static void packetize_metadata(struct encoder *e, struct avenc_data * const s)
     {
@@ -92,8 +91,7 @@ static void live_avcodec_encoder_main(struct encoder *encoder)
             c->profile = FF_PROFILE_AAC_LOW;
 
         // start the codec preferably with float inputs else signed 16 bit integer inputs
-        while (pthread_mutex_trylock(&g.avc_mutex))
-            nanosleep(&time_delay, NULL);
+        pthread_mutex_lock(&g.avc_mutex);
         if (avcodec_open2(c, s->codec, NULL) < 0) {
             fprintf(stderr, "live_avcodec_encoder_main: will retry with signed 16 bit: %s\n", s->codec->name);
             c->sample_fmt = AV_SAMPLE_FMT_S16;
@@ -238,8 +236,11 @@ static void live_avcodec_encoder_main(struct encoder *encoder)
 
     if (encoder->encoder_state == ES_STOPPING) {
         if (s->c) {
-            if (avcodec_is_open(s->c))
+            if (avcodec_is_open(s->c)) {
+                pthread_mutex_lock(&g.avc_mutex);
                 avcodec_close(s->c);
+                pthread_mutex_unlock(&g.avc_mutex);
+            }
             av_free(s->c);
             s->c = NULL;
         }
@@ -42,9 +42,69 @@
 #define AVCODEC_MAX_AUDIO_FRAME_SIZE 192000
 #endif
 
+#define AVIO_BUFFER_SIZE 65536
+
 extern int dynamic_metadata_form[];
 
-static const struct timespec time_delay = { .tv_nsec = 10 };
+/* g.avc_mutex is held only for avcodec_open2 and avcodec_close which are not
+ * thread safe, each player decodes through its own codec context unlocked */
+
+static int avcodecdecode_read(void *opaque, uint8_t *buf, int buf_size)
+    {
+    struct filesource *fs = opaque;
+    size_t bytes = filesource_read(fs, buf, buf_size);
+
+    if (bytes == 0)
+        return fs->error ? AVERROR(fs->error) : AVERROR_EOF;
+    return bytes;
+    }
+
+static int64_t avcodecdecode_seek(void *opaque, int64_t offset, int whence)
+    {
+    struct filesource *fs = opaque;
+
+    if (whence & AVSEEK_SIZE)
+        return filesource_size(fs);
+    if (filesource_seek(fs, offset, whence & ~AVSEEK_FORCE))
+        return -1;
+    return filesource_tell(fs);
+    }
+
+/* avcodecdecode_open_input: avformat_open_input reading from self->fs which is closed on failure */
+static int avcodecdecode_open_input(struct avcodecdecode_vars *self, char *pathname)
+    {
+    unsigned char *buffer;
+
+    if (!(buffer = av_malloc(AVIO_BUFFER_SIZE)) ||
+                !(self->avio = avio_alloc_context(buffer, AVIO_BUFFER_SIZE, 0, self->fs, avcodecdecode_read, NULL, avcodecdecode_seek)))
+        {
+        av_free(buffer);
+        filesource_close(self->fs);
+        return -1;
+        }
+    if (!(self->ic = avformat_alloc_context()))
+        goto fail;
+    self->ic->pb = self->avio;
+    self->ic->flags |= AVFMT_FLAG_CUSTOM_IO;
+    /* self->ic is freed on failure */
+    if (avformat_open_input(&self->ic, pathname, NULL, NULL) < 0)
+        goto fail;
+    return 0;
+
+    fail:
+    av_freep(&self->avio->buffer);
+    av_freep(&self->avio);
+    filesource_close(self->fs);
+    return -1;
+    }
+
+static void avcodecdecode_close_input(struct avcodecdecode_vars *self)
+    {
+    avformat_close_input(&self->ic);
+    av_freep(&self->avio->buffer);
+    av_freep(&self->avio);
+    filesource_close(self->fs);
+    }
 
 static void avcodecdecode_eject(struct xlplayer *xlplayer)
     {
@@ -63,11 +123,10 @@ static void avcodecdecode_eject(struct xlplayer *xlplayer)
     if (self->swr)
         swr_free(&self->swr);
 #endif
-    while (pthread_mutex_trylock(&g.avc_mutex))
-        nanosleep(&time_delay, NULL);
+    pthread_mutex_lock(&g.avc_mutex);
     avcodec_close(self->c);
     pthread_mutex_unlock(&g.avc_mutex);
-    avformat_close_input(&self->ic);
+    avcodecdecode_close_input(self);
     if (self->frame)
         av_freep(&self->frame);
     free(self);
@@ -94,6 +153,22 @@ static void avcodecdecode_init(struct xlplayer *xlplayer)
         }
         
     self->channels = (self->c->channels == 1) ? 1 : 2;
+
+    /* integer formats go through a conversion kernel */
+    switch (self->c->sample_fmt)
+        {
+        case AV_SAMPLE_FMT_S16:
+        case AV_SAMPLE_FMT_S16P:
+            pcmconv_select(&self->conv, 16, 16, self->c->sample_fmt == AV_SAMPLE_FMT_S16P);
+            break;
+        case AV_SAMPLE_FMT_S32:
+        case AV_SAMPLE_FMT_S32P:
+            pcmconv_select(&self->conv, 32, 32, self->c->sample_fmt == AV_SAMPLE_FMT_S32P);
+            break;
+        default:
+            self->conv.kernel = NULL;
+        }
+
     if ((self->resample = (self->c->sample_rate != (int)xlplayer->samplerate)))
         {
         fprintf(stderr, "configuring resampler\n");
@@ -182,10 +257,7 @@ static void avcodecdecode_play(struct xlplayer *xlplayer)
                 avcodec_get_frame_defaults(self->frame);
             }
 
-        while (pthread_mutex_trylock(&g.avc_mutex))
-            nanosleep(&time_delay, NULL);
         len = avcodec_decode_audio4(self->c, self->frame, &got_frame, &self->pktcopy);
-        pthread_mutex_unlock(&g.avc_mutex);
 
         if (len < 0)
             {
@@ -329,51 +401,13 @@ static void avcodecdecode_play(struct xlplayer *xlplayer)
                 break;
                 
             case AV_SAMPLE_FMT_S16:
-                 frames = (buffer_size >> 1) / channels;
-                xlplayer_make_audio_to_float(xlplayer, self->floatsamples,
-                                self->frame->data[0], frames, 16, channels);
-                break;
-
             case AV_SAMPLE_FMT_S16P:
-                frames = (buffer_size >> 1) / channels;
-                {
-                int16_t *l = (int16_t *)self->frame->data[0];
-                int16_t *r = NULL;
-                if (channels == 2)
-                    r = (int16_t *)self->frame->data[1];
-                float *d = self->floatsamples;
-                float *endp = self->floatsamples + (channels * frames);
-                while (d < endp)
-                    {
-                    *d++ = *l++ / 32768.0f;
-                    if (channels == 2)
-                        *d++ = *r++ / 32768.0f;
-                    }
-                }
-                break;
-                
             case AV_SAMPLE_FMT_S32:
-                frames = (buffer_size >> 2) / channels;
-                xlplayer_make_audio_to_float(xlplayer, self->floatsamples,
-                                self->frame->data[0], frames, 32, channels);
-                break;
-
             case AV_SAMPLE_FMT_S32P:
-                frames = (buffer_size >> 2) / channels;
-                {
-                int32_t *l = (int32_t *)self->frame->data[0];
-                int32_t *r = NULL;
-                if (channels == 2)
-                    r = (int32_t *)self->frame->data[1];
-                float *d = self->floatsamples;
-                float *endp = self->floatsamples + (channels * frames);
-                while (d < endp)
-                    {
-                    *d++ = *l++ / 1073741824.0f;
-                    if (channels == 2)
-                        *d++ = *r++ / 1073741824.0f;
-                    }
-                }
+                frames = (buffer_size / (self->conv.container_bits >> 3)) / channels;
+                pcmconv_run(&self->conv, self->floatsamples, (const void * const *)self->frame->data, frames, channels);
+                if (xlplayer->dither && self->conv.valid_bits < 20)
+                    pcmconv_dither(self->floatsamples, frames * channels, 0.5F * self->conv.scale, &xlplayer->noise);
                 break;
 
             case AV_SAMPLE_FMT_NONE:
@@ -438,18 +472,26 @@ int avcodecdecode_reg(struct xlplayer *xlplayer)
     else
         xlplayer->dec_data = self;
     
-    if ((fp = fopen(xlplayer->pathname, "r")))
+    if (!(self->fs = filesource_open(xlplayer->pathname)))
+        {
+        fprintf(stderr, "avcodecdecode_reg: failed to open input file %s\n", xlplayer->pathname);
+        free(self);
+        return REJECTED;
+        }
+
+    if ((fp = filesource_stream(self->fs)))
         {
         mp3_tag_read(&self->taginfo, fp);
+        fclose(fp);
         if ((chapter = mp3_tag_chapter_scan(&self->taginfo, xlplayer->play_progress_ms + 70)))
             {
             self->current_chapter = chapter;
             xlplayer_set_dynamic_metadata(xlplayer, dynamic_metadata_form[chapter->title.encoding], chapter->artist.text, chapter->title.text, chapter->album.text, 70);
             }
-        fclose(fp);
         }
-    
-    if (avformat_open_input(&self->ic, xlplayer->pathname, NULL, NULL) < 0)
+    filesource_seek(self->fs, 0, SEEK_SET);
+
+    if (avcodecdecode_open_input(self, xlplayer->pathname) < 0)
         {
         fprintf(stderr, "avcodecdecode_reg: failed to open input file %s\n", xlplayer->pathname);
         free(self);
@@ -459,21 +501,18 @@ int avcodecdecode_reg(struct xlplayer *xlplayer)
     if (avformat_find_stream_info(self->ic, NULL) < 0)
         {
         fprintf(stderr, "avcodecdecode_reg: call to avformat_find_stream_info failed\n");
-        avformat_close_input(&self->ic);
+        avcodecdecode_close_input(self);
         free(self);
         return REJECTED;
         }
 
-    while (pthread_mutex_trylock(&g.avc_mutex))
-        nanosleep(&time_delay, NULL);
     if ((self->stream = av_find_best_stream(self->ic, AVMEDIA_TYPE_AUDIO, -1, -1, &self->codec, 0)) < 0)
         {
         fprintf(stderr, "Cannot find an audio stream in the input file\n");
-        avformat_close_input(&self->ic);
+        avcodecdecode_close_input(self);
         free(self);
         return REJECTED;
         }
-    pthread_mutex_unlock(&g.avc_mutex);
 
     self->c = self->ic->streams[self->stream]->codec;
 #ifndef USE_SWRESAMPLE
@@ -481,13 +520,12 @@ int avcodecdecode_reg(struct xlplayer *xlplayer)
     self->c->request_channel_layout = AV_CH_LAYOUT_STEREO_DOWNMIX;
 #endif
 
-    while (pthread_mutex_trylock(&g.avc_mutex))
-        nanosleep(&time_delay, NULL);
+    pthread_mutex_lock(&g.avc_mutex);
     if (avcodec_open2(self->c, self->codec, NULL) < 0)
         {
         pthread_mutex_unlock(&g.avc_mutex);
         fprintf(stderr, "avcodecdecode_reg: could not open codec\n");
-        avformat_close_input(&self->ic);
+        avcodecdecode_close_input(self);
         free(self);
         return REJECTED;
         }
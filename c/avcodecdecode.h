@@ -30,6 +30,8 @@
 
 #include "xlplayer.h"
 #include "mp3tagread.h"
+#include "filesource.h"
+#include "pcmconv.h"
 
 struct avcodecdecode_vars
     {
@@ -38,6 +40,8 @@ struct avcodecdecode_vars
     AVPacket pktcopy;
     AVCodecContext *c;
     AVFormatContext *ic;
+    AVIOContext *avio;      /* libavformat reads through the file source */
+    struct filesource *fs;
     int size;
     int resample;
     unsigned int stream;
@@ -46,6 +50,7 @@ struct avcodecdecode_vars
     struct mp3taginfo taginfo;
     struct chapter *current_chapter;
     int channels;   /* number of downmixed channels 1 or 2 */
+    struct pcmconv conv;    /* for integer sample formats */
 
 #ifdef HAVE_SWRESAMPLE
     SwrContext *swr;
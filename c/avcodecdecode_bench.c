@@ -0,0 +1,196 @@
+/*
+#   avcodecdecode_bench.c: aggregate decode throughput of concurrent players
+#   Copyright (C) 2013 Stephen Fairchild (s-fairchild@users.sf.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Usage: avcodecdecode_bench [-n players] [-r rate] [-s] file
+ *
+ * Opens the file on each of n players through avcodecdecode_reg and calls
+ * dec_play until the end of the file, each player in a thread of its own as
+ * the player threads would be. The ringbuffers are emptied after each call
+ * in place of the JACK reader. -r sets the player rate and so whether the
+ * resampler is in use. The -s option holds g.avc_mutex over every dec_play
+ * call as avcodecdecode.c used to, for comparison.
+ */
+
+#include "../config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "xlplayer.h"
+#include "avcodecdecode.h"
+#include "main.h"
+#include "bench_common.h"
+
+#define TRUE 1
+#define FALSE 0
+
+struct globs g;
+unsigned long sr;                       /* the mixer's sample rate as smoothing.c sees it */
+
+#ifdef HAVE_LIBAV
+
+struct bench_player
+    {
+    pthread_t thread_h;
+    struct xlplayer *xlplayer;
+    double seconds;              /* duration of the audio decoded */
+    int failed;
+    };
+
+static int serialize;
+static char *pathname;
+
+/* bench_player_main: what xlplayer_main does to play a track start to finish */
+static void *bench_player_main(void *args)
+    {
+    struct bench_player *self = args;
+    struct xlplayer *p = self->xlplayer;
+
+    self->failed = TRUE;
+    p->pathname = pathname;
+    p->seek_s = 0;
+    p->playmode = PM_STOPPED;
+    if (!avcodecdecode_reg(p))
+        {
+        fprintf(stderr, "bench_player_main: the decoder rejected %s\n", pathname);
+        return NULL;
+        }
+    p->playmode = PM_PLAYING;
+    p->play_progress_ms = 0;
+    p->write_deferred = 0;
+    p->pause = 0;
+    p->samples_written = 0;
+    p->sleep_samples = 0;
+    fade_set(p->fadein, FADE_SET_HIGH, -1.0f, FADE_IN);
+    p->silence = 0.0f;
+    p->dec_init(p);
+    if (p->playmode != PM_PLAYING)
+        {
+        fprintf(stderr, "bench_player_main: the decoder failed to start on %s\n", pathname);
+        return NULL;
+        }
+
+    while (p->playmode == PM_PLAYING)
+        {
+        if (serialize)
+            pthread_mutex_lock(&g.avc_mutex);
+        p->dec_play(p);
+        if (serialize)
+            pthread_mutex_unlock(&g.avc_mutex);
+        jack_ringbuffer_read_advance(p->left_ch, jack_ringbuffer_read_space(p->left_ch));
+        jack_ringbuffer_read_advance(p->right_ch, jack_ringbuffer_read_space(p->right_ch));
+        }
+
+    self->seconds = (double)p->samples_written / p->samplerate;
+    if (p->playmode != PM_STOPPED)
+        p->dec_eject(p);
+    p->playmode = PM_STOPPED;
+    self->failed = FALSE;
+    return NULL;
+    }
+
+int main(int argc, char **argv)
+    {
+    struct bench_player *players;
+    int n_players = 4, rate = 44100, opt, i, volume = 127;
+    double start, elapsed, audio = 0.0;
+    sig_atomic_t shutdown_f = FALSE;
+
+    while ((opt = getopt(argc, argv, "n:r:s")) != -1)
+        switch (opt)
+            {
+            case 'n':
+                n_players = atoi(optarg);
+                break;
+            case 'r':
+                rate = atoi(optarg);
+                break;
+            case 's':
+                serialize = TRUE;
+                break;
+            default:
+                goto usage;
+            }
+    if (optind != argc - 1 || n_players < 1 || rate < 8000)
+        goto usage;
+    pathname = argv[optind];
+
+    if (!(players = calloc(n_players, sizeof (struct bench_player))))
+        {
+        fprintf(stderr, "main: malloc failure\n");
+        exit(5);
+        }
+
+    sr = rate;
+    g.out = stderr;
+    pthread_mutex_init(&g.avc_mutex, NULL);
+    av_register_all();
+    for (i = 0; i < n_players; ++i)
+        {
+        if (!(players[i].xlplayer = xlplayer_create(rate, 1.0, "bench", &shutdown_f, &volume, 0.0f, NULL, NULL, 0.0f)))
+            {
+            fprintf(stderr, "main: failed to create a player\n");
+            exit(5);
+            }
+        players[i].xlplayer->unpaced = TRUE;
+        }
+
+    start = bench_now();
+    for (i = 0; i < n_players; ++i)
+        if (pthread_create(&players[i].thread_h, NULL, bench_player_main, &players[i]))
+            {
+            fprintf(stderr, "main: pthread_create call failed\n");
+            exit(5);
+            }
+    for (i = 0; i < n_players; ++i)
+        pthread_join(players[i].thread_h, NULL);
+    elapsed = bench_now() - start;
+
+    for (i = 0; i < n_players; ++i)
+        {
+        if (players[i].failed)
+            {
+            fprintf(stderr, "main: player %d failed\n", i);
+            exit(5);
+            }
+        audio += players[i].seconds;
+        xlplayer_destroy(players[i].xlplayer);
+        }
+
+    printf("players: %d, player rate: %d Hz, decode calls %s\n", n_players, rate, serialize ? "serialized" : "concurrent");
+    printf("wall time: %.3f s, audio decoded: %.1f s\n", elapsed, audio);
+    printf("aggregate throughput: %.1f x realtime\n", audio / elapsed);
+    free(players);
+    return 0;
+
+    usage:
+    fprintf(stderr, "usage: %s [-n players] [-r rate] [-s] file\n", argv[0]);
+    return 5;
+    }
+
+#else
+
+int main(int argc, char **argv)
+    {
+    fprintf(stderr, "%s: built without libav support\n", argv[0]);
+    return 5;
+    }
+
+#endif /* HAVE_LIBAV */
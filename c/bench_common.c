@@ -0,0 +1,89 @@
+/*
+#   bench_common.c: helpers shared by the benchmark programs
+#   Copyright (C) 2013 Stephen Fairchild (s-fairchild@users.sf.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include "bench_common.h"
+
+/* every heap allocation in the process is counted */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+
+static unsigned long allocations;
+
+void *malloc(size_t size)
+    {
+    __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+    return __libc_malloc(size);
+    }
+
+void *calloc(size_t nmemb, size_t size)
+    {
+    __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+    return __libc_calloc(nmemb, size);
+    }
+
+void *realloc(void *ptr, size_t size)
+    {
+    __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+    return __libc_realloc(ptr, size);
+    }
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+    {
+    __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+    return (*memptr = __libc_memalign(alignment, size)) ? 0 : ENOMEM;
+    }
+
+unsigned long bench_allocations()
+    {
+    return __atomic_load_n(&allocations, __ATOMIC_RELAXED);
+    }
+
+double bench_clock(clockid_t clock)
+    {
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+    }
+
+double bench_now()
+    {
+    return bench_clock(CLOCK_MONOTONIC);
+    }
+
+/* 441 and 659 Hz with a little noise so the codecs have work to do */
+void bench_signal(float *l, float *r, long offset, int n, int rate)
+    {
+    static unsigned seed = 1;
+    long i;
+
+    for (i = 0; i < n; ++i)
+        {
+        seed = seed * 1103515245U + 12345U;
+        l[i] = 0.3f * sinf((offset + i) * 6.283185307f * 441.0f / rate) + ((int)(seed >> 16 & 0x7FFF) - 0x4000) / 327680.0f;
+        seed = seed * 1103515245U + 12345U;
+        r[i] = 0.3f * sinf((offset + i) * 6.283185307f * 659.0f / rate) + ((int)(seed >> 16 & 0x7FFF) - 0x4000) / 327680.0f;
+        }
+    }
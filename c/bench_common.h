@@ -0,0 +1,41 @@
+/*
+#   bench_common.h: helpers shared by the benchmark programs
+#   Copyright (C) 2013 Stephen Fairchild (s-fairchild@users.sf.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BENCH_COMMON_H
+#define BENCH_COMMON_H
+
+#include <time.h>
+
+/* Linking this in replaces malloc, calloc, realloc and posix_memalign for
+ * the whole process with versions that count every call.
+ */
+
+/* bench_allocations: the number of heap allocations made so far */
+unsigned long bench_allocations();
+
+/* bench_clock: seconds by the given clock */
+double bench_clock(clockid_t clock);
+
+/* bench_now: seconds by the monotonic clock */
+double bench_now();
+
+/* bench_signal: n frames of two tones with some noise, from offset at the given rate */
+void bench_signal(float *l, float *r, long offset, int n, int rate);
+
+#endif /* BENCH_COMMON_H */
@@ -0,0 +1,284 @@
+/*
+#   capture_ring.c: single writer, multiple reader audio capture buffer
+#   Copyright (C) 2013 Stephen Fairchild (s-fairchild@users.sourceforge.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "capture_ring.h"
+
+typedef jack_default_audio_sample_t sample_t;
+
+struct capture_ring *capture_ring_create(size_t min_frames)
+    {
+    struct capture_ring *self;
+    size_t size = 1;
+
+    while (size < min_frames)
+        size <<= 1;
+
+    if (!(self = calloc(1, sizeof (struct capture_ring))))
+        {
+        fprintf(stderr, "capture_ring_create: malloc failure\n");
+        return NULL;
+        }
+
+    if (!(self->buffer[0] = calloc(size, sizeof (sample_t))) ||
+                        !(self->buffer[1] = calloc(size, sizeof (sample_t))))
+        {
+        fprintf(stderr, "capture_ring_create: malloc failure\n");
+        capture_ring_destroy(self);
+        return NULL;
+        }
+
+    self->size = size;
+    self->mask = size - 1;
+    pthread_mutex_init(&self->wait_mutex, NULL);
+    pthread_cond_init(&self->wait_cv, NULL);
+    return self;
+    }
+
+void capture_ring_destroy(struct capture_ring *self)
+    {
+    if (self->size)
+        {
+        pthread_cond_destroy(&self->wait_cv);
+        pthread_mutex_destroy(&self->wait_mutex);
+        }
+    free(self->buffer[0]);
+    free(self->buffer[1]);
+    free(self);
+    }
+
+void capture_ring_write(struct capture_ring *self, sample_t **src, size_t n_frames)
+    {
+    size_t w = self->write_pos, index, first;
+
+    if (!__atomic_load_n(&self->n_readers, __ATOMIC_ACQUIRE))
+        return;
+
+    for (int c = 0; c < 2; ++c)
+        {
+        index = w & self->mask;
+        if ((first = self->size - index) > n_frames)
+            first = n_frames;
+        memcpy(self->buffer[c] + index, src[c], first * sizeof (sample_t));
+        memcpy(self->buffer[c], src[c] + first, (n_frames - first) * sizeof (sample_t));
+        }
+
+    /* sequentially consistent against the waiter's n_waiters/write_pos pair */
+    __atomic_store_n(&self->write_pos, w += n_frames, __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&self->n_waiters, __ATOMIC_SEQ_CST)
+                && (ssize_t)(w - __atomic_load_n(&self->wake_pos, __ATOMIC_RELAXED)) >= 0
+                && !pthread_mutex_trylock(&self->wait_mutex))
+        {
+        pthread_cond_broadcast(&self->wait_cv);
+        pthread_mutex_unlock(&self->wait_mutex);
+        }
+    }
+
+size_t capture_ring_max_lag(struct capture_ring *self)
+    {
+    struct capture_reader *reader;
+    size_t w = __atomic_load_n(&self->write_pos, __ATOMIC_ACQUIRE), lag, max_lag = 0;
+
+    pthread_mutex_lock(&self->wait_mutex);
+    for (reader = self->readers; reader; reader = reader->next)
+        if ((lag = w - __atomic_load_n(&reader->pos, __ATOMIC_RELAXED)) > max_lag)
+            max_lag = lag;
+    pthread_mutex_unlock(&self->wait_mutex);
+    return max_lag;
+    }
+
+int capture_ring_wait(struct capture_ring *self, size_t target_pos, int timeout_ms)
+    {
+    struct timespec deadline;
+    size_t wake_pos;
+    int reached;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    if ((deadline.tv_nsec += (timeout_ms % 1000) * 1000000L) >= 1000000000L)
+        {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+        }
+
+    pthread_mutex_lock(&self->wait_mutex);
+    __atomic_add_fetch(&self->n_waiters, 1, __ATOMIC_SEQ_CST);
+    for (;;)
+        {
+        if ((reached = (ssize_t)(__atomic_load_n(&self->write_pos, __ATOMIC_SEQ_CST) - target_pos) >= 0))
+            break;
+        /* the earliest target wins, a stale one that has been passed is replaced */
+        wake_pos = self->wake_pos;
+        if (self->n_waiters == 1 || (ssize_t)(wake_pos - target_pos) > 0
+                    || (ssize_t)(self->write_pos - wake_pos) >= 0)
+            __atomic_store_n(&self->wake_pos, target_pos, __ATOMIC_RELAXED);
+        if (pthread_cond_timedwait(&self->wait_cv, &self->wait_mutex, &deadline))
+            {
+            reached = (ssize_t)(__atomic_load_n(&self->write_pos, __ATOMIC_SEQ_CST) - target_pos) >= 0;
+            break;
+            }
+        }
+    __atomic_sub_fetch(&self->n_waiters, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&self->wait_mutex);
+    return reached;
+    }
+
+void capture_reader_attach(struct capture_reader *self, struct capture_ring *ring, enum capture_overflow_policy policy)
+    {
+    self->ring = ring;
+    self->pos = __atomic_load_n(&ring->write_pos, __ATOMIC_ACQUIRE);
+    self->policy = policy;
+    self->overflows = 0;
+    self->frames_dropped = 0;
+    self->max_lag = 0;
+    pthread_mutex_lock(&ring->wait_mutex);
+    self->next = ring->readers;
+    ring->readers = self;
+    pthread_mutex_unlock(&ring->wait_mutex);
+    __atomic_add_fetch(&ring->n_readers, 1, __ATOMIC_RELEASE);
+    }
+
+void capture_reader_detach(struct capture_reader *self)
+    {
+    struct capture_reader **rp;
+
+    if (self->ring)
+        {
+        __atomic_sub_fetch(&self->ring->n_readers, 1, __ATOMIC_RELEASE);
+        pthread_mutex_lock(&self->ring->wait_mutex);
+        for (rp = &self->ring->readers; *rp; rp = &(*rp)->next)
+            if (*rp == self)
+                {
+                *rp = self->next;
+                break;
+                }
+        pthread_mutex_unlock(&self->ring->wait_mutex);
+        self->ring = NULL;
+        }
+    }
+
+/* capture_reader_overtaken: true when the data at pos may have been overwritten
+ *
+ * The writer only publishes write_pos after a period has been copied in so
+ * the period currently being written has to be allowed for as well.
+ * A ring that is larger than the largest JACK period by a wide margin is
+ * assumed and the check is deliberately pessimistic by one quarter of a ring.
+ */
+static int capture_reader_overtaken(struct capture_reader *self, size_t pos)
+    {
+    struct capture_ring *ring = self->ring;
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&ring->write_pos, __ATOMIC_ACQUIRE) - pos > ring->size - (ring->size >> 2);
+    }
+
+static void capture_reader_overflow(struct capture_reader *self)
+    {
+    struct capture_ring *ring = self->ring;
+    size_t w = __atomic_load_n(&ring->write_pos, __ATOMIC_ACQUIRE);
+    size_t target, lost;
+
+    if (self->policy == CR_FOLD)
+        target = w - (ring->size >> 1);
+    else
+        target = w;
+
+    lost = target - self->pos;
+    __atomic_store_n(&self->pos, target, __ATOMIC_RELAXED);
+    self->overflows++;
+    self->frames_dropped += lost;
+    }
+
+size_t capture_reader_read_space(struct capture_reader *self)
+    {
+    size_t lag;
+
+    if (capture_reader_overtaken(self, self->pos))
+        capture_reader_overflow(self);
+
+    lag = __atomic_load_n(&self->ring->write_pos, __ATOMIC_ACQUIRE) - self->pos;
+    if (lag > self->max_lag)
+        self->max_lag = lag;
+    return lag;
+    }
+
+/* capture_reader_read_stereo: both channels of the same span or nothing at all
+ *
+ * The overflow check covers the pair so the channels can never come out of step.
+ */
+size_t capture_reader_read_stereo(struct capture_reader *self, sample_t **dest, size_t max_frames)
+    {
+    struct capture_ring *ring = self->ring;
+    size_t n, pos, index, first;
+
+    if ((n = capture_reader_read_space(self)) > max_frames)
+        n = max_frames;
+
+    pos = self->pos;
+    index = pos & ring->mask;
+    if ((first = ring->size - index) > n)
+        first = n;
+    for (int c = 0; c < 2; ++c)
+        {
+        memcpy(dest[c], ring->buffer[c] + index, first * sizeof (sample_t));
+        memcpy(dest[c] + first, ring->buffer[c], (n - first) * sizeof (sample_t));
+        }
+
+    /* the writer may have lapped us while we were copying */
+    if (capture_reader_overtaken(self, pos))
+        {
+        capture_reader_overflow(self);
+        return 0;
+        }
+
+    __atomic_store_n(&self->pos, pos + n, __ATOMIC_RELAXED);
+    return n;
+    }
+
+size_t capture_reader_read_mono(struct capture_reader *self, sample_t *dest, size_t max_frames)
+    {
+    struct capture_ring *ring = self->ring;
+    const sample_t *ch0 = ring->buffer[0], *ch1 = ring->buffer[1];
+    size_t n, pos;
+
+    if ((n = capture_reader_read_space(self)) > max_frames)
+        n = max_frames;
+
+    pos = self->pos;
+    for (size_t i = 0; i < n; ++i)
+        {
+        size_t index = (pos + i) & ring->mask;
+
+        dest[i] = (ch0[index] + ch1[index]) * 0.5F;
+        }
+
+    if (capture_reader_overtaken(self, pos))
+        {
+        capture_reader_overflow(self);
+        return 0;
+        }
+
+    __atomic_store_n(&self->pos, pos + n, __ATOMIC_RELAXED);
+    return n;
+    }
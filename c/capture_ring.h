@@ -0,0 +1,87 @@
+/*
+#   capture_ring.h: single writer, multiple reader audio capture buffer
+#   Copyright (C) 2013 Stephen Fairchild (s-fairchild@users.sourceforge.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CAPTURE_RING_H
+#define CAPTURE_RING_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <jack/jack.h>
+
+/* The JACK callback writes each period once into the ring and never waits.
+ * Every reader keeps one cursor for the stereo pair. A reader that falls too far
+ * behind has lost data, which it finds out about on its next read and
+ * recovers from according to its overflow policy.
+ *
+ * Readers that have nothing to do sleep in capture_ring_wait until the writer
+ * has passed the position they asked for. The writer only ever trylocks to
+ * wake them so a wakeup can be deferred by a period but never blocks JACK.
+ */
+
+/* what a reader does on finding the writer has overtaken it */
+enum capture_overflow_policy {
+            CR_DROP,        /* skip to the newest data, discarding the backlog */
+            CR_FOLD         /* skip only the data that has been overwritten */
+            };
+
+struct capture_ring
+    {
+    jack_default_audio_sample_t *buffer[2];
+    size_t size;                 /* in frames, a power of two */
+    size_t mask;
+    size_t write_pos;            /* total frames written, wraps */
+    int n_readers;               /* the writer idles when there are no readers */
+    int n_waiters;               /* readers asleep in capture_ring_wait */
+    size_t wake_pos;             /* earliest write_pos a waiter is waiting for */
+    pthread_mutex_t wait_mutex;
+    pthread_cond_t wait_cv;
+    struct capture_reader *readers; /* attached readers, guarded by wait_mutex */
+    int backpressure;            /* offline rendering: writers that can wait hold back rather than overtake a reader */
+    };
+
+struct capture_reader
+    {
+    struct capture_ring *ring;
+    size_t pos;                  /* read cursor, both channels move together */
+    enum capture_overflow_policy policy;
+    unsigned overflows;          /* times the writer overtook this reader */
+    uint64_t frames_dropped;     /* frames lost as a result */
+    size_t max_lag;              /* high water mark of unread frames */
+    struct capture_reader *next;
+    };
+
+struct capture_ring *capture_ring_create(size_t min_frames);
+void capture_ring_destroy(struct capture_ring *self);
+
+/* called from the JACK callback only */
+void capture_ring_write(struct capture_ring *self, jack_default_audio_sample_t **src, size_t n_frames);
+
+/* the unread frames of the reader furthest behind, for use by the writer */
+size_t capture_ring_max_lag(struct capture_ring *self);
+
+/* returns nonzero once write_pos has reached target_pos, zero on timeout */
+int capture_ring_wait(struct capture_ring *self, size_t target_pos, int timeout_ms);
+
+void capture_reader_attach(struct capture_reader *self, struct capture_ring *ring, enum capture_overflow_policy policy);
+void capture_reader_detach(struct capture_reader *self);
+size_t capture_reader_read_space(struct capture_reader *self);
+size_t capture_reader_read_stereo(struct capture_reader *self, jack_default_audio_sample_t **dest, size_t max_frames);
+size_t capture_reader_read_mono(struct capture_reader *self, jack_default_audio_sample_t *dest, size_t max_frames);
+
+#endif
@@ -0,0 +1,691 @@
+/*
+#   decode_bench.c: throughput, allocations and seek latency of each decoder
+#   Copyright (C) 2013 Stephen Fairchild (s-fairchild@users.sf.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Usage: decode_bench [-d seconds] [-r rate] [-k seeks] [-D] [-C] [-m mmap|pread] [-x speed]
+ *
+ * Generates a test file for each format that can be written here, then for
+ * every decoder opens it through the same registration function the players
+ * use and calls dec_play until the end of the file. The ringbuffers are
+ * emptied after each call in place of the JACK reader. Reported are decoded
+ * seconds per wall second, heap allocations per dec_play call, the time
+ * from opening to the first audio and the same when opening at a seek point.
+ *
+ * The files are 44100 Hz stereo, -r sets the player rate and so whether the
+ * resampler is in use. -D turns on dither. -C drops the test file from the
+ * page cache before every open, which is closer to a library on a network
+ * share. -m chooses how the file source reads the file.
+ *
+ * Then the test files are played twice over as a playlist by the player's
+ * own thread, once without and once with the look-ahead slot, while a reader
+ * takes the audio at -x times real time (0 to skip). Reported is the silence
+ * the reader got at track changes, and elsewhere, the latter meaning that the
+ * decoders are not fast enough for the chosen speed.
+ *
+ * Each FLAC file, native and in Ogg, is also played twice over without and
+ * with the look-ahead slot. Both must deliver the same audio, for the
+ * decoder readied ahead is spliced onto the player, otherwise the exit
+ * status is 1.
+ *
+ * Last a one second effect is started over and over on a player with the
+ * reader at real time, once from the file and once from the PCM cache.
+ * Reported is how long xlplayer_play takes to return and how long until the
+ * first of its audio is in the ringbuffer.
+ */
+
+#include "../config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sndfile.h>
+#ifdef HAVE_FLAC
+#include <FLAC/all.h>
+#endif
+#include "xlplayer.h"
+#include "bench_common.h"
+#include "sndfiledecode.h"
+#include "oggdec.h"
+#include "flacdecode.h"
+#include "mp3dec.h"
+#include "avcodecdecode.h"
+#include "pcmcache.h"
+#include "main.h"
+
+#ifdef HAVE_LAME_LAME_H
+#include <lame/lame.h>
+#else
+#include "lame.h"
+#endif
+
+#ifdef DYN_LAME
+#include "dyn_lame.h"
+#endif
+#ifdef DYN_MPG123
+#include "dyn_mpg123.h"
+#endif
+
+#define TRUE 1
+#define FALSE 0
+
+#define FILE_RATE 44100
+#define READER_PERIOD 256               /* frames the gapless test reader takes at a time */
+#define GAPLESS_RB_SECONDS 2.0
+#define TRIGGERS 20                     /* effect starts timed by the trigger test */
+
+struct bench_format
+    {
+    const char *name;
+    const char *extension;               /* of the generated file it decodes */
+    int (*reg)(struct xlplayer *);
+    };
+
+static struct bench_format formats[] = {
+    { "sndfile", "wav", sndfiledecode_reg },
+#ifdef HAVE_FLAC
+    { "flac", "flac", flacdecode_reg },
+#endif
+    { "ogg", "ogg", oggdecode_reg },
+    { "mp3", "mp3", mp3decode_reg },
+#ifdef HAVE_LIBAV
+    { "avcodec", "mp3", avcodecdecode_reg },
+#endif
+    { NULL, NULL, NULL }};
+
+/* the JACK callback's part in the gapless test */
+struct bench_reader
+    {
+    struct xlplayer *p;
+    double speed;                       /* multiple of real time */
+    volatile int stop;
+    unsigned long boundaries;           /* track changes seen */
+    unsigned long gaps;
+    double gap_ms;                      /* silence at track changes */
+    double worst_gap_ms;
+    double midtrack_ms;                 /* silence while a decoder was running */
+    unsigned long frames;               /* audio received */
+    };
+
+struct globs g;
+unsigned long sr;                       /* the mixer's sample rate as smoothing.c sees it */
+extern int mpg123ok;
+
+static int bench_make_sndfile(const char *pathname, int format, int seconds)
+    {
+    SF_INFO sfinfo = { .samplerate = FILE_RATE, .channels = 2, .format = format };
+    SNDFILE *sf;
+    float l[1024], r[1024], buffer[2048];
+    long i, n = (long)FILE_RATE * seconds;
+    int j;
+
+    if (!sf_format_check(&sfinfo) || !(sf = sf_open(pathname, SFM_WRITE, &sfinfo)))
+        return FALSE;
+    for (i = 0; i < n; i += 1024)
+        {
+        bench_signal(l, r, i, 1024, FILE_RATE);
+        for (j = 0; j < 1024; ++j)
+            {
+            buffer[j * 2] = l[j];
+            buffer[j * 2 + 1] = r[j];
+            }
+        sf_writef_float(sf, buffer, n - i < 1024 ? n - i : 1024);
+        }
+    sf_close(sf);
+    return TRUE;
+    }
+
+static int bench_make_mp3(const char *pathname, int seconds)
+    {
+    lame_global_flags *gfp;
+    unsigned char mp3buf[8192];
+    float l[1024], r[1024];
+    long i, n = (long)FILE_RATE * seconds;
+    int bytes;
+    FILE *fp;
+
+#ifdef DYN_LAME
+    if (!dyn_lame_init())
+        return FALSE;
+#endif
+    if (!(gfp = lame_init()))
+        return FALSE;
+    lame_set_num_channels(gfp, 2);
+    lame_set_brate(gfp, 192);
+    lame_set_in_samplerate(gfp, FILE_RATE);
+    lame_set_out_samplerate(gfp, FILE_RATE);
+    lame_set_mode(gfp, JOINT_STEREO);
+    lame_set_quality(gfp, 5);
+    lame_set_bWriteVbrTag(gfp, 0);
+    lame_set_scale(gfp, 32767.0f);
+    if (lame_init_params(gfp) < 0 || !(fp = fopen(pathname, "w")))
+        {
+        lame_close(gfp);
+        return FALSE;
+        }
+    for (i = 0; i < n; i += 1024)
+        {
+        bench_signal(l, r, i, 1024, FILE_RATE);
+        if ((bytes = lame_encode_buffer_float(gfp, l, r, n - i < 1024 ? n - i : 1024, mp3buf, sizeof mp3buf)) > 0)
+            fwrite(mp3buf, 1, bytes, fp);
+        }
+    if ((bytes = lame_encode_flush_nogap(gfp, mp3buf, sizeof mp3buf)) > 0)
+        fwrite(mp3buf, 1, bytes, fp);
+    lame_close(gfp);
+    return !fclose(fp);
+    }
+
+#ifdef HAVE_FLAC
+/* bench_make_oggflac: libsndfile only puts Vorbis in Ogg */
+static int bench_make_oggflac(const char *pathname, int seconds)
+    {
+    FLAC__StreamEncoder *enc;
+    FLAC__int32 buffer[2048];
+    float l[1024], r[1024];
+    long i, n = (long)FILE_RATE * seconds;
+    int j, frames, ok = TRUE;
+
+    if (!FLAC__API_SUPPORTS_OGG_FLAC || !(enc = FLAC__stream_encoder_new()))
+        return FALSE;
+    FLAC__stream_encoder_set_channels(enc, 2);
+    FLAC__stream_encoder_set_bits_per_sample(enc, 16);
+    FLAC__stream_encoder_set_sample_rate(enc, FILE_RATE);
+    FLAC__stream_encoder_set_total_samples_estimate(enc, n);
+    if (FLAC__stream_encoder_init_ogg_file(enc, pathname, NULL, NULL) != FLAC__STREAM_ENCODER_INIT_STATUS_OK)
+        {
+        FLAC__stream_encoder_delete(enc);
+        return FALSE;
+        }
+    for (i = 0; ok && i < n; i += 1024)
+        {
+        bench_signal(l, r, i, 1024, FILE_RATE);
+        frames = n - i < 1024 ? n - i : 1024;
+        for (j = 0; j < frames; ++j)
+            {
+            buffer[j * 2] = lrintf(l[j] * 32767.0f);
+            buffer[j * 2 + 1] = lrintf(r[j] * 32767.0f);
+            }
+        ok = FLAC__stream_encoder_process_interleaved(enc, buffer, frames);
+        }
+    ok = FLAC__stream_encoder_finish(enc) && ok;
+    FLAC__stream_encoder_delete(enc);
+    return ok;
+    }
+#endif /* HAVE_FLAC */
+
+/* bench_evict: so the next open has to go to the disk */
+static void bench_evict(char *pathname)
+    {
+    int fd;
+
+    if ((fd = open(pathname, O_RDONLY)) >= 0)
+        {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+        }
+    }
+
+/* bench_open: what xlplayer_main does to start a track, the decoder is left playing or stopped */
+static void bench_open(struct xlplayer *p, struct bench_format *f, char *pathname, int seek_s)
+    {
+    p->pathname = pathname;
+    p->seek_s = seek_s;
+    p->playmode = PM_STOPPED;
+    if (!f->reg(p))
+        return;
+    p->playmode = PM_PLAYING;
+    p->play_progress_ms = 0;
+    p->write_deferred = 0;
+    p->pause = 0;
+    p->samples_written = 0;
+    p->sleep_samples = 0;
+    fade_set(p->fadein, seek_s ? FADE_SET_LOW : FADE_SET_HIGH, -1.0f, FADE_IN);
+    p->silence = 0.0f;
+    p->dec_init(p);
+    }
+
+static void bench_close(struct xlplayer *p)
+    {
+    if (p->playmode != PM_STOPPED)
+        p->dec_eject(p);
+    p->playmode = PM_STOPPED;
+    }
+
+/* bench_play: one dec_play call, the output is thrown away */
+static void bench_play(struct xlplayer *p)
+    {
+    p->dec_play(p);
+    jack_ringbuffer_read_advance(p->left_ch, jack_ringbuffer_read_space(p->left_ch));
+    jack_ringbuffer_read_advance(p->right_ch, jack_ringbuffer_read_space(p->right_ch));
+    }
+
+static void bench_format(struct xlplayer *p, struct bench_format *f, char *pathname, int seconds, int n_seeks, int cold)
+    {
+    double start, elapsed, decoded, latency, open_latency, total_latency = 0.0, worst_latency = 0.0;
+    unsigned long calls = 0, allocs;
+    int i;
+
+    if (cold)
+        bench_evict(pathname);
+    start = bench_now();
+    bench_open(p, f, pathname, 0);
+    if (p->playmode != PM_PLAYING)
+        {
+        printf("%-8s %-5s failed to open\n", f->name, f->extension);
+        return;
+        }
+    while (p->playmode == PM_PLAYING && !p->samples_written)
+        bench_play(p);
+    open_latency = bench_now() - start;
+    allocs = bench_allocations();
+    start = bench_now();
+    for (; p->playmode == PM_PLAYING; ++calls)
+        bench_play(p);
+    elapsed = bench_now() - start;
+    allocs = bench_allocations() - allocs;
+    decoded = (double)p->samples_written / p->samplerate;
+    bench_close(p);
+
+    for (i = 1; i <= n_seeks; ++i)
+        {
+        if (cold)
+            bench_evict(pathname);
+        start = bench_now();
+        bench_open(p, f, pathname, seconds * i / (n_seeks + 1));
+        while (p->playmode == PM_PLAYING && !p->samples_written)
+            bench_play(p);
+        latency = bench_now() - start;
+        bench_close(p);
+        total_latency += latency;
+        if (latency > worst_latency)
+            worst_latency = latency;
+        }
+
+    printf("%-8s %-5s %10.1f %12.2f %8.2f %12.2f %12.2f\n", f->name, f->extension, decoded / elapsed,
+                calls ? (double)allocs / calls : 0.0, open_latency * 1e3,
+                n_seeks ? total_latency / n_seeks * 1e3 : 0.0, worst_latency * 1e3);
+    }
+
+static void *bench_reader(void *arg)
+    {
+    struct bench_reader *r = arg;
+    struct xlplayer *p = r->p;
+    float l[READER_PERIOD], rr[READER_PERIOD];
+    struct timespec next;
+    long period_ns = (long)(READER_PERIOD * 1e9 / (p->samplerate * r->speed));
+    int started = FALSE, index = 0;
+    size_t missing;
+    double gap = 0.0, ms;
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    while (!r->stop)
+        {
+        read_from_player(p, l, rr, NULL, NULL, READER_PERIOD);
+        missing = p->avail < READER_PERIOD ? READER_PERIOD - p->avail : 0;
+        ms = missing * 1000.0 / p->samplerate;
+        r->frames += READER_PERIOD - missing;
+
+        if (!started)
+            {
+            if ((started = !missing))
+                index = p->playlistindex;
+            }
+        else if (missing && p->playmode != PM_STOPPED)
+            {
+            /* the player is between decoders or has one that hasn't written anything */
+            if (p->playmode != PM_PLAYING || !p->samples_written)
+                gap += ms;
+            else
+                r->midtrack_ms += ms;
+            }
+        if (started && !missing)
+            {
+            if (p->playlistindex != index)
+                {
+                index = p->playlistindex;
+                ++r->boundaries;
+                }
+            if (gap > 0.0)
+                {
+                ++r->gaps;
+                r->gap_ms += gap;
+                if (gap > r->worst_gap_ms)
+                    r->worst_gap_ms = gap;
+                gap = 0.0;
+                }
+            }
+
+        if ((next.tv_nsec += period_ns) >= 1000000000L)
+            {
+            next.tv_nsec -= 1000000000L;
+            ++next.tv_sec;
+            }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+        }
+    return NULL;
+    }
+
+/* bench_playlist: play n_tracks taken in turn from files through the player thread
+ * returns FALSE if the player has not finished within timeout seconds
+ */
+static int bench_playlist(struct bench_reader *r, char **files, int n_files, int n_tracks, int lookahead, int cold, double timeout)
+    {
+    struct xlplayer *p = r->p;
+    pthread_t thread;
+    char playlist[1024], *end = playlist;
+    double start;
+    int i, finished;
+
+    end += sprintf(end, "%d#", n_tracks);
+    for (i = 0; i < n_tracks; ++i)
+        {
+        end += sprintf(end, "d%d:%s", (int)strlen(files[i % n_files]), files[i % n_files]);
+        if (cold)
+            bench_evict(files[i % n_files]);
+        }
+    strcpy(end, "x");
+
+    p->use_lookahead = lookahead;
+    pthread_create(&thread, NULL, bench_reader, r);
+    xlplayer_playmany(p, playlist, FALSE);
+    for (start = bench_now(); !(finished = p->playmode == PM_STOPPED && p->command == CMD_COMPLETE &&
+                !jack_ringbuffer_read_space(p->right_ch)) && bench_now() - start < timeout; )
+        usleep(10000);
+    r->stop = TRUE;
+    pthread_join(thread, NULL);
+    return finished;
+    }
+
+/* bench_gapless: play the list through the player thread with the reader at speed times real time */
+static int bench_gapless(struct xlplayer *p, char **files, int n_files, int seconds, double speed, int lookahead, int cold)
+    {
+    struct bench_reader r = { .p = p, .speed = speed };
+
+    if (!bench_playlist(&r, files, n_files, n_files * 2, lookahead, cold, n_files * 2 * seconds / speed * 4.0 + 10.0))
+        {
+        printf("%-9s did not finish\n", lookahead ? "on" : "off");
+        return FALSE;
+        }
+    printf("%-9s %10lu %5lu %12.2f %10.2f %12.2f\n", lookahead ? "on" : "off", r.boundaries, r.gaps,
+                r.gap_ms, r.worst_gap_ms, r.midtrack_ms);
+    return TRUE;
+    }
+
+/* bench_splice: a file played twice over must come out the same with the look-ahead as without */
+static int bench_splice(struct xlplayer *p, const char *name, char *pathname, int seconds, double speed)
+    {
+    struct bench_reader off = { .p = p, .speed = speed }, on = { .p = p, .speed = speed };
+    double timeout = 2 * seconds / speed * 4.0 + 10.0;
+    int ok;
+
+    if (!bench_playlist(&off, &pathname, 1, 2, FALSE, FALSE, timeout) || !bench_playlist(&on, &pathname, 1, 2, TRUE, FALSE, timeout))
+        {
+        printf("%-9s did not finish\n", name);
+        return FALSE;
+        }
+    /* allow for a resampler flushing a little differently */
+    ok = on.boundaries == off.boundaries && labs((long)on.frames - (long)off.frames) <= (long)p->samplerate / 100;
+    printf("%-9s %13lu %13lu  %s\n", name, off.frames, on.frames, ok ? "ok" : "mismatch");
+    return ok;
+    }
+
+static void bench_wait_stopped(struct xlplayer *p)
+    {
+    while (p->playmode != PM_STOPPED || jack_ringbuffer_read_space(p->right_ch))
+        usleep(1000);
+    }
+
+/* bench_trigger: start an effect repeatedly as the effects players would be */
+static void bench_trigger(struct xlplayer *p, char *pathname, int cached)
+    {
+    struct bench_reader r = { .p = p, .speed = 1.0 };
+    pthread_t thread;
+    double start, call, audio, total_call = 0.0, total_audio = 0.0, worst_audio = 0.0;
+    int i;
+
+    p->use_pcm_cache = cached;
+    pthread_create(&thread, NULL, bench_reader, &r);
+    if (cached)
+        {
+        /* a complete play puts the effect in the cache */
+        xlplayer_play(p, pathname, 0, 0, 0.0f, 0);
+        bench_wait_stopped(p);
+        }
+    for (i = 0; i < TRIGGERS; ++i)
+        {
+        start = bench_now();
+        xlplayer_play(p, pathname, 0, 0, 0.0f, 0);
+        call = bench_now() - start;
+        while (p->playmode == PM_PLAYING && !p->samples_written)
+            usleep(100);
+        audio = bench_now() - start;
+        total_call += call;
+        total_audio += audio;
+        if (audio > worst_audio)
+            worst_audio = audio;
+        xlplayer_eject(p);
+        bench_wait_stopped(p);
+        }
+    r.stop = TRUE;
+    pthread_join(thread, NULL);
+
+    printf("%-6s %13.2f %12.2f %12.2f\n", cached ? "cache" : "file", total_call / TRIGGERS * 1e3,
+                total_audio / TRIGGERS * 1e3, worst_audio * 1e3);
+    }
+
+int main(int argc, char **argv)
+    {
+    struct xlplayer *p;
+    struct bench_format *f;
+    int seconds = 60, rate = FILE_RATE, n_seeks = 10, dither = FALSE, cold = FALSE, opt, volume = 127;
+    int mpg123_available = TRUE, n_files = 0, failed = FALSE;
+    double speed = 20.0;
+    char wav[64], flac[64], ogg[64], oga[64], mp3[64], effect[64], *pathname, *files[4];
+    sig_atomic_t shutdown_f = FALSE;
+
+    while ((opt = getopt(argc, argv, "d:r:k:DCm:x:")) != -1)
+        switch (opt)
+            {
+            case 'd':
+                seconds = atoi(optarg);
+                break;
+            case 'r':
+                rate = atoi(optarg);
+                break;
+            case 'k':
+                n_seeks = atoi(optarg);
+                break;
+            case 'D':
+                dither = TRUE;
+                break;
+            case 'C':
+                cold = TRUE;
+                break;
+            case 'm':
+                if (strcmp(optarg, "mmap") && strcmp(optarg, "pread"))
+                    goto usage;
+                setenv("file_source", optarg, 1);
+                break;
+            case 'x':
+                speed = atof(optarg);
+                break;
+            default:
+                goto usage;
+            }
+    if (optind != argc || seconds < 2 || rate < 8000 || n_seeks < 0 || speed < 0.0)
+        goto usage;
+
+    /* the user interface normally supplies these */
+    setenv("libmp3lame_filename", "libmp3lame.so.0", 0);
+    setenv("libmpg123_filename", "libmpg123.so.0", 0);
+    sr = rate;
+    g.out = stderr;
+    pthread_mutex_init(&g.avc_mutex, NULL);
+#ifdef HAVE_LIBAV
+    av_register_all();
+#endif
+    snprintf(wav, sizeof wav, "/tmp/decode_bench_%d.wav", (int)getpid());
+    snprintf(flac, sizeof flac, "/tmp/decode_bench_%d.flac", (int)getpid());
+    snprintf(ogg, sizeof ogg, "/tmp/decode_bench_%d.ogg", (int)getpid());
+    snprintf(oga, sizeof oga, "/tmp/decode_bench_%d_flac.oga", (int)getpid());
+    snprintf(mp3, sizeof mp3, "/tmp/decode_bench_%d.mp3", (int)getpid());
+    snprintf(effect, sizeof effect, "/tmp/decode_bench_%d_effect.wav", (int)getpid());
+    fprintf(stderr, "generating %d second test files\n", seconds);
+    if (!bench_make_sndfile(wav, SF_FORMAT_WAV | SF_FORMAT_PCM_16, seconds))
+        fprintf(stderr, "main: could not make a wav file\n");
+    if (!bench_make_sndfile(flac, SF_FORMAT_FLAC | SF_FORMAT_PCM_16, seconds))
+        fprintf(stderr, "main: this libsndfile cannot make flac files\n");
+    if (!bench_make_sndfile(ogg, SF_FORMAT_OGG | SF_FORMAT_VORBIS, seconds))
+        fprintf(stderr, "main: this libsndfile cannot make ogg vorbis files\n");
+#ifdef HAVE_FLAC
+    if (!bench_make_oggflac(oga, seconds))
+        fprintf(stderr, "main: this libFLAC cannot make ogg flac files\n");
+#endif
+    if (!bench_make_mp3(mp3, seconds))
+        fprintf(stderr, "main: lame is not available to make an mp3 file\n");
+#ifdef DYN_MPG123
+    if (!(mpg123_available = dyn_mpg123_init()))
+        fprintf(stderr, "main: libmpg123 is not available\n");
+#endif
+    mpg123ok = mpg123_available;
+
+    if (!(p = xlplayer_create(rate, 1.0, "bench", &shutdown_f, &volume, 0.0f, NULL, NULL, 0.0f)))
+        {
+        fprintf(stderr, "main: failed to create a player\n");
+        exit(5);
+        }
+    p->unpaced = TRUE;
+    p->dither = dither;
+
+    printf("player rate: %d Hz, file rate %d Hz, dither %s, file source %s, %s cache\n", rate, FILE_RATE,
+                dither ? "on" : "off", getenv("file_source") ? getenv("file_source") : "pread", cold ? "cold" : "warm");
+    printf("decoder  file  realtime x  allocs/call  open ms  seek avg ms  seek max ms\n");
+    for (f = formats; f->name; ++f)
+        {
+        if (!strcmp(f->extension, "wav"))
+            pathname = wav;
+        else if (!strcmp(f->extension, "flac"))
+            pathname = flac;
+        else if (!strcmp(f->extension, "ogg"))
+            pathname = ogg;
+        else
+            pathname = mp3;
+        if (f->reg == mp3decode_reg && !mpg123_available)
+            {
+            printf("%-8s %-5s no libmpg123\n", f->name, f->extension);
+            continue;
+            }
+        if (access(pathname, R_OK))
+            {
+            printf("%-8s %-5s no test file\n", f->name, f->extension);
+            continue;
+            }
+        bench_format(p, f, pathname, seconds, n_seeks, cold);
+        }
+    xlplayer_destroy(p);
+
+    /* the playlist holds whichever files the player's own registration will take */
+    if (!access(wav, R_OK))
+        files[n_files++] = wav;
+#ifdef HAVE_FLAC
+    if (!access(flac, R_OK))
+        files[n_files++] = flac;
+#endif
+    if (!access(ogg, R_OK))
+        files[n_files++] = ogg;
+    if (mpg123_available && !access(mp3, R_OK))
+        files[n_files++] = mp3;
+    if (speed > 0.0 && n_files)
+        {
+        if (!(p = xlplayer_create(rate, GAPLESS_RB_SECONDS, "gapless", &shutdown_f, &volume, 0.0f, NULL, NULL, 0.0f)))
+            {
+            fprintf(stderr, "main: failed to create a player\n");
+            exit(5);
+            }
+        p->unpaced = TRUE;
+        p->dither = dither;
+        printf("\ngapless playlist of %d tracks, read at %.1fx real time, %.1f s ringbuffer\n", n_files * 2, speed, GAPLESS_RB_SECONDS);
+        printf("lookahead boundaries  gaps  gap total ms  gap max ms  mid-track ms\n");
+        if (!bench_gapless(p, files, n_files, seconds, speed, FALSE, cold) || !bench_gapless(p, files, n_files, seconds, speed, TRUE, cold))
+            goto stuck;
+        xlplayer_destroy(p);
+        }
+
+#ifdef HAVE_FLAC
+    /* the FLAC decoders are reached through their callbacks so must be told of the splice */
+    if (!(p = xlplayer_create(rate, GAPLESS_RB_SECONDS, "splice", &shutdown_f, &volume, 0.0f, NULL, NULL, 0.0f)))
+        {
+        fprintf(stderr, "main: failed to create a player\n");
+        exit(5);
+        }
+    p->unpaced = TRUE;
+    p->dither = dither;
+    printf("\neach file played twice over, read at %.1fx real time\n", speed > 0.0 ? speed : 20.0);
+    printf("splice    frames w/o la  frames with la\n");
+    if (!access(flac, R_OK) && !bench_splice(p, "flac", flac, seconds, speed > 0.0 ? speed : 20.0))
+        failed = TRUE;
+    if (p->playmode == PM_STOPPED && !access(oga, R_OK) && !bench_splice(p, "ogg flac", oga, seconds, speed > 0.0 ? speed : 20.0))
+        failed = TRUE;
+    if (p->playmode != PM_STOPPED)
+        goto stuck;
+    xlplayer_destroy(p);
+#endif
+
+    if (bench_make_sndfile(effect, SF_FORMAT_WAV | SF_FORMAT_PCM_16, 1))
+        {
+        pcmcache_init(64 << 20);
+        if (!(p = xlplayer_create(rate, 1.0, "trigger", &shutdown_f, &volume, 0.0f, NULL, NULL, 0.0f)))
+            {
+            fprintf(stderr, "main: failed to create a player\n");
+            exit(5);
+            }
+        p->dither = dither;
+        printf("\none second effect started %d times, reader at real time\n", TRIGGERS);
+        printf("source  play call ms  audio avg ms  audio max ms\n");
+        bench_trigger(p, effect, FALSE);
+        bench_trigger(p, effect, TRUE);
+        xlplayer_destroy(p);
+        pcmcache_cleanup();
+        unlink(effect);
+        }
+
+    unlink(wav);
+    unlink(flac);
+    unlink(ogg);
+    unlink(oga);
+    unlink(mp3);
+    return failed ? 1 : 0;
+
+    stuck:
+    /* the player is left as it is, tearing it down would wait on it */
+    fprintf(stderr, "main: a player did not finish its playlist\n");
+    unlink(wav);
+    unlink(flac);
+    unlink(ogg);
+    unlink(oga);
+    unlink(mp3);
+    return 1;
+
+    usage:
+    fprintf(stderr, "usage: %s [-d seconds] [-r rate] [-k seeks] [-D] [-C] [-m mmap|pread] [-x speed]\n", argv[0]);
+    return 5;
+    }
@@ -45,6 +45,8 @@ static int (*close)(mpg123_handle *);
 static int (*format)(mpg123_handle *, long, int, int);
 static off_t (*seek)(mpg123_handle *, off_t, int);
 static int (*open_fd)(mpg123_handle *, int);
+static int (*open_handle)(mpg123_handle *, void *);
+static int (*replace_reader_handle)(mpg123_handle *, ssize_t (*)(void *, void *, size_t), off_t (*)(void *, off_t, int), void (*)(void *));
 static int (*format_none)(mpg123_handle *);
 static int (*param)(mpg123_handle *, enum mpg123_parms, long, double);
 static int (*init)();
@@ -75,6 +77,8 @@ int dyn_mpg123_init()
                 (format = dlsym(handle, "mpg123_format")) &&
                 (seek = dlsym(handle, "mpg123_seek")) &&
                 (open_fd = dlsym(handle, "mpg123_open_fd")) &&
+                (open_handle = dlsym(handle, "mpg123_open_handle")) &&
+                (replace_reader_handle = dlsym(handle, "mpg123_replace_reader_handle")) &&
                 (format_none = dlsym(handle, "mpg123_format_none")) &&
                 (param = dlsym(handle, "mpg123_param")) &&
                 (init = dlsym(handle, "mpg123_init")) &&
@@ -133,6 +137,16 @@ int mpg123_open_fd(mpg123_handle *mh, int fd)
     return open_fd(mh, fd);
     }
 
+int mpg123_open_handle(mpg123_handle *mh, void *iohandle)
+    {
+    return open_handle(mh, iohandle);
+    }
+
+int mpg123_replace_reader_handle(mpg123_handle *mh, ssize_t (*r_read)(void *, void *, size_t), off_t (*r_lseek)(void *, off_t, int), void (*cleanup)(void *))
+    {
+    return replace_reader_handle(mh, r_read, r_lseek, cleanup);
+    }
+
 int mpg123_format_none(mpg123_handle *mh)
     {
     return format_none(mh);
@@ -0,0 +1,464 @@
+/*
+#   encode_bench.c: throughput and latency of the live encoders
+#   Copyright (C) 2013 Stephen Fairchild (s-fairchild@users.sf.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Usage: encode_bench [-c codec,...] [-n encoders] [-d seconds] [-r rate] [-p frames] [-F]
+ *
+ * For each codec in turn starts -n encoders of it with encoder_start, the
+ * way the user interface would, and writes synthetic audio into the capture
+ * ring in place of the JACK callback. A client is registered on every
+ * encoder and drains its packets as a streamer would.
+ *
+ * Reported per codec are the encoder thread CPU time per second of audio
+ * given as a realtime factor, which is also how many such encoders one core
+ * can sustain, the worst single run_encoder call, the time from the last
+ * sample of a packet entering the capture ring to the packet being queued
+ * to its clients, and heap allocations per second of audio.
+ *
+ * By default audio is written one period at a time at the real rate so the
+ * latency figures mean something. With -F it is written as fast as the
+ * slowest encoder will take it, which measures throughput only.
+ */
+
+#include "../config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include "sourceclient.h"
+#include "main.h"
+#include "bench_common.h"
+
+#ifdef HAVE_LIBAV
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#endif
+
+#ifdef DYN_LAME
+#include "dyn_lame.h"
+#endif
+
+#define TRUE 1
+#define FALSE 0
+
+#define MAX_LATENCIES (1 << 20)
+
+struct bench_codec
+    {
+    const char *name;
+    char *family;
+    char *codec;
+    char *samplerate;                    /* NULL for the feed rate */
+    char *bitrate;
+    char *mode;
+    char *quality;
+    char *variability;
+    };
+
+static struct bench_codec codecs[] = {
+    { "mp3", "mpeg", "mp3", NULL, "128", "jointstereo", "2", NULL },
+#ifdef HAVE_TWOLAME
+    { "mp2", "mpeg", "mp2", NULL, "192", "jointstereo", NULL, NULL },
+#endif
+#if defined(HAVE_AVCODEC) && defined(HAVE_AVFORMAT)
+    { "aac", "mpeg", "aac", NULL, "128", "stereo", NULL, NULL },
+#endif
+    { "vorbis", "ogg", "vorbis", NULL, "128", "stereo", NULL, "constant" },
+#ifdef HAVE_OGGFLAC
+    { "flac", "ogg", "flac", NULL, "0", "stereo", NULL, NULL },
+#endif
+#ifdef HAVE_SPEEX
+    { "speex", "ogg", "speex", "32000", "0", "mono", "8", NULL },
+#endif
+#ifdef HAVE_OPUS
+    { "opus", "ogg", "opus", "48000", "128", "stereo", NULL, "vbr" },
+#endif
+    { NULL }};
+
+/* what is known about one encoder under test */
+struct bench_slot
+    {
+    void (*run_encoder)(struct encoder *);   /* the one being timed */
+    double busy;                 /* thread CPU seconds in run_encoder */
+    double worst;
+    unsigned long calls;
+    unsigned long packets;
+    uint64_t bytes;
+    struct encoder_op *op;
+    };
+
+struct globs g;
+
+static struct threads_info ti;
+static struct bench_slot *slots;
+static int rate, period;
+static double *write_time;               /* when each period entered the ring */
+static size_t periods_written;
+static double *latencies;
+static size_t n_latencies;
+static int consumer_quit;
+static int notify_fd;
+
+/* bench_run_encoder: stands in for the encoder's own run_encoder function
+ * which it calls and times, following it should the encoder swap itself */
+static void bench_run_encoder(struct encoder *e)
+    {
+    struct bench_slot *s = &slots[e->numeric_id];
+    double t0, t;
+
+    t0 = bench_clock(CLOCK_THREAD_CPUTIME_ID);
+    s->run_encoder(e);
+    t = bench_clock(CLOCK_THREAD_CPUTIME_ID) - t0;
+    s->busy += t;
+    if (t > s->worst)
+        s->worst = t;
+    s->calls++;
+    if (e->run_encoder != bench_run_encoder && (s->run_encoder = e->run_encoder))
+        e->run_encoder = bench_run_encoder;
+    }
+
+/* bench_packet: latency from the last sample in the packet being written to the packet being queued */
+static void bench_packet(struct bench_slot *s, struct encoder_op_packet *packet)
+    {
+    long frame, k;
+    size_t n = __atomic_load_n(&periods_written, __ATOMIC_ACQUIRE);
+
+    s->packets++;
+    s->bytes += packet->header.data_size;
+    if (packet->header.flags & (PF_HEADER | PF_METADATA) || !packet->header.data_size || !n)
+        return;
+    frame = (long)(packet->header.timestamp * rate + 0.5);
+    if ((k = (frame + period - 1) / period - 1) < 0)
+        return;
+    if ((size_t)k >= n)
+        k = n - 1;
+    if (n_latencies < MAX_LATENCIES)
+        latencies[n_latencies++] = packet->queued.tv_sec + packet->queued.tv_nsec / 1e9 - write_time[k];
+    }
+
+/* bench_consumer: empties every client queue in the manner of a streamer */
+static void *bench_consumer(void *arg)
+    {
+    struct pollfd pfd = { .fd = notify_fd, .events = POLLIN };
+    struct encoder_op_packet *packet;
+    eventfd_t value;
+    int i, quit;
+
+    do  {
+        quit = __atomic_load_n(&consumer_quit, __ATOMIC_ACQUIRE);
+        if (poll(&pfd, 1, 100) > 0)
+            eventfd_read(notify_fd, &value);
+        for (i = 0; i < ti.n_encoders; ++i)
+            if (slots[i].op)
+                while ((packet = encoder_client_get_packet(slots[i].op)))
+                    {
+                    bench_packet(&slots[i], packet);
+                    encoder_client_free_packet(packet);
+                    }
+        } while (!quit);
+    return NULL;
+    }
+
+/* bench_slowest: the read position of the reader furthest behind on the capture ring */
+static size_t bench_slowest(struct capture_ring *ring)
+    {
+    struct encoder *e;
+    size_t pos, slowest = ring->write_pos;
+    int i;
+
+    for (i = 0; i < ti.n_encoders; ++i)
+        {
+        e = ti.encoder[i];
+        if (e->resampler)
+            pos = __atomic_load_n(&e->resampler->input.pos, __ATOMIC_RELAXED);
+        else if (e->input.ring)
+            pos = __atomic_load_n(&e->input.pos, __ATOMIC_RELAXED);
+        else
+            continue;
+        if (ring->write_pos - pos > ring->write_pos - slowest)
+            slowest = pos;
+        }
+    return slowest;
+    }
+
+static int bench_compare(const void *a, const void *b)
+    {
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+    }
+
+static void bench_codec(struct bench_codec *c, int seconds, int unpaced)
+    {
+    struct capture_ring *ring = ti.audio_feed->capture_ring;
+    struct universal_vars uv = { .tab = 0 };
+    struct encoder_vars ev = {
+        .encode_source = "jack", .resample_quality = "medium", .family = c->family, .codec = c->codec,
+        .bitrate = c->bitrate, .variability = c->variability, .bitwidth = "16", .quality = c->quality,
+        .complexity = "5", .framesize = "20", .mode = c->mode, .metadata_mode = "suppressed",
+        .standard = "1", .pregain = "1.0", .postgain = "0" };
+    struct timespec next, wait = { 0, 200000 };
+    float *buffer[2];
+    long period_ns = 1000000000LL * period / rate;
+    size_t i, n_periods = ((size_t)seconds * rate + period - 1) / period, last, pos;
+    unsigned long allocs;
+    double busy = 0.0, worst = 0.0, wall, progress;
+    unsigned long calls = 0, packets = 0;
+    uint64_t bytes = 0;
+    pthread_t consumer_h;
+    int started = 0;
+
+    if (!(buffer[0] = malloc(period * sizeof (float))) || !(buffer[1] = malloc(period * sizeof (float))) ||
+                !(write_time = malloc(n_periods * sizeof (double))))
+        {
+        fprintf(stderr, "bench_codec: malloc failure\n");
+        exit(5);
+        }
+    n_latencies = periods_written = 0;
+    memset(slots, 0, ti.n_encoders * sizeof (struct bench_slot));
+
+    for (uv.tab = 0; uv.tab < ti.n_encoders; ++uv.tab)
+        {
+        /* encoder_start may realloc this one */
+        if (!(ev.samplerate = malloc(12)))
+            {
+            fprintf(stderr, "bench_codec: malloc failure\n");
+            exit(5);
+            }
+        if (c->samplerate)
+            strcpy(ev.samplerate, c->samplerate);
+        else
+            snprintf(ev.samplerate, 12, "%d", rate);
+        if (encoder_start(&ti, &uv, &ev) == SUCCEEDED)
+            {
+            slots[uv.tab].run_encoder = ti.encoder[uv.tab]->run_encoder;
+            ti.encoder[uv.tab]->run_encoder = bench_run_encoder;
+            if ((slots[uv.tab].op = encoder_register_client(&ti, uv.tab)))
+                encoder_client_set_notify(slots[uv.tab].op, notify_fd);
+            ++started;
+            }
+        free(ev.samplerate);
+        }
+    if (started < ti.n_encoders)
+        {
+        printf("%-7s failed to start\n", c->name);
+        goto stop;
+        }
+
+    consumer_quit = FALSE;
+    if (pthread_create(&consumer_h, NULL, bench_consumer, NULL))
+        {
+        fprintf(stderr, "bench_codec: pthread_create call failed\n");
+        exit(5);
+        }
+
+    allocs = bench_allocations();
+    wall = bench_now();
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for (i = 0; i < n_periods; ++i)
+        {
+        bench_signal(buffer[0], buffer[1], i * period, period, rate);
+        if (unpaced)
+            {
+            /* as fast as the slowest encoder without overwriting its input */
+            while (ring->write_pos + period - bench_slowest(ring) > ring->size / 2)
+                nanosleep(&wait, NULL);
+            }
+        else
+            {
+            if ((next.tv_nsec += period_ns) >= 1000000000L)
+                {
+                next.tv_sec += next.tv_nsec / 1000000000L;
+                next.tv_nsec %= 1000000000L;
+                }
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL))
+                ;
+            }
+        capture_ring_write(ring, buffer, period);
+        write_time[i] = bench_now();
+        __atomic_store_n(&periods_written, i + 1, __ATOMIC_RELEASE);
+        }
+
+    /* let the encoders catch up with what they are able to */
+    for (last = bench_slowest(ring), progress = bench_now(); bench_now() - progress < 0.5; )
+        {
+        if ((pos = bench_slowest(ring)) == ring->write_pos)
+            break;
+        if (pos != last)
+            {
+            last = pos;
+            progress = bench_now();
+            }
+        nanosleep(&wait, NULL);
+        }
+    wall = bench_now() - wall;
+    allocs = bench_allocations() - allocs;
+
+    __atomic_store_n(&consumer_quit, TRUE, __ATOMIC_RELEASE);
+    pthread_join(consumer_h, NULL);
+
+    for (i = 0; i < (size_t)ti.n_encoders; ++i)
+        {
+        busy += slots[i].busy;
+        calls += slots[i].calls;
+        packets += slots[i].packets;
+        bytes += slots[i].bytes;
+        if (slots[i].worst > worst)
+            worst = slots[i].worst;
+        }
+    qsort(latencies, n_latencies, sizeof (double), bench_compare);
+    printf("%-7s %10.1f %9.1f %9.2f %8.1f %8.1f %8.1f %9.1f %9.1f\n", c->name,
+            (double)seconds * ti.n_encoders / busy, (double)seconds / wall, worst * 1e3,
+            n_latencies ? latencies[n_latencies / 2] * 1e3 : 0.0,
+            n_latencies ? latencies[n_latencies * 99 / 100] * 1e3 : 0.0,
+            n_latencies ? latencies[n_latencies - 1] * 1e3 : 0.0,
+            bytes * 8.0 / 1000.0 / seconds / ti.n_encoders, allocs / (double)seconds);
+    fprintf(stderr, "bench_codec: %s %lu calls, %lu packets, %lu latency samples\n", c->name, calls, packets, (unsigned long)n_latencies);
+
+    stop:
+    for (uv.tab = 0; uv.tab < ti.n_encoders; ++uv.tab)
+        {
+        if (slots[uv.tab].op)
+            encoder_unregister_client(slots[uv.tab].op);
+        slots[uv.tab].op = NULL;
+        encoder_stop(&ti, &uv, NULL);
+        }
+    free(buffer[0]);
+    free(buffer[1]);
+    free(write_time);
+    }
+
+/* bench_selected: whether name is in the comma separated list */
+static int bench_selected(const char *list, const char *name)
+    {
+    size_t len = strlen(name), n;
+
+    if (!list)
+        return TRUE;
+    for (; *list; list += n + !!list[n])
+        {
+        n = strcspn(list, ",");
+        if (n == len && !strncmp(list, name, len))
+            return TRUE;
+        }
+    return FALSE;
+    }
+
+int main(int argc, char **argv)
+    {
+    struct bench_codec *c;
+    char *list = NULL;
+    int seconds = 20, n_encoders = 1, unpaced = FALSE, lame_available = TRUE, opt, i;
+
+    rate = 44100;
+    period = 1024;
+    while ((opt = getopt(argc, argv, "c:n:d:r:p:F")) != -1)
+        switch (opt)
+            {
+            case 'c':
+                list = optarg;
+                break;
+            case 'n':
+                n_encoders = atoi(optarg);
+                break;
+            case 'd':
+                seconds = atoi(optarg);
+                break;
+            case 'r':
+                rate = atoi(optarg);
+                break;
+            case 'p':
+                period = atoi(optarg);
+                break;
+            case 'F':
+                unpaced = TRUE;
+                break;
+            default:
+                goto usage;
+            }
+    if (optind != argc || n_encoders < 1 || seconds < 1 || rate < 8000 || period < 16 || period > rate / 4)
+        goto usage;
+
+    /* the user interface and main normally supply these */
+    setenv("libmp3lame_filename", "libmp3lame.so.0", 0);
+    setenv("encoder_queue_ms", "4000", 0);
+    g.out = stderr;
+#ifdef HAVE_LIBAV
+    pthread_mutex_init(&g.avc_mutex, NULL);
+    avcodec_register_all();
+    av_register_all();
+#endif
+#ifdef DYN_LAME
+    if (!(lame_available = dyn_lame_init()))
+        fprintf(stderr, "main: lame is not available\n");
+#endif
+
+    /* an audio feed as audio_feed_init makes but without JACK */
+    if (!(ti.audio_feed = calloc(1, sizeof (struct audio_feed))) ||
+                !(ti.audio_feed->capture_ring = capture_ring_create(rate * 2)) ||
+                !(slots = calloc(n_encoders, sizeof (struct bench_slot))) ||
+                !(ti.encoder = calloc(n_encoders, sizeof (struct encoder *))) ||
+                !(latencies = malloc(MAX_LATENCIES * sizeof (double))))
+        {
+        fprintf(stderr, "main: malloc failure\n");
+        exit(5);
+        }
+    ti.audio_feed->threads_info = &ti;
+    ti.audio_feed->sample_rate = rate;
+    ti.audio_feed->overflow_policy = CR_FOLD;
+    for (ti.n_encoders = 0; ti.n_encoders < n_encoders; ++ti.n_encoders)
+        if (!(ti.encoder[ti.n_encoders] = encoder_init(&ti, ti.n_encoders)))
+            exit(5);
+    if ((notify_fd = eventfd(0, EFD_NONBLOCK)) < 0)
+        {
+        fprintf(stderr, "main: eventfd failed\n");
+        exit(5);
+        }
+
+    printf("%d encoder%s per codec, feed %d Hz in %d frame periods, %s\n", n_encoders, n_encoders == 1 ? "" : "s",
+                rate, period, unpaced ? "unpaced" : "paced in real time");
+    printf("codec   realtime x  wall x  worst ms  lat p50  lat p99  lat max  kbit/s  allocs/s\n");
+    for (c = codecs; c->name; ++c)
+        {
+        if (!bench_selected(list, c->name))
+            continue;
+        if (!strcmp(c->name, "mp3") && !lame_available)
+            {
+            printf("%-7s no libmp3lame\n", c->name);
+            continue;
+            }
+        bench_codec(c, seconds, unpaced);
+        }
+
+    for (i = 0; i < ti.n_encoders; ++i)
+        encoder_destroy(ti.encoder[i]);
+    close(notify_fd);
+    capture_ring_destroy(ti.audio_feed->capture_ring);
+    free(ti.audio_feed);
+    return 0;
+
+    usage:
+    fprintf(stderr, "usage: %s [-c codec,...] [-n encoders] [-d seconds] [-r rate] [-p frames] [-F]\n", argv[0]);
+    return 5;
+    }
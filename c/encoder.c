@@ -25,6 +25,7 @@
 #include <string.h>
 #include <time.h>
 #include <stdint.h>
+#include <sys/eventfd.h>
 #include <jack/ringbuffer.h>
 #include "sourceclient.h"
 #include "sig.h"
@@ -41,14 +42,31 @@
 #include "dyn_lame.h"
 #endif
 
-#define RS_INPUT_SAMPLES 512
-
 typedef jack_default_audio_sample_t sample_t;
 
-static const size_t rb_n_samples = 53000;       /* maximum number of samples to hold in the ring buffer */
 static uint32_t encoder_packet_magic_number = 'I' << 24 | 'D' << 16 | 'J' << 8 | 'C';
 static const float fade_floor = 0.0003f;
 
+/* per client queue limits, the byte limit is scaled up for high bitrates */
+#define OP_QUEUE_MIN_BYTES 65536
+#define OP_QUEUE_MIN_SLOTS 1024
+/* the smallest packet size assumed when working out the number of slots */
+#define OP_QUEUE_PACKET_BYTES 128
+/* released packets kept for reuse beyond which they are freed */
+#define PACKET_POOL_MAX 256
+/* a running encoder sleeps until this much input is available unless the
+ * encoder plugin has asked encoder_get_input_data for some other amount */
+#define WAKE_SAMPLES 1024
+/* upper bound on any one sleep so that flag based requests are still seen */
+#define WAIT_TIMEOUT_MS 100
+
+/* encoded packets are copied once into a pooled packet which is then shared by
+ * reference among all the clients of the encoder, the last holder to release
+ * it returns it to the pool along with its data buffer */
+static struct encoder_op_packet *packet_pool;
+static int packet_pool_n;
+static pthread_mutex_t packet_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 int encoder_init_lame(struct threads_info *ti, struct universal_vars *uv, void *param)
     {
     int l = 1;
@@ -139,41 +157,32 @@ static int encoder_get_resample_mode(char *rm_string)
 
 static void encoder_free_input_ringbuffers(struct encoder *self)
     {
-    struct timespec ms10 = { 0, 10000000 };
-    
-    if (self->jack_dataflow_control == JD_ON)
-        self->jack_dataflow_control = JD_FLUSH;
-    while (self->jack_dataflow_control != JD_OFF)
-        nanosleep(&ms10, NULL);
-    
-    if (self->input_rb[0])
-        jack_ringbuffer_free(self->input_rb[0]);
-    if (self->input_rb[1])
-        jack_ringbuffer_free(self->input_rb[1]);
-    self->input_rb[0] = self->input_rb[1] = NULL;
+    if (self->input.ring)
+        {
+        if (self->input.overflows)
+            fprintf(stderr, "encoder_free_input_ringbuffers: input overflowed %u times, %llu frames dropped\n", self->input.overflows, (unsigned long long)self->input.frames_dropped);
+        capture_reader_detach(&self->input);
+        }
     }
 
 static void encoder_free_resampler(struct encoder *self)
     {
-    int i;
-    
-    for (i = 0; i < 2; i++)
-        if (self->src_state[i])
-            {
-            src_delete(self->src_state[i]);
-            self->src_state[i] = NULL;
-            }
+    if (self->resampler)
+        {
+        resample_stage_release(self->resampler);
+        self->resampler = NULL;
+        }
     }
 
 static void encoder_plugin_terminate(struct encoder *self)
     {
-    struct timespec ms10 = { 0, 10000000 };
-        
     self->run_request_f = FALSE;
     if (self->encoder_state != ES_STOPPED)
         fprintf(stderr, "encoder_plugin_terminate: waiting for encoder to finish\n");
+    pthread_mutex_lock(&self->state_mutex);
     while (self->encoder_state != ES_STOPPED)
-        nanosleep(&ms10, NULL);
+        pthread_cond_wait(&self->state_cv, &self->state_mutex);
+    pthread_mutex_unlock(&self->state_mutex);
     }
 
 static void encoder_unlink(struct encoder *self)
@@ -183,86 +192,14 @@ static void encoder_unlink(struct encoder *self)
     encoder_free_resampler(self);
     }
 
-static long encoder_input_rb_mono_downmix(jack_ringbuffer_t **rb, float *bptr, int max_samples)
-    {
-    jack_ringbuffer_data_t rbvec0[2], rbvec1[2];
-    sample_t *ch0, *ch1;
-    int transition, i;
-    long n_samples;
-
-    jack_ringbuffer_get_read_vector(rb[0], rbvec0);
-    jack_ringbuffer_get_read_vector(rb[1], rbvec1);
-    n_samples = (rbvec1[0].len + rbvec1[1].len) / sizeof (sample_t);
-    if (n_samples > max_samples)
-        n_samples = max_samples;
-    /* transition is the point at the end of the ringbuffer where we must wrap around */
-    if((transition = rbvec0[0].len / sizeof (sample_t)) > n_samples)
-        transition = n_samples;
-    ch0 = (sample_t *)rbvec0[0].buf;     /* set channel 0 and 1 pointers */
-    ch1 = (sample_t *)rbvec1[0].buf;
-    for (i = 0; i < transition; i++)
-        *bptr++ = (*ch0++ + *ch1++) * 0.5F;       /* copy up to the transition */
-    ch0 = (sample_t *)rbvec0[1].buf;     /* set pointers for segment 2 */
-    ch1 = (sample_t *)rbvec1[1].buf;
-    for (i = transition; i < n_samples; i++)     /* do the second segment if relevant */
-        *bptr++ = (*ch0++ + *ch1++) * 0.5F;
-    jack_ringbuffer_read_advance(rb[0], n_samples * sizeof (sample_t));
-    jack_ringbuffer_read_advance(rb[1], n_samples * sizeof (sample_t));
-    return n_samples;
-    }
-    
-static long encoder_input_rb_stereo(jack_ringbuffer_t **rb, float **dest, long max_samples)
-    {
-    long n_samples;
-    int i;
-
-    n_samples = jack_ringbuffer_read_space(rb[1]) / sizeof (sample_t);
-    if (n_samples > max_samples)
-        n_samples = max_samples;
-    for (i = 0; i < 2; i++, rb++, dest++)
-        jack_ringbuffer_read(*rb, (char *)*dest, n_samples * sizeof (sample_t));
-    return n_samples;
-    }
-    
-static long encoder_input_rb_one_channel(jack_ringbuffer_t **rb, float **dest, long max_samples, int c)
-    {
-    long n_samples;
-
-    n_samples = jack_ringbuffer_read_space(rb[c]) / sizeof (sample_t);
-    if (n_samples > max_samples)
-        n_samples = max_samples;
-    jack_ringbuffer_read(rb[c], (char *)dest[c], n_samples * sizeof (sample_t));
-    return n_samples;
-    }
-
-static long encoder_resampler_get_data(void *cb_data, float **data)
-    {
-    struct encoder *encoder = cb_data;
-    long n_samples;
-    
-    if (encoder->rs_channel >= 0)
-        {
-        n_samples = encoder_input_rb_one_channel(encoder->input_rb, encoder->rs_input, RS_INPUT_SAMPLES, encoder->rs_channel);
-        *data = encoder->rs_input[encoder->rs_channel];
-        }
-    else
-        {
-        n_samples = encoder_input_rb_mono_downmix(encoder->input_rb, encoder->rs_input[0], RS_INPUT_SAMPLES);
-        *data = encoder->rs_input[0];
-        }
-
-    return (long)n_samples;
-    }
-
 struct encoder_ip_data *encoder_get_input_data(struct encoder *encoder, size_t min_samples_needed, size_t max_samples, float **caller_supplied_buffer)
     {
     struct encoder_ip_data *id;
-    ssize_t n_samples;
-    size_t samples_available;
     int i;
     
     if (max_samples == 0)
         return NULL;
+    encoder->wake_samples = min_samples_needed;
     
     if (!(id = calloc(1, sizeof (struct encoder_ip_data))))
         {
@@ -287,39 +224,22 @@ struct encoder_ip_data *encoder_get_input_data(struct encoder *encoder, size_t m
                 goto no_data;
                 }
         }
-    if (!encoder->resample_f)
-        {
-        if (jack_ringbuffer_read_space(encoder->input_rb[1]) / sizeof (sample_t) < min_samples_needed)
-            goto no_data;
-        if (encoder->n_channels == 2)
-            id->qty_samples = encoder_input_rb_stereo(encoder->input_rb, id->buffer, max_samples);
-        else
-            id->qty_samples = encoder_input_rb_mono_downmix(encoder->input_rb, id->buffer[0], max_samples);
-        }
+    /* resampled audio comes from a stage that may be shared with other encoders */
+    if (encoder->resampler)
+        resample_stage_pump(encoder->resampler);
+
+    if (capture_reader_read_space(&encoder->input) < min_samples_needed)
+        goto no_data;
+    if (encoder->n_channels == 2)
+        id->qty_samples = capture_reader_read_stereo(&encoder->input, id->buffer, max_samples);
     else
-        {                 /* handle the resampling condition */
-        /* note 128 samples are held back to make sure the resampler gives the full number of samples on both reads */
-        n_samples = (ssize_t)(jack_ringbuffer_read_space(encoder->input_rb[1]) / sizeof (sample_t) * encoder->sr_conv_ratio) - 128;
-        samples_available = (n_samples > 0) ? n_samples : 0;
-        if (samples_available > max_samples)
-            samples_available = max_samples;
-        if (samples_available < min_samples_needed)
-            goto no_data;
-        if (encoder->n_channels == 2)
-            {
-            encoder->rs_channel = 0;
-            id->qty_samples = (size_t)src_callback_read(encoder->src_state[0], encoder->sr_conv_ratio, samples_available, id->buffer[0]);
-            encoder->rs_channel = 1;
-            src_callback_read(encoder->src_state[1], encoder->sr_conv_ratio, id->qty_samples, id->buffer[1]);
-            }
-        else
-            {
-            encoder->rs_channel = -1;
-            id->qty_samples = (size_t)src_callback_read(encoder->src_state[0], encoder->sr_conv_ratio, samples_available, id->buffer[0]);
-            }
-        if (id->qty_samples == 0)
-            goto no_data;
-        }
+        id->qty_samples = capture_reader_read_mono(&encoder->input, id->buffer[0], max_samples);
+    if (id->qty_samples == 0)
+        goto no_data;
+
+    if (encoder->input.overflows || (encoder->resampler &&
+                resample_stage_overflows(encoder->resampler) != encoder->resampler_overflows))
+        encoder->performance_warning_indicator = PW_AUDIO_DATA_DROPPED;
 
     pthread_mutex_lock(&encoder->fade_mutex);
     if (encoder->pregain != 1.0f || encoder->fadescale != 1.0f)
@@ -360,115 +280,249 @@ void encoder_ip_data_free(struct encoder_ip_data *id)
     free(id);
     }
 
+static long encoder_elapsed_us(struct timespec *since)
+    {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - since->tv_sec) * 1000000L + (now.tv_nsec - since->tv_nsec) / 1000;
+    }
+
+static struct encoder_op_packet *encoder_packet_acquire(size_t data_size)
+    {
+    struct encoder_op_packet *packet;
+    void *data;
+
+    pthread_mutex_lock(&packet_pool_mutex);
+    if ((packet = packet_pool))
+        {
+        packet_pool = packet->next_free;
+        packet_pool_n--;
+        }
+    pthread_mutex_unlock(&packet_pool_mutex);
+
+    if (!packet && !(packet = calloc(1, sizeof (struct encoder_op_packet))))
+        {
+        fprintf(stderr, "encoder_packet_acquire: malloc failure\n");
+        return NULL;
+        }
+    if (packet->capacity < data_size)
+        {
+        if (!(data = realloc(packet->data, data_size)))
+            {
+            fprintf(stderr, "encoder_packet_acquire: malloc failure for data buffer\n");
+            free(packet->data);
+            free(packet);
+            return NULL;
+            }
+        packet->data = data;
+        packet->capacity = data_size;
+        }
+    packet->next_free = NULL;
+    packet->refcount = 1;
+    return packet;
+    }
+
 /* note encoder.mutex must be locked before helper threads can safely traverse 
     encoder.output_chain to find the op structure to pass to this function */
+/* packet must come from the pool, the queue takes its own reference to it */
 size_t encoder_write_packet(struct encoder_op *op, struct encoder_op_packet *packet)
     {
-    size_t packet_size, written;
+    size_t packet_size;
+    struct encoder_op_packet *stale;
      
-    packet->header.magic = encoder_packet_magic_number;
-    packet->header.serial = op->encoder->oggserial;
     packet_size = sizeof packet->header + packet->header.data_size;
-    while (packet_size > jack_ringbuffer_write_space(op->packet_rb))
+    if (packet_size > op->queue_limit)
         {
-        if (jack_ringbuffer_read_space(op->packet_rb) == 0)
+        fprintf(stderr, "encoder_write_packet: packet too big to fit in the queue\n");
+        return 0;
+        }
+    pthread_mutex_lock(&op->mutex);
+    while (op->queue_count == op->queue_slots || op->queue_bytes + packet_size > op->queue_limit)
+        {
+        if (!op->full)
             {
-            fprintf(stderr, "encoder_write_packet: packet too big to fit in the ringbuffer\n");
-            return 0;
+            op->full = TRUE;
+            clock_gettime(CLOCK_MONOTONIC, &op->full_since);
             }
-        encoder_client_free_packet(encoder_client_get_packet(op)); /* flush stale packets */
+        /* flush stale packets */
+        stale = op->queue[op->queue_head];
+        op->queue_head = (op->queue_head + 1) % op->queue_slots;
+        op->queue_count--;
+        op->queue_bytes -= sizeof stale->header + stale->header.data_size;
+        op->stats.bytes_dropped += stale->header.data_size;
+        encoder_client_free_packet(stale);
         op->performance_warning_indicator = PW_AUDIO_DATA_DROPPED;
         }
-    pthread_mutex_lock(&op->mutex);
-    written = jack_ringbuffer_write(op->packet_rb, (char *)&packet->header, sizeof packet->header);
-    written += jack_ringbuffer_write(op->packet_rb, (char *)packet->data, packet->header.data_size);
+    __atomic_add_fetch(&packet->refcount, 1, __ATOMIC_RELAXED);
+    op->queue[(op->queue_head + op->queue_count++) % op->queue_slots] = packet;
+    if ((op->queue_bytes += packet_size) > op->stats.high_water)
+        op->stats.high_water = op->queue_bytes;
+    pthread_cond_signal(&op->cv);
+    /* poll driven clients drain the whole queue so only the first packet needs to wake them */
+    if (op->notify_fd >= 0 && op->queue_count == 1)
+        eventfd_write(op->notify_fd, 1);
     pthread_mutex_unlock(&op->mutex);
-    return written;
+    return packet_size;
     }
     
 void encoder_write_packet_all(struct encoder *encoder, struct encoder_op_packet *packet)
     {
     struct encoder_op *iter;
-    struct timespec ms10 = { 0, 10000000 };
+    struct encoder_op_packet *shared;
     
-    while (pthread_mutex_trylock(&encoder->mutex))
-        nanosleep(&ms10, NULL);
+    if (!(shared = encoder_packet_acquire(packet->header.data_size)))
+        return;
+    shared->header = packet->header;
+    shared->header.magic = encoder_packet_magic_number;
+    shared->header.serial = encoder->oggserial;
+    if (packet->header.data_size)
+        memcpy(shared->data, packet->data, packet->header.data_size);
+    clock_gettime(CLOCK_MONOTONIC, &shared->queued);
+
+    pthread_mutex_lock(&encoder->mutex);
     for (iter = encoder->output_chain; iter; iter = iter->next)
-        encoder_write_packet(iter, packet);
+        encoder_write_packet(iter, shared);
     pthread_mutex_unlock(&encoder->mutex);
+    encoder_client_free_packet(shared);
     }
 
+/* the returned packet is shared with other clients and must not be modified */
 struct encoder_op_packet *encoder_client_get_packet(struct encoder_op *op)
     {
-    struct encoder_op_packet *packet;
+    struct encoder_op_packet *packet = NULL;
     
     pthread_mutex_lock(&op->mutex);
-    if (jack_ringbuffer_read_space(op->packet_rb) >= sizeof (struct encoder_op_packet_header))
+    if (op->queue_count)
         {
-        if (!(packet = calloc(1, sizeof (struct encoder_op_packet))))
-            {
-            fprintf(stderr, "encoder_client_get_packet: malloc failure\n");
-            goto unlock;
-            }
-        jack_ringbuffer_read(op->packet_rb, (char *)packet, sizeof (struct encoder_op_packet_header));
-        if (packet->header.magic != encoder_packet_magic_number)
-            {
-            fprintf(stderr, "encoder_client_get_packet: magic number missing\n");
-            free(packet);
-            goto unlock;
-            }
-        if (jack_ringbuffer_read_space(op->packet_rb) < packet->header.data_size)
+        packet = op->queue[op->queue_head];
+        op->queue_head = (op->queue_head + 1) % op->queue_slots;
+        op->queue_count--;
+        op->queue_bytes -= sizeof packet->header + packet->header.data_size;
+        if (op->full)
             {
-            fprintf(stderr, "encoder_client_get_packet: packet header specifying more data than can fit in the buffer\n");
-            free(packet);
-            goto unlock;
-            }   
-        if (packet->header.data_size)
-            {
-            if (!(packet->data = malloc(packet->header.data_size)))
-                {
-                fprintf(stderr, "encoder_client_get_packet: malloc failure for data buffer\n");
-                free(packet);
-                goto unlock;
-                }
-            jack_ringbuffer_read(op->packet_rb, packet->data, packet->header.data_size);
+            op->full = FALSE;
+            op->stats.full_us += encoder_elapsed_us(&op->full_since);
             }
-        pthread_mutex_unlock(&op->mutex);
-        return packet;
         }
-    unlock:
     pthread_mutex_unlock(&op->mutex);
-    return NULL;
+    return packet;
+    }
+
+void encoder_client_get_stats(struct encoder_op *op, struct encoder_op_stats *stats)
+    {
+    pthread_mutex_lock(&op->mutex);
+    *stats = op->stats;
+    if (op->full)
+        stats->full_us += encoder_elapsed_us(&op->full_since);
+    pthread_mutex_unlock(&op->mutex);
+    }
+
+/* sleep until a packet is queued, returns zero on timeout */
+int encoder_client_wait_packet(struct encoder_op *op, int timeout_ms)
+    {
+    struct timespec deadline;
+    int ready;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    if ((deadline.tv_nsec += (timeout_ms % 1000) * 1000000L) >= 1000000000L)
+        {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+        }
+
+    pthread_mutex_lock(&op->mutex);
+    while (!op->queue_count)
+        if (pthread_cond_timedwait(&op->cv, &op->mutex, &deadline))
+            break;
+    ready = op->queue_count != 0;
+    pthread_mutex_unlock(&op->mutex);
+    return ready;
+    }
+
+/* for clients that wait in poll or epoll rather than encoder_client_wait_packet */
+void encoder_client_set_notify(struct encoder_op *op, int fd)
+    {
+    pthread_mutex_lock(&op->mutex);
+    op->notify_fd = fd;
+    if (fd >= 0 && op->queue_count)
+        eventfd_write(fd, 1);
+    pthread_mutex_unlock(&op->mutex);
+    }
+
+/* how long ago the encoder queued the packet */
+long encoder_packet_age_us(struct encoder_op_packet *packet)
+    {
+    return encoder_elapsed_us(&packet->queued);
     }
     
+/* for holding on to a packet beyond the matching encoder_client_free_packet */
+void encoder_client_ref_packet(struct encoder_op_packet *packet)
+    {
+    __atomic_add_fetch(&packet->refcount, 1, __ATOMIC_RELAXED);
+    }
+
 void encoder_client_free_packet(struct encoder_op_packet *packet)
     {
-    if (packet->data)
-        free(packet->data);
-    free(packet);
+    if (__atomic_sub_fetch(&packet->refcount, 1, __ATOMIC_ACQ_REL))
+        return;
+
+    pthread_mutex_lock(&packet_pool_mutex);
+    if (packet_pool_n < PACKET_POOL_MAX)
+        {
+        packet->next_free = packet_pool;
+        packet_pool = packet;
+        packet_pool_n++;
+        packet = NULL;
+        }
+    pthread_mutex_unlock(&packet_pool_mutex);
+
+    if (packet)
+        {
+        if (packet->data)
+            free(packet->data);
+        free(packet);
+        }
     }
 
 int encoder_client_set_flush(struct encoder_op *op)
     {
     struct encoder *encoder = op->encoder;
-    struct timespec ns1 = { 0, 1 };
     int serial;
     
-    while (pthread_mutex_trylock(&encoder->flush_mutex))
-        nanosleep(&ns1, NULL);
+    pthread_mutex_lock(&encoder->flush_mutex);
     serial = encoder->oggserial;
     encoder->flush = TRUE;
     pthread_mutex_unlock(&encoder->flush_mutex);
     return serial;
     }
 
+/* encoder_size_client_queue: enough for queue_target_ms of audio at the current bitrate */
+static void encoder_size_client_queue(struct encoder *enc, struct encoder_op *op)
+    {
+    double byte_rate;
+
+    if (enc->bitrate > 0)
+        byte_rate = enc->bitrate * 1000.0 / 8.0;
+    else
+        /* bitrate not known, assume 16 bit pcm which lossless codecs won't exceed */
+        byte_rate = enc->target_samplerate * enc->n_channels * 2.0;
+
+    op->queue_limit = (size_t)(byte_rate * enc->queue_target_ms / 1000.0);
+    if (op->queue_limit < OP_QUEUE_MIN_BYTES)
+        op->queue_limit = OP_QUEUE_MIN_BYTES;
+    if ((op->queue_slots = op->queue_limit / OP_QUEUE_PACKET_BYTES) < OP_QUEUE_MIN_SLOTS)
+        op->queue_slots = OP_QUEUE_MIN_SLOTS;
+    fprintf(stderr, "encoder_register_client: queue of %lu bytes for %d ms\n", (unsigned long)op->queue_limit, enc->queue_target_ms);
+    }
+
 /* this is called from a recipient thread to obtain a handle for getting data */ 
 /* the numeric_id is the encoder that is requested */
 struct encoder_op *encoder_register_client(struct threads_info *ti, int numeric_id)
     {
     struct encoder *enc;
     struct encoder_op *op;
-    struct timespec ms10 = { 0, 10000000 };
     
     if (numeric_id >= ti->n_encoders || numeric_id < 0)
         {
@@ -480,17 +534,19 @@ struct encoder_op *encoder_register_client(struct threads_info *ti, int numeric_
         fprintf(stderr, "encoder_register_client: malloc failure\n");
         return NULL;
         }
-    if (!(op->packet_rb = jack_ringbuffer_create(65536)))
+    enc = ti->encoder[numeric_id];
+    encoder_size_client_queue(enc, op);
+    if (!(op->queue = calloc(op->queue_slots, sizeof (struct encoder_op_packet *))))
         {
         fprintf(stderr, "encoder_register_client: malloc failure\n");
         free(op);
         return NULL;
         }
-    enc = ti->encoder[numeric_id];
     op->encoder = enc;
     pthread_mutex_init(&op->mutex, NULL);
-    while (pthread_mutex_trylock(&op->encoder->mutex))
-        nanosleep(&ms10, NULL);
+    pthread_cond_init(&op->cv, NULL);
+    op->notify_fd = -1;
+    pthread_mutex_lock(&op->encoder->mutex);
     op->next = enc->output_chain;
     enc->output_chain = op;
     enc->client_count++;
@@ -501,11 +557,9 @@ struct encoder_op *encoder_register_client(struct threads_info *ti, int numeric_
 void encoder_unregister_client(struct encoder_op *op)
     {
     struct encoder_op *iter;
-    struct timespec ms10 = { 0, 10000000 };      /* ten milliseconds */
     
     fprintf(stderr, "encoder_unregister_client called\n");
-    while (pthread_mutex_trylock(&op->encoder->mutex))
-        nanosleep(&ms10, NULL);
+    pthread_mutex_lock(&op->encoder->mutex);
     if ((iter = op->encoder->output_chain) == op)
         op->encoder->output_chain = op->next;
     else
@@ -516,22 +570,59 @@ void encoder_unregister_client(struct encoder_op *op)
         }
     op->encoder->client_count--;
     pthread_mutex_unlock(&op->encoder->mutex);
+    if (op->stats.bytes_dropped)
+        fprintf(stderr, "encoder_unregister_client: client fell behind, %llu bytes dropped, peak queue %lu of %lu bytes\n",
+                (unsigned long long)op->stats.bytes_dropped, (unsigned long)op->stats.high_water, (unsigned long)op->queue_limit);
+    pthread_cond_destroy(&op->cv);
     pthread_mutex_destroy(&op->mutex);
-    jack_ringbuffer_free(op->packet_rb);
+    while (op->queue_count--)
+        {
+        encoder_client_free_packet(op->queue[op->queue_head]);
+        op->queue_head = (op->queue_head + 1) % op->queue_slots;
+        }
+    free(op->queue);
     free(op);
     fprintf(stderr, "encoder_unregister_client finished\n");
     }
 
+/* encoder_wait_input: sleep until the next encoder_get_input_data call can succeed */
+static void encoder_wait_input(struct encoder *self)
+    {
+    struct resample_stage *rs = self->resampler;
+    struct timespec ms10 = { 0, 10000000 };
+    size_t space, wanted = self->wake_samples ? self->wake_samples : WAKE_SAMPLES;
+
+    if (!self->input.ring)
+        {
+        nanosleep(&ms10, NULL);
+        return;
+        }
+
+    if ((space = capture_reader_read_space(&self->input)) >= wanted)
+        return;
+
+    if (rs)
+        {
+        /* wait on the source side of the resampler allowing for what it holds back */
+        size_t need = (size_t)((wanted - space + 128) / rs->ratio) + 1;
+
+        capture_ring_wait(rs->input.ring, __atomic_load_n(&rs->input.pos, __ATOMIC_RELAXED) + need, WAIT_TIMEOUT_MS);
+        }
+    else
+        capture_ring_wait(self->input.ring, __atomic_load_n(&self->input.pos, __ATOMIC_RELAXED) + wanted - space, WAIT_TIMEOUT_MS);
+    }
+
 void *encoder_main(void *args)
     {
     struct encoder *self = args;
     struct timespec ms10 = { 0, 10000000 };      /* ten milliseconds */
+    enum encoder_state state;
 
     sig_mask_thread();
     while(!self->thread_terminate_f)
         {
         pthread_mutex_lock(&self->flush_mutex);
-        switch(self->encoder_state)
+        switch(state = self->encoder_state)
             {
             case ES_STOPPED:
                 break;
@@ -543,7 +634,29 @@ void *encoder_main(void *args)
                 break;
             }
         pthread_mutex_unlock(&self->flush_mutex);
-        nanosleep(&ms10, NULL);
+
+        if (self->encoder_state != state)
+            {
+            pthread_mutex_lock(&self->state_mutex);
+            pthread_cond_broadcast(&self->state_cv);
+            pthread_mutex_unlock(&self->state_mutex);
+            continue;
+            }
+
+        switch (state)
+            {
+            case ES_STOPPED:
+                pthread_mutex_lock(&self->state_mutex);
+                while (self->encoder_state == ES_STOPPED && !self->thread_terminate_f)
+                    pthread_cond_wait(&self->state_cv, &self->state_mutex);
+                pthread_mutex_unlock(&self->state_mutex);
+                break;
+            case ES_RUNNING:
+                encoder_wait_input(self);
+                break;
+            default:
+                nanosleep(&ms10, NULL);
+            }
         }
     return NULL;
     }
@@ -552,9 +665,8 @@ int encoder_start(struct threads_info *ti, struct universal_vars *uv, void *othe
     {
     struct encoder *self = ti->encoder[uv->tab];
     struct encoder_vars *ev = other;
-    struct timespec ms10 = { 0, 10000000 };
     int (*encoder_init)(struct encoder *, struct encoder_vars *) = NULL;
-    int i, resample_mode, error;
+    int resample_mode;
 
     if (self->encoder_state != ES_STOPPED)
         {
@@ -633,6 +745,7 @@ int encoder_start(struct threads_info *ti, struct universal_vars *uv, void *othe
         }
 
     self->performance_warning_indicator = PW_OK;
+    self->wake_samples = 0;
     self->samplerate = (long)self->threads_info->audio_feed->sample_rate;
     self->target_samplerate = atol(ev->samplerate);
     self->resample_f = !(self->samplerate == self->target_samplerate);
@@ -646,14 +759,12 @@ int encoder_start(struct threads_info *ti, struct universal_vars *uv, void *othe
         self->new_metadata = TRUE;
     if (self->resample_f)
         {
-        fprintf(stderr, "encoder_start: initiating resampler(s)\n");
+        fprintf(stderr, "encoder_start: initiating resampler\n");
         resample_mode = encoder_get_resample_mode(ev->resample_quality);
-        for (i = 0; i < self->n_channels; i++)
-            {
-            if (!(self->src_state[i] = src_callback_new(encoder_resampler_get_data, resample_mode, 1, &error, self)))
-                goto failed;
-            src_set_ratio(self->src_state[i], self->sr_conv_ratio);
-            }
+        if (!(self->resampler = resample_stage_get(self->threads_info->audio_feed, self->target_samplerate, resample_mode)))
+            goto failed;
+        /* losses from before this encoder joined the stage are not its own */
+        self->resampler_overflows = resample_stage_overflows(self->resampler);
         }
     else
         fprintf(stderr, "encoder_start: resampler will not be used\n");
@@ -662,22 +773,18 @@ int encoder_start(struct threads_info *ti, struct universal_vars *uv, void *othe
         {
         if (self->data_format.source == ENCODER_SOURCE_JACK)
             {
-            self->input_rb[0] = jack_ringbuffer_create(rb_n_samples * sizeof (sample_t));
-            self->input_rb[1] = jack_ringbuffer_create(rb_n_samples * sizeof (sample_t));
-            if (!(self->input_rb[0] && self->input_rb[1]))
-                {
-                fprintf(stderr, "encoder_start: jack ringbuffer creation failure\n");
-                goto failed;
-                }
-            self->jack_dataflow_control = JD_ON;
+            struct audio_feed *af = self->threads_info->audio_feed;
+
+            capture_reader_attach(&self->input, self->resampler ? self->resampler->output : af->capture_ring, af->overflow_policy);
             }
 
         self->run_request_f = TRUE;
+        pthread_mutex_lock(&self->state_mutex);
         self->encoder_state = ES_STARTING;
-        while (self->encoder_state == ES_STARTING)
-            nanosleep(&ms10, NULL);
-        while (self->encoder_state == ES_STOPPING)
-            nanosleep(&ms10, NULL);
+        pthread_cond_broadcast(&self->state_cv);
+        while (self->encoder_state == ES_STARTING || self->encoder_state == ES_STOPPING)
+            pthread_cond_wait(&self->state_cv, &self->state_mutex);
+        pthread_mutex_unlock(&self->state_mutex);
         if (self->encoder_state == ES_STOPPED)
             {
             fprintf(stderr, "encoder_start: encoder failed during initialisation\n");
@@ -801,14 +908,6 @@ struct encoder *encoder_init(struct threads_info *ti, int numeric_id)
         fprintf(stderr, "encoder_init: malloc failure\n");
         return NULL;
         }
-    self->rs_input[0] = malloc(RS_INPUT_SAMPLES * sizeof (sample_t));
-    self->rs_input[1] = malloc(RS_INPUT_SAMPLES * sizeof (sample_t));
-    if (!(self->rs_input[0] && self->rs_input[1]))
-        {
-        fprintf(stderr, "encoder_init: malloc failure\n");
-        free(self);
-        return NULL;
-        }
     self->threads_info = ti;
     self->numeric_id = numeric_id;
     self->artist = strdup("");
@@ -820,6 +919,10 @@ struct encoder *encoder_init(struct threads_info *ti, int numeric_id)
     pthread_mutex_init(&self->metadata_mutex, NULL);
     pthread_mutex_init(&self->flush_mutex, NULL);
     pthread_mutex_init(&self->fade_mutex, NULL);
+    pthread_mutex_init(&self->state_mutex, NULL);
+    pthread_cond_init(&self->state_cv, NULL);
+    if ((self->queue_target_ms = atoi(getenv("encoder_queue_ms"))) <= 0)
+        self->queue_target_ms = 4000;
     if (pthread_create(&self->thread_h, NULL, encoder_main, self))
         {
         fprintf(stderr, "encoder_init: pthread_create call failed\n");
@@ -831,16 +934,17 @@ struct encoder *encoder_init(struct threads_info *ti, int numeric_id)
 
 void encoder_destroy(struct encoder *self)
     {
+    pthread_mutex_lock(&self->state_mutex);
     self->thread_terminate_f = TRUE;
+    pthread_cond_broadcast(&self->state_cv);
+    pthread_mutex_unlock(&self->state_mutex);
     pthread_join(self->thread_h, NULL);
+    pthread_cond_destroy(&self->state_cv);
+    pthread_mutex_destroy(&self->state_mutex);
     pthread_mutex_destroy(&self->mutex);
     pthread_mutex_destroy(&self->metadata_mutex);
     pthread_mutex_destroy(&self->flush_mutex);
     pthread_mutex_destroy(&self->fade_mutex);
-    if (self->rs_input[0])
-        free(self->rs_input[0]);
-    if (self->rs_input[1])
-        free(self->rs_input[1]);
     if (self->custom_meta)
         free(self->custom_meta);
     if (self->artist)
@@ -22,12 +22,14 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <time.h>
 #include <samplerate.h>
 #include <jack/ringbuffer.h>
 #include <pthread.h>
 #include "sourceclient.h"
+#include "capture_ring.h"
+#include "resample_stage.h"
 
-enum jack_dataflow { JD_OFF, JD_ON, JD_FLUSH };
 enum performance_warning { PW_OK, PW_AUDIO_DATA_DROPPED };
 enum encoder_source {ENCODER_SOURCE_UNHANDLED, ENCODER_SOURCE_JACK, ENCODER_SOURCE_FILE};
 enum encoder_family {ENCODER_FAMILY_UNHANDLED, ENCODER_FAMILY_MPEG, ENCODER_FAMILY_OGG};
@@ -102,15 +104,36 @@ struct encoder_op_packet
     {
     struct encoder_op_packet_header header;
     void *data;
+    int refcount;                        /* pooled packets: number of queues and readers holding it */
+    size_t capacity;                     /* pooled packets: allocated size of data */
+    struct encoder_op_packet *next_free; /* pooled packets: free list link */
+    struct timespec queued;              /* when the encoder handed it to the clients */
+    };
+
+struct encoder_op_stats                 /* backpressure seen by one client */
+    {
+    uint64_t bytes_dropped;              /* stale packet data discarded to make room */
+    size_t high_water;                   /* the most bytes that have been queued */
+    uint64_t full_us;                    /* time spent unable to take a packet without dropping */
     };
 
 struct encoder_op                       /* encoder output object */
     {
     struct encoder *encoder;             /* parent encoder */
     struct encoder_op *next;             /* the next encoder output object */
-    jack_ringbuffer_t *packet_rb;        /* ringbuffer containing ogg or mp3 packets */
+    struct encoder_op_packet **queue;    /* references to shared ogg or mp3 packets */
+    unsigned queue_head;                 /* index of the oldest queued packet */
+    unsigned queue_count;                /* number of queued packets */
+    size_t queue_bytes;                  /* header plus data bytes currently queued */
+    size_t queue_limit;                  /* byte limit derived from the bitrate and target latency */
+    unsigned queue_slots;                /* length of the queue array */
+    struct encoder_op_stats stats;
+    int full;                            /* packets have been dropped since the client last read */
+    struct timespec full_since;
     enum performance_warning performance_warning_indicator; /* indicates ringbuffer overflow condition */
     pthread_mutex_t mutex;               /* this enables the encoder to expire old output packets safely */
+    pthread_cond_t cv;                   /* signalled when a packet is queued */
+    int notify_fd;                       /* eventfd written when the queue stops being empty, or -1 */
     };
 
 struct encoder_header_buffer
@@ -128,8 +151,8 @@ struct encoder
     int thread_terminate_f;              /* signal the encoder thread to exit */
     int run_request_f;                   /* to run or not to run... */
     enum encoder_state encoder_state;    /* indicate what the encoder should be doing */
-    enum jack_dataflow jack_dataflow_control;    /* tells the jack callback routine what we want it to do */
-    jack_ringbuffer_t *input_rb[2];      /* circular buffer containing pcm audio data */
+    struct capture_reader input;         /* pcm audio data from the jack callback */
+    size_t wake_samples;                 /* input wanted by the last encoder_get_input_data call */
     struct encoder_data_format data_format;
     int n_channels;                      /* stream parameters information... */
     int bitrate;
@@ -139,15 +162,17 @@ struct encoder
     long samplerate;
     long target_samplerate;
     double sr_conv_ratio;
-    SRC_STATE *src_state[2];     /* resampler variables */
-    float *rs_input[2];          /* buffer used by resampler input callback */
-    int rs_channel;              /* resampler callback channel control */
+    struct resample_stage *resampler;    /* shared with other encoders where possible */
+    unsigned resampler_overflows;        /* its input overflow count when this encoder joined */
     int resample_f;              /* true or false to resampling required */
     int client_count;            /* number of streamers/recorders connected */
     pthread_mutex_t flush_mutex; /* to block encoder so it's in a known state before flush */
     pthread_mutex_t mutex;/* for blocking encoder_unregister_client while the encoder is writing out data */
     pthread_mutex_t metadata_mutex;      /* used when metadata is read or written */
     pthread_mutex_t fade_mutex;     /* for blocking fade initiate while fade being processed */
+    pthread_mutex_t state_mutex;         /* encoder_state changes are broadcast on state_cv */
+    pthread_cond_t state_cv;
+    int queue_target_ms;                 /* client queue length in terms of audio */
     struct encoder_op *output_chain;     /* one output buffer per client connection */
     struct encoder_header_buffer *header_buffer; /* point to needed headers or NULL */
     enum performance_warning performance_warning_indicator; /* indicates ringbuffer overflow condition */
@@ -168,6 +193,11 @@ struct encoder *encoder_init(struct threads_info *ti, int numeric_id);
 int encoder_init_lame(struct threads_info *ti, struct universal_vars *uv, void *param);
 void encoder_destroy(struct encoder *self);
 struct encoder_op_packet *encoder_client_get_packet(struct encoder_op *op);
+int encoder_client_wait_packet(struct encoder_op *op, int timeout_ms);
+void encoder_client_set_notify(struct encoder_op *op, int fd);
+long encoder_packet_age_us(struct encoder_op_packet *packet);
+void encoder_client_get_stats(struct encoder_op *op, struct encoder_op_stats *stats);
+void encoder_client_ref_packet(struct encoder_op_packet *packet);
 void encoder_client_free_packet(struct encoder_op_packet *packet);
 int encoder_client_set_flush(struct encoder_op *op);
 size_t encoder_write_packet(struct encoder_op *op, struct encoder_op_packet *packet);
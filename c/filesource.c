@@ -0,0 +1,328 @@
+/*
+#   filesource.c: shared read access to media files for the decoders
+#   Copyright (C) 2013 Stephen Fairchild (s-fairchild@users.sf.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "gnusource.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#ifdef __linux__
+#include <sys/vfs.h>
+#endif
+#include "filesource.h"
+
+#define TRUE 1
+#define FALSE 0
+
+#define PAGE_MASK ((off_t)4095)
+
+/* filesource_remote: where a page fault can mean a network round trip or a
+ * SIGBUS should the file be truncated under us, so not mapped even on request
+ */
+static int filesource_remote(int fd)
+    {
+#ifdef __linux__
+    static const unsigned long remote[] = {
+            0x6969,             /* NFS */
+            0xFF534D42,         /* CIFS */
+            0xFE534D42,         /* SMB2 */
+            0x517B,             /* SMB */
+            0x65735546,         /* FUSE */
+            0x01021997,         /* 9P */
+            0x00C36400,         /* Ceph */
+            0x5346414F,         /* AFS */
+            0 };
+    struct statfs sfs;
+
+    if (fstatfs(fd, &sfs))
+        return FALSE;
+    for (int i = 0; remote[i]; ++i)
+        if ((unsigned long)(unsigned)sfs.f_type == remote[i])
+            return TRUE;
+#endif
+    return FALSE;
+    }
+
+/* filesource_hint: keep the kernel reading up to a block ahead of a sequential reader */
+static void filesource_hint(struct filesource *self)
+    {
+    off_t start = self->pos & ~PAGE_MASK, len;
+
+    if (start >= self->hint_start && start < self->hinted)
+        {
+        if (self->hinted - start > FILESOURCE_BLOCK / 2)
+            return;
+        start = self->hinted;
+        }
+    else
+        self->hint_start = start;
+    if ((len = self->size - start) > FILESOURCE_BLOCK)
+        len = FILESOURCE_BLOCK;
+    if (len <= 0)
+        return;
+    if (self->mapped)
+        posix_madvise(self->map + start, len, POSIX_MADV_WILLNEED);
+    else
+        posix_fadvise(self->fd, start, len, POSIX_FADV_WILLNEED);
+    self->hinted = start + len;
+    }
+
+struct filesource *filesource_open(const char *pathname)
+    {
+    struct filesource *self;
+    struct stat st;
+    char *mode = getenv("file_source");
+    int use_map;
+
+    if (!(self = calloc(1, sizeof (struct filesource))))
+        {
+        fprintf(stderr, "filesource_open: malloc failure\n");
+        return NULL;
+        }
+
+    if ((self->fd = open(pathname, O_RDONLY)) < 0)
+        {
+        free(self);
+        return NULL;
+        }
+
+    if (fstat(self->fd, &st) || !S_ISREG(st.st_mode))
+        {
+        fprintf(stderr, "filesource_open: %s is not a regular file\n", pathname);
+        goto fail;
+        }
+    self->size = st.st_size;
+
+    use_map = mode && !strcmp(mode, "mmap") && !filesource_remote(self->fd);
+
+    if (use_map && self->size > 0 && (uintmax_t)self->size <= SIZE_MAX / 2)
+        {
+        if ((self->map = mmap(NULL, self->size, PROT_READ, MAP_PRIVATE, self->fd, 0)) != MAP_FAILED)
+            self->mapped = TRUE;
+        else
+            self->map = NULL;
+        }
+
+    if (!self->mapped)
+        {
+        if (!(self->block = malloc(FILESOURCE_BLOCK)))
+            {
+            fprintf(stderr, "filesource_open: malloc failure\n");
+            goto fail;
+            }
+        posix_fadvise(self->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        }
+
+    filesource_hint(self);
+    return self;
+
+    fail:
+    close(self->fd);
+    free(self);
+    return NULL;
+    }
+
+void filesource_close(struct filesource *self)
+    {
+    if (self->mapped)
+        munmap(self->map, self->size);
+    free(self->block);
+    close(self->fd);
+    free(self);
+    }
+
+/* filesource_pread: fill the block buffer from the page containing pos
+ * following on from the last read a whole block is read, otherwise it's
+ * probably a seek bisection and only a little is wanted from here
+ */
+static int filesource_pread(struct filesource *self, int sequential)
+    {
+    off_t start = self->pos & ~PAGE_MASK;
+    size_t size = sequential ? FILESOURCE_BLOCK : FILESOURCE_PROBE;
+    ssize_t bytes;
+
+    while ((bytes = pread(self->fd, self->block, size, start)) < 0 && errno == EINTR);
+    if (bytes <= 0)
+        {
+        if (bytes < 0 && !self->error)
+            self->error = errno;
+        self->block_len = 0;
+        return FALSE;
+        }
+    self->block_start = start;
+    self->block_len = bytes;
+    return self->pos < start + bytes;
+    }
+
+size_t filesource_read(struct filesource *self, void *buf, size_t n)
+    {
+    unsigned char *p = buf;
+    size_t chunk, total = 0;
+    off_t offset;
+    ssize_t bytes;
+    int sequential = (self->pos == self->read_end);
+
+    if (self->pos >= self->size)
+        return 0;
+    if ((off_t)n > self->size - self->pos)
+        n = self->size - self->pos;
+
+    if (self->mapped)
+        {
+        memcpy(p, self->map + self->pos, n);
+        self->read_end = self->pos += n;
+        if (sequential)
+            filesource_hint(self);
+        return n;
+        }
+
+    while (total < n)
+        {
+        offset = self->pos - self->block_start;
+        if (self->block_len && offset >= 0 && offset < (off_t)self->block_len)
+            {
+            chunk = self->block_len - offset;
+            if (chunk > n - total)
+                chunk = n - total;
+            memcpy(p + total, self->block + offset, chunk);
+            }
+        else if (n - total >= FILESOURCE_BLOCK)
+            {
+            /* big reads go straight to the caller */
+            while ((bytes = pread(self->fd, p + total, n - total, self->pos)) < 0 && errno == EINTR);
+            if (bytes <= 0)
+                {
+                if (bytes < 0 && !self->error)
+                    self->error = errno;
+                break;
+                }
+            chunk = bytes;
+            }
+        else
+            {
+            if (!filesource_pread(self, sequential || total))
+                break;
+            continue;
+            }
+        total += chunk;
+        self->pos += chunk;
+        }
+
+    self->read_end = self->pos;
+    if (sequential)
+        filesource_hint(self);
+    return total;
+    }
+
+int filesource_seek(struct filesource *self, off_t offset, int whence)
+    {
+    switch (whence)
+        {
+        case SEEK_CUR:
+            offset += self->pos;
+            break;
+        case SEEK_END:
+            offset += self->size;
+            break;
+        case SEEK_SET:
+            break;
+        default:
+            return -1;
+        }
+    if (offset < 0)
+        return -1;
+    self->pos = offset;
+    return 0;
+    }
+
+off_t filesource_tell(struct filesource *self)
+    {
+    return self->pos;
+    }
+
+off_t filesource_size(struct filesource *self)
+    {
+    return self->size;
+    }
+
+int filesource_eof(struct filesource *self)
+    {
+    return self->pos >= self->size;
+    }
+
+#ifdef _GNU_SOURCE
+
+static ssize_t filesource_cookie_read(void *cookie, char *buf, size_t size)
+    {
+    struct filesource *self = cookie;
+    size_t bytes = filesource_read(self, buf, size);
+
+    return (bytes == 0 && self->error) ? -1 : (ssize_t)bytes;
+    }
+
+static int filesource_cookie_seek(void *cookie, off64_t *offset, int whence)
+    {
+    struct filesource *self = cookie;
+
+    if (filesource_seek(self, *offset, whence))
+        return -1;
+    *offset = self->pos;
+    return 0;
+    }
+
+static int filesource_cookie_close(void *cookie)
+    {
+    return 0;
+    }
+
+FILE *filesource_stream(struct filesource *self)
+    {
+    cookie_io_functions_t io = {
+            .read = filesource_cookie_read,
+            .write = NULL,
+            .seek = filesource_cookie_seek,
+            .close = filesource_cookie_close };
+
+    return fopencookie(self, "r", io);
+    }
+
+#else
+
+FILE *filesource_stream(struct filesource *self)
+    {
+    FILE *fp;
+    int fd;
+
+    if ((fd = dup(self->fd)) < 0)
+        return NULL;
+    if (!(fp = fdopen(fd, "r")))
+        {
+        close(fd);
+        return NULL;
+        }
+    fseeko(fp, self->pos, SEEK_SET);
+    return fp;
+    }
+
+#endif /* _GNU_SOURCE */
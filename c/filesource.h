@@ -0,0 +1,72 @@
+/*
+#   filesource.h: shared read access to media files for the decoders
+#   Copyright (C) 2013 Stephen Fairchild (s-fairchild@users.sf.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FILESOURCE_H
+#define FILESOURCE_H
+
+#include <stdio.h>
+#include <sys/types.h>
+
+/* Files are read in large blocks with pread. On request the whole file of a
+ * local filesystem is memory mapped instead so reads and seeks cost no system
+ * calls, at the price of a SIGBUS should the file be truncated while in use.
+ * Either way the kernel is asked to read ahead of a sequential reader while
+ * a seek costs only a small read.
+ *
+ * The environment variable file_source may be set to mmap to request the
+ * mapping or to pread for the default.
+ */
+
+#define FILESOURCE_BLOCK (256 * 1024)
+#define FILESOURCE_PROBE (16 * 1024)
+
+struct filesource
+    {
+    int fd;
+    off_t size;
+    off_t pos;
+    int error;                  /* errno of the first failed read */
+    int mapped;
+    unsigned char *map;         /* the whole file when mapped */
+    unsigned char *block;       /* otherwise the most recently read block */
+    off_t block_start;
+    size_t block_len;
+    off_t read_end;             /* where the last read finished */
+    off_t hint_start;           /* readahead has been requested for this range */
+    off_t hinted;
+    };
+
+struct filesource *filesource_open(const char *pathname);
+void filesource_close(struct filesource *self);
+
+/* filesource_read: like fread, returns fewer than n bytes at the end of the file or on error */
+size_t filesource_read(struct filesource *self, void *buf, size_t n);
+
+/* filesource_seek: like lseek but returns 0 on success or -1 if out of range */
+int filesource_seek(struct filesource *self, off_t offset, int whence);
+off_t filesource_tell(struct filesource *self);
+off_t filesource_size(struct filesource *self);
+int filesource_eof(struct filesource *self);
+
+/* filesource_stream: a stdio view sharing the file position, for the tag readers
+ * closing it leaves the filesource open
+ */
+FILE *filesource_stream(struct filesource *self);
+
+#endif /* FILESOURCE_H */
@@ -22,6 +22,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <FLAC/all.h>
 #include <math.h>
 #include "flacdecode.h"
@@ -32,37 +33,25 @@
 #define ACCEPTED 1
 #define REJECTED 0
 
-void make_flac_audio_to_float(struct xlplayer *self, float *flbuf, const FLAC__int32 * const inputbuffer[], unsigned int numsamples, unsigned int bits_per_sample, unsigned int numchannels)
+/* make_flac_audio_to_float: the kernel is chosen on the first block of a track */
+void make_flac_audio_to_float(struct xlplayer *self, struct pcmconv *conv, float *flbuf, const FLAC__int32 * const inputbuffer[], unsigned int numsamples, unsigned int bits_per_sample, unsigned int numchannels)
     {
-    int shiftvalue = 32 - bits_per_sample;
-    unsigned sample, channel;
-    const float half_randmax = (float)(RAND_MAX >> 1);
-    float dither;
-    float dscale;
-    
-    if (!self->dither || bits_per_sample >= 20)
-        {
-        for (sample = 0; sample < numsamples; sample++)
-            for (channel = 0; channel < numchannels; channel++)
-                *flbuf++ = ((float)(inputbuffer[channel][sample] << shiftvalue)) / 2147483648.0F;
-        }
-    else
-        {
-        dscale = 0.25F / (half_randmax * powf(2.0F, (float)bits_per_sample));
-        for (sample = 0; sample < numsamples; sample++)
-            for (channel = 0; channel < numchannels; channel++)
-                {
-                dither = ((((float)rand_r(&self->seed)) - half_randmax) +
-                            (((float)rand_r(&self->seed)) - half_randmax)) * dscale;
-                *flbuf++ = ((float)(inputbuffer[channel][sample] << shiftvalue)) / 2147483648.0F + dither;
-                }
-        }
+    if (!conv->kernel || conv->valid_bits != (int)bits_per_sample)
+        if (!pcmconv_select(conv, 32, bits_per_sample, TRUE))
+            {
+            memset(flbuf, 0, sizeof (float) * numsamples * numchannels);
+            return;
+            }
+
+    pcmconv_run(conv, flbuf, (const void * const *)inputbuffer, numsamples, numchannels);
+    if (self->dither && bits_per_sample < 20)
+        pcmconv_dither(flbuf, numsamples * numchannels, 0.25F * conv->scale, &self->noise);
     }
 
 static FLAC__StreamDecoderWriteStatus flac_writer_callback(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const inputbuffer[], void *client_data)
     {
-    struct xlplayer *xlplayer = client_data;
-    struct flacdecode_vars *self = xlplayer->dec_data;
+    struct flacdecode_vars *self = client_data;
+    struct xlplayer *xlplayer = self->xlplayer;
     SRC_DATA *src_data = &(xlplayer->src_data);
     int src_error;
 
@@ -83,7 +72,7 @@ static FLAC__StreamDecoderWriteStatus flac_writer_callback(const FLAC__StreamDec
             src_data->data_in = realloc(src_data->data_in, src_data->input_frames * frame->header.channels * sizeof (float));
             src_data->output_frames = (int)(src_data->input_frames * src_data->src_ratio) + 2 + (512 * src_data->end_of_input);
             src_data->data_out = realloc(src_data->data_out, src_data->output_frames * frame->header.channels * sizeof (float));
-            make_flac_audio_to_float(xlplayer, src_data->data_in, inputbuffer, frame->header.blocksize, frame->header.bits_per_sample, frame->header.channels);
+            make_flac_audio_to_float(xlplayer, &self->conv, src_data->data_in, inputbuffer, frame->header.blocksize, frame->header.bits_per_sample, frame->header.channels);
             if ((src_error = src_process(xlplayer->src_state, src_data)))
                 {
                 fprintf(stderr, "flac_writer_callback: src_process reports %s\n", src_strerror(src_error));
@@ -100,7 +89,7 @@ static FLAC__StreamDecoderWriteStatus flac_writer_callback(const FLAC__StreamDec
                 xlplayer->playmode = PM_EJECTING;
                 return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
                 }
-            make_flac_audio_to_float(xlplayer, self->flbuf, inputbuffer, frame->header.blocksize, frame->header.bits_per_sample, frame->header.channels);
+            make_flac_audio_to_float(xlplayer, &self->conv, self->flbuf, inputbuffer, frame->header.blocksize, frame->header.bits_per_sample, frame->header.channels);
             xlplayer_demux_channel_data(xlplayer, self->flbuf, frame->header.blocksize, frame->header.channels, 1.f);
             }
         xlplayer_write_channel_data(xlplayer);
@@ -110,7 +99,7 @@ static FLAC__StreamDecoderWriteStatus flac_writer_callback(const FLAC__StreamDec
 
 static void flac_error_callback(const FLAC__StreamDecoder *decoder,FLAC__StreamDecoderErrorStatus se, void *client_data)
     {
-    struct xlplayer *xlplayer = client_data;
+    struct xlplayer *xlplayer = ((struct flacdecode_vars *)client_data)->xlplayer;
             
     switch (se)
         {
@@ -128,20 +117,75 @@ static void flac_error_callback(const FLAC__StreamDecoder *decoder,FLAC__StreamD
         }
     }
 
+static FLAC__StreamDecoderReadStatus flac_read_callback(const FLAC__StreamDecoder *decoder, FLAC__byte buffer[], size_t *bytes, void *client_data)
+    {
+    struct flacdecode_vars *self = client_data;
+
+    if (*bytes == 0)
+        return FLAC__STREAM_DECODER_READ_STATUS_ABORT;
+    *bytes = filesource_read(self->fs, buffer, *bytes);
+    if (self->fs->error)
+        return FLAC__STREAM_DECODER_READ_STATUS_ABORT;
+    if (*bytes == 0)
+        return FLAC__STREAM_DECODER_READ_STATUS_END_OF_STREAM;
+    return FLAC__STREAM_DECODER_READ_STATUS_CONTINUE;
+    }
+
+static FLAC__StreamDecoderSeekStatus flac_seek_callback(const FLAC__StreamDecoder *decoder, FLAC__uint64 absolute_byte_offset, void *client_data)
+    {
+    struct flacdecode_vars *self = client_data;
+
+    if (filesource_seek(self->fs, (off_t)absolute_byte_offset, SEEK_SET))
+        return FLAC__STREAM_DECODER_SEEK_STATUS_ERROR;
+    return FLAC__STREAM_DECODER_SEEK_STATUS_OK;
+    }
+
+static FLAC__StreamDecoderTellStatus flac_tell_callback(const FLAC__StreamDecoder *decoder, FLAC__uint64 *absolute_byte_offset, void *client_data)
+    {
+    struct flacdecode_vars *self = client_data;
+
+    *absolute_byte_offset = filesource_tell(self->fs);
+    return FLAC__STREAM_DECODER_TELL_STATUS_OK;
+    }
+
+static FLAC__StreamDecoderLengthStatus flac_length_callback(const FLAC__StreamDecoder *decoder, FLAC__uint64 *stream_length, void *client_data)
+    {
+    struct flacdecode_vars *self = client_data;
+
+    *stream_length = filesource_size(self->fs);
+    return FLAC__STREAM_DECODER_LENGTH_STATUS_OK;
+    }
+
+static FLAC__bool flac_eof_callback(const FLAC__StreamDecoder *decoder, void *client_data)
+    {
+    struct flacdecode_vars *self = client_data;
+
+    return filesource_eof(self->fs);
+    }
+
 static void flacdecode_init(struct xlplayer *xlplayer)
     {
     struct flacdecode_vars *self = xlplayer->dec_data;
     int src_error;
     
+    if (!(self->fs = filesource_open(xlplayer->pathname)))
+        {
+        fprintf(stderr, "flacdecode_init: %s could not open %s\n", xlplayer->playername, xlplayer->pathname);
+        goto cleanup;
+        }
     if (!(self->decoder = FLAC__stream_decoder_new()))
         {
         fprintf(stderr, "flacdecode_init: %s could not initialise flac decoder\n", xlplayer->playername);
+        filesource_close(self->fs);
         goto cleanup;
         }
-    if (FLAC__stream_decoder_init_file(self->decoder, xlplayer->pathname, flac_writer_callback, NULL, flac_error_callback, xlplayer) != FLAC__STREAM_DECODER_INIT_STATUS_OK)
+    if (FLAC__stream_decoder_init_stream(self->decoder, flac_read_callback, flac_seek_callback, flac_tell_callback,
+                flac_length_callback, flac_eof_callback, flac_writer_callback, NULL, flac_error_callback, self)
+                != FLAC__STREAM_DECODER_INIT_STATUS_OK)
         {
         fprintf(stderr, "flacdecode_init: %s error during flac player initialisation\n", xlplayer->playername);
         FLAC__stream_decoder_delete(self->decoder);
+        filesource_close(self->fs);
         goto cleanup;
         }
     if (xlplayer->seek_s)
@@ -158,6 +202,7 @@ static void flacdecode_init(struct xlplayer *xlplayer)
             {
             fprintf(stderr, "flacdecode_init: %s src_new reports - %s\n", xlplayer->playername, src_strerror(src_error));
             FLAC__stream_decoder_delete(self->decoder);
+            filesource_close(self->fs);
             goto cleanup;
             }
         xlplayer->src_data.output_frames = 0;
@@ -170,6 +215,7 @@ static void flacdecode_init(struct xlplayer *xlplayer)
         xlplayer->src_state = NULL;
     self->suppress_audio_output = FALSE;
     self->flbuf = NULL;
+    pcmconv_select(&self->conv, 32, self->metainfo.data.stream_info.bits_per_sample, TRUE);
     return;
 cleanup:
     free(self);
@@ -192,6 +238,7 @@ static void flacdecode_eject(struct xlplayer *xlplayer)
 
     FLAC__stream_decoder_finish(self->decoder);
     FLAC__stream_decoder_delete(self->decoder);
+    filesource_close(self->fs);
     if (self->flbuf)
         free(self->flbuf);
     if (self->resample_f)
@@ -203,6 +250,14 @@ static void flacdecode_eject(struct xlplayer *xlplayer)
     free(self);
     }
 
+/* flacdecode_rebind: a decoder readied by the look-ahead moves to its player */
+static void flacdecode_rebind(struct xlplayer *xlplayer)
+    {
+    struct flacdecode_vars *self = xlplayer->dec_data;
+
+    self->xlplayer = xlplayer;
+    }
+
 int flacdecode_reg(struct xlplayer *xlplayer)
     {
     struct flacdecode_vars *self;
@@ -217,6 +272,8 @@ int flacdecode_reg(struct xlplayer *xlplayer)
         xlplayer->dec_init = flacdecode_init;
         xlplayer->dec_play = flacdecode_play;
         xlplayer->dec_eject = flacdecode_eject;
+        xlplayer->dec_rebind = flacdecode_rebind;
+        self->xlplayer = xlplayer;
         return ACCEPTED;
         }
     return REJECTED;
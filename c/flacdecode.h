@@ -21,20 +21,25 @@
 #ifdef HAVE_FLAC
 
 #include "xlplayer.h"
+#include "filesource.h"
+#include "pcmconv.h"
 
 struct flacdecode_vars
     {
+    struct xlplayer *xlplayer;          /* the callbacks reach the player through here */
     FLAC__StreamDecoder *decoder;
+    struct filesource *fs;
     FLAC__StreamMetadata metainfo;
     int decoderstate;
     int resample_f;
     int suppress_audio_output;
     FLAC__uint64 totalsamples;
     float *flbuf;
+    struct pcmconv conv;
     };
 
 int flacdecode_reg(struct xlplayer *xlplayer);
 
-void make_flac_audio_to_float(struct xlplayer *self, float *flbuf, const FLAC__int32 * const inputbuffer[], unsigned int numsamples, unsigned int bits_per_sample, unsigned int numchannels);
+void make_flac_audio_to_float(struct xlplayer *self, struct pcmconv *conv, float *flbuf, const FLAC__int32 * const inputbuffer[], unsigned int numsamples, unsigned int bits_per_sample, unsigned int numchannels);
 
 #endif
@@ -23,8 +23,74 @@
 #include <string.h>
 #include <assert.h>
 #include "kvpdict.h"
+#include "phash.h"
 #include "bsdcompat.h"
 
+#define MAX_INDEXED_DICTS 8
+
+/* hashed key indexes, built for each dictionary on first use */
+static struct kvp_index
+    {
+    struct kvpdict *dict;
+    const char **keys;
+    struct phash hash;
+    } indexes[MAX_INDEXED_DICTS];
+static int n_indexes;
+static pthread_mutex_t index_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static struct kvp_index *kvp_get_index(struct kvpdict *dict)
+    {
+    struct kvp_index *index;
+    struct kvpdict *dp;
+    int i, n_keys;
+
+    pthread_mutex_lock(&index_mutex);
+    for (i = 0; i < n_indexes; ++i)
+        if (indexes[i].dict == dict)
+            {
+            pthread_mutex_unlock(&index_mutex);
+            return &indexes[i];
+            }
+
+    if (n_indexes == MAX_INDEXED_DICTS)
+        {
+        pthread_mutex_unlock(&index_mutex);
+        return NULL;
+        }
+    index = &indexes[n_indexes];
+    for (n_keys = 0, dp = dict; dp->target; ++dp, ++n_keys);
+    if (!(index->keys = malloc(n_keys * sizeof (char *))))
+        {
+        fprintf(stderr, "kvp_get_index: malloc failure\n");
+        exit(5);
+        }
+    for (i = 0; i < n_keys; ++i)
+        index->keys[i] = dict[i].key;
+    /* a duplicate key is a programming error */
+    if (!phash_init(&index->hash, index->keys, n_keys))
+        exit(5);
+    index->dict = dict;
+    n_indexes++;
+    pthread_mutex_unlock(&index_mutex);
+    return index;
+    }
+
+/* kvp_lookup: find the dictionary entry for key or NULL */
+static struct kvpdict *kvp_lookup(struct kvpdict *dict, const char *key)
+    {
+    struct kvp_index *index = kvp_get_index(dict);
+    struct kvpdict *dp;
+    int i;
+
+    if (index)
+        return (i = phash_lookup(&index->hash, key)) < 0 ? NULL : dict + i;
+
+    for (dp = dict; dp->target; dp++)
+        if (!strcmp(key, dp->key))
+            return dp;
+    return NULL;
+    }
+
 /* kvp_extract_value: extract the value of a key value pair from a string. The value is a copy of the orignial and is allocated on the heap.  The returned "value" should be destroyed with free() when no longer needed.  The string supplied is truncated at the = sign */
 char *kvp_extract_value(char *pair)
     {
@@ -46,45 +112,42 @@ char *kvp_extract_value(char *pair)
     }
 
 /* dict_apply_to_target: sets a pointers object listed in a kvpdict to point to target when its key matches the one supplied to the function.  Target is not made a member of the dictionary, but rather one of the dictionary members, which is itself a pointer is set to point to target.  The memory used by the old target is freed */
-int kvp_apply_to_dict(struct kvpdict *dp, char *key, char *target)
+int kvp_apply_to_dict(struct kvpdict *dict, char *key, char *target)
     {
+    struct kvpdict *dp;
     int append;
     size_t origtext_siz, newtext_siz;
 
     if ((append = (key[0] == '+')))      /* If key starts with a plus we will not replace -- we will append */
         ++key;
 
-    for (; dp->target; dp++)             /* Iterate over NULL terminated dictionary */
+    if (!(dp = kvp_lookup(dict, key)))
+        return 0;                        /* No matches */
+
+    if (dp->pm)                          /* If a pthread mutex is supplied then use it */
+        pthread_mutex_lock(dp->pm);
+    if (!append)
+        {
+        if (*(dp->target))                /* Conditionally free the old target buffer */
+            free(*(dp->target));
+        *(dp->target) = target;           /* Dictionary member's pointer gets a new target */
+        }
+    else
         {
-        if (!strcmp(key, dp->key))        /* If the key matches */
+        /* append mode -- multiple appends separated by a newline character */
+        *(dp->target) = realloc(*(dp->target), (origtext_siz = strlen(*(dp->target))) + (newtext_siz = strlen(target)) + 2);
+        if (!(*(dp->target)))
             {
-            if (dp->pm)                    /* If a pthread mutex is supplied then use it */
-                pthread_mutex_lock(dp->pm);
-            if (!append)
-                {
-                if (*(dp->target))          /* Conditionally free the old target buffer */
-                    free(*(dp->target));
-                *(dp->target) = target;     /* Dictionary member's pointer gets a new target */
-                }
-            else
-                {
-                /* append mode -- multiple appends separated by a newline character */
-                *(dp->target) = realloc(*(dp->target), (origtext_siz = strlen(*(dp->target))) + (newtext_siz = strlen(target)) + 2);
-                if (!(*(dp->target)))
-                    {
-                    fprintf(stderr, "malloc failure\n");
-                    exit(5);
-                    }
-                memcpy(*(dp->target) + origtext_siz, target, newtext_siz);
-                memcpy(*(dp->target) + origtext_siz + newtext_siz, "\n", 2);
-                free(target);
-                }
-            if (dp->pm)                    /* Unlock the pthread mutex if one was specified */
-                pthread_mutex_unlock(dp->pm);
-            return 1;                      /* We have a match so return 1 */
+            fprintf(stderr, "malloc failure\n");
+            exit(5);
             }
+        memcpy(*(dp->target) + origtext_siz, target, newtext_siz);
+        memcpy(*(dp->target) + origtext_siz + newtext_siz, "\n", 2);
+        free(target);
         }
-    return 0;                            /* No matches */
+    if (dp->pm)                          /* Unlock the pthread mutex if one was specified */
+        pthread_mutex_unlock(dp->pm);
+    return 1;                            /* We have a match so return 1 */
     }
 
 void kvp_free_dict(struct kvpdict *dp)
@@ -90,7 +90,7 @@ int live_ogg_write_packet(struct encoder *encoder, ogg_page *op, int flags)
     packet.header.n_channels = encoder->n_channels;
     packet.header.flags = flags;
     packet.header.data_size = op->header_len + op->body_len;
-    packet.header.timestamp = encoder->timestamp = (double)ogg_page_granulepos(op) / (double)encoder->samplerate;
+    packet.header.timestamp = encoder->timestamp = (double)ogg_page_granulepos(op) / (double)encoder->target_samplerate;
     packet.data = buffer;
     encoder_write_packet_all(encoder, &packet);
     free(buffer);
@@ -154,7 +154,7 @@ static FLAC__StreamEncoderWriteStatus live_oggflac_encoder_write_cb(const FLAC__
         packet.header.n_channels = encoder->n_channels;
         packet.header.flags = s->flags;
         packet.header.data_size = s->pab_rqd;
-        packet.header.timestamp = encoder->timestamp = (double)s->samples / (double)encoder->samplerate;
+        packet.header.timestamp = encoder->timestamp = (double)s->samples / (double)encoder->target_samplerate;
         packet.data = s->pab;
         encoder_write_packet_all(encoder, &packet);
         }
@@ -37,6 +37,7 @@
 #include "sig.h"
 #include "mixer.h"
 #include "sourceclient.h"
+#include "telemetry.h"
 #include "main.h"
 
 #define FALSE 0
@@ -123,6 +124,94 @@ static int main_process_audio(jack_nframes_t n_frames, void *arg)
     return rv;
     }
 
+/* without these being set the backend will segfault */
+void backend_defaults()
+    {
+    int o = FALSE;    /* Overwrite flag */
+    if (setenv("session_type", "L0", o) ||
+            setenv("client_id", "idjc_nofrontend", o) ||
+            setenv("mic_qty", "4", o) ||
+            setenv("num_streamers", "6", o) ||
+            setenv("num_encoders", "6", o) ||
+            setenv("num_recorders", "2", o) ||
+            setenv("num_effects", "24", o) ||
+            setenv("block_mixer", "1", o) ||
+            setenv("audio_feed_overflow", "drop", o) ||
+            setenv("encoder_queue_ms", "4000", o) ||
+            setenv("pcm_cache_mb", "64", o) ||
+            setenv("telemetry_ms", "50", o) ||
+            setenv("record_tag_reserve_kb", "64", o) ||
+            setenv("record_buffer_kb", "1024", o) ||
+            setenv("record_buffers", "8", o) ||
+            setenv("record_prealloc_mb", "64", o) ||
+            setenv("record_direct_io", "0", o) ||
+            setenv("record_sync_ms", "0", o) ||
+            setenv("offline_render", "0", o) ||
+            setenv("ogg_index_dir", "", o) ||
+            setenv("player_lookahead", "1", o) ||
+            setenv("jack_parameter", "default", o) ||
+            setenv("has_head", "0", o) ||
+            /* C locale required for . as radix character. */
+            setenv("LC_ALL", "C", 1))
+        {
+        perror("main: failed to set environment variable");
+        exit(5);
+        }
+    }
+
+/* registration of JACK ports */
+void backend_register_ports()
+    {
+    struct jack_ports *p = &g.port;
+
+    #define MK_AUDIO_INPUT(var, name) var = jack_port_register(g.client, name, JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput, 0);
+    #define MK_AUDIO_OUTPUT(var, name) var = jack_port_register(g.client, name, JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
+
+    /* Mixer ports. */
+    MK_AUDIO_OUTPUT(p->dj_out_l, "dj_out_l");
+    MK_AUDIO_OUTPUT(p->dj_out_r, "dj_out_r");
+    MK_AUDIO_OUTPUT(p->dsp_out_l, "dsp_out_l");
+    MK_AUDIO_OUTPUT(p->dsp_out_r, "dsp_out_r");
+    MK_AUDIO_INPUT(p->dsp_in_l, "dsp_in_l");
+    MK_AUDIO_INPUT(p->dsp_in_r, "dsp_in_r");
+    MK_AUDIO_OUTPUT(p->str_out_l, "str_out_l");
+    MK_AUDIO_OUTPUT(p->str_out_r, "str_out_r");
+    MK_AUDIO_OUTPUT(p->voip_out_l, "voip_out_l");
+    MK_AUDIO_OUTPUT(p->voip_out_r, "voip_out_r");
+    MK_AUDIO_INPUT(p->voip_in_l, "voip_in_l");
+    MK_AUDIO_INPUT(p->voip_in_r, "voip_in_r");
+    MK_AUDIO_OUTPUT(p->alarm_out, "alarm_out");
+    /* Player related ports. */
+    MK_AUDIO_OUTPUT(p->pl_out_l, "pl_out_l");
+    MK_AUDIO_OUTPUT(p->pl_out_r, "pl_out_r");
+    MK_AUDIO_OUTPUT(p->pr_out_l, "pr_out_l");
+    MK_AUDIO_OUTPUT(p->pr_out_r, "pr_out_r");
+    MK_AUDIO_OUTPUT(p->pi_out_l, "pi_out_l");
+    MK_AUDIO_OUTPUT(p->pi_out_r, "pi_out_r");
+    MK_AUDIO_OUTPUT(p->pe1_out_l, "pe01-12_out_l");
+    MK_AUDIO_OUTPUT(p->pe1_out_r, "pe01-12_out_r");
+    MK_AUDIO_OUTPUT(p->pe2_out_l, "pe13-24_out_l");
+    MK_AUDIO_OUTPUT(p->pe2_out_r, "pe13-24_out_r");
+    MK_AUDIO_INPUT(p->pl_in_l, "pl_in_l");
+    MK_AUDIO_INPUT(p->pl_in_r, "pl_in_r");
+    MK_AUDIO_INPUT(p->pr_in_l, "pr_in_l");
+    MK_AUDIO_INPUT(p->pr_in_r, "pr_in_r");
+    MK_AUDIO_INPUT(p->pi_in_l, "pi_in_l");
+    MK_AUDIO_INPUT(p->pi_in_r, "pi_in_r");
+    MK_AUDIO_INPUT(p->pe_in_l, "pe_in_l");
+    MK_AUDIO_INPUT(p->pe_in_r, "pe_in_r");
+
+    /* Not really a mixer port but handled in the mixer code. */
+    p->midi_port = jack_port_register(g.client, "midi_control", JACK_DEFAULT_MIDI_TYPE, JackPortIsInput, 0);
+
+    /* Sourceclient ports. */
+    MK_AUDIO_INPUT(p->output_in_l, "output_in_l");
+    MK_AUDIO_INPUT(p->output_in_r, "output_in_r");
+
+    #undef MK_AUDIO_INPUT
+    #undef MK_AUDIO_OUTPUT
+    }
+
 static int backend_main()
     {
     char *buffer = NULL;
@@ -130,25 +219,7 @@ static int backend_main()
     int keep_running = TRUE;
     jack_options_t options = 0;
 
-    /* Without these being set the backend will segfault. */
-        {
-        int o = FALSE;    /* Overwrite flag */
-        if (setenv("session_type", "L0", o) ||
-                setenv("client_id", "idjc_nofrontend", o) ||
-                setenv("mic_qty", "4", o) ||
-                setenv("num_streamers", "6", o) ||
-                setenv("num_encoders", "6", o) ||
-                setenv("num_recorders", "2", o) ||
-                setenv("num_effects", "24", o) ||
-                setenv("jack_parameter", "default", o) ||
-                setenv("has_head", "0", o) ||
-                /* C locale required for . as radix character. */
-                setenv("LC_ALL", "C", 1))
-            {
-            perror("main: failed to set environment variable");
-            exit(5);
-            }
-        }
+    backend_defaults();
 
     setlocale(LC_ALL, getenv("LC_ALL"));
     g.has_head = atoi(getenv("has_head"));
@@ -193,59 +264,10 @@ static int backend_main()
     jack_set_process_callback(g.client, main_process_audio, NULL);
     jack_set_buffer_size_callback(g.client, buffer_size_callback, NULL);
 
-    /* Registration of JACK ports. */
-    #define MK_AUDIO_INPUT(var, name) var = jack_port_register(g.client, name, JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput, 0);
-    #define MK_AUDIO_OUTPUT(var, name) var = jack_port_register(g.client, name, JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
-    
-        {
-        struct jack_ports *p = &g.port;
-
-        /* Mixer ports. */
-        MK_AUDIO_OUTPUT(p->dj_out_l, "dj_out_l");
-        MK_AUDIO_OUTPUT(p->dj_out_r, "dj_out_r");
-        MK_AUDIO_OUTPUT(p->dsp_out_l, "dsp_out_l");
-        MK_AUDIO_OUTPUT(p->dsp_out_r, "dsp_out_r");
-        MK_AUDIO_INPUT(p->dsp_in_l, "dsp_in_l");
-        MK_AUDIO_INPUT(p->dsp_in_r, "dsp_in_r");
-        MK_AUDIO_OUTPUT(p->str_out_l, "str_out_l");
-        MK_AUDIO_OUTPUT(p->str_out_r, "str_out_r");
-        MK_AUDIO_OUTPUT(p->voip_out_l, "voip_out_l");
-        MK_AUDIO_OUTPUT(p->voip_out_r, "voip_out_r");
-        MK_AUDIO_INPUT(p->voip_in_l, "voip_in_l");
-        MK_AUDIO_INPUT(p->voip_in_r, "voip_in_r");
-        MK_AUDIO_OUTPUT(p->alarm_out, "alarm_out");
-        /* Player related ports. */
-        MK_AUDIO_OUTPUT(p->pl_out_l, "pl_out_l");
-        MK_AUDIO_OUTPUT(p->pl_out_r, "pl_out_r");
-        MK_AUDIO_OUTPUT(p->pr_out_l, "pr_out_l");
-        MK_AUDIO_OUTPUT(p->pr_out_r, "pr_out_r");
-        MK_AUDIO_OUTPUT(p->pi_out_l, "pi_out_l");
-        MK_AUDIO_OUTPUT(p->pi_out_r, "pi_out_r");
-        MK_AUDIO_OUTPUT(p->pe1_out_l, "pe01-12_out_l");
-        MK_AUDIO_OUTPUT(p->pe1_out_r, "pe01-12_out_r");
-        MK_AUDIO_OUTPUT(p->pe2_out_l, "pe13-24_out_l");
-        MK_AUDIO_OUTPUT(p->pe2_out_r, "pe13-24_out_r");
-        MK_AUDIO_INPUT(p->pl_in_l, "pl_in_l");
-        MK_AUDIO_INPUT(p->pl_in_r, "pl_in_r");
-        MK_AUDIO_INPUT(p->pr_in_l, "pr_in_l");
-        MK_AUDIO_INPUT(p->pr_in_r, "pr_in_r");
-        MK_AUDIO_INPUT(p->pi_in_l, "pi_in_l");
-        MK_AUDIO_INPUT(p->pi_in_r, "pi_in_r");
-        MK_AUDIO_INPUT(p->pe_in_l, "pe_in_l");
-        MK_AUDIO_INPUT(p->pe_in_r, "pe_in_r");
-
-        /* Not really a mixer port but handled in the mixer code. */
-        p->midi_port = jack_port_register(g.client, "midi_control", JACK_DEFAULT_MIDI_TYPE, JackPortIsInput, 0);
-
-        /* Sourceclient ports. */
-        MK_AUDIO_INPUT(p->output_in_l, "output_in_l");
-        MK_AUDIO_INPUT(p->output_in_r, "output_in_r");
-        }
-
-    #undef MK_AUDIO_INPUT
-    #undef MK_AUDIO_OUTPUT
+    backend_register_ports();
 
     /* Submodule initialization. */
+    telemetry_init();
     mixer_init();
     sourceclient_init();
 
@@ -257,6 +279,7 @@ static int backend_main()
         exit(5);
         }
     atexit(cleanup_jack);
+    telemetry_start();
 
     fprintf(g.out, "idjc backend ready\n");
     fflush(g.out);
@@ -268,6 +291,8 @@ static int backend_main()
         /* Filter commands to submodules. */
         if (!strcmp(buffer, "mx\n"))
             keep_running = mixer_main();
+        else if (!strcmp(buffer, "mb\n"))
+            keep_running = mixer_main_binary();
         else
             {
             if (!strcmp(buffer, "sc\n"))
@@ -83,3 +83,6 @@ struct globs
     };
 
 extern struct globs g;
+
+void backend_defaults();
+void backend_register_ports();
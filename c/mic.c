@@ -80,7 +80,7 @@ static void mic_process_start(struct mic *self, jack_nframes_t nframes)
             self->mute = 0.0f;
             self->unp = self->unpm = self->unpmdj = 0.0f;
             self->lc = self->rc = self->lrc = self->lcm = self->rcm = 0.0f;
-            self->peak = peak_init;
+            peakfilter_reset(self->pf);
             }
 
         self->mode = mode_request;
@@ -162,9 +162,7 @@ static void mic_process_stage4(struct mic *self)
     self->rcm = self->rc * self->mute;
     
     /* record peak levels */
-    float l = fabsf(self->lrc);
-    if (l > self->peak)
-        self->peak = l;
+    peakfilter_process(self->pf, self->lrc);
         
     self->munp = self->unp * m;
     self->munpm = self->unpm * m;
@@ -215,25 +213,27 @@ float mic_process_all(struct mic **mics)
 static int mic_getpeak(struct mic *self)
     {
     int peakdb;
+    float peak = peakfilter_read(self->pf);
     
-    peakdb = (int)level2db(self->peak);
-    self->peak = peak_init;
+    peakdb = (int)level2db((peak > peak_init) ? peak : peak_init);
     return (peakdb < 0) ? peakdb : 0;
     }
 
-static void mic_stats(struct mic *self)
+static void mic_telemetry(struct mic *self, struct telemetry_mic *tm)
     {
     int red, yellow, green;
-    
+
     agc_get_meter_levels(self->host->agc, &red, &yellow, &green);
-    fprintf(g.out, "mic_%d_levels=%d,%d,%d,%d\n", self->id,
-                                    mic_getpeak(self), red, yellow, green);
+    tm->peak = mic_getpeak(self);
+    tm->red = red;
+    tm->yellow = yellow;
+    tm->green = green;
     }
 
-void mic_stats_all(struct mic **mics)
+void mic_telemetry_all(struct mic **mics, struct telemetry_mic *tm)
     {
     while (*mics)
-        mic_stats(*mics++);
+        mic_telemetry(*mics++, tm++);
     }
 
 static void mic_set_role(struct mic *self, int role)
@@ -272,13 +272,14 @@ static struct mic *mic_init(jack_client_t *client, int sample_rate, int id)
     self->sample_rate = (float)sample_rate;   
     self->pan = 50;
     self->aux_g = 1.0f;
-    self->peak = peak_init;
     if (!(self->agc = agc_init(sample_rate, 0.01161f, id)))
         {
         fprintf(stderr, "mic_init: agc_init failed\n");
         free(self);
         return NULL;
         }
+    /* a zero length window gives plain peak hold */
+    self->pf = peakfilter_create(0.0f, sample_rate);
     snprintf(port_name, 10, "ch_in_%d", id);  
     self->jack_port = jack_port_register(client, port_name,
                             JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput, 0); 
@@ -330,6 +331,7 @@ static void mic_free(struct mic *self)
     {
     agc_free(self->agc);
     self->agc = NULL;
+    peakfilter_destroy(self->pf);
     if (self->default_mapped_port_name)
         {
         free(self->default_mapped_port_name);
@@ -19,6 +19,8 @@
 
 #include <jack/jack.h>
 #include "agc.h"
+#include "peakfilter.h"
+#include "telemetry.h"
 
 struct mic
     {
@@ -78,7 +80,7 @@ struct mic
     float igain;   /* inversion gain value (inversion relative) */
     float mute;    /* gain applied by soft mute control */
     float djmute;  /* gain applied for muting from the dj mix */
-    float peak;    /* highest signal level since last call to mic_getpeak */
+    struct peakfilter *pf; /* highest signal level since last call to mic_getpeak */
     float mic_g;   /* mic gain for muting */
     float aux_g;   /* aux gain for muting */
     float rel_igain; /* invert for paired mic */
@@ -91,7 +93,7 @@ struct mic
 
 void mic_process_start_all(struct mic **mics, jack_nframes_t nframes);
 float mic_process_all(struct mic **mics);
-void mic_stats_all(struct mic **mics);
+void mic_telemetry_all(struct mic **mics, struct telemetry_mic *tm);
 struct mic **mic_init_all(int n_mics, jack_client_t *client);
 void mic_free_all(struct mic **self);
 void mic_valueparse(struct mic *s, char *param);
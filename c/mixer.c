@@ -47,10 +47,15 @@
 #include "sndfileinfo.h"
 #include "avcodecdecode.h"
 #include "oggdec.h"
+#include "pcmcache.h"
 #include "mic.h"
 #include "bsdcompat.h"
 #include "peakfilter.h"
 #include "sig.h"
+#include "ialloc.h"
+#include "telemetry.h"
+#include "phash.h"
+#include "mixer.h"
 #include "main.h"
 
 #define TRUE 1
@@ -115,6 +120,12 @@ static int voip_pan_f;
 static float voip_pan_l, voip_pan_r;
 
 static jack_nframes_t alarm_size;
+/* index value for reading from a table of fade gain values */
+static jack_nframes_t alarm_index;
+/* a counter variable used to trigger the volume smoothing on a regular basis */
+static unsigned vol_smooth_count;
+/* when set the block based mixer is used in place of the per sample one */
+static int block_mixer;
 
 static float headroom_db;                      /* player muting level when mic is open */
 static float str_l_tally, str_r_tally;  /* used to calculate rms value */
@@ -176,6 +187,104 @@ static char *jackport, *jackport2, *jackfilter;
 static char *effect_ix, *voip_pan;
 static char *session_event_string, *session_commandline;
 
+/* the actions understood by mixer_main, ACTN=<name> */
+enum mixer_action {
+            ACT_PING,
+            ACT_MP3_GETSTATUS,
+            ACT_JACKPORTREAD,
+            ACT_JACKCONNECT,
+            ACT_JACKDISCONNECT,
+            ACT_FREEWHEEL_TOGGLE,
+            ACT_FREEWHEEL_ON,
+            ACT_FREEWHEEL_OFF,
+            ACT_BLOCKMIXER_ON,
+            ACT_BLOCKMIXER_OFF,
+            ACT_SESSION_REPLY,
+            ACT_PLAYEFFECT,
+            ACT_STOPEFFECT,
+            ACT_MIC_CONTROL,
+            ACT_NEW_CHANNEL_MODE_STRING,
+            ACT_HEADROOM,
+            ACT_ANYMIC,
+            ACT_FADEMODE_LEFT,
+            ACT_FADEMODE_RIGHT,
+            ACT_FADEMODE_INTERLUDE,
+            ACT_PLAYLEFT,
+            ACT_PLAYRIGHT,
+            ACT_PLAYINTERLUDE,
+            ACT_PLAYNOFLUSHLEFT,
+            ACT_PLAYNOFLUSHRIGHT,
+            ACT_PLAYNOFLUSHINTERLUDE,
+            ACT_PRELOADLEFT,
+            ACT_PRELOADRIGHT,
+            ACT_PRELOADINTERLUDE,
+            ACT_PLAYMANYJINGLES,
+            ACT_STOPLEFT,
+            ACT_STOPRIGHT,
+            ACT_STOPJINGLES,
+            ACT_STOPINTERLUDE,
+            ACT_DITHER,
+            ACT_DONTDITHER,
+            ACT_RESAMPLEQUALITY,
+            ACT_OGGINFOREQUEST,
+            ACT_SNDFILEINFOREQUEST,
+            ACT_SPEEXREADTAGREQUEST,
+            ACT_SPEEXWRITETAGREQUEST,
+            ACT_VOIPPAN,
+            ACT_MIXSTATS,
+            ACT_REQUESTEVENTS,
+            N_ACTIONS };
+
+static const char *action_names[N_ACTIONS] = {
+            [ACT_PING] = "ping",
+            [ACT_MP3_GETSTATUS] = "mp3_getstatus",
+            [ACT_JACKPORTREAD] = "jackportread",
+            [ACT_JACKCONNECT] = "jackconnect",
+            [ACT_JACKDISCONNECT] = "jackdisconnect",
+            [ACT_FREEWHEEL_TOGGLE] = "freewheel_toggle",
+            [ACT_FREEWHEEL_ON] = "freewheel_on",
+            [ACT_FREEWHEEL_OFF] = "freewheel_off",
+            [ACT_BLOCKMIXER_ON] = "blockmixer_on",
+            [ACT_BLOCKMIXER_OFF] = "blockmixer_off",
+            [ACT_SESSION_REPLY] = "session_reply",
+            [ACT_PLAYEFFECT] = "playeffect",
+            [ACT_STOPEFFECT] = "stopeffect",
+            [ACT_MIC_CONTROL] = "mic_control",
+            [ACT_NEW_CHANNEL_MODE_STRING] = "new_channel_mode_string",
+            [ACT_HEADROOM] = "headroom",
+            [ACT_ANYMIC] = "anymic",
+            [ACT_FADEMODE_LEFT] = "fademode_left",
+            [ACT_FADEMODE_RIGHT] = "fademode_right",
+            [ACT_FADEMODE_INTERLUDE] = "fademode_interlude",
+            [ACT_PLAYLEFT] = "playleft",
+            [ACT_PLAYRIGHT] = "playright",
+            [ACT_PLAYINTERLUDE] = "playinterlude",
+            [ACT_PLAYNOFLUSHLEFT] = "playnoflushleft",
+            [ACT_PLAYNOFLUSHRIGHT] = "playnoflushright",
+            [ACT_PLAYNOFLUSHINTERLUDE] = "playnoflushinterlude",
+            [ACT_PRELOADLEFT] = "preloadleft",
+            [ACT_PRELOADRIGHT] = "preloadright",
+            [ACT_PRELOADINTERLUDE] = "preloadinterlude",
+            [ACT_PLAYMANYJINGLES] = "playmanyjingles",
+            [ACT_STOPLEFT] = "stopleft",
+            [ACT_STOPRIGHT] = "stopright",
+            [ACT_STOPJINGLES] = "stopjingles",
+            [ACT_STOPINTERLUDE] = "stopinterlude",
+            [ACT_DITHER] = "dither",
+            [ACT_DONTDITHER] = "dontdither",
+            [ACT_RESAMPLEQUALITY] = "resamplequality",
+            [ACT_OGGINFOREQUEST] = "ogginforequest",
+            [ACT_SNDFILEINFOREQUEST] = "sndfileinforequest",
+            [ACT_SPEEXREADTAGREQUEST] = "speexreadtagrequest",
+            [ACT_SPEEXWRITETAGREQUEST] = "speexwritetagrequest",
+            [ACT_VOIPPAN] = "voippan",
+            [ACT_MIXSTATS] = "mixstats",
+            [ACT_REQUESTEVENTS] = "requestevents",
+            };
+
+/* collision free hash table of the above for O(1) dispatch */
+static struct phash action_hash;
+
 static struct smoothing_volume jingles_headroom_smoothing;
 static int jingles_headroom_control;
 
@@ -430,6 +539,399 @@ static void update_smoothed_volumes()
         }
     }
 
+/* the jack port buffers as used by the mixer */
+struct mixer_ports
+    {
+    sample_t *aap, *lap, *rap, *lsp, *rsp, *lpsp, *rpsp, *lprp, *rprp;
+    sample_t *dolp, *dorp, *dilp, *dirp;
+    sample_t *plolp, *plorp, *prolp, *prorp, *piolp, *piorp, *pe1olp, *pe1orp, *pe2olp, *pe2orp;
+    sample_t *plilp, *plirp, *prilp, *prirp, *piilp, *piirp, *peilp, *peirp;
+    };
+
+/* block mixer scratch space -- one period's worth of the microphone mix */
+static struct block_scratch
+    {
+    sample_t *df;
+    sample_t *lc_s_micmix, *rc_s_micmix;
+    sample_t *lc_s_auxmix, *rc_s_auxmix;
+    sample_t *dl_micmix, *dr_micmix;
+    } bs;
+
+/* block_mic_mix: the microphone processing is inherently serial so it runs
+ * sample by sample with the results being collected for the mix stage
+ */
+static void block_mic_mix(jack_nframes_t o, jack_nframes_t n, int ducking, int unmixed)
+    {
+    const float hr = db2level(current_headroom);
+    struct mic **micp;
+    float df;
+
+    for (jack_nframes_t i = o; i < o + n; ++i)
+        {
+        sample_t lc_s_micmix, rc_s_micmix, lc_s_auxmix, rc_s_auxmix, dl_micmix, dr_micmix;
+
+        if (ducking)
+            df = powf(mic_process_all(mics), dfmod);
+        else
+            {
+            mic_process_all(mics);
+            df = 1.0f;
+            }
+
+        lc_s_micmix = rc_s_micmix = lc_s_auxmix = rc_s_auxmix = dl_micmix = dr_micmix = 0.0f;
+        if (unmixed)
+            for (micp = mics; *micp; micp++)
+                {
+                lc_s_micmix += (*micp)->mlc;
+                rc_s_micmix += (*micp)->mrc;
+                lc_s_auxmix += (*micp)->alcm;
+                rc_s_auxmix += (*micp)->arcm;
+                dl_micmix += (*micp)->lmunpm;
+                dr_micmix += (*micp)->rmunpm;
+                }
+        else
+            for (micp = mics; *micp; micp++)
+                {
+                lc_s_micmix += (*micp)->mlcm;
+                rc_s_micmix += (*micp)->mrcm;
+                lc_s_auxmix += (*micp)->alcm;
+                rc_s_auxmix += (*micp)->arcm;
+                dl_micmix += (*micp)->lmunpmdj;
+                dr_micmix += (*micp)->rmunpmdj;
+                }
+
+        bs.df[i] = ducking ? ((df < hr) ? df : hr) : hr;
+        bs.lc_s_micmix[i] = lc_s_micmix;
+        bs.rc_s_micmix[i] = rc_s_micmix;
+        bs.lc_s_auxmix[i] = lc_s_auxmix;
+        bs.rc_s_auxmix[i] = rc_s_auxmix;
+        bs.dl_micmix[i] = dl_micmix;
+        bs.dr_micmix[i] = dr_micmix;
+        }
+    }
+
+/* block_limit: applies the limiter -- this has to go sample by sample */
+static void block_limit(struct compressor *limiter_s, sample_t *l, sample_t *r, jack_nframes_t n)
+    {
+    sample_t compressor_gain;
+
+    while (n--)
+        {
+        compressor_gain = db2level(limiter(limiter_s, *l, *r));
+        *l++ *= compressor_gain;
+        *r++ *= compressor_gain;
+        }
+    }
+
+/* block_voip_in: level, limit, and pan the incoming voip audio */
+static void block_voip_in(sample_t *lprp, sample_t *rprp, jack_nframes_t n)
+    {
+    sample_t compressor_gain;
+
+    for (jack_nframes_t i = 0; i < n; ++i)
+        {
+        compressor_gain = db2level(limiter(&incoming_phone_limiter, lprp[i] *= voip_lc_aud, rprp[i] *= voip_rc_aud));
+        lprp[i] *= compressor_gain;
+        rprp[i] *= compressor_gain;
+        }
+
+    if (voip_pan_f)
+        for (jack_nframes_t i = 0; i < n; ++i)
+            {
+            float dnmix = (lprp[i] + rprp[i]) / 2.0f;
+
+            lprp[i] = dnmix * voip_pan_l;
+            rprp[i] = dnmix * voip_pan_r;
+            }
+    }
+
+/* block_meter_and_alarm: the tail end of the mix common to all the modes */
+static void block_meter_and_alarm(const struct mixer_ports *mp, jack_nframes_t o, jack_nframes_t n)
+    {
+    sample_t * restrict lap = mp->lap + o, * restrict rap = mp->rap + o;
+    sample_t * restrict lsp = mp->lsp + o, * restrict rsp = mp->rsp + o;
+    sample_t * restrict aap = mp->aap + o;
+    const sample_t gain = dj_audio_gain;
+    jack_nframes_t i;
+
+    /* apply dj audio sound level */
+    for (i = 0; i < n; ++i)
+        {
+        lap[i] *= gain;
+        rap[i] *= gain;
+        }
+
+    /* make note of the peak volume levels */
+    peakfilter_process_block(str_pf_l, lsp, n);
+    peakfilter_process_block(str_pf_r, rsp, n);
+
+    /* used for rms calculation */
+    for (i = 0; i < n; ++i)
+        {
+        str_l_tally += lsp[i] * lsp[i];
+        str_r_tally += rsp[i] * rsp[i];
+        }
+    rms_tally_count += n;
+
+    for (i = 0; i < n; ++i)
+        {
+        if (eot_alarm_f) /* end-of-track alarm tone */
+            {
+            if (alarm_index >= alarm_size)
+                {
+                alarm_index = 0;
+                eot_alarm_f = 0;
+                }
+            else
+                {
+                aap[i] = eot_alarm_table[alarm_index] * alarm_audio_gain;
+                alarm_index++;
+                }
+            }
+        else
+            aap[i] = 0.0f;
+        }
+    }
+
+/* block_mix: the block based version of the per sample mixer code in
+ * mixer_process_audio giving bit identical output
+ *
+ * That holds because each expression keeps the operand order of the per
+ * sample code and because this file and xlplayer.c are built with
+ * -ffp-contract=off. GCC otherwise fuses multiply-adds when the target has
+ * FMA and would be free to do so in one path and not the other.
+ * mixer_bench -V checks that the two paths agree.
+ *
+ * Player audio is read for the whole period. The remaining work is done in
+ * runs of samples ending at each volume smoothing update so that within a run
+ * all gain values are constant. Each stage loops over the run on its own which
+ * leaves only the microphone processing, limiters and metering as serial code.
+ */
+static void block_mix(struct mixer_ports *mp, jack_nframes_t nframes)
+    {
+    jack_nframes_t o, n, i;
+    int ducking, unmixed;
+
+    if (mixermode == NO_PHONE)
+        {
+        memset(mp->lpsp, 0, nframes * sizeof (sample_t)); /* send silence to VOIP */
+        memset(mp->rpsp, 0, nframes * sizeof (sample_t));
+        }
+
+    xlplayer_read_block_all(players, nframes);
+    xlplayer_read_block_all(plr_j_roster, nframes);
+
+    /* player audio routing through jack ports */
+    memcpy(mp->plolp, plr_l->lsb, nframes * sizeof (sample_t));
+    memcpy(mp->plorp, plr_l->rsb, nframes * sizeof (sample_t));
+    memcpy(mp->prolp, plr_r->lsb, nframes * sizeof (sample_t));
+    memcpy(mp->prorp, plr_r->rsb, nframes * sizeof (sample_t));
+    memcpy(mp->piolp, plr_i->lsb, nframes * sizeof (sample_t));
+    memcpy(mp->piorp, plr_i->rsb, nframes * sizeof (sample_t));
+    memcpy(plr_l->lsb, mp->plilp, nframes * sizeof (sample_t));
+    memcpy(plr_l->rsb, mp->plirp, nframes * sizeof (sample_t));
+    memcpy(plr_r->lsb, mp->prilp, nframes * sizeof (sample_t));
+    memcpy(plr_r->rsb, mp->prirp, nframes * sizeof (sample_t));
+    memcpy(plr_i->lsb, mp->piilp, nframes * sizeof (sample_t));
+    memcpy(plr_i->rsb, mp->piirp, nframes * sizeof (sample_t));
+
+    ducking = (mixermode == NO_PHONE || (mixermode == PHONE_PRIVATE && mic_on));
+    unmixed = (mixermode == PHONE_PRIVATE && !mic_on);
+
+    for (o = 0; o < nframes; o += n)
+        {
+        /* the run length goes up to the next smoothing update */
+        n = 100 - vol_smooth_count % 100;
+        if (-vol_smooth_count && -vol_smooth_count < n)
+            n = -vol_smooth_count;       /* the counter is about to wrap */
+        if (n > nframes - o)
+            n = nframes - o;
+
+        if (vol_smooth_count % 100 == 0)
+            update_smoothed_volumes();
+        vol_smooth_count += n;
+
+        block_mic_mix(o, n, ducking, unmixed);
+        xlplayer_levels_block_all(players, o, n);
+        xlplayer_levels_block_all(plr_j_roster, o, n);
+
+        /* effects audio from multiple players goes out on one port */
+            {
+            sample_t * restrict e1l = mp->pe1olp + o, * restrict e1r = mp->pe1orp + o;
+            sample_t * restrict e2l = mp->pe2olp + o, * restrict e2r = mp->pe2orp + o;
+
+            memset(e1l, 0, n * sizeof (sample_t));
+            memset(e1r, 0, n * sizeof (sample_t));
+            memset(e2l, 0, n * sizeof (sample_t));
+            memset(e2r, 0, n * sizeof (sample_t));
+
+            for (struct xlplayer **p = plr_j_roster; *p; ++p)
+                {
+                const sample_t * restrict ls = (*p)->ls_strb + o, * restrict rs = (*p)->rs_strb + o;
+                sample_t * restrict el = ((*p)->id < (1 << 12)) ? e1l : e2l;
+                sample_t * restrict er = ((*p)->id < (1 << 12)) ? e1r : e2r;
+
+                for (i = 0; i < n; ++i)
+                    {
+                    el[i] += ls[i];
+                    er[i] += rs[i];
+                    }
+                }
+            }
+
+            {
+            const float jh = jingles_headroom_smoothing.level;
+            const float jhi = inter_force ? jh : 1.0f;
+            const sample_t * restrict df = bs.df + o;
+            const sample_t * restrict lc_s_micmix = bs.lc_s_micmix + o, * restrict rc_s_micmix = bs.rc_s_micmix + o;
+            const sample_t * restrict lc_s_auxmix = bs.lc_s_auxmix + o, * restrict rc_s_auxmix = bs.rc_s_auxmix + o;
+            const sample_t * restrict dl_micmix = bs.dl_micmix + o, * restrict dr_micmix = bs.dr_micmix + o;
+            const sample_t * restrict l_ls_str = plr_l->ls_strb + o, * restrict l_rs_str = plr_l->rs_strb + o;
+            const sample_t * restrict r_ls_str = plr_r->ls_strb + o, * restrict r_rs_str = plr_r->rs_strb + o;
+            const sample_t * restrict i_ls_str = plr_i->ls_strb + o, * restrict i_rs_str = plr_i->rs_strb + o;
+            const sample_t * restrict l_ls_aud = plr_l->ls_audb + o, * restrict l_rs_aud = plr_l->rs_audb + o;
+            const sample_t * restrict r_ls_aud = plr_r->ls_audb + o, * restrict r_rs_aud = plr_r->rs_audb + o;
+            const sample_t * restrict i_ls_aud = plr_i->ls_audb + o, * restrict i_rs_aud = plr_i->rs_audb + o;
+            const sample_t *e_ls = mp->peilp + o, *e_rs = mp->peirp + o;
+            sample_t *dolp = mp->dolp + o, *dorp = mp->dorp + o;
+            sample_t *lsp = mp->lsp + o, *rsp = mp->rsp + o;
+            sample_t *lap = mp->lap + o, *rap = mp->rap + o;
+            sample_t *lpsp = mp->lpsp + o, *rpsp = mp->rpsp + o;
+            sample_t *lprp = mp->lprp + o, *rprp = mp->rprp + o;
+
+            #define IDF(i) (inter_force ? df[i] : 1.0f)
+
+            switch (mixermode)
+                {
+                case NO_PHONE:
+                    /* the stream mix */
+                    for (i = 0; i < n; ++i)
+                        {
+                        dolp[i] = ((l_ls_str[i] + r_ls_str[i]) * jh + e_ls[i]) * df[i] + lc_s_micmix[i] + lc_s_auxmix[i] + i_ls_str[i] * IDF(i) * jhi;
+                        dorp[i] = ((l_rs_str[i] + r_rs_str[i]) * jh + e_rs[i]) * df[i] + rc_s_micmix[i] + rc_s_auxmix[i] + i_rs_str[i] * IDF(i) * jhi;
+                        }
+                    block_limit(&stream_limiter, dolp, dorp, n);
+                    break;
+                case PHONE_PUBLIC:
+                    /* do the phone mix */
+                    for (i = 0; i < n; ++i)
+                        {
+                        lpsp[i] = lc_s_micmix[i] + e_ls[i];
+                        rpsp[i] = rc_s_micmix[i] + e_rs[i];
+                        }
+                    block_limit(&phone_limiter, lpsp, rpsp, n);
+                    block_voip_in(lprp, rprp, n);
+
+                    /* the main mix */
+                    for (i = 0; i < n; ++i)
+                        {
+                        dolp[i] = (l_ls_str[i] + r_ls_str[i]) * jh * df[i] + lprp[i] + lpsp[i] + lc_s_auxmix[i] + i_ls_str[i] * IDF(i) * jhi;
+                        dorp[i] = (l_rs_str[i] + r_rs_str[i]) * jh * df[i] + rprp[i] + rpsp[i] + rc_s_auxmix[i] + i_rs_str[i] * IDF(i) * jhi;
+                        }
+                    block_limit(&stream_limiter, dolp, dorp, n);
+                    break;
+                case PHONE_PRIVATE:
+                    if (!mic_on)
+                        {
+                        /* the main mix */
+                        for (i = 0; i < n; ++i)
+                            {
+                            dolp[i] = l_ls_str[i] + r_ls_str[i] + lc_s_auxmix[i] + i_ls_str[i];
+                            dorp[i] = l_rs_str[i] + r_rs_str[i] + rc_s_auxmix[i] + i_rs_str[i];
+                            }
+                        block_limit(&stream_limiter, dolp, dorp, n);
+
+                        /* the mix the voip listeners receive */
+                        for (i = 0; i < n; ++i)
+                            {
+                            lpsp[i] = (dolp[i] * mb_lc_aud) + e_ls[i] + lc_s_micmix[i];
+                            rpsp[i] = (dorp[i] * mb_lc_aud) + e_rs[i] + rc_s_micmix[i];
+                            }
+                        block_limit(&phone_limiter, lpsp, rpsp, n);
+                        block_voip_in(lprp, rprp, n);
+                        }
+                    else
+                        {
+                        /* the main mix */
+                        for (i = 0; i < n; ++i)
+                            {
+                            dolp[i] = ((l_ls_str[i] + r_ls_str[i]) * jh + e_ls[i]) * df[i] + lc_s_micmix[i] + lc_s_auxmix[i] + i_ls_str[i] * IDF(i) * jhi;
+                            dorp[i] = ((l_rs_str[i] + r_rs_str[i]) * jh + e_rs[i]) * df[i] + rc_s_micmix[i] + rc_s_auxmix[i] + i_rs_str[i] * IDF(i) * jhi;
+                            }
+                        block_limit(&stream_limiter, dolp, dorp, n);
+
+                        /* voip callers get stream mix at a certain volume */
+                        for (i = 0; i < n; ++i)
+                            {
+                            lpsp[i] = dolp[i] * mb_lc_aud;
+                            rpsp[i] = dorp[i] * mb_rc_aud;
+                            }
+                        }
+                    break;
+                }
+
+            if (using_dsp)
+                {
+                memmove(lsp, mp->dilp + o, n * sizeof (sample_t));
+                memmove(rsp, mp->dirp + o, n * sizeof (sample_t));
+                }
+            else
+                {
+                memcpy(lsp, dolp, n * sizeof (sample_t));
+                memcpy(rsp, dorp, n * sizeof (sample_t));
+                }
+
+            if (stream_monitor == FALSE)
+                {
+                switch (mixermode)
+                    {
+                    case NO_PHONE:
+                        for (i = 0; i < n; ++i)
+                            {
+                            lap[i] = ((l_ls_aud[i] + r_ls_aud[i]) * jh + e_ls[i]) * df[i] + dl_micmix[i] + lc_s_auxmix[i] + i_ls_aud[i] * IDF(i) * jhi;
+                            rap[i] = ((l_rs_aud[i] + r_rs_aud[i]) * jh + e_rs[i]) * df[i] + dr_micmix[i] + rc_s_auxmix[i] + i_rs_aud[i] * IDF(i) * jhi;
+                            }
+                        break;
+                    case PHONE_PUBLIC:
+                        for (i = 0; i < n; ++i)
+                            {
+                            lap[i] = (l_ls_aud[i] + r_ls_aud[i]) * jh * df[i] + lprp[i] + lc_s_auxmix[i] + i_ls_aud[i] * IDF(i) * jhi + dl_micmix[i] + e_ls[i];
+                            rap[i] = (l_rs_aud[i] + r_rs_aud[i]) * jh * df[i] + rprp[i] + rc_s_auxmix[i] + i_rs_aud[i] * IDF(i) * jhi + dr_micmix[i] + e_rs[i];
+                            }
+                        break;
+                    case PHONE_PRIVATE:
+                        if (!mic_on) /* the DJ can hear the VOIP phone call */
+                            for (i = 0; i < n; ++i)
+                                {
+                                lap[i] = (lsp[i] * mb_lc_aud) + e_ls[i] + dl_micmix[i] + (lc_s_auxmix[i] *mb_lc_aud) + lprp[i];
+                                rap[i] = (rsp[i] * mb_lc_aud) + e_rs[i] + dr_micmix[i] + (rc_s_auxmix[i] *mb_rc_aud) + rprp[i];
+                                }
+                        else
+                            for (i = 0; i < n; ++i)
+                                {
+                                lap[i] = ((l_ls_aud[i] + r_ls_aud[i]) * jh + e_ls[i]) * df[i] + dl_micmix[i] + lc_s_auxmix[i] + i_ls_aud[i] * IDF(i) * jhi;
+                                rap[i] = ((l_rs_aud[i] + r_rs_aud[i]) * jh + e_ls[i]) * df[i] + dr_micmix[i] + rc_s_auxmix[i] + i_rs_aud[i] * IDF(i) * jhi;
+                                }
+                        break;
+                    }
+                block_limit(&audio_limiter, lap, rap, n);
+                }
+            else
+                {
+                memcpy(lap, lsp, n * sizeof (sample_t));  /* allow the DJ to hear the mix that the listeners are hearing */
+                memcpy(rap, rsp, n * sizeof (sample_t));
+                }
+
+            #undef IDF
+            }
+
+        block_meter_and_alarm(mp, o, n);
+        }
+
+    str_l_meansqrd = str_l_tally/rms_tally_count;
+    str_r_meansqrd = str_r_tally/rms_tally_count;
+    }
+
 /* process_audio: the JACK callback routine */
 int mixer_process_audio(jack_nframes_t nframes, void *arg)
     {
@@ -441,10 +943,6 @@ int mixer_process_audio(jack_nframes_t nframes, void *arg)
     sample_t lc_s_auxmix, rc_s_auxmix;
     /* the following are used to apply the output of the compressor code to the audio levels */
     sample_t compressor_gain = 1.0;
-    /* a counter variable used to trigger the volume smoothing on a regular basis */
-    static unsigned vol_smooth_count = 0;
-    /* index values for reading from a table of fade gain values */
-    static jack_nframes_t alarm_index = 0;
     /* pointers to buffers provided by JACK */
     sample_t *aap, *lap, *rap, *lsp, *rsp, *lpsp, *rpsp, *lprp, *rprp;
     sample_t *al_buffer, *la_buffer, *ra_buffer, *ls_buffer, *rs_buffer, *lps_buffer, *rps_buffer;
@@ -564,6 +1062,28 @@ int mixer_process_audio(jack_nframes_t nframes, void *arg)
     mic_process_start_all(mics, nframes);
     xlplayer_read_start_all(players, nframes, players_roster);
     xlplayer_read_start_all(plr_j, nframes, plr_j_roster);
+
+    /* which effects are playing, for the ducking calculation */
+    effects_active = 0;
+    for (struct xlplayer **p = plr_j_roster; *p; ++p)
+        effects_active |= (*p)->id;
+
+    if (block_mixer && simple_mixer == FALSE && (mixermode == NO_PHONE ||
+                        mixermode == PHONE_PUBLIC || mixermode == PHONE_PRIVATE))
+        {
+        struct mixer_ports mp = {
+            .aap = aap, .lap = lap, .rap = rap, .lsp = lsp, .rsp = rsp,
+            .lpsp = lpsp, .rpsp = rpsp, .lprp = lprp, .rprp = rprp,
+            .dolp = dolp, .dorp = dorp, .dilp = dilp, .dirp = dirp,
+            .plolp = plolp, .plorp = plorp, .prolp = prolp, .prorp = prorp,
+            .piolp = piolp, .piorp = piorp, .pe1olp = pe1olp, .pe1orp = pe1orp,
+            .pe2olp = pe2olp, .pe2orp = pe2orp, .plilp = plilp, .plirp = plirp,
+            .prilp = prilp, .prirp = prirp, .piilp = piilp, .piirp = piirp,
+            .peilp = peilp, .peirp = peirp };
+
+        block_mix(&mp, nframes);
+        return 0;
+        }
     
     /* there are four mixer modes with a lot of shared code */
     /* to keep things smaller and more maintainable macros have been used */
@@ -1070,8 +1590,6 @@ static void jackportread(const char *portname, const char *filter)
   
 static struct mixer {
     const char **outport;
-    int str_l_peak_db, str_r_peak_db;
-    int str_l_rms_db, str_r_rms_db;
     float normrise, normfall;
     int fadeout_f;
     int flush_left, flush_right, flush_jingles, flush_interlude;
@@ -1087,6 +1605,37 @@ static struct mixer {
     char *sc_client_name;
     } s;
 
+/* mixer_telemetry: runs in the telemetry thread at a fixed rate */
+static void mixer_telemetry(struct telemetry *t)
+    {
+    struct telemetry_header *h = t->header;
+    unsigned int ports_diff = port_connection_count - port_reports;
+
+    /* make logarithmic values for the peak levels */
+    h->str_l_peak = peak_to_log(peakfilter_read(str_pf_l));
+    h->str_r_peak = peak_to_log(peakfilter_read(str_pf_r));
+    /* set values for a totally blank signal then compute the rms values */
+    h->str_l_rms = h->str_r_rms = 120;
+    if (str_l_meansqrd)
+        h->str_l_rms = (int) fabs(level2db(sqrt(str_l_meansqrd)));
+    if (str_r_meansqrd)
+        h->str_r_rms = (int) fabs(level2db(sqrt(str_r_meansqrd)));
+    /* tell the jack mixer it can reset its vu stats now */
+    reset_vu_stats_f = TRUE;
+
+    mic_telemetry_all(mics, t->mics);
+    xlplayer_telemetry_all(players, t->players);
+    xlplayer_telemetry_all(plr_j, t->effects);
+
+    h->effects_playing = effects_active;
+    h->freewheel_mode = g.freewheel;
+
+    /* anything that goes in the text reply to ACTN=requestevents */
+    h->events_pending = midi_nqueued > 0 || ports_diff || sig_usr1_pending() ||
+                (g.session_event_rb && jack_ringbuffer_read_space(g.session_event_rb)) ||
+                xlplayer_new_metadata_pending(players) || xlplayer_new_metadata_pending(plr_j);
+    }
+
 static void mixer_cleanup()
     {
     free(eot_alarm_table);
@@ -1099,20 +1648,50 @@ static void mixer_cleanup()
     mic_free_all(mics);
     peakfilter_destroy(str_pf_l);
     peakfilter_destroy(str_pf_r);
+    phash_free(&action_hash);
+    ifree(bs.df);
+    ifree(bs.lc_s_micmix);
+    ifree(bs.rc_s_micmix);
+    ifree(bs.lc_s_auxmix);
+    ifree(bs.rc_s_auxmix);
+    ifree(bs.dl_micmix);
+    ifree(bs.dr_micmix);
     xlplayer_destroy(plr_l);
     xlplayer_destroy(plr_r);
     xlplayer_destroy(plr_i);
     for (struct xlplayer **p = plr_j; *p; ++p)
         xlplayer_destroy(*p);
+    pcmcache_cleanup();
     free(plr_j);
     free(plr_j_roster);
     }
 
+/* mixer_render_ready: true when no player would run dry in the next nframes, offline rendering only */
+int mixer_render_ready(jack_nframes_t nframes)
+    {
+    for (struct xlplayer **p = players; *p; ++p)
+        if (!xlplayer_render_ready(*p, nframes))
+            return FALSE;
+
+    for (struct xlplayer **p = plr_j; *p; ++p)
+        if (!xlplayer_render_ready(*p, nframes))
+            return FALSE;
+
+    return TRUE;
+    }
+
 int mixer_new_buffer_size(jack_nframes_t n_frames)
     {
     fprintf(stderr, "player read buffer allocated for %ld frames\n", (long)n_frames);
     xlplayer_buffer_alloc_all(players, n_frames);
     xlplayer_buffer_alloc_all(plr_j, n_frames);
+    bs.df = irealloc(bs.df, n_frames);
+    bs.lc_s_micmix = irealloc(bs.lc_s_micmix, n_frames);
+    bs.rc_s_micmix = irealloc(bs.rc_s_micmix, n_frames);
+    bs.lc_s_auxmix = irealloc(bs.lc_s_auxmix, n_frames);
+    bs.rc_s_auxmix = irealloc(bs.rc_s_auxmix, n_frames);
+    bs.dl_micmix = irealloc(bs.dl_micmix, n_frames);
+    bs.dr_micmix = irealloc(bs.dr_micmix, n_frames);
     return 0;
     }
 
@@ -1121,6 +1700,7 @@ void mixer_init(void)
     sr = jack_get_sample_rate(g.client);
     jingles_samples_cutoff = sr / 12;            /* A twelfth of a second early */
     player_samples_cutoff = sr * 0.25;           /* for gapless playback */
+    block_mixer = atoi(getenv("block_mixer"));
     int n = 0;
     int ne = atoi(getenv("num_effects"));
 
@@ -1153,7 +1733,9 @@ void mixer_init(void)
             exit(5);
             }
         plr_j[i]->fade_mode = 3;
+        plr_j[i]->use_pcm_cache = TRUE;
         }
+    pcmcache_init((size_t)atoi(getenv("pcm_cache_mb")) << 20);
     
     if (!(players[n++] = plr_i = xlplayer_create(sr, MAIN_RB_SIZE, "interlude", &g.app_shutdown, &interludevol, 0, &inter_stream, &inter_audio, 0.3f)))
         {
@@ -1162,6 +1744,10 @@ void mixer_init(void)
         }
     plr_i->cf_aud = 1;  /* crossfader values to apply in dj audio -- the crossfader interface is used to implement the soft fade in/out */
 
+    /* the main players get the next track ready while the current one plays out */
+    for (struct xlplayer **p = players; *p; ++p)
+        (*p)->use_lookahead = atoi(getenv("player_lookahead"));
+
     players[n++] = NULL;
     if (n != sizeof players / sizeof players[0])
         {
@@ -1169,6 +1755,15 @@ void mixer_init(void)
         exit(5);
         }
 
+    /* decoders run flat out when the mixer is clocked by the offline renderer */
+    if (atoi(getenv("offline_render")))
+        {
+        for (struct xlplayer **p = players; *p; ++p)
+            (*p)->unpaced = TRUE;
+        for (struct xlplayer **p = plr_j; *p; ++p)
+            (*p)->unpaced = TRUE;
+        }
+
     smoothing_volume_init(&jingles_headroom_smoothing, &jingles_headroom_control, 0.0f);
 
     if (!init_dblookup_table())
@@ -1206,410 +1801,454 @@ void mixer_init(void)
     mics = mic_init_all(atoi(getenv("mic_qty")), g.client);
         
     jack_set_port_connect_callback(g.client, custom_jack_port_connect_callback, NULL);
+    telemetry_register(mixer_telemetry);
+
+    if (!phash_init(&action_hash, action_names, N_ACTIONS))
+        exit(5);
                 
     atexit(mixer_cleanup);
     g.mixer_up = TRUE;
     }
         
-int mixer_main()
+/* mixer_apply_stats: act on new values from either form of mixstats */
+static void mixer_apply_stats()
     {
-    unsigned int lead, ports_diff;
-    jack_session_event_t *session_event;
-    
-    if (!(kvp_parse(kvpdict, g.in)))
-        {
-        fprintf(stderr, "kvp_parse returned false\n");
-        return FALSE;
-        }
-
-    if (!strcmp(action, "ping"))
-        {
-        fprintf(g.out, "pong\n");
-        fflush(g.out);
-        }
-
-    if (!strcmp(action, "mp3_getstatus"))
-        xlplayer_mpg123_status();
-
-    if (!strcmp(action, "jackportread"))
-        jackportread(jackport, jackfilter);
-        
-    if (!strcmp(action, "freewheel_toggle"))
-        jack_set_freewheel(g.client, !g.freewheel);
-
-    if (!strcmp(action, "freewheel_on"))
-        jack_set_freewheel(g.client, 1);
-
-    if (!strcmp(action, "freewheel_off"))
-        jack_set_freewheel(g.client, 0);
-
-    void dis_connect(char *str, int (*fn)(jack_client_t *, const char *, const char *))
-        {
-        const char **jackports, **jp;
-        jack_port_t *port;
-        
-        if (!strcmp(action, str))
-            {
-            if (strlen(jackport2))
-                {
-                if ((port = jack_port_by_name(g.client, jackport)))
-                    {
-                    if (jack_port_flags(port) & JackPortIsOutput)
-                        fn(g.client, jackport, jackport2);
-	            else
-	                fn(g.client, jackport2, jackport);
-                    }
-                else
-                    fprintf(stderr, "port %s does not exist\n", jackport);
-                }
-            else
-                {
-                /* do regular expression lookup of ports then disconnect them */
-                if (!strcmp(str, "jackdisconnect"))
-                    {
-                    if ((jackports = jack_get_ports(g.client, jackport, NULL, 0L)))
-                        {
-                        for (jp = jackports; *jp; ++jp)
-                            {
-                            if ((port = jack_port_by_name(g.client, *jp)))
-                                jack_port_disconnect(g.client, port);
-                            else
-                                fprintf(stderr, "port %s does not exist\n", jackport);
-                            }
-
-                        jack_free(jackports);
-                        }
-                    }
-                }
-            }
-        }
-    dis_connect("jackconnect", jack_connect);
-    dis_connect("jackdisconnect", jack_disconnect);
+    eot_alarm_f |= eot_alarm_set;
 
-    if (!strcmp(action, "session_reply"))
-        {
-        sscanf(session_event_string, "%p", &session_event);
-        session_event->command_line = session_commandline;
-        /* Transfer of ownership of heap allocated string. */
-        session_commandline = NULL;
-        jack_session_reply(g.client, session_event);
-        jack_session_event_free(session_event);
-        /* Unblock the user interface which is waiting on a reply. */
-        fprintf(g.out, "session event handled\n");
-        fflush(g.out);
-        }
+    plr_l->fadeout_f = plr_r->fadeout_f = plr_i->fadeout_f = s.fadeout_f;
+    for (struct xlplayer **p = plr_j; *p; ++p)
+        (*p)->fadeout_f = s.fadeout_f;
 
-    if (!strcmp(action, "playeffect"))
-        {
-        int i = atoi(effect_ix);
+    plr_l->use_sv = plr_r->use_sv = plr_i->use_sv = speed_variance;
 
-        xlplayer_play(plr_j[i], playerpathname, 0, 0, atoi(rg_db), i);
-        }
+    if (s.use_dsp != using_dsp)
+        using_dsp = s.use_dsp;
 
-    if (!strcmp(action, "stopeffect"))
+    if (s.new_left_pause != plr_l->pause)
         {
-        int i = atoi(effect_ix);
-        
-        if (1 << i == plr_j[i]->id)
-            xlplayer_eject(plr_j[i]);
+        if (s.new_left_pause)
+            xlplayer_pause(plr_l);
+        else
+            xlplayer_unpause(plr_l);
         }
 
-    if (!strcmp(action, "mic_control"))
+    if (s.new_right_pause != plr_r->pause)
         {
-        mic_valueparse(mics[atoi(item_index)], mic_param);
+        if (s.new_right_pause)
+            xlplayer_pause(plr_r);
+        else
+            xlplayer_unpause(plr_r);
         }
 
-    if (!strcmp(action, "new_channel_mode_string"))
+    if (s.new_inter_pause != plr_i->pause)
         {
-        mic_set_role_all(mics, channel_mode_string);
+        if (s.new_inter_pause)
+            xlplayer_pause(plr_i);
+        else
+            xlplayer_unpause(plr_i);
         }
+    }
 
-    if (!strcmp(action, "headroom"))
-        {
-        headroom_db = strtof(headroom, NULL);
-        }
+int mixer_main_binary()
+    {
+    struct mixer_frame_header header;
+    struct mixer_stats_frame f;
+    char payload[256];
 
-    if (!strcmp(action, "anymic"))
+    if (fread(&header, sizeof header, 1, g.in) != 1 || header.length > sizeof payload ||
+                (header.length && fread(payload, header.length, 1, g.in) != 1))
         {
-        mic_on = (flag[0] == '1') ? 1 : 0;
+        fprintf(stderr, "mixer_main_binary: bad or truncated frame\n");
+        return FALSE;
         }
 
-    if (!strcmp(action, "fademode_left"))
-        plr_l->fade_mode = atoi(fade_mode);
-        
-    if (!strcmp(action, "fademode_right"))
-        plr_r->fade_mode = atoi(fade_mode);
-
-    if (!strcmp(action, "fademode_interlude"))
-        plr_i->fade_mode = atoi(fade_mode);
-
-    if (!strcmp(action, "playleft"))
-        {
-        fprintf(g.out, "context_id=%d\n", xlplayer_play(plr_l, playerpathname, atoi(seek_s), atoi(size), atof(rg_db), 0));
-        fflush(g.out);
-        }
-    if (!strcmp(action, "playright"))
-        {
-        fprintf(g.out, "context_id=%d\n", xlplayer_play(plr_r, playerpathname, atoi(seek_s), atoi(size), atof(rg_db), 0));
-        fflush(g.out);
-        }
-    if (!strcmp(action, "playinterlude"))
-        {
-        fprintf(g.out, "context_id=%d\n", xlplayer_play(plr_i, playerpathname, atoi(seek_s), atoi(size), atof(rg_db), 0));
-        fflush(g.out);
-        }
-    if (!strcmp(action, "playnoflushleft"))
-        {
-        fprintf(g.out, "context_id=%d\n", xlplayer_play_noflush(plr_l, playerpathname, atoi(seek_s), atoi(size), atof(rg_db), 0));
-        fflush(g.out);
-        }
-    if (!strcmp(action, "playnoflushright"))
-        {
-        fprintf(g.out, "context_id=%d\n", xlplayer_play_noflush(plr_r, playerpathname, atoi(seek_s), atoi(size), atof(rg_db), 0));
-        fflush(g.out);
-        }
-    if (!strcmp(action, "playnoflushinterlude"))
-        {
-        fprintf(g.out, "context_id=%d\n", xlplayer_play_noflush(plr_i, playerpathname, atoi(seek_s), atoi(size), atof(rg_db), 0));
-        fflush(g.out);
+    switch (header.type) {
+        case MF_MIXSTATS:
+            if (header.length != sizeof f)
+                {
+                fprintf(stderr, "mixer_main_binary: mixstats frame has the wrong length\n");
+                break;
+                }
+            memcpy(&f, payload, sizeof f);
+            volume = f.volume;
+            volume2 = f.volume2;
+            crossfade = f.crossfade;
+            jinglesvolume1 = f.jinglesvolume1;
+            jinglesheadroom1 = f.jinglesheadroom1;
+            jinglesvolume2 = f.jinglesvolume2;
+            jinglesheadroom2 = f.jinglesheadroom2;
+            interludevol = f.interludevol;
+            mixbackvol = f.mixbackvol;
+            jingles_playing = f.jingles_playing;
+            left_stream = f.left_stream;
+            left_audio = f.left_audio;
+            right_stream = f.right_stream;
+            right_audio = f.right_audio;
+            stream_monitor = f.stream_monitor;
+            s.new_left_pause = f.left_pause;
+            s.new_right_pause = f.right_pause;
+            s.flush_left = f.flush_left;
+            s.flush_right = f.flush_right;
+            s.flush_jingles = f.flush_jingles;
+            s.flush_interlude = f.flush_interlude;
+            simple_mixer = f.simple_mixer;
+            eot_alarm_set = f.eot_alarm_set;
+            mixermode = f.mixermode;
+            s.fadeout_f = f.fadeout_f;
+            main_play = f.main_play;
+            plr_l->newpbspeed = f.left_pbspeed;
+            plr_r->newpbspeed = f.right_pbspeed;
+            speed_variance = f.speed_variance;
+            dj_audio_level = f.dj_audio_level;
+            crosspattern = f.crosspattern;
+            s.use_dsp = f.use_dsp;
+            s.new_inter_pause = f.inter_pause;
+            inter_stream = f.inter_stream;
+            inter_audio = f.inter_audio;
+            inter_force = f.inter_force;
+            alarm_audio_level = f.alarm_audio_level;
+            voipvol = f.voipvol;
+            plr_i->newpbspeed = f.inter_pbspeed;
+            mixer_apply_stats();
+            break;
+        default:
+            fprintf(stderr, "mixer_main_binary: unhandled frame type %d\n", header.type);
         }
+    return TRUE;
+    }
 
-#if 0 
-    if (!strcmp(action, "playmanyjingles"))
+int mixer_main()
+    {
+    unsigned int lead, ports_diff;
+    jack_session_event_t *session_event;
+    int act;
+    
+    if (!(kvp_parse(kvpdict, g.in)))
         {
-        fprintf(g.out, "context_id=%d\n", xlplayer_playmany(plr_j, playerplaylist, loop[0]=='1'));
-        fflush(g.out);
+        fprintf(stderr, "kvp_parse returned false\n");
+        return FALSE;
         }
-#endif
-
-    if (!strcmp(action, "stopleft"))
-        xlplayer_eject(plr_l);
-    if (!strcmp(action, "stopright"))
-        xlplayer_eject(plr_r);
-    if (!strcmp(action, "stopjingles"))
-        xlplayer_eject(plr_j[atoi(effect_ix)]);
-    if (!strcmp(action, "stopinterlude"))
-        xlplayer_eject(plr_i);
 
-    if (!strcmp(action, "dither"))
-        {
-        xlplayer_dither(plr_l, TRUE);
-        xlplayer_dither(plr_r, TRUE);
-        for (struct xlplayer **p = plr_j; *p; ++p)
-            xlplayer_dither(*p, TRUE);
-        xlplayer_dither(plr_i, TRUE);
-        }
+    act = action ? phash_lookup(&action_hash, action) : -1;
 
-    if (!strcmp(action, "dontdither"))
+    void dis_connect(enum mixer_action which, int (*fn)(jack_client_t *, const char *, const char *))
         {
-        xlplayer_dither(plr_l, FALSE);
-        xlplayer_dither(plr_r, FALSE);
-        for (struct xlplayer **p = plr_j; *p; ++p)
-            xlplayer_dither(*p, FALSE);
-        xlplayer_dither(plr_i, FALSE);
-        }
-    
-    if (!strcmp(action, "resamplequality"))
-        {
-        for (struct xlplayer **p = players; *p; ++p)
-            (*p)->rsqual = resamplequality[0] - '0';
-            
-        for (struct xlplayer **p = plr_j; *p; ++p)
-            (*p)->rsqual = resamplequality[0] - '0';
-        }
-    
-    if (!strcmp(action, "ogginforequest"))
-        {
-        if (oggdecode_get_metainfo(oggpathname, &s.artist, &s.title, &s.album, &s.length, &s.replaygain))
+        const char **jackports, **jp;
+        jack_port_t *port;
+        
+        if (strlen(jackport2))
             {
-            fprintf(g.out, "OIR:ARTIST=%s\nOIR:TITLE=%s\nOIR:ALBUM=%s\nOIR:LENGTH=%f\nOIR:REPLAYGAIN_TRACK_GAIN=%s\nOIR:end\n", s.artist, s.title, s.album, s.length, s.replaygain);
-            fflush(g.out);
+            if ((port = jack_port_by_name(g.client, jackport)))
+                {
+                if (jack_port_flags(port) & JackPortIsOutput)
+                    fn(g.client, jackport, jackport2);
+                else
+                    fn(g.client, jackport2, jackport);
+                }
+            else
+                fprintf(stderr, "port %s does not exist\n", jackport);
             }
         else
             {
-            fprintf(g.out, "OIR:NOT VALID\n");
-            fflush(g.out);
-            }
-        }
-    
-    if (!strcmp(action, "sndfileinforequest"))
-        sndfileinfo(sndfilepathname);
-
-#ifdef HAVE_SPEEX
-    if (!(strcmp(action, "speexreadtagrequest")))
-        speex_tag_read(speexpathname);
-    if (!(strcmp(action, "speexwritetagrequest")))
-        speex_tag_write(speexpathname, speexcreatedby, speextaglist);
-#endif
+            /* do regular expression lookup of ports then disconnect them */
+            if (which == ACT_JACKDISCONNECT)
+                {
+                if ((jackports = jack_get_ports(g.client, jackport, NULL, 0L)))
+                    {
+                    for (jp = jackports; *jp; ++jp)
+                        {
+                        if ((port = jack_port_by_name(g.client, *jp)))
+                            jack_port_disconnect(g.client, port);
+                        else
+                            fprintf(stderr, "port %s does not exist\n", jackport);
+                        }
 
-    if (!strcmp(action, "voippan"))
-        {
-        int voippanval = atoi(voip_pan);
-        
-        if (voippanval == -1)
-            voip_pan_f = 0;
-        else
-            {
-            double x = voippanval * M_PI_2 / 100.0;
-            
-            voip_pan_l = (float)cos(x);
-            voip_pan_r = (float)sin(x);
-            
-            voip_pan_f = 1;
+                    jack_free(jackports);
+                    }
+                }
             }
         }
 
-    if (!strcmp(action, "mixstats"))
+    switch (act)
         {
-        if(sscanf(mixer_string,
-                 ":%03d:%03d:%03d:%03d:%03d:%03d:%03d:%03d:%03d:%d:%1d%1d%1d"
-                 "%1d%1d:%1d%1d:%1d%1d%1d%1d:%1d:%1d:%1d:%1d:%1d:%f:%f:%1d:%f"
-                 ":%d:%d:%d:%1d:%1d:%1d:%f:%03d:%f:",
-                 &volume, &volume2, &crossfade, &jinglesvolume1, &jinglesheadroom1,
-                 &jinglesvolume2, &jinglesheadroom2 ,&interludevol, &mixbackvol, &jingles_playing,
-                 &left_stream, &left_audio, &right_stream, &right_audio, &stream_monitor,
-                 &s.new_left_pause, &s.new_right_pause, &s.flush_left, &s.flush_right, &s.flush_jingles, &s.flush_interlude,
-                 &simple_mixer, &eot_alarm_set, &mixermode, &s.fadeout_f, &main_play, &(plr_l->newpbspeed), &(plr_r->newpbspeed),
-                 &speed_variance, &dj_audio_level, &crosspattern, &s.use_dsp, &s.new_inter_pause,
-                 &inter_stream, &inter_audio, &inter_force, &alarm_audio_level, &voipvol, &(plr_i->newpbspeed)) !=39)
+        case ACT_PING:
+            fprintf(g.out, "pong\n");
+            fflush(g.out);
+            break;
+        case ACT_MP3_GETSTATUS:
+            xlplayer_mpg123_status();
+            break;
+        case ACT_JACKPORTREAD:
+            jackportread(jackport, jackfilter);
+            break;
+        case ACT_FREEWHEEL_TOGGLE:
+            jack_set_freewheel(g.client, !g.freewheel);
+            break;
+        case ACT_FREEWHEEL_ON:
+            jack_set_freewheel(g.client, 1);
+            break;
+        case ACT_FREEWHEEL_OFF:
+            jack_set_freewheel(g.client, 0);
+            break;
+        /* for A/B comparison of the two mixer implementations */
+        case ACT_BLOCKMIXER_ON:
+            block_mixer = TRUE;
+            break;
+        case ACT_BLOCKMIXER_OFF:
+            block_mixer = FALSE;
+            break;
+        case ACT_JACKCONNECT:
+            dis_connect(ACT_JACKCONNECT, jack_connect);
+            break;
+        case ACT_JACKDISCONNECT:
+            dis_connect(ACT_JACKDISCONNECT, jack_disconnect);
+            break;
+        case ACT_SESSION_REPLY:
+            sscanf(session_event_string, "%p", &session_event);
+            session_event->command_line = session_commandline;
+            /* Transfer of ownership of heap allocated string. */
+            session_commandline = NULL;
+            jack_session_reply(g.client, session_event);
+            jack_session_event_free(session_event);
+            /* Unblock the user interface which is waiting on a reply. */
+            fprintf(g.out, "session event handled\n");
+            fflush(g.out);
+            break;
+        case ACT_PLAYEFFECT:
             {
-            fprintf(stderr, "mixer got bad mixer string\n");
-            return TRUE;
-            }
-        eot_alarm_f |= eot_alarm_set;
-
-        plr_l->fadeout_f = plr_r->fadeout_f = plr_i->fadeout_f = s.fadeout_f;
-        for (struct xlplayer **p = plr_j; *p; ++p)
-            (*p)->fadeout_f = s.fadeout_f;
-            
-        plr_l->use_sv = plr_r->use_sv = plr_i->use_sv = speed_variance;
-
-        if (s.use_dsp != using_dsp)
-            using_dsp = s.use_dsp;
+            int i = atoi(effect_ix);
 
-        if (s.new_left_pause != plr_l->pause)
-            {
-            if (s.new_left_pause)
-                xlplayer_pause(plr_l);
-            else
-                xlplayer_unpause(plr_l);
+            xlplayer_play(plr_j[i], playerpathname, 0, 0, atoi(rg_db), i);
             }
-            
-        if (s.new_right_pause != plr_r->pause)
+            break;
+        case ACT_STOPEFFECT:
             {
-            if (s.new_right_pause)
-                xlplayer_pause(plr_r);
-            else
-                xlplayer_unpause(plr_r);
-            }
+            int i = atoi(effect_ix);
 
-        if (s.new_inter_pause != plr_i->pause)
-            {
-            if (s.new_inter_pause)
-                xlplayer_pause(plr_i);
-            else
-                xlplayer_unpause(plr_i);
+            if (1 << i == plr_j[i]->id)
+                xlplayer_eject(plr_j[i]);
             }
-        }
+            break;
+        case ACT_MIC_CONTROL:
+            mic_valueparse(mics[atoi(item_index)], mic_param);
+            break;
+        case ACT_NEW_CHANNEL_MODE_STRING:
+            mic_set_role_all(mics, channel_mode_string);
+            break;
+        case ACT_HEADROOM:
+            headroom_db = strtof(headroom, NULL);
+            break;
+        case ACT_ANYMIC:
+            mic_on = (flag[0] == '1') ? 1 : 0;
+            break;
+        case ACT_FADEMODE_LEFT:
+            plr_l->fade_mode = atoi(fade_mode);
+            break;
+        case ACT_FADEMODE_RIGHT:
+            plr_r->fade_mode = atoi(fade_mode);
+            break;
+        case ACT_FADEMODE_INTERLUDE:
+            plr_i->fade_mode = atoi(fade_mode);
+            break;
+        case ACT_PLAYLEFT:
+            fprintf(g.out, "context_id=%d\n", xlplayer_play(plr_l, playerpathname, atoi(seek_s), atoi(size), atof(rg_db), 0));
+            fflush(g.out);
+            break;
+        case ACT_PLAYRIGHT:
+            fprintf(g.out, "context_id=%d\n", xlplayer_play(plr_r, playerpathname, atoi(seek_s), atoi(size), atof(rg_db), 0));
+            fflush(g.out);
+            break;
+        case ACT_PLAYINTERLUDE:
+            fprintf(g.out, "context_id=%d\n", xlplayer_play(plr_i, playerpathname, atoi(seek_s), atoi(size), atof(rg_db), 0));
+            fflush(g.out);
+            break;
+        case ACT_PLAYNOFLUSHLEFT:
+            fprintf(g.out, "context_id=%d\n", xlplayer_play_noflush(plr_l, playerpathname, atoi(seek_s), atoi(size), atof(rg_db), 0));
+            fflush(g.out);
+            break;
+        case ACT_PLAYNOFLUSHRIGHT:
+            fprintf(g.out, "context_id=%d\n", xlplayer_play_noflush(plr_r, playerpathname, atoi(seek_s), atoi(size), atof(rg_db), 0));
+            fflush(g.out);
+            break;
+        case ACT_PLAYNOFLUSHINTERLUDE:
+            fprintf(g.out, "context_id=%d\n", xlplayer_play_noflush(plr_i, playerpathname, atoi(seek_s), atoi(size), atof(rg_db), 0));
+            fflush(g.out);
+            break;
+        case ACT_PRELOADLEFT:
+            xlplayer_preload(plr_l, playerpathname, atoi(seek_s), atof(rg_db));
+            break;
+        case ACT_PRELOADRIGHT:
+            xlplayer_preload(plr_r, playerpathname, atoi(seek_s), atof(rg_db));
+            break;
+        case ACT_PRELOADINTERLUDE:
+            xlplayer_preload(plr_i, playerpathname, atoi(seek_s), atof(rg_db));
+            break;
+#if 0 
+        case ACT_PLAYMANYJINGLES:
+            fprintf(g.out, "context_id=%d\n", xlplayer_playmany(plr_j, playerplaylist, loop[0]=='1'));
+            fflush(g.out);
+            break;
+#endif
+        case ACT_STOPLEFT:
+            xlplayer_eject(plr_l);
+            break;
+        case ACT_STOPRIGHT:
+            xlplayer_eject(plr_r);
+            break;
+        case ACT_STOPJINGLES:
+            xlplayer_eject(plr_j[atoi(effect_ix)]);
+            break;
+        case ACT_STOPINTERLUDE:
+            xlplayer_eject(plr_i);
+            break;
+        case ACT_DITHER:
+            xlplayer_dither(plr_l, TRUE);
+            xlplayer_dither(plr_r, TRUE);
+            for (struct xlplayer **p = plr_j; *p; ++p)
+                xlplayer_dither(*p, TRUE);
+            xlplayer_dither(plr_i, TRUE);
+            break;
+        case ACT_DONTDITHER:
+            xlplayer_dither(plr_l, FALSE);
+            xlplayer_dither(plr_r, FALSE);
+            for (struct xlplayer **p = plr_j; *p; ++p)
+                xlplayer_dither(*p, FALSE);
+            xlplayer_dither(plr_i, FALSE);
+            break;
+        case ACT_RESAMPLEQUALITY:
+            for (struct xlplayer **p = players; *p; ++p)
+                (*p)->rsqual = resamplequality[0] - '0';
+
+            for (struct xlplayer **p = plr_j; *p; ++p)
+                (*p)->rsqual = resamplequality[0] - '0';
+            break;
+        case ACT_OGGINFOREQUEST:
+            if (oggdecode_get_metainfo(oggpathname, &s.artist, &s.title, &s.album, &s.length, &s.replaygain))
+                {
+                fprintf(g.out, "OIR:ARTIST=%s\nOIR:TITLE=%s\nOIR:ALBUM=%s\nOIR:LENGTH=%f\nOIR:REPLAYGAIN_TRACK_GAIN=%s\nOIR:end\n", s.artist, s.title, s.album, s.length, s.replaygain);
+                fflush(g.out);
+                }
+            else
+                {
+                fprintf(g.out, "OIR:NOT VALID\n");
+                fflush(g.out);
+                }
+            break;
+        case ACT_SNDFILEINFOREQUEST:
+            sndfileinfo(sndfilepathname);
+            break;
+#ifdef HAVE_SPEEX
+        case ACT_SPEEXREADTAGREQUEST:
+            speex_tag_read(speexpathname);
+            break;
+        case ACT_SPEEXWRITETAGREQUEST:
+            speex_tag_write(speexpathname, speexcreatedby, speextaglist);
+            break;
+#endif
+        case ACT_VOIPPAN:
+            {
+            int voippanval = atoi(voip_pan);
 
-    if (!strcmp(action, "requestlevels"))
-        {
-        /* make logarithmic values for the peak levels */
-        s.str_l_peak_db = peak_to_log(peakfilter_read(str_pf_l));
-        s.str_r_peak_db = peak_to_log(peakfilter_read(str_pf_r));
-        /* set reply values for a totally blank signal */
-        s.str_l_rms_db = s.str_r_rms_db = 120;
-        /* compute the rms values */
-        if (str_l_meansqrd)
-            s.str_l_rms_db = (int) fabs(level2db(sqrt(str_l_meansqrd)));
-        if (str_r_meansqrd)
-            s.str_r_rms_db = (int) fabs(level2db(sqrt(str_r_meansqrd)));
-            
-        /* send the meter and other stats to the main app */
-        mic_stats_all(mics);
+            if (voippanval == -1)
+                voip_pan_f = 0;
+            else
+                {
+                double x = voippanval * M_PI_2 / 100.0;
 
-        /* forward any MIDI commands that have been queued since last time */
-        pthread_mutex_lock(&midi_mutex);
-        s.midi_output[0]= '\0';
-        if (midi_nqueued>0) /* exclude leading `,`, include trailing `\0` */
-            memcpy(s.midi_output, midi_queue+1, midi_nqueued*sizeof(char));
-        midi_queue[0]= '\0';
-        midi_nqueued= 0;
-        pthread_mutex_unlock(&midi_mutex);
+                voip_pan_l = (float)cos(x);
+                voip_pan_r = (float)sin(x);
 
-        if (sig_recent_usr1())
-            s.session_command = "save_L1";
-        else
-            {
-            if (g.session_event_rb && jack_ringbuffer_read_space(g.session_event_rb) >= sizeof session_event)
+                voip_pan_f = 1;
+                }
+            }
+            break;
+        case ACT_MIXSTATS:
+            if(sscanf(mixer_string,
+                     ":%03d:%03d:%03d:%03d:%03d:%03d:%03d:%03d:%03d:%d:%1d%1d%1d"
+                     "%1d%1d:%1d%1d:%1d%1d%1d%1d:%1d:%1d:%1d:%1d:%1d:%f:%f:%1d:%f"
+                     ":%d:%d:%d:%1d:%1d:%1d:%f:%03d:%f:",
+                     &volume, &volume2, &crossfade, &jinglesvolume1, &jinglesheadroom1,
+                     &jinglesvolume2, &jinglesheadroom2 ,&interludevol, &mixbackvol, &jingles_playing,
+                     &left_stream, &left_audio, &right_stream, &right_audio, &stream_monitor,
+                     &s.new_left_pause, &s.new_right_pause, &s.flush_left, &s.flush_right, &s.flush_jingles, &s.flush_interlude,
+                     &simple_mixer, &eot_alarm_set, &mixermode, &s.fadeout_f, &main_play, &(plr_l->newpbspeed), &(plr_r->newpbspeed),
+                     &speed_variance, &dj_audio_level, &crosspattern, &s.use_dsp, &s.new_inter_pause,
+                     &inter_stream, &inter_audio, &inter_force, &alarm_audio_level, &voipvol, &(plr_i->newpbspeed)) !=39)
                 {
-                jack_ringbuffer_read(g.session_event_rb, (char *)&session_event, sizeof session_event);
-                switch (session_event->type) {
-                    case JackSessionSave:
-                        s.session_command = "save_JACK";
-                        break;
-                    case JackSessionSaveAndQuit:
-                        s.session_command = "saveandquit_JACK";
-                        break;
-                    case JackSessionSaveTemplate:
-                        s.session_command = "savetemplate_JACK";
-                    }
-
-                fprintf(g.out, "session_event=%p\n"
-                                "session_directory=%s\n"
-                                "session_uuid=%s\n",
-                                 session_event,
-                                 session_event->session_dir,
-                                 session_event->client_uuid);
+                fprintf(stderr, "mixer got bad mixer string\n");
+                return TRUE;
                 }
+            mixer_apply_stats();
+            break;
+        /* meter levels and player status are in the telemetry block, only the
+         * occasional events are passed as text
+         */
+        case ACT_REQUESTEVENTS:
+            /* forward any MIDI commands that have been queued since last time */
+            pthread_mutex_lock(&midi_mutex);
+            s.midi_output[0]= '\0';
+            if (midi_nqueued>0) /* exclude leading `,`, include trailing `\0` */
+                memcpy(s.midi_output, midi_queue+1, midi_nqueued*sizeof(char));
+            midi_queue[0]= '\0';
+            midi_nqueued= 0;
+            pthread_mutex_unlock(&midi_mutex);
+
+            if (sig_recent_usr1())
+                s.session_command = "save_L1";
             else
-                s.session_command = "";
-            }
-
-        lead = port_connection_count;
-        if (lead - port_reports > UINT_MAX << 1)
-            ports_diff = UINT_MAX - lead + port_reports + 1;    /* handle wrap */
-        else
-            ports_diff = lead - port_reports;
+                {
+                if (g.session_event_rb && jack_ringbuffer_read_space(g.session_event_rb) >= sizeof session_event)
+                    {
+                    jack_ringbuffer_read(g.session_event_rb, (char *)&session_event, sizeof session_event);
+                    switch (session_event->type) {
+                        case JackSessionSave:
+                            s.session_command = "save_JACK";
+                            break;
+                        case JackSessionSaveAndQuit:
+                            s.session_command = "saveandquit_JACK";
+                            break;
+                        case JackSessionSaveTemplate:
+                            s.session_command = "savetemplate_JACK";
+                        }
 
-        xlplayer_stats_all(players);
-        xlplayer_stats_all(plr_j);
+                    fprintf(g.out, "session_event=%p\n"
+                                    "session_directory=%s\n"
+                                    "session_uuid=%s\n",
+                                     session_event,
+                                     session_event->session_dir,
+                                     session_event->client_uuid);
+                    }
+                else
+                    s.session_command = "";
+                }
 
-        int effects = 0;
-        for (struct xlplayer **p = plr_j_roster; *p; ++p)
-            effects |= (*p)->id;
-        if (effects == effects_active)
-            effects = -1;   // -1 for no change, UI can skip updating indicators
-        else
-            effects_active = effects;
-
-        fprintf(g.out, 
-                    "str_l_peak=%d\nstr_r_peak=%d\n"
-                    "str_l_rms=%d\nstr_r_rms=%d\n"
-                    "midi=%s\n"
-                    "session_command=%s\n"
-                    "ports_connections_changed=%d\n"
-                    "effects_playing=%d\n"
-                    "freewheel_mode=%d\n"
-                    "end\n",
-                    s.str_l_peak_db, s.str_r_peak_db,
-                    s.str_l_rms_db, s.str_r_rms_db,
-                    s.midi_output,
-                    s.session_command,
-                    ports_diff,
-                    effects,
-                    g.freewheel
-                    );
+            lead = port_connection_count;
+            if (lead - port_reports > UINT_MAX << 1)
+                ports_diff = UINT_MAX - lead + port_reports + 1;    /* handle wrap */
+            else
+                ports_diff = lead - port_reports;
+
+            xlplayer_new_metadata_all(players);
+            xlplayer_new_metadata_all(plr_j);
+
+            fprintf(g.out, 
+                        "midi=%s\n"
+                        "session_command=%s\n"
+                        "ports_connections_changed=%d\n"
+                        "end\n",
+                        s.midi_output,
+                        s.session_command,
+                        ports_diff
+                        );
+
+            if (ports_diff)
+                {
+                port_reports += ports_diff;
+                fprintf(stderr, "%d JACK port connection(s) changed\n", ports_diff);
+                }
 
-        if (ports_diff)
-            {
-            port_reports += ports_diff;
-            fprintf(stderr, "%d JACK port connection(s) changed\n", ports_diff);
-            }
-            
-        /* tell the jack mixer it can reset its vu stats now */
-        reset_vu_stats_f = TRUE;
-        fflush(g.out);
+            fflush(g.out);
+            break;
         }
         
     return TRUE;
@@ -17,12 +17,47 @@
 #   If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <stdint.h>
 #include <jack/jack.h>
 
+/* Binary command frames are the alternative to key=value text for
+ * frequently sent commands. The module line "mb" is followed by the header
+ * and then length bytes of payload, all in host byte order.
+ */
+
+enum mixer_frame_type { MF_MIXSTATS = 1 };
+
+struct mixer_frame_header
+    {
+    uint16_t type;
+    uint16_t length;                /* payload bytes to follow */
+    };
+
+/* the payload of MF_MIXSTATS, field for field the same as the text form */
+struct mixer_stats_frame
+    {
+    int32_t volume, volume2, crossfade;
+    int32_t jinglesvolume1, jinglesheadroom1, jinglesvolume2, jinglesheadroom2;
+    int32_t interludevol, mixbackvol, jingles_playing;
+    int32_t left_stream, left_audio, right_stream, right_audio, stream_monitor;
+    int32_t left_pause, right_pause;
+    int32_t flush_left, flush_right, flush_jingles, flush_interlude;
+    int32_t simple_mixer, eot_alarm_set, mixermode, fadeout_f, main_play;
+    float left_pbspeed, right_pbspeed;
+    int32_t speed_variance;
+    float dj_audio_level;
+    int32_t crosspattern, use_dsp, inter_pause, inter_stream, inter_audio, inter_force;
+    float alarm_audio_level;
+    int32_t voipvol;
+    float inter_pbspeed;
+    };
+
 void mixer_init();
 int mixer_main();
+int mixer_main_binary();
 int mixer_control(char *command);
 int mixer_healthcheck();
 int mixer_process_audio(jack_nframes_t n_frames, void *arg);
 void mixer_stop_players();
 int mixer_new_buffer_size(jack_nframes_t n_frames);
+int mixer_render_ready(jack_nframes_t nframes);
@@ -0,0 +1,482 @@
+/*
+#   mixer_bench.c: cost of the mixer process callback without a JACK server
+#   Copyright (C) 2013 Stephen Fairchild (s-fairchild@users.sf.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Usage: mixer_bench [-n nframes] [-r rate] [-e effects] [-m mics]
+ *                    [-M mixermode] [-s] [-c] [-V] [-d seconds] [-F] [file]
+ *
+ * Runs mixer_process_audio against stub ports holding synthetic audio. The
+ * main players play the file, or a generated tone when none is given, as do
+ * the first few effects players. Mics are put in fully processed mode and
+ * opened. -M selects the mixer mode, 0 for no phone, 1 phone public, 2 phone
+ * private. -s selects the simple mixer, -c the per sample mixer code in place
+ * of the block mixer. Callbacks are paced at the period like the JACK server
+ * would so the decoder threads run as normal, -F runs them back to back.
+ *
+ * -V checks the block mixer against the per sample mixer. A child process
+ * runs the per sample code and records every output port, then the block
+ * mixer is run on the same input and any sample that is not bit identical
+ * is counted. The exit status is 1 when there are any.
+ */
+
+#include "../config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sndfile.h>
+#include <jack/jack.h>
+#include <jack/midiport.h>
+#include "main.h"
+#include "mixer.h"
+#include "bench_common.h"
+
+#define TRUE 1
+#define FALSE 0
+
+/* the buffer of a stub port, any jack_port_t pointer the mixer holds is one of these */
+struct bench_port
+    {
+    float *buffer;
+    };
+
+struct globs g;
+
+/* the audio outputs, what -V compares */
+static jack_port_t **bench_outputs[] = {
+    &g.port.dj_out_l, &g.port.dj_out_r, &g.port.dsp_out_l, &g.port.dsp_out_r, &g.port.str_out_l,
+    &g.port.str_out_r, &g.port.voip_out_l, &g.port.voip_out_r, &g.port.alarm_out, &g.port.pl_out_l,
+    &g.port.pl_out_r, &g.port.pr_out_l, &g.port.pr_out_r, &g.port.pi_out_l, &g.port.pi_out_r,
+    &g.port.pe1_out_l, &g.port.pe1_out_r, &g.port.pe2_out_l, &g.port.pe2_out_r, NULL };
+
+static jack_nframes_t sample_rate = 48000;
+static jack_nframes_t max_nframes;
+static unsigned noise_seed = 1;
+
+static jack_port_t *bench_port_new(int is_input)
+    {
+    struct bench_port *port;
+    jack_nframes_t i;
+
+    if (!(port = malloc(sizeof (struct bench_port))) ||
+                !(port->buffer = calloc(max_nframes, sizeof (float))))
+        {
+        fprintf(stderr, "bench_port_new: malloc failure\n");
+        exit(5);
+        }
+    /* quiet noise on the inputs, a new value per port */
+    if (is_input)
+        for (i = 0; i < max_nframes; ++i)
+            {
+            noise_seed = noise_seed * 1103515245U + 12345U;
+            port->buffer[i] = ((int)(noise_seed >> 16 & 0x7FFF) - 0x4000) / 163840.0f;
+            }
+    return (jack_port_t *)port;
+    }
+
+/* The mixer modules call these by their libjack names and the definitions
+ * in the executable take precedence over those in the shared library.
+ */
+
+void *jack_port_get_buffer(jack_port_t *port, jack_nframes_t nframes)
+    {
+    return ((struct bench_port *)port)->buffer;
+    }
+
+jack_nframes_t jack_get_sample_rate(jack_client_t *client)
+    {
+    return sample_rate;
+    }
+
+jack_port_t *jack_port_register(jack_client_t *client, const char *port_name,
+                const char *port_type, unsigned long flags, unsigned long buffer_size)
+    {
+    return bench_port_new(flags & JackPortIsInput);
+    }
+
+const char **jack_get_ports(jack_client_t *client, const char *port_name_pattern,
+                const char *type_name_pattern, unsigned long flags)
+    {
+    return NULL;
+    }
+
+void jack_free(void *ptr)
+    {
+    free(ptr);
+    }
+
+int jack_set_port_connect_callback(jack_client_t *client, JackPortConnectCallback cb, void *arg)
+    {
+    return 0;
+    }
+
+uint32_t jack_midi_get_event_count(void *port_buffer)
+    {
+    return 0;
+    }
+
+int jack_midi_event_get(jack_midi_event_t *event, void *port_buffer, uint32_t event_index)
+    {
+    return ENODATA;
+    }
+
+static void bench_ports_init()
+    {
+    struct jack_ports *p = &g.port;
+    jack_port_t **inputs[] = {
+        &p->dsp_in_l, &p->dsp_in_r, &p->voip_in_l, &p->voip_in_r, &p->pl_in_l, &p->pl_in_r,
+        &p->pr_in_l, &p->pr_in_r, &p->pi_in_l, &p->pi_in_r, &p->pe_in_l, &p->pe_in_r,
+        &p->output_in_l, &p->output_in_r, NULL };
+
+    for (jack_port_t ***pp = bench_outputs; *pp; ++pp)
+        **pp = bench_port_new(FALSE);
+    p->midi_port = bench_port_new(FALSE);
+    for (jack_port_t ***pp = inputs; *pp; ++pp)
+        **pp = bench_port_new(TRUE);
+    }
+
+/* bench_command: feeds a key=value command to the mixer as the user interface would */
+static void bench_command(const char *fmt, ...)
+    {
+    char command[1024];
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(command, sizeof command, fmt, ap);
+    va_end(ap);
+    if (!(g.in = fmemopen(command, strlen(command), "r")) || !mixer_main())
+        {
+        fprintf(stderr, "bench_command: failed on %s", command);
+        exit(5);
+        }
+    fclose(g.in);
+    }
+
+static void bench_mixstats(int simple_mixer, int mixermode)
+    {
+    struct
+        {
+        struct mixer_frame_header header;
+        struct mixer_stats_frame f;
+        } frame;
+
+    memset(&frame, 0, sizeof frame);
+    frame.header.type = MF_MIXSTATS;
+    frame.header.length = sizeof frame.f;
+    frame.f.volume = frame.f.volume2 = 127;
+    frame.f.crossfade = 50;
+    frame.f.jinglesvolume1 = frame.f.jinglesvolume2 = 127;
+    frame.f.interludevol = 127;
+    frame.f.mixbackvol = frame.f.voipvol = 64;
+    frame.f.left_stream = frame.f.left_audio = frame.f.right_stream = frame.f.right_audio = 1;
+    frame.f.stream_monitor = 1;
+    frame.f.simple_mixer = simple_mixer;
+    frame.f.mixermode = mixermode;
+    frame.f.fadeout_f = 1;
+    frame.f.main_play = 1;
+    frame.f.left_pbspeed = frame.f.right_pbspeed = frame.f.inter_pbspeed = 1.0f;
+    frame.f.inter_stream = frame.f.inter_force = 1;
+
+    if (!(g.in = fmemopen(&frame, sizeof frame, "r")) || !mixer_main_binary())
+        {
+        fprintf(stderr, "bench_mixstats: the mixer rejected the frame\n");
+        exit(5);
+        }
+    fclose(g.in);
+    }
+
+/* bench_tone: writes a stereo test tone long enough to last the run */
+static void bench_tone(const char *pathname, int seconds)
+    {
+    SF_INFO sfinfo = { .samplerate = sample_rate, .channels = 2,
+                       .format = SF_FORMAT_WAV | SF_FORMAT_PCM_16 };
+    SNDFILE *sf;
+    float buffer[2048];
+    long i, n = (long)sample_rate * seconds;
+
+    if (!(sf = sf_open(pathname, SFM_WRITE, &sfinfo)))
+        {
+        fprintf(stderr, "bench_tone: failed to create %s\n", pathname);
+        exit(5);
+        }
+    for (i = 0; i < n; ++i)
+        {
+        buffer[i % 1024 * 2] = 0.3f * sinf(i * 6.283185307f * 441.0f / sample_rate);
+        buffer[i % 1024 * 2 + 1] = 0.3f * sinf(i * 6.283185307f * 659.0f / sample_rate);
+        if (i % 1024 == 1023 || i == n - 1)
+            sf_writef_float(sf, buffer, i % 1024 + 1);
+        }
+    sf_close(sf);
+    }
+
+/* bench_record: the per sample mixer's output for one period */
+static void bench_record(FILE *fp, jack_nframes_t nframes)
+    {
+    for (jack_port_t ***pp = bench_outputs; *pp; ++pp)
+        if (fwrite(((struct bench_port *)**pp)->buffer, sizeof (float), nframes, fp) != nframes)
+            {
+            fprintf(stderr, "bench_record: write failed\n");
+            exit(5);
+            }
+    }
+
+/* bench_verify: compare one period with the recording, returns the number of samples that differ */
+static unsigned long bench_verify(FILE *fp, jack_nframes_t nframes, unsigned period)
+    {
+    static float *ref;
+    unsigned long mismatches = 0;
+    jack_nframes_t i;
+    float *out;
+
+    if (!ref && !(ref = malloc(max_nframes * sizeof (float))))
+        {
+        fprintf(stderr, "bench_verify: malloc failure\n");
+        exit(5);
+        }
+    for (jack_port_t ***pp = bench_outputs; *pp; ++pp)
+        {
+        if (fread(ref, sizeof (float), nframes, fp) != nframes)
+            {
+            fprintf(stderr, "bench_verify: recording is short\n");
+            exit(5);
+            }
+        out = ((struct bench_port *)**pp)->buffer;
+        for (i = 0; i < nframes; ++i)
+            if (memcmp(out + i, ref + i, sizeof (float)))
+                {
+                if (!mismatches++)
+                    fprintf(stderr, "bench_verify: period %u output %d frame %u: %.9g per sample, %.9g block\n",
+                                period, (int)(pp - bench_outputs), i, ref[i], out[i]);
+                }
+        }
+    return mismatches;
+    }
+
+static int compare_double(const void *a, const void *b)
+    {
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+    }
+
+int main(int argc, char **argv)
+    {
+    jack_nframes_t nframes = 1024;
+    int n_effects = 0, n_mics = 0, mixermode = 0, simple_mixer = FALSE, block_mixer = TRUE;
+    int seconds = 10, paced = TRUE, verify = FALSE, opt, i, status;
+    unsigned periods, n;
+    unsigned long mismatches = 0;
+    char *pathname = NULL, tone[64], env[16], ref[64];
+    FILE *ref_fp = NULL;
+    pid_t child = 0;
+    double *cost, total = 0.0, period, start;
+    struct timespec next;
+    long period_ns;
+
+    while ((opt = getopt(argc, argv, "n:r:e:m:M:scVd:F")) != -1)
+        switch (opt)
+            {
+            case 'n':
+                nframes = atoi(optarg);
+                break;
+            case 'r':
+                sample_rate = atoi(optarg);
+                break;
+            case 'e':
+                n_effects = atoi(optarg);
+                break;
+            case 'm':
+                n_mics = atoi(optarg);
+                break;
+            case 'M':
+                mixermode = atoi(optarg);
+                break;
+            case 's':
+                simple_mixer = TRUE;
+                break;
+            case 'c':
+                block_mixer = FALSE;
+                break;
+            case 'V':
+                verify = TRUE;
+                break;
+            case 'd':
+                seconds = atoi(optarg);
+                break;
+            case 'F':
+                paced = FALSE;
+                break;
+            default:
+                goto usage;
+            }
+    if (optind < argc - 1 || nframes < 1 || sample_rate < 8000 || n_effects < 0 ||
+                n_mics < 0 || mixermode < 0 || mixermode > 2 || seconds < 1 ||
+                (verify && (simple_mixer || !block_mixer)))
+        goto usage;
+    if (optind == argc - 1)
+        pathname = argv[optind];
+
+    /* the same resources as the user interface sets up by default */
+    snprintf(env, sizeof env, "%d", n_effects > 24 ? n_effects : 24);
+    setenv("num_effects", env, 1);
+    snprintf(env, sizeof env, "%d", n_mics > 4 ? (n_mics + 1) & ~1 : 4);
+    setenv("mic_qty", env, 1);
+    setenv("pcm_cache_mb", "64", 0);
+    setenv("offline_render", "0", 0);
+    setenv("player_lookahead", "1", 0);
+
+    if (!pathname)
+        {
+        snprintf(tone, sizeof tone, "/tmp/mixer_bench_%d.wav", (int)getpid());
+        bench_tone(tone, seconds + 2);
+        pathname = tone;
+        }
+
+    /* the child makes the recording with the per sample code before the block mixer runs */
+    if (verify)
+        {
+        snprintf(ref, sizeof ref, "/tmp/mixer_bench_%d.ref", (int)getpid());
+        if ((child = fork()) < 0)
+            {
+            fprintf(stderr, "main: fork failed\n");
+            exit(5);
+            }
+        if (child)
+            {
+            if (waitpid(child, &status, 0) != child || !WIFEXITED(status) || WEXITSTATUS(status))
+                {
+                fprintf(stderr, "main: the per sample run failed\n");
+                exit(5);
+                }
+            }
+        else
+            block_mixer = FALSE;
+        if (!(ref_fp = fopen(ref, child ? "r" : "w")))
+            {
+            fprintf(stderr, "main: failed to open %s\n", ref);
+            exit(5);
+            }
+        }
+    setenv("block_mixer", block_mixer ? "1" : "0", 1);
+
+    max_nframes = nframes;
+    pthread_mutex_init(&g.avc_mutex, NULL);
+    if (!(g.out = fopen("/dev/null", "w")))
+        {
+        fprintf(stderr, "main: failed to open /dev/null\n");
+        exit(5);
+        }
+    bench_ports_init();
+    mixer_init();
+    mixer_new_buffer_size(nframes);
+    bench_mixstats(simple_mixer, mixermode);
+
+    bench_command("PLRP=%s\nSEEK=0\nSIZE=%d\nRGDB=0\nACTN=playleft\nend\n", pathname, seconds + 2);
+    bench_command("PLRP=%s\nSEEK=0\nSIZE=%d\nRGDB=0\nACTN=playright\nend\n", pathname, seconds + 2);
+    for (i = 0; i < n_effects; ++i)
+        bench_command("PLRP=%s\nRGDB=0\nEFCT=%d\nACTN=playeffect\nend\n", pathname, i);
+    for (i = 0; i < n_mics; ++i)
+        {
+        bench_command("INDX=%d\nAGCP=mode=2\nACTN=mic_control\nend\n", i);
+        bench_command("INDX=%d\nAGCP=open=1\nACTN=mic_control\nend\n", i);
+        }
+    if (n_mics)
+        bench_command("FLAG=1\nACTN=anymic\nend\n");
+
+    /* give the decoders a head start */
+    usleep(500000);
+
+    periods = (unsigned)((double)seconds * sample_rate / nframes);
+    period = (double)nframes / sample_rate;
+    period_ns = (long)(period * 1e9);
+    if (!(cost = malloc(periods * sizeof (double))))
+        {
+        fprintf(stderr, "main: malloc failure\n");
+        exit(5);
+        }
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for (n = 0; n < periods; ++n)
+        {
+        start = bench_now();
+        mixer_process_audio(nframes, NULL);
+        total += cost[n] = bench_now() - start;
+        if (verify)
+            {
+            if (child)
+                mismatches += bench_verify(ref_fp, nframes, n);
+            else
+                bench_record(ref_fp, nframes);
+            }
+
+        if (paced)
+            {
+            if ((next.tv_nsec += period_ns) >= 1000000000L)
+                {
+                next.tv_sec += next.tv_nsec / 1000000000L;
+                next.tv_nsec %= 1000000000L;
+                }
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL))
+                ;
+            }
+        }
+    if (verify && !child)
+        {
+        if (fclose(ref_fp))
+            {
+            fprintf(stderr, "main: failed writing %s\n", ref);
+            exit(5);
+            }
+        exit(0);
+        }
+    qsort(cost, periods, sizeof (double), compare_double);
+
+    printf("nframes: %u, sample rate: %u, period: %.3f ms\n", nframes, sample_rate, period * 1e3);
+    printf("mixer: %s, mode %d, effects playing: %d, mics open: %d, %s\n",
+                simple_mixer ? "simple" : (block_mixer ? "block" : "per sample"),
+                mixermode, n_effects, n_mics, paced ? "paced" : "back to back");
+    printf("callbacks: %u\n", periods);
+    printf("mean: %.1f ns/frame, %.2f%% of period\n", total / periods / nframes * 1e9, total / periods / period * 100.0);
+    printf("median: %.2f%%, 99th percentile: %.2f%%, worst: %.2f%% of period\n",
+                cost[periods / 2] / period * 100.0, cost[periods * 99 / 100] / period * 100.0,
+                cost[periods - 1] / period * 100.0);
+
+    if (verify)
+        {
+        printf("verify: %lu samples differ from the per sample mixer\n", mismatches);
+        fclose(ref_fp);
+        unlink(ref);
+        }
+
+    free(cost);
+    if (pathname == tone)
+        unlink(tone);
+    return mismatches ? 1 : 0;
+
+    usage:
+    fprintf(stderr, "usage: %s [-n nframes] [-r rate] [-e effects] [-m mics] [-M mixermode] [-s] [-c] [-V] [-d seconds] [-F] [file]\n", argv[0]);
+    return 5;
+    }
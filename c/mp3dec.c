@@ -53,12 +53,27 @@ static void mp3decode_eject(struct xlplayer *xlplayer)
     mp3_tag_cleanup(&self->taginfo);
     mpg123_close(self->mh);
     mpg123_delete(self->mh);
-    fclose(self->fp);
+    filesource_close(self->fs);
     free(self);
     fprintf(stderr, "finished eject\n");
     }
 
 
+static ssize_t mp3decode_read(void *iohandle, void *buf, size_t count)
+    {
+    struct filesource *fs = iohandle;
+    size_t bytes = filesource_read(fs, buf, count);
+
+    return (bytes == 0 && fs->error) ? -1 : (ssize_t)bytes;
+    }
+
+static off_t mp3decode_lseek(void *iohandle, off_t offset, int whence)
+    {
+    if (filesource_seek(iohandle, offset, whence))
+        return -1;
+    return filesource_tell(iohandle);
+    }
+
 static void mp3decode_init(struct xlplayer *xlplayer)
     {
     }
@@ -155,7 +170,8 @@ int mp3decode_reg(struct xlplayer *xlplayer)
     static pthread_once_t once_control = PTHREAD_ONCE_INIT;
     struct mp3decode_vars *self;
     struct chapter *chapter;
-    int fd, rv;
+    FILE *fp;
+    int rv;
     long rate;
     int channels, encoding;
     int src_error;
@@ -214,18 +230,23 @@ int mp3decode_reg(struct xlplayer *xlplayer)
     mpg123_format(self->mh, 11025, MPG123_STEREO, MPG123_ENC_FLOAT_32);
     mpg123_format(self->mh, 8000, MPG123_STEREO, MPG123_ENC_FLOAT_32);
 
-    if (!(self->fp = fopen(xlplayer->pathname, "r")))
+    if (!(self->fs = filesource_open(xlplayer->pathname)))
         {
         fprintf(stderr, "mp3decode_reg: failed to open %s\n", xlplayer->pathname);
         goto rej_;
         }
 
-    mp3_tag_read(&self->taginfo, self->fp);
-    lseek(fd = fileno(self->fp), 0, SEEK_SET);
+    if ((fp = filesource_stream(self->fs)))
+        {
+        mp3_tag_read(&self->taginfo, fp);
+        fclose(fp);
+        }
+    filesource_seek(self->fs, 0, SEEK_SET);
 
-    if ((rv = mpg123_open_fd(self->mh, fd)) != MPG123_OK)
+    if ((rv = mpg123_replace_reader_handle(self->mh, mp3decode_read, mp3decode_lseek, NULL)) != MPG123_OK ||
+                (rv = mpg123_open_handle(self->mh, self->fs)) != MPG123_OK)
         {
-        fprintf(stderr, "mp3decode_reg: mpg123_open_fd failed with return value %d\n", rv);
+        fprintf(stderr, "mp3decode_reg: mpg123_open_handle failed with return value %d\n", rv);
         goto rej__;
         }
         
@@ -288,7 +309,7 @@ int mp3decode_reg(struct xlplayer *xlplayer)
     mpg123_delete(self->mh);
     rej__:
     mp3_tag_cleanup(&self->taginfo);
-    fclose(self->fp);
+    filesource_close(self->fs);
     rej_:
     free(self);
     rej:
@@ -29,10 +29,11 @@
 
 #include "xlplayer.h"
 #include "mp3tagread.h"
+#include "filesource.h"
 
 struct mp3decode_vars
    {
-   FILE *fp;
+   struct filesource *fs;
    mpg123_handle *mh;
    struct mp3taginfo taginfo;
    struct chapter *current_chapter;
@@ -81,7 +81,7 @@ ogg_flacdec_write_resample_callback(const FLAC__StreamDecoder *dec, const FLAC__
         src_data->data_in = realloc(src_data->data_in, src_data->input_frames * frame->header.channels * sizeof (float));
         src_data->output_frames = ((int)(src_data->input_frames * src_data->src_ratio)) + 512;
         src_data->data_out = realloc(src_data->data_out, src_data->output_frames * frame->header.channels * sizeof (float));
-        make_flac_audio_to_float(xlplayer, src_data->data_in, inputbuffer, frame->header.blocksize, frame->header.bits_per_sample, frame->header.channels);
+        make_flac_audio_to_float(xlplayer, &self->conv, src_data->data_in, inputbuffer, frame->header.blocksize, frame->header.bits_per_sample, frame->header.channels);
 
         if ((src_error = src_process(xlplayer->src_state, src_data)))
             {
@@ -113,7 +113,7 @@ ogg_flacdec_write_callback(const FLAC__StreamDecoder *decoder, const FLAC__Frame
             return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
             }
 
-        make_flac_audio_to_float(xlplayer, self->flbuf, inputbuffer, frame->header.blocksize, frame->header.bits_per_sample, frame->header.channels);
+        make_flac_audio_to_float(xlplayer, &self->conv, self->flbuf, inputbuffer, frame->header.blocksize, frame->header.bits_per_sample, frame->header.channels);
         xlplayer_demux_channel_data(xlplayer, self->flbuf, frame->header.blocksize, frame->header.channels, 1.f);
         
         xlplayer_write_channel_data(xlplayer);
@@ -154,7 +154,7 @@ int ogg_flacdec_init(struct xlplayer *xlplayer)
         return REJECTED;
         }
 
-    fseeko(od->fp, od->bos_offset[od->ix], SEEK_SET);
+    filesource_seek(od->fs, od->bos_offset[od->ix], SEEK_SET);
 
     if (!(self->dec = FLAC__stream_decoder_new()))
         {
@@ -23,6 +23,7 @@
 
 #include <FLAC/all.h>
 #include "xlplayer.h"
+#include "pcmconv.h"
 
 struct oggflacdec_vars
     {
@@ -30,6 +31,7 @@ struct oggflacdec_vars
     int resample;
     int suppress_audio_output;
     float *flbuf;
+    struct pcmconv conv;   /* chosen on the first block */
     };
 
 int ogg_flacdec_init(struct xlplayer *xlplayer);
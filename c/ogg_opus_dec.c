@@ -190,7 +190,7 @@ int ogg_opusdec_init(struct xlplayer *xlplayer)
     fprintf(stderr, "ogg_opusdec_init was called\n");
 
     ogg_stream_reset_serialno(&od->os, od->serial[od->ix]);
-    fseeko(od->fp, od->bos_offset[od->ix], SEEK_SET);
+    filesource_seek(od->fs, od->bos_offset[od->ix], SEEK_SET);
     ogg_sync_reset(&od->oy);
 
     /* sanity checking was pre-done in opus_get_samplerate() */
@@ -192,7 +192,7 @@ int ogg_speexdec_init(struct xlplayer *xlplayer)
         }
 
     ogg_stream_reset_serialno(&od->os, od->serial[od->ix]);
-    fseeko(od->fp, od->bos_offset[od->ix], SEEK_SET);
+    filesource_seek(od->fs, od->bos_offset[od->ix], SEEK_SET);
     ogg_sync_reset(&od->oy);
 
     if (!(oggdec_get_next_packet(od) && ogg_stream_packetout(&od->os, &od->op) == 0 && (self->header = speex_packet_to_header((char *)od->op.packet, od->op.bytes))))
@@ -181,7 +181,7 @@ int ogg_vorbisdec_init(struct xlplayer *xlplayer)
         }
 
     ogg_stream_reset_serialno(&od->os, od->serial[od->ix]);
-    fseeko(od->fp, od->bos_offset[od->ix], SEEK_SET);
+    filesource_seek(od->fs, od->bos_offset[od->ix], SEEK_SET);
     ogg_sync_reset(&od->oy);
     
     vorbis_info_init(&self->vi);
@@ -30,10 +30,14 @@
 #include "ogg_flac_dec.h"
 #include "ogg_speex_dec.h"
 #include "vorbistagparse.h"
+#include "oggindex.h"
 
 #define ACCEPTED 1
 #define REJECTED 0
 
+#define SEEK_POINTS 256                 /* shared by all the streams in a file */
+#define SEEK_POINT_SPACING 65536        /* minimum bytes between seek points */
+
 int oggdec_get_next_packet(struct oggdec_vars *self)
     {
     char *buffer;
@@ -45,7 +49,7 @@ int oggdec_get_next_packet(struct oggdec_vars *self)
         while (ogg_sync_pageout(&self->oy, &self->og) != 1)
             {
             buffer = ogg_sync_buffer(&self->oy, 8192);
-            bytes = fread(buffer, 1, 8192, self->fp);
+            bytes = filesource_read(self->fs, buffer, 8192);
             ogg_sync_wrote(&self->oy, bytes);
             if (bytes == 0)
                 {
@@ -174,9 +178,9 @@ FLAC__StreamDecoderReadStatus oggflac_read_callback(const FLAC__StreamDecoder *d
     off_t bytes_remaining;
 
     if (self->ix == self->n_streams - 1)
-        bytes_remaining = self->eos_offset - ftello(self->fp);
+        bytes_remaining = self->eos_offset - filesource_tell(self->fs);
     else
-        bytes_remaining = self->bos_offset[self->ix + 1] - ftello(self->fp);
+        bytes_remaining = self->bos_offset[self->ix + 1] - filesource_tell(self->fs);
 
     if (bytes_remaining < 0 || *bytes <= 0)
         return FLAC__STREAM_DECODER_READ_STATUS_ABORT;
@@ -184,9 +188,9 @@ FLAC__StreamDecoderReadStatus oggflac_read_callback(const FLAC__StreamDecoder *d
     if (*bytes > (size_t)bytes_remaining)
         *bytes = bytes_remaining;
 
-    *bytes = fread(buffer, sizeof (FLAC__byte), *bytes, self->fp);
+    *bytes = filesource_read(self->fs, buffer, *bytes);
 
-    if (ferror(self->fp))
+    if (self->fs->error)
         return FLAC__STREAM_DECODER_READ_STATUS_ABORT;
         
     if (*bytes == 0)
@@ -213,7 +217,7 @@ FLAC__StreamDecoderSeekStatus oggflac_seek_callback(const FLAC__StreamDecoder *d
         return FLAC__STREAM_DECODER_SEEK_STATUS_ERROR;
         }
     
-    if (fseeko(self->fp, start_bound + (off_t)absolute_byte_offset, SEEK_SET) < 0)
+    if (filesource_seek(self->fs, start_bound + (off_t)absolute_byte_offset, SEEK_SET) < 0)
         {
         fprintf(stderr, "oggflac_seek_callback: seek error2\n");
         return FLAC__STREAM_DECODER_SEEK_STATUS_ERROR;
@@ -227,7 +231,7 @@ FLAC__StreamDecoderTellStatus oggflac_tell_callback(const FLAC__StreamDecoder *d
     struct oggdec_vars *self = client_data;
     off_t where;
     
-    where = ftello(self->fp);
+    where = filesource_tell(self->fs);
     
     if (where < self->bos_offset[self->ix])
         return FLAC__STREAM_DECODER_TELL_STATUS_ERROR;
@@ -264,7 +268,7 @@ FLAC__bool oggflac_eof_callback(const FLAC__StreamDecoder *decoder, void *client
     struct oggdec_vars *self = client_data;
     off_t offset;
 
-    offset = ftello(self->fp) + self->bos_offset[self->ix];
+    offset = filesource_tell(self->fs) + self->bos_offset[self->ix];
     if (self->ix == self->n_streams - 1)
         return offset >= self->eos_offset;
     else
@@ -694,7 +698,7 @@ static off_t oggscan_eos(struct oggdec_vars *self, off_t offset, off_t offset_en
         return -1;
         } 
 
-    fseeko(self->fp, midpoint, SEEK_SET);
+    filesource_seek(self->fs, midpoint, SEEK_SET);
     ogg_sync_reset(&self->oy);
 
     while ((retval = ogg_sync_pageseek(&self->oy, &self->og)) <= 0)
@@ -708,7 +712,7 @@ static off_t oggscan_eos(struct oggdec_vars *self, off_t offset, off_t offset_en
         else
             {
             buffer = ogg_sync_buffer(&self->oy, 8192);
-            bytes = fread(buffer, 1, 8192, self->fp);
+            bytes = filesource_read(self->fs, buffer, 8192);
             ogg_sync_wrote(&self->oy, bytes);
             if (bytes == 0)
                 {
@@ -785,7 +789,7 @@ static off_t oggscan(struct oggdec_vars *self, off_t *offset, off_t offset_end)
     int    serial;
     off_t  retval;
     
-    fseeko(self->fp, *offset, SEEK_SET);
+    filesource_seek(self->fs, *offset, SEEK_SET);
     
     ogg_sync_reset(&self->oy);
     while ((retval = ogg_sync_pageseek(&self->oy, &self->og)) <= 0 || ogg_page_bos(&self->og) == 0)
@@ -796,7 +800,7 @@ static off_t oggscan(struct oggdec_vars *self, off_t *offset, off_t offset_end)
             if (retval == 0)
                 {
                 buffer = ogg_sync_buffer(&self->oy, 8192);
-                bytes = fread(buffer, 1, 8192, self->fp);
+                bytes = filesource_read(self->fs, buffer, 8192);
                 ogg_sync_wrote(&self->oy, bytes);
                 if (bytes == 0)
                     return -1;     /* was offset_end */
@@ -809,10 +813,68 @@ static off_t oggscan(struct oggdec_vars *self, off_t *offset, off_t offset_end)
     return oggscan_eos(self, *offset, offset_end, serial, 0);
     }
 
+/* oggscan_seek_points: sample the granule position at even intervals through each stream */
+static void oggscan_seek_points(struct oggdec_vars *self)
+    {
+    struct oggdec_seek_point *sp;
+    off_t start, end, pos, total = self->eos_offset - self->bos_offset[0];
+    long retval;
+    char *buffer;
+    size_t bytes;
+    int i, j, n;
+
+    for (i = 0; i < self->n_streams; i++)
+        {
+        if (self->duration[i] == 0.0)
+            continue;
+        start = self->bos_offset[i];
+        end = (i == self->n_streams - 1) ? self->eos_offset : self->bos_offset[i + 1];
+        if ((n = (double)SEEK_POINTS * (end - start) / total) > (end - start) / SEEK_POINT_SPACING)
+            n = (end - start) / SEEK_POINT_SPACING;
+        if (n < 2 || !(sp = self->seek_points[i] = malloc(n * sizeof (struct oggdec_seek_point))))
+            continue;
+
+        for (j = 1; j < n; j++)
+            {
+            pos = start + (end - start) / n * j;
+            filesource_seek(self->fs, pos, SEEK_SET);
+            ogg_sync_reset(&self->oy);
+            while (pos < end)
+                {
+                if ((retval = ogg_sync_pageseek(&self->oy, &self->og)) < 0)
+                    pos -= retval;
+                else if (retval == 0)
+                    {
+                    buffer = ogg_sync_buffer(&self->oy, 8192);
+                    bytes = filesource_read(self->fs, buffer, 8192);
+                    ogg_sync_wrote(&self->oy, bytes);
+                    if (bytes == 0)
+                        break;
+                    }
+                else
+                    {
+                    /* the first page of this stream that completes a packet */
+                    if (ogg_page_serialno(&self->og) == self->serial[i] && ogg_page_granulepos(&self->og) >= 0)
+                        {
+                        if (!self->n_seek_points[i] || sp[self->n_seek_points[i] - 1].offset < pos)
+                            {
+                            sp[self->n_seek_points[i]].offset = pos;
+                            sp[self->n_seek_points[i]++].granulepos = ogg_page_granulepos(&self->og);
+                            }
+                        break;
+                        }
+                    pos += retval;
+                    }
+                }
+            }
+        }
+    }
+
 static struct oggdec_vars *oggdecode_get_metadata(char *pathname)
     {
     struct oggdec_vars *self;
     long   id3size = 0;
+    unsigned char id3[10];
     off_t  offset = 0, offset_end, offset_new;
     size_t bytes;
     char  *buffer;
@@ -830,7 +892,7 @@ static struct oggdec_vars *oggdecode_get_metadata(char *pathname)
     self->magic = 4747;
     
     /* open the media file */
-    if (!(self->fp = fopen(pathname, "r")))
+    if (!(self->fs = filesource_open(pathname)))
         {
         fprintf(stderr, "oggdecode_reg: unable to open media file %s\n", pathname);
         free(self);
@@ -838,24 +900,23 @@ static struct oggdec_vars *oggdecode_get_metadata(char *pathname)
         }
 
     /* jump past the ID3 version 2 tag if one is found */
-    if (fgetc(self->fp) == 'I' && fgetc(self->fp) == 'D' && fgetc(self->fp) == '3' && fgetc(self->fp) != '\xFF' && fgetc(self->fp) != '\xFF')
+    if (filesource_read(self->fs, id3, sizeof id3) == sizeof id3 && !memcmp(id3, "ID3", 3) && id3[3] != 0xFF && id3[4] != 0xFF)
         {
         fprintf(stderr, "ID3 tag detected\n");
-        fgetc(self->fp);
-        id3size =  fgetc(self->fp);
+        id3size = id3[6];
         id3size <<= 7;
-        id3size |= fgetc(self->fp);
+        id3size |= id3[7];
         id3size <<= 7;
-        id3size |= fgetc(self->fp);
+        id3size |= id3[8];
         id3size <<= 7;
-        id3size |= fgetc(self->fp);
+        id3size |= id3[9];
         offset += id3size;
         }
 
     if (ogg_sync_init(&self->oy))
         {
         fprintf(stderr, "oggdecode_reg: call to ogg_sync_init_failed\n");
-        fclose(self->fp);
+        filesource_close(self->fs);
         free(self);
         return NULL;
         }
@@ -864,13 +925,19 @@ static struct oggdec_vars *oggdecode_get_metadata(char *pathname)
         {
         fprintf(stderr, "oggdecode_reg: call to ogg_stream_init failed\n");
         ogg_sync_clear(&self->oy);
-        fclose(self->fp);
+        filesource_close(self->fs);
         free(self);
         return NULL;
         }
 
-    fseek(self->fp, 0, SEEK_END);
-    offset_end = self->eos_offset = ftello(self->fp);
+    offset_end = self->eos_offset = filesource_size(self->fs);
+
+    if (oggindex_load(self))
+        {
+        self->ix = self->n_streams;
+        fprintf(stderr, "total_duration   %lf (cached)\n", self->total_duration);
+        return self;
+        }
 
     while (offset < offset_end)
         {
@@ -885,12 +952,12 @@ static struct oggdec_vars *oggdecode_get_metadata(char *pathname)
     for (self->ix = i = 0; i < self->n_streams; i++, self->ix++)
         {
         ogg_stream_reset_serialno(&self->os, self->serial[i]);
-        fseeko(self->fp, self->bos_offset[i], SEEK_SET);
+        filesource_seek(self->fs, self->bos_offset[i], SEEK_SET);
         ogg_sync_reset(&self->oy);
         while (ogg_sync_pageout(&self->oy, &self->og) != 1)
             {
             buffer = ogg_sync_buffer(&self->oy, 8192);
-            bytes = fread(buffer, 1, 8192, self->fp);
+            bytes = filesource_read(self->fs, buffer, 8192);
             ogg_sync_wrote(&self->oy, bytes);
             }
 
@@ -909,7 +976,7 @@ static struct oggdec_vars *oggdecode_get_metadata(char *pathname)
             if (self->op.bytes >= 5 && !memcmp(self->op.packet, "\x7F""FLAC", 5))
                 {
                 self->streamtype[i] = ST_FLAC;
-                fseeko(self->fp, self->bos_offset[i], SEEK_SET);
+                filesource_seek(self->fs, self->bos_offset[i], SEEK_SET);
                 samplerate = flac_get_samplerate(self);
                 break;
                 }
@@ -968,6 +1035,17 @@ static struct oggdec_vars *oggdecode_get_metadata(char *pathname)
 #endif
         }
     fprintf(stderr, "total_duration   %lf\n", self->total_duration);
+
+    if (self->n_streams)
+        {
+        self->seek_points = calloc(self->n_streams, sizeof (struct oggdec_seek_point *));
+        self->n_seek_points = calloc(self->n_streams, sizeof (int));
+        if (self->seek_points && self->n_seek_points && oggindex_enabled())
+            {
+            oggscan_seek_points(self);
+            oggindex_save(self);
+            }
+        }
     return self;
     }
 
@@ -977,7 +1055,7 @@ static void oggdecode_free_metadata(struct oggdec_vars *self)
     
     ogg_stream_clear(&self->os);
     ogg_sync_clear(&self->oy);
-    fclose(self->fp);
+    filesource_close(self->fs);
     if (self->n_streams)
         {
         for (i = 0; i < self->n_streams; i++)
@@ -988,18 +1066,27 @@ static void oggdecode_free_metadata(struct oggdec_vars *self)
                 free(self->title[i]);
             if (self->album[i])
                 free(self->album[i]);
+            if (self->replaygain[i])
+                free(self->replaygain[i]);
+            if (self->seek_points)
+                free(self->seek_points[i]);
             }
             
         free(self->bos_offset);
         free(self->initial_granulepos);
         free(self->final_granulepos);
         free(self->serial);
+        free(self->samplerate);
+        free(self->channels);
         free(self->artist);
         free(self->title);
         free(self->album);
+        free(self->replaygain);
         free(self->streamtype);
         free(self->start_time);
         free(self->duration);
+        free(self->seek_points);
+        free(self->n_seek_points);
         }
     
     free(self);
@@ -1013,6 +1100,7 @@ void oggdecode_seek_to_packet(struct oggdec_vars *self)
     ogg_int64_t granulepos = 0;
     char *buffer;
     size_t bytes;
+    struct oggdec_seek_point *sp;
      
     start = self->bos_offset[self->ix];
     if (self->ix == self->n_streams - 1)
@@ -1021,10 +1109,23 @@ void oggdecode_seek_to_packet(struct oggdec_vars *self)
         end = self->bos_offset[self->ix + 1];
     target = self->seek_s * self->samplerate[self->ix];
 
+    /* the seek table brackets the target leaving a short bisection */
+    if (self->n_seek_points)
+        for (sp = self->seek_points[self->ix]; sp < self->seek_points[self->ix] + self->n_seek_points[self->ix]; sp++)
+            {
+            if (sp->granulepos - self->initial_granulepos[self->ix] < target)
+                start = sp->offset;
+            else
+                {
+                end = sp->offset;
+                break;
+                }
+            }
+
     while (start + 1 < end)
         {
         mid = (end - start) / 2 + start;
-        fseeko(self->fp, mid, SEEK_SET);
+        filesource_seek(self->fs, mid, SEEK_SET);
         ogg_sync_reset(&self->oy);
 
         for (;;)
@@ -1042,7 +1143,7 @@ void oggdecode_seek_to_packet(struct oggdec_vars *self)
                 else
                     {
                     buffer = ogg_sync_buffer(&self->oy, 8192);
-                    bytes = fread(buffer, 1, 8192, self->fp);
+                    bytes = filesource_read(self->fs, buffer, 8192);
                     ogg_sync_wrote(&self->oy, bytes);
                     if (bytes == 0)
                         {
@@ -1192,6 +1293,14 @@ void oggdecode_playnext(struct xlplayer *xlplayer)
     xlplayer->dec_play = oggdecode_dynamic_dispatcher;
     }
 
+/* oggdecode_rebind: a decoder readied by the look-ahead moves to its player */
+static void oggdecode_rebind(struct xlplayer *xlplayer)
+    {
+    struct oggdec_vars *self = xlplayer->dec_data;
+
+    self->xlplayer = xlplayer;
+    }
+
 int oggdecode_reg(struct xlplayer *xlplayer)
     {
     struct oggdec_vars *self;
@@ -1205,6 +1314,7 @@ int oggdecode_reg(struct xlplayer *xlplayer)
         xlplayer->dec_init = oggdecode_init;
         xlplayer->dec_play = oggdecode_dynamic_dispatcher;
         xlplayer->dec_eject = oggdecode_eject;
+        xlplayer->dec_rebind = oggdecode_rebind;
         
         return ACCEPTED;
         }
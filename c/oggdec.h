@@ -20,13 +20,21 @@
 #include "../config.h"
 #include <ogg/ogg.h>
 #include "xlplayer.h"
+#include "filesource.h"
 
 enum streamtype_t { ST_UNHANDLED, ST_VORBIS, ST_FLAC, ST_SPEEX, ST_OPUS };
 
+/* a page start and its granule position, for narrowing the seek bisection */
+struct oggdec_seek_point
+    {
+    off_t offset;
+    ogg_int64_t granulepos;
+    };
+
 struct oggdec_vars
     {
     int magic;              /* 4545 */
-    FILE  *fp;              /* file handle */
+    struct filesource *fs;  /* file handle */
     double seek_s;          /* time offset for first stream to be played */
     void *dec_data;         /* decoder state variables live here */
     void (*dec_cleanup)(struct xlplayer *xlplayer); /* decoder cleanup function */
@@ -56,6 +64,8 @@ struct oggdec_vars
     enum streamtype_t *streamtype;    /* indicate which type ie vorbis, flac */
     double *start_time;      /* the time when each stream starts */
     double *duration;        /* playback time */
+    struct oggdec_seek_point **seek_points; /* coarse seek table per stream, may be empty */
+    int    *n_seek_points;
     int     n_streams;       /* number of logical streams found */
     int     ix;              /* index of the stream of interest */
     off_t   eos_offset;      /* offset to the end of file */
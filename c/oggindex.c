@@ -0,0 +1,423 @@
+/*
+#   oggindex.c: persistent cache of the structure of Ogg files
+#   Copyright (C) 2013 Stephen Fairchild (s-fairchild@users.sf.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "gnusource.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <limits.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "oggdec.h"
+#include "oggindex.h"
+
+#define TRUE 1
+#define FALSE 0
+
+#define OGGINDEX_MAGIC "IDJCOGI2"
+#define OGGINDEX_MAX_BYTES (16 << 20)
+/* beyond this many entries the least recently used quarter is deleted */
+#define OGGINDEX_MAX_ENTRIES 4096
+
+/* The entry is the header, then for each stream an oggindex_stream followed
+ * by its seek points and its four tag strings. The layout field rejects an
+ * entry written by a build with differently sized records.
+ */
+
+struct oggindex_header
+    {
+    char magic[8];
+    uint32_t layout;
+    uint32_t n_streams;
+    uint64_t dev;
+    uint64_t ino;
+    int64_t size;
+    int64_t mtime_s;
+    int64_t mtime_ns;
+    int64_t eos_offset;
+    double total_duration;
+    };
+
+struct oggindex_stream
+    {
+    int64_t bos_offset;
+    double start_time;
+    double duration;
+    uint32_t initial_granulepos;
+    uint32_t final_granulepos;
+    int32_t serial;
+    uint32_t samplerate;
+    int32_t channels;
+    int32_t streamtype;
+    uint32_t n_seek_points;
+    uint32_t text_bytes;        /* artist, title, album, replaygain each nul terminated */
+    uint32_t tags_set;          /* bits for those of the four that were not NULL */
+    };
+
+struct oggindex_point
+    {
+    int64_t offset;
+    int64_t granulepos;
+    };
+
+#define OGGINDEX_LAYOUT (sizeof (struct oggindex_header) << 16 | sizeof (struct oggindex_stream) << 8 | sizeof (struct oggindex_point))
+
+int oggindex_enabled()
+    {
+    char *dir = getenv("ogg_index_dir");
+
+    return dir && *dir;
+    }
+
+/* oggindex_key: the header an entry for this file must have and where it is kept */
+static int oggindex_key(struct oggdec_vars *self, struct oggindex_header *h, char *pathname, size_t n)
+    {
+    struct stat st;
+    char *dir = getenv("ogg_index_dir");
+
+    if (!dir || !*dir || fstat(self->fs->fd, &st))
+        return FALSE;
+
+    memset(h, 0, sizeof (struct oggindex_header));
+    memcpy(h->magic, OGGINDEX_MAGIC, sizeof h->magic);
+    h->layout = OGGINDEX_LAYOUT;
+    h->dev = st.st_dev;
+    h->ino = st.st_ino;
+    h->size = st.st_size;
+    h->mtime_s = st.st_mtim.tv_sec;
+    h->mtime_ns = st.st_mtim.tv_nsec;
+    snprintf(pathname, n, "%s/%llx-%llx", dir, (unsigned long long)h->dev, (unsigned long long)h->ino);
+    return TRUE;
+    }
+
+static void oggindex_discard(struct oggdec_vars *self)
+    {
+    /* the arrays may be partly allocated */
+    for (int i = 0; i < self->n_streams; ++i)
+        {
+        if (self->artist)
+            free(self->artist[i]);
+        if (self->title)
+            free(self->title[i]);
+        if (self->album)
+            free(self->album[i]);
+        if (self->replaygain)
+            free(self->replaygain[i]);
+        if (self->seek_points)
+            free(self->seek_points[i]);
+        }
+    free(self->bos_offset);
+    free(self->initial_granulepos);
+    free(self->final_granulepos);
+    free(self->serial);
+    free(self->samplerate);
+    free(self->channels);
+    free(self->artist);
+    free(self->title);
+    free(self->album);
+    free(self->replaygain);
+    free(self->streamtype);
+    free(self->start_time);
+    free(self->duration);
+    free(self->seek_points);
+    free(self->n_seek_points);
+    self->bos_offset = NULL;
+    self->initial_granulepos = self->final_granulepos = self->samplerate = NULL;
+    self->serial = self->channels = self->n_seek_points = NULL;
+    self->artist = self->title = self->album = self->replaygain = NULL;
+    self->streamtype = NULL;
+    self->start_time = self->duration = NULL;
+    self->seek_points = NULL;
+    self->n_streams = 0;
+    self->total_duration = 0.0;
+    }
+
+/* oggindex_string: take a nul terminated string from the entry, an unset tag
+ * is skipped over and left NULL
+ */
+static int oggindex_string(char **p, char *end, int set, char **s)
+    {
+    char *nul;
+
+    if (!(nul = memchr(*p, '\0', end - *p)) || (set && !(*s = strdup(*p))))
+        return FALSE;
+    *p = nul + 1;
+    return TRUE;
+    }
+
+int oggindex_load(struct oggdec_vars *self)
+    {
+    struct oggindex_header key, *h;
+    struct oggindex_stream st;
+    struct oggindex_point pt;
+    char pathname[PATH_MAX], *data = NULL, *p, *end, *text_end;
+    struct stat sb;
+    int fd, n;
+
+    if (!oggindex_key(self, &key, pathname, sizeof pathname))
+        return FALSE;
+    if ((fd = open(pathname, O_RDONLY)) < 0)
+        return FALSE;
+    if (fstat(fd, &sb) || sb.st_size < (off_t)sizeof key || sb.st_size > OGGINDEX_MAX_BYTES ||
+                !(data = malloc(sb.st_size)) || read(fd, data, sb.st_size) != sb.st_size)
+        {
+        close(fd);
+        free(data);
+        return FALSE;
+        }
+    /* the modification time of the entry is when it was last used */
+    futimens(fd, NULL);
+    close(fd);
+
+    h = (struct oggindex_header *)data;
+    if (memcmp(h->magic, key.magic, sizeof key.magic) || h->layout != key.layout || h->dev != key.dev ||
+                h->ino != key.ino || h->size != key.size || h->mtime_s != key.mtime_s ||
+                h->mtime_ns != key.mtime_ns || h->n_streams == 0 || h->n_streams > 65536)
+        {
+        free(data);
+        return FALSE;
+        }
+
+    n = h->n_streams;
+    if (!(self->bos_offset = calloc(n, sizeof (off_t))) ||
+                !(self->initial_granulepos = calloc(n, sizeof (unsigned))) ||
+                !(self->final_granulepos = calloc(n, sizeof (unsigned))) ||
+                !(self->serial = calloc(n, sizeof (int))) ||
+                !(self->samplerate = calloc(n, sizeof (unsigned))) ||
+                !(self->channels = calloc(n, sizeof (int))) ||
+                !(self->artist = calloc(n, sizeof (char *))) ||
+                !(self->title = calloc(n, sizeof (char *))) ||
+                !(self->album = calloc(n, sizeof (char *))) ||
+                !(self->replaygain = calloc(n, sizeof (char *))) ||
+                !(self->streamtype = calloc(n, sizeof (enum streamtype_t))) ||
+                !(self->start_time = calloc(n, sizeof (double))) ||
+                !(self->duration = calloc(n, sizeof (double))) ||
+                !(self->seek_points = calloc(n, sizeof (struct oggdec_seek_point *))) ||
+                !(self->n_seek_points = calloc(n, sizeof (int))))
+        {
+        fprintf(stderr, "oggindex_load: malloc failure\n");
+        goto fail;
+        }
+    self->n_streams = n;
+    self->eos_offset = h->eos_offset;
+    self->total_duration = h->total_duration;
+
+    p = data + sizeof (struct oggindex_header);
+    end = data + sb.st_size;
+    for (int i = 0; i < n; ++i)
+        {
+        if (end - p < (ptrdiff_t)sizeof st)
+            goto fail;
+        memcpy(&st, p, sizeof st);
+        p += sizeof st;
+        self->bos_offset[i] = st.bos_offset;
+        self->start_time[i] = st.start_time;
+        self->duration[i] = st.duration;
+        self->initial_granulepos[i] = st.initial_granulepos;
+        self->final_granulepos[i] = st.final_granulepos;
+        self->serial[i] = st.serial;
+        self->samplerate[i] = st.samplerate;
+        self->channels[i] = st.channels;
+        self->streamtype[i] = st.streamtype;
+
+        if (st.n_seek_points)
+            {
+            if ((size_t)(end - p) / sizeof pt < st.n_seek_points ||
+                        !(self->seek_points[i] = malloc(st.n_seek_points * sizeof (struct oggdec_seek_point))))
+                goto fail;
+            for (unsigned j = 0; j < st.n_seek_points; ++j)
+                {
+                memcpy(&pt, p, sizeof pt);
+                p += sizeof pt;
+                self->seek_points[i][j].offset = pt.offset;
+                self->seek_points[i][j].granulepos = pt.granulepos;
+                }
+            self->n_seek_points[i] = st.n_seek_points;
+            }
+
+        if ((size_t)(end - p) < st.text_bytes)
+            goto fail;
+        text_end = p + st.text_bytes;
+        if (!oggindex_string(&p, text_end, st.tags_set & 1, &self->artist[i]) ||
+                    !oggindex_string(&p, text_end, st.tags_set & 2, &self->title[i]) ||
+                    !oggindex_string(&p, text_end, st.tags_set & 4, &self->album[i]) ||
+                    !oggindex_string(&p, text_end, st.tags_set & 8, &self->replaygain[i]))
+            goto fail;
+        p = text_end;
+        }
+
+    free(data);
+    return TRUE;
+
+    fail:
+    fprintf(stderr, "oggindex_load: discarding entry %s\n", pathname);
+    self->n_streams = n;
+    oggindex_discard(self);
+    free(data);
+    unlink(pathname);
+    return FALSE;
+    }
+
+/* oggindex_write_string: with the nul, an unset tag is written as empty and
+ * told apart by tags_set */
+static void oggindex_write_string(FILE *fp, char *s)
+    {
+    if (!s)
+        s = "";
+    fwrite(s, 1, strlen(s) + 1, fp);
+    }
+
+struct oggindex_age
+    {
+    char *name;
+    time_t mtime;
+    };
+
+static int oggindex_age_cmp(const void *a, const void *b)
+    {
+    time_t ta = ((const struct oggindex_age *)a)->mtime;
+    time_t tb = ((const struct oggindex_age *)b)->mtime;
+
+    return (ta > tb) - (ta < tb);
+    }
+
+/* oggindex_prune: an entry outlives the file it describes when that is
+ * deleted or replaced so the least recently used are removed once there are
+ * too many
+ */
+static void oggindex_prune(char *dir)
+    {
+    DIR *dp;
+    struct dirent *de;
+    struct stat st;
+    struct oggindex_age *ages = NULL, *new_ages;
+    size_t n = 0, size = 0;
+    int dfd;
+
+    if (!(dp = opendir(dir)))
+        return;
+    dfd = dirfd(dp);
+    while ((de = readdir(dp)))
+        {
+        if (de->d_name[0] == '.' || fstatat(dfd, de->d_name, &st, AT_SYMLINK_NOFOLLOW) || !S_ISREG(st.st_mode))
+            continue;
+        if (n == size)
+            {
+            if (!(new_ages = realloc(ages, (size = size ? size * 2 : 256) * sizeof (struct oggindex_age))))
+                goto done;
+            ages = new_ages;
+            }
+        if (!(ages[n].name = strdup(de->d_name)))
+            goto done;
+        ages[n++].mtime = st.st_mtime;
+        }
+
+    if (n > OGGINDEX_MAX_ENTRIES)
+        {
+        qsort(ages, n, sizeof (struct oggindex_age), oggindex_age_cmp);
+        for (size_t i = 0; i < n - OGGINDEX_MAX_ENTRIES * 3 / 4; ++i)
+            unlinkat(dfd, ages[i].name, 0);
+        fprintf(stderr, "oggindex_prune: removed %zu unused entries\n", n - OGGINDEX_MAX_ENTRIES * 3 / 4);
+        }
+
+    done:
+    for (size_t i = 0; i < n; ++i)
+        free(ages[i].name);
+    free(ages);
+    closedir(dp);
+    }
+
+void oggindex_save(struct oggdec_vars *self)
+    {
+    struct oggindex_header h;
+    struct oggindex_stream st;
+    struct oggindex_point pt;
+    char pathname[PATH_MAX], tmpname[PATH_MAX + 8], *dir = getenv("ogg_index_dir");
+    FILE *fp;
+    int fd;
+
+    if (!self->n_streams || !oggindex_key(self, &h, pathname, sizeof pathname))
+        return;
+    h.n_streams = self->n_streams;
+    h.eos_offset = self->eos_offset;
+    h.total_duration = self->total_duration;
+
+    /* written in full elsewhere then renamed so a reader never sees half an entry */
+    snprintf(tmpname, sizeof tmpname, "%s.XXXXXX", pathname);
+    if ((fd = mkstemp(tmpname)) < 0 && errno == ENOENT && !mkdir(dir, S_IRWXU))
+        {
+        snprintf(tmpname, sizeof tmpname, "%s.XXXXXX", pathname);
+        fd = mkstemp(tmpname);
+        }
+    if (fd < 0)
+        {
+        fprintf(stderr, "oggindex_save: failed to create an entry in %s: %s\n", dir, strerror(errno));
+        return;
+        }
+    if (!(fp = fdopen(fd, "w")))
+        {
+        close(fd);
+        unlink(tmpname);
+        return;
+        }
+
+    fwrite(&h, sizeof h, 1, fp);
+    for (int i = 0; i < self->n_streams; ++i)
+        {
+        memset(&st, 0, sizeof st);
+        st.bos_offset = self->bos_offset[i];
+        st.start_time = self->start_time[i];
+        st.duration = self->duration[i];
+        st.initial_granulepos = self->initial_granulepos[i];
+        st.final_granulepos = self->final_granulepos[i];
+        st.serial = self->serial[i];
+        st.samplerate = self->samplerate[i];
+        st.channels = self->channels[i];
+        st.streamtype = self->streamtype[i];
+        st.n_seek_points = self->n_seek_points ? self->n_seek_points[i] : 0;
+        st.tags_set = (self->artist[i] ? 1 : 0) | (self->title[i] ? 2 : 0) |
+                    (self->album[i] ? 4 : 0) | (self->replaygain[i] ? 8 : 0);
+        st.text_bytes = strlen(self->artist[i] ? self->artist[i] : "") + strlen(self->title[i] ? self->title[i] : "") +
+                    strlen(self->album[i] ? self->album[i] : "") + strlen(self->replaygain[i] ? self->replaygain[i] : "") + 4;
+        fwrite(&st, sizeof st, 1, fp);
+        for (unsigned j = 0; j < st.n_seek_points; ++j)
+            {
+            pt.offset = self->seek_points[i][j].offset;
+            pt.granulepos = self->seek_points[i][j].granulepos;
+            fwrite(&pt, sizeof pt, 1, fp);
+            }
+        oggindex_write_string(fp, self->artist[i]);
+        oggindex_write_string(fp, self->title[i]);
+        oggindex_write_string(fp, self->album[i]);
+        oggindex_write_string(fp, self->replaygain[i]);
+        }
+
+    if (ferror(fp) | fclose(fp) || rename(tmpname, pathname))
+        {
+        fprintf(stderr, "oggindex_save: failed to write %s\n", pathname);
+        unlink(tmpname);
+        }
+    else
+        oggindex_prune(dir);
+    }
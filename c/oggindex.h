@@ -0,0 +1,44 @@
+/*
+#   oggindex.h: persistent cache of the structure of Ogg files
+#   Copyright (C) 2013 Stephen Fairchild (s-fairchild@users.sf.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef OGGINDEX_H
+#define OGGINDEX_H
+
+struct oggdec_vars;
+
+/* What oggdecode_get_metadata learns about a file, the logical streams with
+ * their tags and a coarse seek table, is saved in the directory named by the
+ * environment variable ogg_index_dir, one file per device and inode. An entry
+ * is used only while the size and modification time of the file still match
+ * and the least recently used entries are removed when there are too many.
+ * With ogg_index_dir empty or unset there is no cache.
+ */
+
+/* oggindex_enabled: whether a table built now would be kept */
+int oggindex_enabled();
+
+/* oggindex_load: fill in the stream table of self from the cache
+ * returns 1 on success, 0 if there is no valid entry
+ */
+int oggindex_load(struct oggdec_vars *self);
+
+/* oggindex_save: cache the stream table of self, failure is not reported */
+void oggindex_save(struct oggdec_vars *self);
+
+#endif /* OGGINDEX_H */
@@ -0,0 +1,317 @@
+/*
+#   pcmcache.c: in memory cache of decoded audio for the effects players
+#   Copyright (C) 2013 Stephen Fairchild (s-fairchild@users.sf.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "pcmcache.h"
+
+#define TRUE 1
+#define FALSE 0
+#define ACCEPTED 1
+#define REJECTED 0
+
+/* frames handed to the player ringbuffer per dec_play call */
+static const size_t pcmcache_frameqty = 2048;
+
+static struct pcmcache_entry *head, *tail;
+static size_t budget;                    /* bytes */
+static size_t total;                     /* bytes held by entries in the list */
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static size_t pcmcache_entry_bytes(struct pcmcache_entry *entry)
+    {
+    return entry->capacity * 2 * sizeof (float);
+    }
+
+static void pcmcache_entry_free(struct pcmcache_entry *entry)
+    {
+    free(entry->pathname);
+    free(entry->left);
+    free(entry->right);
+    free(entry);
+    }
+
+/* the entry is linked when it is in the lru list or the list has just the one entry */
+static int pcmcache_linked(struct pcmcache_entry *entry)
+    {
+    return entry->prev || entry->next || head == entry;
+    }
+
+/* pcmcache_unlink: remove from the list, freeing the entry if no player is using it */
+static void pcmcache_unlink(struct pcmcache_entry *entry)
+    {
+    if (entry->prev)
+        entry->prev->next = entry->next;
+    else
+        head = entry->next;
+    if (entry->next)
+        entry->next->prev = entry->prev;
+    else
+        tail = entry->prev;
+    entry->prev = entry->next = NULL;
+    total -= pcmcache_entry_bytes(entry);
+    if (!entry->refcount)
+        pcmcache_entry_free(entry);
+    }
+
+static void pcmcache_link_head(struct pcmcache_entry *entry)
+    {
+    entry->prev = NULL;
+    if ((entry->next = head))
+        head->prev = entry;
+    else
+        tail = entry;
+    head = entry;
+    }
+
+/* pcmcache_evict: drop least recently used entries until within budget */
+static void pcmcache_evict()
+    {
+    struct pcmcache_entry *entry, *prev;
+
+    for (entry = tail; entry && total > budget; entry = prev)
+        {
+        prev = entry->prev;
+        if (!entry->refcount)
+            {
+            fprintf(stderr, "pcmcache_evict: %s\n", entry->pathname);
+            pcmcache_unlink(entry);
+            }
+        }
+    }
+
+static struct pcmcache_entry *pcmcache_lookup(char *pathname, float gain)
+    {
+    struct pcmcache_entry *entry;
+    struct stat st;
+
+    if (!budget || stat(pathname, &st))
+        return NULL;
+
+    pthread_mutex_lock(&cache_mutex);
+    for (entry = head; entry; entry = entry->next)
+        if (entry->gain == gain && !strcmp(entry->pathname, pathname))
+            break;
+    if (entry)
+        {
+        if (entry->mtime != st.st_mtime)
+            {
+            /* the file has changed since it was cached */
+            pcmcache_unlink(entry);
+            entry = NULL;
+            }
+        else
+            {
+            entry->refcount++;
+            if (entry != head)
+                {
+                entry->prev->next = entry->next;
+                if (entry->next)
+                    entry->next->prev = entry->prev;
+                else
+                    tail = entry->prev;
+                pcmcache_link_head(entry);
+                }
+            }
+        }
+    pthread_mutex_unlock(&cache_mutex);
+    return entry;
+    }
+
+static void pcmcache_release(struct pcmcache_entry *entry)
+    {
+    pthread_mutex_lock(&cache_mutex);
+    if (!--entry->refcount && !pcmcache_linked(entry))
+        pcmcache_entry_free(entry);
+    pthread_mutex_unlock(&cache_mutex);
+    }
+
+void pcmcache_init(size_t budget_bytes)
+    {
+    budget = budget_bytes;
+    fprintf(stderr, "pcmcache_init: budget of %lu bytes\n", (unsigned long)budget);
+    }
+
+void pcmcache_cleanup()
+    {
+    pthread_mutex_lock(&cache_mutex);
+    while (head)
+        pcmcache_unlink(head);
+    pthread_mutex_unlock(&cache_mutex);
+    }
+
+struct pcmcache_entry *pcmcache_capture_begin(char *pathname, float gain)
+    {
+    struct pcmcache_entry *entry;
+    struct stat st;
+
+    if (!budget || stat(pathname, &st))
+        return NULL;
+
+    if (!(entry = calloc(1, sizeof (struct pcmcache_entry))) || !(entry->pathname = strdup(pathname)))
+        {
+        fprintf(stderr, "pcmcache_capture_begin: malloc failure\n");
+        free(entry);
+        return NULL;
+        }
+    entry->mtime = st.st_mtime;
+    entry->gain = gain;
+    return entry;
+    }
+
+/* pcmcache_capture_append: returns FALSE when the capture has to be abandoned */
+int pcmcache_capture_append(struct pcmcache_entry *entry, float *left, float *right, size_t n_frames)
+    {
+    size_t capacity;
+    float *l, *r;
+
+    if (entry->n_frames + n_frames > entry->capacity)
+        {
+        capacity = entry->capacity ? entry->capacity * 2 : 65536;
+        while (capacity < entry->n_frames + n_frames)
+            capacity *= 2;
+        /* no single file is allowed more than half of the budget */
+        if ((entry->n_frames + n_frames) * 2 * sizeof (float) > budget / 2)
+            return FALSE;
+        if (!(l = realloc(entry->left, capacity * sizeof (float))))
+            return FALSE;
+        entry->left = l;
+        if (!(r = realloc(entry->right, capacity * sizeof (float))))
+            return FALSE;
+        entry->right = r;
+        entry->capacity = capacity;
+        }
+
+    memcpy(entry->left + entry->n_frames, left, n_frames * sizeof (float));
+    memcpy(entry->right + entry->n_frames, right, n_frames * sizeof (float));
+    entry->n_frames += n_frames;
+    return TRUE;
+    }
+
+void pcmcache_capture_commit(struct pcmcache_entry *entry)
+    {
+    struct pcmcache_entry *iter;
+    float *l, *r;
+
+    if (!entry->n_frames)
+        {
+        pcmcache_capture_abandon(entry);
+        return;
+        }
+
+    /* give back the growth slack */
+    if ((l = realloc(entry->left, entry->n_frames * sizeof (float))))
+        entry->left = l;
+    if ((r = realloc(entry->right, entry->n_frames * sizeof (float))))
+        entry->right = r;
+    if (l && r)
+        entry->capacity = entry->n_frames;
+
+    pthread_mutex_lock(&cache_mutex);
+    for (iter = head; iter; iter = iter->next)
+        if (iter->gain == entry->gain && !strcmp(iter->pathname, entry->pathname))
+            {
+            pcmcache_unlink(iter);
+            break;
+            }
+    pcmcache_link_head(entry);
+    total += pcmcache_entry_bytes(entry);
+    pcmcache_evict();
+    fprintf(stderr, "pcmcache_capture_commit: cached %s, %lu frames, %lu of %lu bytes in use\n",
+                entry->pathname, (unsigned long)entry->n_frames, (unsigned long)total, (unsigned long)budget);
+    pthread_mutex_unlock(&cache_mutex);
+    }
+
+void pcmcache_capture_abandon(struct pcmcache_entry *entry)
+    {
+    pcmcache_entry_free(entry);
+    }
+
+static void pcmcache_dec_play(struct xlplayer *xlplayer);
+
+/* the first block goes into the ringbuffer before xlplayer_play returns so
+ * a cached effect is audible on the next JACK period, a look-ahead decoder
+ * has no ringbuffer and its output is held back regardless
+ */
+static void pcmcache_dec_init(struct xlplayer *xlplayer)
+    {
+    if (xlplayer->lookahead.staging || jack_ringbuffer_write_space(xlplayer->right_ch) >= pcmcache_frameqty * sizeof (float))
+        pcmcache_dec_play(xlplayer);
+    }
+
+static void pcmcache_dec_play(struct xlplayer *xlplayer)
+    {
+    struct pcmcache_vars *self = xlplayer->dec_data;
+    struct pcmcache_entry *entry = self->entry;
+    size_t n;
+
+    if ((n = entry->n_frames - self->pos) == 0)
+        {
+        xlplayer->playmode = PM_FLUSH;
+        return;
+        }
+    if (n > pcmcache_frameqty)
+        n = pcmcache_frameqty;
+
+    xlplayer->op_buffersize = n * sizeof (float);
+    if (!(xlplayer->leftbuffer = realloc(xlplayer->leftbuffer, xlplayer->op_buffersize)) ||
+                !(xlplayer->rightbuffer = realloc(xlplayer->rightbuffer, xlplayer->op_buffersize)))
+        {
+        fprintf(stderr, "pcmcache_dec_play: malloc failure\n");
+        exit(5);
+        }
+    memcpy(xlplayer->leftbuffer, entry->left + self->pos, xlplayer->op_buffersize);
+    memcpy(xlplayer->rightbuffer, entry->right + self->pos, xlplayer->op_buffersize);
+    self->pos += n;
+    xlplayer_write_channel_data(xlplayer);
+    }
+
+static void pcmcache_dec_eject(struct xlplayer *xlplayer)
+    {
+    struct pcmcache_vars *self = xlplayer->dec_data;
+
+    pcmcache_release(self->entry);
+    free(self);
+    }
+
+int pcmcache_reg(struct xlplayer *xlplayer)
+    {
+    struct pcmcache_vars *self;
+    struct pcmcache_entry *entry;
+
+    if (xlplayer->seek_s || !(entry = pcmcache_lookup(xlplayer->pathname, xlplayer->gain)))
+        return REJECTED;
+
+    if (!(xlplayer->dec_data = self = calloc(1, sizeof (struct pcmcache_vars))))
+        {
+        fprintf(stderr, "pcmcache_reg: malloc failure\n");
+        pcmcache_release(entry);
+        return REJECTED;
+        }
+    self->entry = entry;
+    xlplayer->dec_init = pcmcache_dec_init;
+    xlplayer->dec_play = pcmcache_dec_play;
+    xlplayer->dec_eject = pcmcache_dec_eject;
+    return ACCEPTED;
+    }
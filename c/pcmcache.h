@@ -0,0 +1,66 @@
+/*
+#   pcmcache.h: in memory cache of decoded audio for the effects players
+#   Copyright (C) 2013 Stephen Fairchild (s-fairchild@users.sf.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PCMCACHE_H
+#define PCMCACHE_H
+
+#include <time.h>
+#include "xlplayer.h"
+
+/* The first complete play of a file is captured as it is written to the
+ * player ringbuffers, which is after resampling, gain and fade-in, and is
+ * keyed on pathname, modification time and gain. Later plays of the same
+ * file copy straight out of memory with no decoder involved. Entries are
+ * evicted least recently used first to keep within the memory budget.
+ */
+
+struct pcmcache_entry
+    {
+    struct pcmcache_entry *prev;         /* lru list, most recently used first */
+    struct pcmcache_entry *next;
+    char *pathname;
+    time_t mtime;
+    float gain;
+    size_t n_frames;
+    size_t capacity;                     /* frames allocated */
+    float *left;
+    float *right;
+    int refcount;                        /* players reading from this entry */
+    };
+
+struct pcmcache_vars
+    {
+    struct pcmcache_entry *entry;
+    size_t pos;                          /* next frame to play */
+    };
+
+/* pcmcache_init: budget is in bytes, zero disables the cache */
+void pcmcache_init(size_t budget);
+void pcmcache_cleanup();
+
+/* pcmcache_reg: the decoder registration function for cached files */
+int pcmcache_reg(struct xlplayer *xlplayer);
+
+/* for capturing a play, NULL is returned when the file will not be cached */
+struct pcmcache_entry *pcmcache_capture_begin(char *pathname, float gain);
+int pcmcache_capture_append(struct pcmcache_entry *entry, float *left, float *right, size_t n_frames);
+void pcmcache_capture_commit(struct pcmcache_entry *entry);
+void pcmcache_capture_abandon(struct pcmcache_entry *entry);
+
+#endif /* PCMCACHE_H */
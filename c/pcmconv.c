@@ -0,0 +1,305 @@
+/*
+#   pcmconv.c: integer PCM to float conversion kernels for the decoders
+#   Copyright (C) 2013 Stephen Fairchild (s-fairchild@users.sf.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "pcmconv.h"
+
+#define TRUE 1
+#define FALSE 0
+
+/* packed 24 bit little-endian, sign extended */
+static inline int32_t pcmconv_s24(const uint8_t *p)
+    {
+    return (int32_t)((uint32_t)p[0] << 8 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 24) >> 8;
+    }
+
+#ifdef __SSE2__
+
+/* four int16 sign extended to float */
+static inline __m128 pcmconv_sse_s16x4(const int16_t *p)
+    {
+    __m128i x = _mm_loadl_epi64((const __m128i *)p);
+
+    return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16));
+    }
+
+static inline __m128 pcmconv_sse_s32x4(const int32_t *p)
+    {
+    return _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)p));
+    }
+
+#endif /* __SSE2__ */
+
+static void pcmconv_s16_interleaved(float *out, const void * const *in, int frames, int channels, float scale)
+    {
+    const int16_t * restrict s = in[0];
+    float * restrict d = out;
+    int i = 0, n = frames * channels;
+
+#ifdef __SSE2__
+    const __m128 k = _mm_set1_ps(scale);
+
+    for (; i + 8 <= n; i += 8)
+        {
+        __m128i x = _mm_loadu_si128((const __m128i *)(s + i));
+
+        _mm_storeu_ps(d + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16)), k));
+        _mm_storeu_ps(d + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16)), k));
+        }
+#endif
+    for (; i < n; ++i)
+        d[i] = (float)s[i] * scale;
+    }
+
+static void pcmconv_s24_interleaved(float *out, const void * const *in, int frames, int channels, float scale)
+    {
+    const uint8_t * restrict s = in[0];
+    float * restrict d = out;
+    int i, n = frames * channels;
+
+    for (i = 0; i < n; ++i, s += 3)
+        d[i] = (float)pcmconv_s24(s) * scale;
+    }
+
+static void pcmconv_s32_interleaved(float *out, const void * const *in, int frames, int channels, float scale)
+    {
+    const int32_t * restrict s = in[0];
+    float * restrict d = out;
+    int i = 0, n = frames * channels;
+
+#ifdef __SSE2__
+    const __m128 k = _mm_set1_ps(scale);
+
+    for (; i + 8 <= n; i += 8)
+        {
+        _mm_storeu_ps(d + i, _mm_mul_ps(pcmconv_sse_s32x4(s + i), k));
+        _mm_storeu_ps(d + i + 4, _mm_mul_ps(pcmconv_sse_s32x4(s + i + 4), k));
+        }
+#endif
+    for (; i < n; ++i)
+        d[i] = (float)s[i] * scale;
+    }
+
+/* for planar input with one channel the interleaved kernels do the job, with
+ * two the channels are converted side by side and zipped together
+ */
+
+static void pcmconv_s16_planar(float *out, const void * const *in, int frames, int channels, float scale)
+    {
+    float * restrict d = out;
+    int c, i = 0;
+
+    if (channels == 1)
+        {
+        pcmconv_s16_interleaved(out, in, frames, 1, scale);
+        return;
+        }
+    if (channels == 2)
+        {
+        const int16_t * restrict l = in[0], * restrict r = in[1];
+
+#ifdef __SSE2__
+        const __m128 k = _mm_set1_ps(scale);
+
+        for (; i + 4 <= frames; i += 4, d += 8)
+            {
+            __m128 lf = _mm_mul_ps(pcmconv_sse_s16x4(l + i), k);
+            __m128 rf = _mm_mul_ps(pcmconv_sse_s16x4(r + i), k);
+
+            _mm_storeu_ps(d, _mm_unpacklo_ps(lf, rf));
+            _mm_storeu_ps(d + 4, _mm_unpackhi_ps(lf, rf));
+            }
+#endif
+        for (; i < frames; ++i)
+            {
+            *d++ = (float)l[i] * scale;
+            *d++ = (float)r[i] * scale;
+            }
+        return;
+        }
+    for (c = 0; c < channels; ++c)
+        {
+        const int16_t * restrict s = in[c];
+
+        for (i = 0; i < frames; ++i)
+            d[i * channels + c] = (float)s[i] * scale;
+        }
+    }
+
+static void pcmconv_s24_planar(float *out, const void * const *in, int frames, int channels, float scale)
+    {
+    float * restrict d = out;
+    int c, i;
+
+    for (c = 0; c < channels; ++c)
+        {
+        const uint8_t * restrict s = in[c];
+
+        for (i = 0; i < frames; ++i, s += 3)
+            d[i * channels + c] = (float)pcmconv_s24(s) * scale;
+        }
+    }
+
+static void pcmconv_s32_planar(float *out, const void * const *in, int frames, int channels, float scale)
+    {
+    float * restrict d = out;
+    int c, i = 0;
+
+    if (channels == 1)
+        {
+        pcmconv_s32_interleaved(out, in, frames, 1, scale);
+        return;
+        }
+    if (channels == 2)
+        {
+        const int32_t * restrict l = in[0], * restrict r = in[1];
+
+#ifdef __SSE2__
+        const __m128 k = _mm_set1_ps(scale);
+
+        for (; i + 4 <= frames; i += 4, d += 8)
+            {
+            __m128 lf = _mm_mul_ps(pcmconv_sse_s32x4(l + i), k);
+            __m128 rf = _mm_mul_ps(pcmconv_sse_s32x4(r + i), k);
+
+            _mm_storeu_ps(d, _mm_unpacklo_ps(lf, rf));
+            _mm_storeu_ps(d + 4, _mm_unpackhi_ps(lf, rf));
+            }
+#endif
+        for (; i < frames; ++i)
+            {
+            *d++ = (float)l[i] * scale;
+            *d++ = (float)r[i] * scale;
+            }
+        return;
+        }
+    for (c = 0; c < channels; ++c)
+        {
+        const int32_t * restrict s = in[c];
+
+        for (i = 0; i < frames; ++i)
+            d[i * channels + c] = (float)s[i] * scale;
+        }
+    }
+
+int pcmconv_select(struct pcmconv *self, int container_bits, int valid_bits, int planar)
+    {
+    static const pcmconv_kernel kernels[3][2] = {
+            { pcmconv_s16_interleaved, pcmconv_s16_planar },
+            { pcmconv_s24_interleaved, pcmconv_s24_planar },
+            { pcmconv_s32_interleaved, pcmconv_s32_planar } };
+
+    if ((container_bits != 16 && container_bits != 24 && container_bits != 32)
+                || valid_bits < 2 || valid_bits > container_bits)
+        {
+        self->kernel = NULL;
+        return FALSE;
+        }
+
+    self->kernel = kernels[container_bits / 8 - 2][planar ? 1 : 0];
+    self->container_bits = container_bits;
+    self->valid_bits = valid_bits;
+    self->planar = planar;
+    self->scale = ldexpf(1.0f, 1 - valid_bits);
+    return TRUE;
+    }
+
+void pcmconv_run(struct pcmconv *self, float *out, const void * const *in, int frames, int channels)
+    {
+    self->kernel(out, in, frames, channels, self->scale);
+    }
+
+void pcmconv_noise_init(struct pcmconv_noise *self, uint32_t seed)
+    {
+    int i;
+
+    /* spread the seed with an LCG and a mix so no two lanes run in step */
+    for (i = 0; i < PCMCONV_LANES; ++i)
+        {
+        seed = seed * 1664525U + 1013904223U;
+        self->lane[i] = seed ^ (seed >> 16) ^ (seed << 7);
+        if (!self->lane[i])
+            self->lane[i] = 0x9E3779B9U;
+        }
+    }
+
+/* each uniform is a lane's output taken as signed and so spans -2^31 to 2^31,
+ * the sum of two scaled by peak / 2^32 is a triangle from -peak to +peak
+ */
+void pcmconv_dither(float *buffer, int n, float peak, struct pcmconv_noise *noise)
+    {
+    const float k = peak * (1.0F / 4294967296.0F);
+    float * restrict d = buffer;
+    int i;
+
+#ifdef __SSE2__
+    __m128i a = _mm_loadu_si128((const __m128i *)noise->lane);
+    __m128i b = _mm_loadu_si128((const __m128i *)(noise->lane + 4));
+    const __m128 kv = _mm_set1_ps(k);
+    float tail[4];
+
+    for (; n > 0; n -= 4, d += 4)
+        {
+        a = _mm_xor_si128(a, _mm_slli_epi32(a, 13));
+        a = _mm_xor_si128(a, _mm_srli_epi32(a, 17));
+        a = _mm_xor_si128(a, _mm_slli_epi32(a, 5));
+        b = _mm_xor_si128(b, _mm_slli_epi32(b, 13));
+        b = _mm_xor_si128(b, _mm_srli_epi32(b, 17));
+        b = _mm_xor_si128(b, _mm_slli_epi32(b, 5));
+        __m128 t = _mm_mul_ps(_mm_add_ps(_mm_cvtepi32_ps(a), _mm_cvtepi32_ps(b)), kv);
+
+        if (n >= 4)
+            _mm_storeu_ps(d, _mm_add_ps(_mm_loadu_ps(d), t));
+        else
+            {
+            _mm_storeu_ps(tail, t);
+            for (i = 0; i < n; ++i)
+                d[i] += tail[i];
+            }
+        }
+    _mm_storeu_si128((__m128i *)noise->lane, a);
+    _mm_storeu_si128((__m128i *)(noise->lane + 4), b);
+#else
+    uint32_t x[PCMCONV_LANES];
+    float t[4];
+
+    for (i = 0; i < PCMCONV_LANES; ++i)
+        x[i] = noise->lane[i];
+    for (; n > 0; n -= 4, d += 4)
+        {
+        for (i = 0; i < PCMCONV_LANES; ++i)
+            {
+            x[i] ^= x[i] << 13;
+            x[i] ^= x[i] >> 17;
+            x[i] ^= x[i] << 5;
+            }
+        for (i = 0; i < 4; ++i)
+            t[i] = ((float)(int32_t)x[i] + (float)(int32_t)x[i + 4]) * k;
+        for (i = 0; i < 4 && i < n; ++i)
+            d[i] += t[i];
+        }
+    for (i = 0; i < PCMCONV_LANES; ++i)
+        noise->lane[i] = x[i];
+#endif
+    }
@@ -0,0 +1,71 @@
+/*
+#   pcmconv.h: integer PCM to float conversion kernels for the decoders
+#   Copyright (C) 2013 Stephen Fairchild (s-fairchild@users.sf.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PCMCONV_H
+#define PCMCONV_H
+
+#include <stdint.h>
+
+/* A decoder picks the kernel for its sample format once per track and runs
+ * it on every block. Input is 16 or 32 bit integers in host byte order, or
+ * packed 24 bit little-endian, either interleaved in in[0] or one channel
+ * per in[n]. Output is always interleaved float in the range -1 to +1.
+ *
+ * Where SSE2 is available the 16 and 32 bit kernels convert four or eight
+ * samples at a time, the rest are plain loops for the compiler to unroll.
+ *
+ * Dither noise comes from eight xorshift32 generators run side by side, a
+ * pair of which makes four triangular samples per step. The sequence is the
+ * same with or without SSE2.
+ */
+
+#define PCMCONV_LANES 8
+
+typedef void (*pcmconv_kernel)(float *out, const void * const *in, int frames, int channels, float scale);
+
+struct pcmconv
+    {
+    pcmconv_kernel kernel;
+    int container_bits;         /* storage per sample: 16, 24 or 32 */
+    int valid_bits;             /* significant bits, right justified and sign extended */
+    int planar;
+    float scale;                /* 1 / 2^(valid_bits - 1) */
+    };
+
+/* dither generator state, lanes 0-3 and 4-7 make the two halves of each triangle */
+struct pcmconv_noise
+    {
+    uint32_t lane[PCMCONV_LANES];
+    };
+
+/* pcmconv_select: choose the kernel for a sample format
+ * returns 1 on success, 0 if there is none for this format
+ */
+int pcmconv_select(struct pcmconv *self, int container_bits, int valid_bits, int planar);
+
+/* pcmconv_run: convert frames of audio to interleaved float */
+void pcmconv_run(struct pcmconv *self, float *out, const void * const *in, int frames, int channels);
+
+/* pcmconv_noise_init: seed the dither generator */
+void pcmconv_noise_init(struct pcmconv_noise *self, uint32_t seed);
+
+/* pcmconv_dither: add triangular dither of the given peak amplitude to n samples */
+void pcmconv_dither(float *buffer, int n, float peak, struct pcmconv_noise *noise);
+
+#endif /* PCMCONV_H */
@@ -0,0 +1,365 @@
+/*
+#   pcmconv_bench.c: speed of the PCM conversion kernels against the generic loops
+#   Copyright (C) 2013 Stephen Fairchild (s-fairchild@users.sf.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Usage: pcmconv_bench [-d seconds] [-b frames] [-D]
+ *
+ * Converts -d seconds of 44.1 kHz stereo noise in blocks of -b frames, per
+ * format, once with the loop the decoders used to run and once with the
+ * kernel pcmconv_select picks. The interleaved formats are compared with
+ * the byte at a time loop xlplayer_make_audio_to_float had, planar 16 bit
+ * with the loop avcodecdecode had and planar 32 bit with that of FLAC.
+ *
+ * Reported are nanoseconds per sample for each and the largest difference
+ * in the output, which without -D must be zero or the exit status is 1.
+ * With -D dither is added wherever the decoders would add it.
+ *
+ * With -D the dither generator is then measured alone against the rand_r
+ * pair it replaced, on stereo 16 bit blocks. Alongside the cost are the
+ * mean and the variance relative to that of a triangle, the share within
+ * half the peak, which for a triangle is 0.75, and the correlation of each
+ * sample with the next.
+ */
+
+#include "../config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include "pcmconv.h"
+#include "bench_common.h"
+
+#define TRUE 1
+#define FALSE 0
+
+#define RATE 44100
+#define CHANNELS 2
+
+enum bench_reference { REF_BYTES, REF_S16P, REF_FLAC };
+
+struct bench_format
+    {
+    const char *name;
+    int container_bits;
+    int valid_bits;
+    int planar;
+    enum bench_reference reference;
+    };
+
+static struct bench_format formats[] = {
+    { "s16", 16, 16, FALSE, REF_BYTES },
+    { "s24", 24, 24, FALSE, REF_BYTES },
+    { "s32", 32, 32, FALSE, REF_BYTES },
+    { "s16p", 16, 16, TRUE, REF_S16P },
+    { "flac16", 32, 16, TRUE, REF_FLAC },
+    { "flac24", 32, 24, TRUE, REF_FLAC },
+    { NULL } };
+
+static int dither;
+static unsigned seed = 1;
+static struct pcmconv_noise noise;
+static volatile float sink;
+
+/* the generic loop xlplayer_make_audio_to_float had */
+static void bench_ref_bytes(float *buffer, uint8_t *data, int num_samples, int bits_per_sample, int num_channels)
+    {
+    int num_bytes;
+    int i;
+    uint32_t msb_mask;
+    uint32_t neg_mask;
+    uint32_t holder;
+    uint32_t mult;
+    float *fptr = buffer;
+    float fscale;
+    const float half_randmax = (float)(RAND_MAX >> 1);
+    float dscale;
+
+    msb_mask = 1UL << (bits_per_sample - 1);
+    neg_mask = (uint32_t)((~0UL) << (bits_per_sample));
+    fscale = 1.0F/(float)msb_mask;
+    dscale = 0.25F / half_randmax * fscale;
+
+    while (num_samples--)
+        {
+        for (i = 0; i < num_channels; i++)
+            {
+            for (num_bytes = (bits_per_sample + 7) >> 3, mult = 1, holder = 0; num_bytes--; mult <<=8)
+                {
+                holder |= ((uint32_t)*data++) * mult;
+                }
+            if (holder & msb_mask)
+                holder |= neg_mask;
+            if (dither && bits_per_sample < 20)
+                *fptr++ = (((float)(int32_t)holder) * fscale) +
+                (((((float)rand_r(&seed)) - half_randmax) +
+                (((float)rand_r(&seed)) - half_randmax)) * dscale);
+            else
+                *fptr++ = ((float)((int32_t)holder)) * fscale;
+            }
+        }
+    }
+
+/* the planar 16 bit loop avcodecdecode had */
+static void bench_ref_s16p(float *buffer, const void * const *in, int frames, int channels)
+    {
+    const int16_t *l = in[0], *r = in[1];
+    float *d = buffer;
+    float *endp = buffer + (channels * frames);
+
+    while (d < endp)
+        {
+        *d++ = *l++ / 32768.0f;
+        if (channels == 2)
+            *d++ = *r++ / 32768.0f;
+        }
+    }
+
+/* the loop from make_flac_audio_to_float */
+static void bench_ref_flac(float *flbuf, const int32_t * const inputbuffer[], unsigned numsamples, unsigned bits_per_sample, unsigned numchannels)
+    {
+    int shiftvalue = 32 - bits_per_sample;
+    unsigned sample, channel;
+    const float half_randmax = (float)(RAND_MAX >> 1);
+    float dscale;
+
+    if (!dither || bits_per_sample >= 20)
+        {
+        for (sample = 0; sample < numsamples; sample++)
+            for (channel = 0; channel < numchannels; channel++)
+                *flbuf++ = ((float)(inputbuffer[channel][sample] << shiftvalue)) / 2147483648.0F;
+        }
+    else
+        {
+        dscale = 0.25F / (half_randmax * powf(2.0F, (float)bits_per_sample));
+        for (sample = 0; sample < numsamples; sample++)
+            for (channel = 0; channel < numchannels; channel++)
+                *flbuf++ = ((float)(inputbuffer[channel][sample] << shiftvalue)) / 2147483648.0F +
+                            ((((float)rand_r(&seed)) - half_randmax) +
+                            (((float)rand_r(&seed)) - half_randmax)) * dscale;
+        }
+    }
+
+/* bench_fill: noise in the format, interleaved in buffers[0] or one channel per buffer */
+static void bench_fill(struct bench_format *f, uint8_t **buffers, int frames)
+    {
+    int bytes = f->container_bits / 8, i, c, b;
+    uint32_t x = 2463534242U, v;
+    uint8_t *p;
+
+    for (i = 0; i < frames; ++i)
+        for (c = 0; c < CHANNELS; ++c)
+            {
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            v = (uint32_t)((int32_t)x >> (32 - f->valid_bits));
+            p = f->planar ? buffers[c] + i * bytes : buffers[0] + (i * CHANNELS + c) * bytes;
+            for (b = 0; b < bytes; ++b)
+                p[b] = v >> (8 * b);
+            }
+    }
+
+static void bench_reference(struct bench_format *f, float *out, uint8_t **buffers, int frames)
+    {
+    switch (f->reference)
+        {
+        case REF_BYTES:
+            bench_ref_bytes(out, buffers[0], frames, f->container_bits, CHANNELS);
+            break;
+        case REF_S16P:
+            bench_ref_s16p(out, (const void * const *)buffers, frames, CHANNELS);
+            break;
+        case REF_FLAC:
+            bench_ref_flac(out, (const int32_t * const *)buffers, frames, f->valid_bits, CHANNELS);
+            break;
+        }
+    }
+
+static void bench_kernel(struct bench_format *f, struct pcmconv *conv, float *out, uint8_t **buffers, int frames)
+    {
+    pcmconv_run(conv, out, (const void * const *)buffers, frames, CHANNELS);
+    if (dither && f->valid_bits < 20)
+        pcmconv_dither(out, frames * CHANNELS, (f->reference == REF_FLAC ? 0.25F : 0.5F) * conv->scale, &noise);
+    }
+
+/* bench_format: returns FALSE if the kernel is missing or, without dither, its output differs */
+static int bench_format(struct bench_format *f, int seconds, int frames)
+    {
+    struct pcmconv conv;
+    uint8_t *buffers[CHANNELS];
+    float *ref, *out, diff = 0.0f;
+    long blocks = (long)seconds * RATE / frames, n;
+    double start, t_ref, t_kernel;
+    int c, i;
+
+    if (!pcmconv_select(&conv, f->container_bits, f->valid_bits, f->planar))
+        {
+        printf("%-7s no kernel\n", f->name);
+        return FALSE;
+        }
+    for (c = 0; c < CHANNELS; ++c)
+        if (!(buffers[c] = malloc(frames * CHANNELS * f->container_bits / 8)))
+            {
+            fprintf(stderr, "bench_format: malloc failure\n");
+            exit(5);
+            }
+    if (!(ref = malloc(frames * CHANNELS * sizeof (float))) || !(out = malloc(frames * CHANNELS * sizeof (float))))
+        {
+        fprintf(stderr, "bench_format: malloc failure\n");
+        exit(5);
+        }
+    bench_fill(f, buffers, frames);
+
+    bench_reference(f, ref, buffers, frames);
+    bench_kernel(f, &conv, out, buffers, frames);
+    for (i = 0; i < frames * CHANNELS; ++i)
+        if (fabsf(ref[i] - out[i]) > diff)
+            diff = fabsf(ref[i] - out[i]);
+
+    start = bench_now();
+    for (n = 0; n < blocks; ++n)
+        {
+        bench_reference(f, ref, buffers, frames);
+        sink = ref[n % frames];
+        }
+    t_ref = bench_now() - start;
+
+    start = bench_now();
+    for (n = 0; n < blocks; ++n)
+        {
+        bench_kernel(f, &conv, out, buffers, frames);
+        sink = out[n % frames];
+        }
+    t_kernel = bench_now() - start;
+
+    n = blocks * frames * CHANNELS;
+    printf("%-7s %10.3f %14.3f %8.1f %15.3g\n", f->name, t_ref * 1e9 / n, t_kernel * 1e9 / n, t_ref / t_kernel, diff);
+
+    for (c = 0; c < CHANNELS; ++c)
+        free(buffers[c]);
+    free(ref);
+    free(out);
+    return dither || diff == 0.0f;
+    }
+
+/* the rand_r pair the decoders used for triangular dither */
+static void bench_dither_rand_r(float *buffer, int n, float peak, struct pcmconv_noise *unused)
+    {
+    const float half_randmax = (float)(RAND_MAX >> 1);
+    const float dscale = 0.5f * peak / half_randmax;
+
+    while (n--)
+        *buffer++ += ((((float)rand_r(&seed)) - half_randmax) +
+                      (((float)rand_r(&seed)) - half_randmax)) * dscale;
+    }
+
+static void bench_dither(const char *name, void (*fn)(float *, int, float, struct pcmconv_noise *), int seconds, int frames)
+    {
+    const float peak = 0.5f / 32768.0f;         /* as for 16 bit decode */
+    long blocks = (long)seconds * RATE / frames, b;
+    int i, n = frames * CHANNELS;
+    double start, elapsed, x, prev = 0.0, sum = 0.0, sumsq = 0.0, lag = 0.0, inner = 0.0;
+    float *buffer;
+
+    if (!(buffer = malloc(n * sizeof (float))))
+        {
+        fprintf(stderr, "bench_dither: malloc failure\n");
+        exit(5);
+        }
+
+    start = bench_now();
+    for (b = 0; b < blocks; ++b)
+        {
+        memset(buffer, 0, n * sizeof (float));
+        fn(buffer, n, peak, &noise);
+        sink = buffer[b % n];
+        }
+    elapsed = bench_now() - start;
+
+    /* the statistics from a fresh run of the same length */
+    for (b = 0; b < blocks; ++b)
+        {
+        memset(buffer, 0, n * sizeof (float));
+        fn(buffer, n, peak, &noise);
+        for (i = 0; i < n; ++i)
+            {
+            x = buffer[i] / peak;
+            sum += x;
+            sumsq += x * x;
+            lag += x * prev;
+            inner += fabs(x) < 0.5;
+            prev = x;
+            }
+        }
+    b = blocks * n;
+    /* a triangle from -1 to +1 has a variance of 1/6 */
+    printf("%-7s %8.3f %11.2e %10.4f %11.4f %12.2e\n", name, elapsed * 1e9 / b, sum / b,
+                sumsq / b * 6.0, inner / b, (lag / b) / (sumsq / b));
+    free(buffer);
+    }
+
+int main(int argc, char **argv)
+    {
+    struct bench_format *f;
+    int seconds = 600, frames = 4096, opt, exact = TRUE;
+
+    while ((opt = getopt(argc, argv, "d:b:D")) != -1)
+        switch (opt)
+            {
+            case 'd':
+                seconds = atoi(optarg);
+                break;
+            case 'b':
+                frames = atoi(optarg);
+                break;
+            case 'D':
+                dither = TRUE;
+                break;
+            default:
+                goto usage;
+            }
+    if (optind != argc || seconds < 1 || frames < 1)
+        goto usage;
+
+    pcmconv_noise_init(&noise, 17234);
+    printf("%d s of %d channel audio in blocks of %d frames, dither %s\n", seconds, CHANNELS, frames, dither ? "on" : "off");
+    printf("format  ref ns/smp  kernel ns/smp  speedup  max difference\n");
+    for (f = formats; f->name; ++f)
+        if (!bench_format(f, seconds, frames))
+            exact = FALSE;
+
+    if (dither)
+        {
+        printf("\ndither  ns/smp  mean/peak  var/tri  within 1/2  lag-1 corr\n");
+        bench_dither("rand_r", bench_dither_rand_r, seconds, frames);
+        bench_dither("lanes", pcmconv_dither, seconds, frames);
+        }
+    if (!exact)
+        {
+        fprintf(stderr, "main: a kernel does not match the loop it replaced\n");
+        return 1;
+        }
+    return 0;
+
+    usage:
+    fprintf(stderr, "usage: %s [-d seconds] [-b frames] [-D]\n", argv[0]);
+    return 5;
+    }
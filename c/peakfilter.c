@@ -39,39 +39,68 @@ struct peakfilter *peakfilter_create(float window, int sample_rate)
     if ((n_stages = (int)(window * sample_rate)) < 1)
         n_stages = 1;
     
-    if (!(self->ptr = self->start = calloc(n_stages, sizeof (float))))
+    if (!(self->value = calloc(n_stages, sizeof (float))) ||
+                    !(self->index = calloc(n_stages, sizeof (unsigned))))
         {
         fprintf(stderr, "malloc failure\n");
         exit(-5);
         }
         
-    self->end = self->start + n_stages;   
-    self->peak = 0.0f;
+    self->size = n_stages;
+    peakfilter_reset(self);
     
     return self;
     }
 
 void peakfilter_destroy(struct peakfilter *self)
     {
-    free(self->start);
+    free(self->value);
+    free(self->index);
     free(self);
     }
 
+/* peakfilter_reset: the window starts out filled with silence */
+void peakfilter_reset(struct peakfilter *self)
+    {
+    self->t = 0;
+    self->head = 0;
+    self->count = 1;
+    self->value[0] = 0.0f;
+    self->index[0] = -1U;   /* the newest of the initial zero samples */
+    self->peak = 0.0f;
+    }
+
 void peakfilter_process(struct peakfilter *self, float sample)
     {
-    float least;
-    float *p;
+    const unsigned size = self->size;
+    const unsigned t = self->t++;
+    const float v = fabsf(sample);
+    unsigned tail;
     
-    *self->ptr++ = fabsf(sample);
-    if (self->ptr == self->end)
-        self->ptr = self->start;
-        
-    for (p = self->start, least = HUGE_VALF; p < self->end; p++)
-        if (*p < least)
-            least = *p;
+    /* entries no smaller than the new sample can never be the minimum again */
+    while (self->count && self->value[tail = (self->head + self->count - 1) % size] >= v)
+        self->count--;
     
-    if (least > self->peak)
-        self->peak = least;
+    /* entries that have slid out of the window */
+    if (self->count && t - self->index[self->head] >= size)
+        {
+        self->head = (self->head + 1) % size;
+        self->count--;
+        }
+    
+    tail = (self->head + self->count++) % size;
+    self->value[tail] = v;
+    self->index[tail] = t;
+    
+    /* the oldest entry is the window minimum */
+    if (self->value[self->head] > self->peak)
+        self->peak = self->value[self->head];
+    }
+
+void peakfilter_process_block(struct peakfilter *self, const float *buffer, unsigned n_samples)
+    {
+    while (n_samples--)
+        peakfilter_process(self, *buffer++);
     }
 
 float peakfilter_read(struct peakfilter *self)
@@ -17,16 +17,31 @@
 #   If not, see <http://www.gnu.org/licenses/>.
 */
 
+#ifndef PEAKFILTER_H
+#define PEAKFILTER_H
+
+/* The signal is passed through a sliding window minimum filter of the
+ * absolute sample values before peak detection so that the reading isn't
+ * thrown by the odd stray sample. With a window of one sample it is a plain
+ * peak hold. The minimum is tracked with a monotonic deque so each sample
+ * costs amortized O(1) regardless of the window size.
+ */
 struct peakfilter
     {
-    float *start;
-    float *end;
-    float *ptr;
+    float *value;       /* the deque, stored in a circular buffer */
+    unsigned *index;    /* sample index of each entry */
+    unsigned size;      /* window size in samples, also deque capacity */
+    unsigned head;      /* position of the oldest entry */
+    unsigned count;     /* number of entries */
+    unsigned t;         /* sample counter */
     float peak;
     };
 
 struct peakfilter *peakfilter_create(float window, int sample_rate);
 void peakfilter_destroy(struct peakfilter *self);
 void peakfilter_process(struct peakfilter *self, float sample);
+void peakfilter_process_block(struct peakfilter *self, const float *buffer, unsigned n_samples);
 float peakfilter_read(struct peakfilter *self);
+void peakfilter_reset(struct peakfilter *self);
 
+#endif
@@ -0,0 +1,97 @@
+/*
+#   phash.c: collision free string lookup tables for command dispatch
+#   Copyright (C) 2013 Stephen Fairchild (s-fairchild@users.sf.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "phash.h"
+
+#define SEED_TRIES 256
+
+/* FNV-1a with the seed mixed into the offset basis */
+static unsigned phash_hash(unsigned seed, const char *key)
+    {
+    unsigned h = 2166136261u ^ seed;
+
+    while (*key)
+        {
+        h ^= (unsigned char)*key++;
+        h *= 16777619u;
+        }
+    return h ^ (h >> 15);
+    }
+
+/* phash_try: fill the table using seed, fails on the first collision */
+static int phash_try(struct phash *self, int n_keys)
+    {
+    unsigned slot;
+
+    memset(self->slots, 0, (self->mask + 1) * sizeof (int));
+    for (int i = 0; i < n_keys; ++i)
+        {
+        slot = phash_hash(self->seed, self->keys[i]) & self->mask;
+        if (self->slots[slot])
+            return 0;
+        self->slots[slot] = i + 1;
+        }
+    return 1;
+    }
+
+int phash_init(struct phash *self, const char **keys, int n_keys)
+    {
+    unsigned size;
+
+    self->keys = keys;
+    self->slots = NULL;
+    /* start at twice the key count and double when no seed is found */
+    for (size = 2; size < (unsigned)n_keys * 2; size <<= 1);
+    for (; size <= (unsigned)n_keys * 64; size <<= 1)
+        {
+        if (!(self->slots = realloc(self->slots, size * sizeof (int))))
+            {
+            fprintf(stderr, "phash_init: malloc failure\n");
+            return 0;
+            }
+        self->mask = size - 1;
+        for (self->seed = 0; self->seed < SEED_TRIES; ++self->seed)
+            if (phash_try(self, n_keys))
+                return 1;
+        }
+
+    fprintf(stderr, "phash_init: no collision free table for %d keys\n", n_keys);
+    free(self->slots);
+    self->slots = NULL;
+    return 0;
+    }
+
+int phash_lookup(struct phash *self, const char *key)
+    {
+    int i = self->slots[phash_hash(self->seed, key) & self->mask] - 1;
+
+    if (i < 0 || strcmp(key, self->keys[i]))
+        return -1;
+    return i;
+    }
+
+void phash_free(struct phash *self)
+    {
+    free(self->slots);
+    self->slots = NULL;
+    }
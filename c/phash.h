@@ -0,0 +1,43 @@
+/*
+#   phash.h: collision free string lookup tables for command dispatch
+#   Copyright (C) 2013 Stephen Fairchild (s-fairchild@users.sf.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PHASH_H
+#define PHASH_H
+
+/* The key set is fixed so a hash seed is searched for that puts every key
+ * in a slot of its own. A lookup is then one hash, one probe and one strcmp
+ * to reject strings that are not in the set.
+ */
+
+struct phash
+    {
+    unsigned seed;
+    unsigned mask;              /* table size - 1, a power of two */
+    const char **keys;          /* the key for each index */
+    int *slots;                 /* key index + 1, 0 for an empty slot */
+    };
+
+/* phash_init: keys is an array of n_keys distinct strings which must outlive
+ * the table, returns 0 on failure */
+int phash_init(struct phash *self, const char **keys, int n_keys);
+/* phash_lookup: returns the index of the key or -1 */
+int phash_lookup(struct phash *self, const char *key);
+void phash_free(struct phash *self);
+
+#endif /* PHASH_H */
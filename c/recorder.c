@@ -17,6 +17,7 @@
 #   If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include "gnusource.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -31,8 +32,11 @@
 
 typedef jack_default_audio_sample_t sample_t;
 
-static const size_t rb_n_samples = 10000;       /* maximum number of samples to hold in the ring buffer */
 static const size_t audio_buffer_elements = 256;
+/* the longest the recorder thread sleeps before rechecking its request flags */
+static const int wait_timeout_ms = 100;
+/* unencoded recording wakes once this many frames have been captured */
+static const size_t raw_wake_frames = 2048;
 
 #if 0
 static void recorder_write_ogg_metaheader(struct recorder *self)
@@ -121,6 +125,67 @@ static void recorder_write_ogg_metaheader(struct recorder *self)
     }
 #endif /* recorder_write_ogg_metaheader */
 
+/* an id3v2.4 tag header for a tag size bytes long in total */
+static void recorder_id3_header(unsigned char *block, size_t size)
+    {
+    size -= 10;
+    memcpy(block, "ID3\x04\x00\x00", 6);
+    block[6] = size >> 21 & 0x7F;
+    block[7] = size >> 14 & 0x7F;
+    block[8] = size >> 7 & 0x7F;
+    block[9] = size & 0x7F;
+    }
+
+/* libsndfile writes through the write-behind buffers */
+static sf_count_t recorder_sf_get_filelen(void *wb)
+    {
+    return writebehind_size(wb);
+    }
+
+static sf_count_t recorder_sf_seek(sf_count_t offset, int whence, void *wb)
+    {
+    return writebehind_seek(wb, offset, whence);
+    }
+
+static sf_count_t recorder_sf_read(void *ptr, sf_count_t count, void *wb)
+    {
+    return writebehind_read(wb, ptr, count);
+    }
+
+static sf_count_t recorder_sf_write(const void *ptr, sf_count_t count, void *wb)
+    {
+    return writebehind_write(wb, ptr, count);
+    }
+
+static sf_count_t recorder_sf_tell(void *wb)
+    {
+    return writebehind_tell(wb);
+    }
+
+static SF_VIRTUAL_IO recorder_sf_io = { recorder_sf_get_filelen, recorder_sf_seek,
+                    recorder_sf_read, recorder_sf_write, recorder_sf_tell };
+
+/* a histogram as comma separated counts */
+static char *recorder_histogram(char *buffer, unsigned *counts)
+    {
+    char *p = buffer;
+    int i;
+
+    for (i = 0; i < WRITEBEHIND_BUCKETS; ++i)
+        p += sprintf(p, i ? ",%u" : "%u", counts[i]);
+    return buffer;
+    }
+
+static void recorder_display_write_stats(struct recorder *self)
+    {
+    struct writebehind_stats *s = &self->wb_stats;
+    char depth[WRITEBEHIND_BUCKETS * 11], latency[WRITEBEHIND_BUCKETS * 11];
+
+    fprintf(stderr, "recorder_display_write_stats: %llu bytes, %u stalls\n", (unsigned long long)s->bytes, s->stalls);
+    fprintf(stderr, "queue depth 1..%d: %s\n", WRITEBEHIND_BUCKETS, recorder_histogram(depth, s->depth));
+    fprintf(stderr, "write latency <1ms..2^%dms: %s\n", WRITEBEHIND_BUCKETS - 1, recorder_histogram(latency, s->latency));
+    }
+
 static int recorder_write_id3_tag(struct recorder *self, FILE *fp)
     {
     struct metadata_item *mi;
@@ -279,6 +344,82 @@ static int recorder_write_xing_tag(struct recorder *self, FILE *fp)
     return SUCCEEDED;
     }
 
+/* an empty id3 tag filling the space the final tags will be written over */
+static int recorder_reserve_tag_space(struct recorder *self)
+    {
+    char *value = getenv("record_tag_reserve_kb");
+    size_t size = value ? atoi(value) * 1024 : 0;
+    unsigned char *block;
+
+    self->tag_reserve = 0;
+    if (size < 1024)
+        return SUCCEEDED;
+    if (!(block = calloc(1, size)))
+        {
+        fprintf(stderr, "recorder_reserve_tag_space: malloc failure\n");
+        return FAILED;
+        }
+    recorder_id3_header(block, size);
+    if (writebehind_write(self->wb, block, size) != (ssize_t)size)
+        {
+        fprintf(stderr, "recorder_reserve_tag_space: error writing to file\n");
+        free(block);
+        return FAILED;
+        }
+    free(block);
+    self->tag_reserve = size;
+    return SUCCEEDED;
+    }
+
+/* write the tags over the reserved space at the start of the file
+ * the id3 tag takes up the slack as padding */
+static int recorder_patch_mp3_tags(struct recorder *self)
+    {
+    int fd = writebehind_fd(self->wb);
+    FILE *mfp;
+    char *xing = NULL, *id3 = NULL;
+    size_t xing_size, id3_size;
+    unsigned char *block;
+    int ok = FALSE;
+
+    if (pread(fd, self->first_mp3_header, 4, self->tag_reserve) != 4)
+        {
+        fprintf(stderr, "recorder_patch_mp3_tags: failed to obtain the first four bytes of the recording\n");
+        return FAILED;
+        }
+    if (!(mfp = open_memstream(&xing, &xing_size)))
+        return FAILED;
+    ok = recorder_write_xing_tag(self, mfp);
+    fclose(mfp);
+    if (ok && (mfp = open_memstream(&id3, &id3_size)))
+        {
+        ok = recorder_write_id3_tag(self, mfp);
+        fclose(mfp);
+        }
+    else
+        ok = FALSE;
+
+    if (ok && id3_size + xing_size > self->tag_reserve)
+        {
+        fprintf(stderr, "recorder_patch_mp3_tags: %lu bytes of tags do not fit in %lu reserved\n",
+                    (unsigned long)(id3_size + xing_size), (unsigned long)self->tag_reserve);
+        ok = FALSE;
+        }
+    if (ok && (block = calloc(1, self->tag_reserve)))
+        {
+        memcpy(block, id3, id3_size);
+        recorder_id3_header(block, self->tag_reserve - xing_size);
+        memcpy(block + self->tag_reserve - xing_size, xing, xing_size);
+        ok = pwrite(fd, block, self->tag_reserve, 0) == (ssize_t)self->tag_reserve;
+        free(block);
+        }
+    else
+        ok = FALSE;
+    free(xing);
+    free(id3);
+    return ok;
+    }
+
 static void recorder_apply_mp3_tags(struct recorder *self)
     {
     char *tmpname;
@@ -286,6 +427,18 @@ static void recorder_apply_mp3_tags(struct recorder *self)
     char buffer[2048];
     int bytes;
     
+    if (writebehind_drain(self->wb))
+        fprintf(stderr, "recorder_apply_mp3_tags: the recording is incomplete\n");
+    if (self->tag_reserve)
+        {
+        if (recorder_patch_mp3_tags(self))
+            {
+            fprintf(stderr, "recorder_apply_mp3_tags: successfully tagged the mp3 file in place\n");
+            return;
+            }
+        fprintf(stderr, "recorder_apply_mp3_tags: falling back to rewriting the file\n");
+        }
+
     if (!(tmpname = malloc(strlen(self->pathname) + 5)))
         {
         fprintf(stderr, "recorder_apply_mp3_tags: malloc failure\n");
@@ -308,7 +461,7 @@ static void recorder_apply_mp3_tags(struct recorder *self)
         return;
         }
         
-    if (!fread(self->first_mp3_header, 4, 1, fpr))
+    if (fseek(fpr, self->tag_reserve, SEEK_SET) || !fread(self->first_mp3_header, 4, 1, fpr))
         {
         fprintf(stderr, "failed to obtain the first four bytes of the recording\n");
         fclose(fpr);
@@ -317,7 +470,8 @@ static void recorder_apply_mp3_tags(struct recorder *self)
         free(tmpname);
         return;
         } 
-    rewind(fpr);
+    /* the reserved space is replaced */
+    fseek(fpr, self->tag_reserve, SEEK_SET);
         
     if (!(recorder_write_id3_tag(self, fpw) && recorder_write_xing_tag(self, fpw)))
         {
@@ -437,11 +591,16 @@ static void recorder_display_logged_metadata2(struct metadata_item2 *mi2)
 static void recorder_append_metadata(struct recorder *self, struct encoder_op_packet *packet)
     {
     struct metadata_item *mi;
-    char *artist, *title, *album, *stringp;
+    char *artist, *title, *album, *stringp, *copy = NULL;
 
     if (packet)
         {
-        stringp = packet->data;
+        /* the packet is shared with other clients so work on a copy */
+        if (!(stringp = copy = strdup(packet->data)))
+            {
+            fprintf(stderr, "recorder_append_metadata: malloc failure\n");
+            return;
+            }
         strsep(&stringp, "\n");   /* we discard the first value */
         artist = strsep(&stringp, "\n");
         title  = strsep(&stringp, "\n");
@@ -455,18 +614,21 @@ static void recorder_append_metadata(struct recorder *self, struct encoder_op_pa
                 && !strcmp(self->mi_last->album, album))
         {
         fprintf(stderr, "recorder_append_metadata: duplicate artist-title, skipping\n");
+        free(copy);
         return;
         }
 
     if (!(mi = calloc(1, sizeof (struct metadata_item))))
         {
         fprintf(stderr, "recorder_append_metadata: malloc failure\n");
+        free(copy);
         return;
         }
 
     mi->artist = strdup(artist);
     mi->title = strdup(title);
     mi->album = strdup(album);
+    free(copy);
     mi->time_offset = self->recording_length_ms;
     mi->byte_offset = self->bytes_written;
     if (!(self->mi_first))
@@ -524,19 +686,37 @@ static void recorder_display_logged_metadata(struct metadata_item *mi)
         fprintf(stderr, "No metadata was logged for the recording.\n");
     }
 
+static void recorder_set_mode(struct recorder *self, enum record_mode mode)
+    {
+    pthread_mutex_lock(&self->mode_mutex);
+    self->record_mode = mode;
+    pthread_cond_broadcast(&self->mode_cv);
+    pthread_mutex_unlock(&self->mode_mutex);
+    }
+
 static void *recorder_main(void *args)
     {
     struct recorder *self = args;
     struct timespec ms10 = { 0, 10000000 };
     struct encoder_op_packet *packet;
     char *rl, *rr, *w, *endp;
-    size_t nbytes;
+    sample_t *lr[2];
+    size_t nbytes, n_frames;
     int m, s, f;
      
     sig_mask_thread();
     while (!self->thread_terminate_f)
         {
-        nanosleep(&ms10, NULL);
+        if (self->record_mode == RM_RECORDING || self->record_mode == RM_PAUSED)
+            {
+            if (self->input.ring)
+                capture_ring_wait(self->input.ring, __atomic_load_n(&self->input.pos, __ATOMIC_RELAXED) + raw_wake_frames, wait_timeout_ms);
+            else if (self->record_mode == RM_RECORDING)
+                encoder_client_wait_packet(self->encoder_op, wait_timeout_ms);
+            else
+                nanosleep(&ms10, NULL);
+            }
+        __atomic_add_fetch(&self->wakeups, 1, __ATOMIC_RELAXED);
 
         switch (self->record_mode)
             {
@@ -549,9 +729,11 @@ static void *recorder_main(void *args)
             case RM_RECORDING:
                 if (self->initial_serial == -1)
                     {
-                    while ((nbytes = jack_ringbuffer_read(self->input_rb[1], self->right, audio_buffer_elements * sizeof (sample_t))))
+                    lr[0] = (sample_t *)self->left;
+                    lr[1] = (sample_t *)self->right;
+                    while ((n_frames = capture_reader_read_stereo(&self->input, lr, audio_buffer_elements)))
                         {
-                        jack_ringbuffer_read(self->input_rb[0], self->left, nbytes);
+                        nbytes = n_frames * sizeof (sample_t);
                         rl = self->left;
                         rr = self->right;
                         endp = rl + nbytes;
@@ -568,18 +750,20 @@ static void *recorder_main(void *args)
                         if (self->stop_request || self->pause_request)
                             break;
                         }
+                    if (self->input.overflows)
+                        self->performance_warning_indicator = PW_AUDIO_DATA_DROPPED;
                     self->recording_length_s = self->sf_samples / self->sfinfo.samplerate;
                     self->recording_length_ms = self->sf_samples * 1000 / self->sfinfo.samplerate;
                     
                     if (self->stop_request)
                         {
                         self->stop_request = FALSE;
-                        self->record_mode = RM_STOPPING;
+                        recorder_set_mode(self, RM_STOPPING);
                         }
                     if (self->pause_request)
                         {
                         self->pause_request = FALSE;
-                        self->record_mode = RM_PAUSED;
+                        recorder_set_mode(self, RM_PAUSED);
                         }
                         
                     if (self->new_artist_title)
@@ -603,22 +787,24 @@ static void *recorder_main(void *args)
                     {
                     if ((packet = encoder_client_get_packet(self->encoder_op)))
                         {
+                        __atomic_add_fetch(&self->latency_us_total, encoder_packet_age_us(packet), __ATOMIC_RELAXED);
+                        __atomic_add_fetch(&self->latency_count, 1, __ATOMIC_RELAXED);
                         if (packet->header.serial >= self->initial_serial)
                             {
                             if ((packet->header.flags & PF_INITIAL) && self->id3_mode)
                                 recorder_append_metadata2(self, packet);
                             if (packet->header.flags & (PF_OGG | PF_MP3 | PF_MP2 | PF_AAC | PF_AACP2))
                                 {
-                                if (packet->header.data_size != fwrite(packet->data, 1, packet->header.data_size, self->fp))
+                                if ((ssize_t)packet->header.data_size != writebehind_write(self->wb, packet->data, packet->header.data_size))
                                     {
                                     fprintf(stderr, "recorder_main: failed writing to file %s\n", self->pathname);
-                                    self->record_mode = RM_STOPPING;
+                                    recorder_set_mode(self, RM_STOPPING);
                                     }
                                 else
                                     {
                                     self->recording_length_s = (int)(self->accumulated_time + packet->header.timestamp);
                                     self->recording_length_ms = (int)((self->accumulated_time + packet->header.timestamp) * 1000.0);
-                                    self->bytes_written = ftell(self->fp);
+                                    self->bytes_written = writebehind_tell(self->wb) - self->tag_reserve;
                                     }
                                 }
                             if (packet->header.flags & PF_FINAL)
@@ -626,7 +812,7 @@ static void *recorder_main(void *args)
                                 self->accumulated_time += packet->header.timestamp;
                                 if (self->pause_pending && packet->header.serial >= self->final_serial)
                                     {
-                                    self->record_mode = RM_PAUSED;
+                                    recorder_set_mode(self, RM_PAUSED);
                                     self->pause_pending = FALSE;
                                     fprintf(stderr, "recorder_main: entering pause mode\n");
                                     }
@@ -652,12 +838,14 @@ static void *recorder_main(void *args)
                 break;
             case RM_PAUSED:
                 if (self->stop_request || self->stop_pending)
-                    self->record_mode = RM_STOPPING;
+                    recorder_set_mode(self, RM_STOPPING);
                 else
                     {
-                    while ((nbytes = jack_ringbuffer_read(self->input_rb[1], self->right, audio_buffer_elements * sizeof (sample_t))))
+                    if (self->input.ring)
                         {
-                        jack_ringbuffer_read(self->input_rb[0], self->left, nbytes);
+                        lr[0] = (sample_t *)self->left;
+                        lr[1] = (sample_t *)self->right;
+                        while (capture_reader_read_stereo(&self->input, lr, audio_buffer_elements));
                         }
                         
                     if (self->unpause_request)
@@ -665,7 +853,7 @@ static void *recorder_main(void *args)
                         self->unpause_request = FALSE;
                         if (self->initial_serial != -1)
                             self->initial_serial = encoder_client_set_flush(self->encoder_op) + 1;
-                        self->record_mode = RM_RECORDING;
+                        recorder_set_mode(self, RM_RECORDING);
                         }
                     }
                 break;
@@ -674,11 +862,9 @@ static void *recorder_main(void *args)
                     {
                     sf_close(self->sf);
                     fclose(self->fpcue);
-                    self->jack_dataflow_control = JD_FLUSH;
-                    while (self->jack_dataflow_control != JD_OFF)
-                        nanosleep(&ms10, NULL);
-                    jack_ringbuffer_free(self->input_rb[0]);
-                    jack_ringbuffer_free(self->input_rb[1]);
+                    if (self->input.overflows)
+                        fprintf(stderr, "recorder_main: input overflowed %u times, %llu frames dropped\n", self->input.overflows, (unsigned long long)self->input.frames_dropped);
+                    capture_reader_detach(&self->input);
                     free(self->left);
                     free(self->right);
                     free(self->combined);
@@ -701,7 +887,9 @@ static void *recorder_main(void *args)
                     encoder_unregister_client(self->encoder_op);
                     }
 
-                fclose(self->fp);
+                if (writebehind_close(self->wb))
+                    fprintf(stderr, "recorder_main: error writing to file %s\n", self->pathname);
+                recorder_display_write_stats(self);
                 free(self->pathname);
                 free(self->cuepathname);
                 free(self->timestamp);
@@ -715,7 +903,8 @@ static void *recorder_main(void *args)
                 self->recording_length_ms = 0;
                 self->accumulated_time = 0.0;
                 self->bytes_written = 0;
-                self->fp = NULL;
+                self->tag_reserve = 0;
+                self->wb = NULL;
                 self->pathname = NULL;
                 self->cuepathname = NULL;
                 self->encoder_op = NULL;
@@ -723,7 +912,7 @@ static void *recorder_main(void *args)
                 self->stop_pending = FALSE;
                 self->pause_request = FALSE;
                 self->pause_pending = FALSE;
-                self->record_mode = RM_STOPPED;
+                recorder_set_mode(self, RM_STOPPED);
                 break;
             default:
                 fprintf(stderr, "recorder_main: unhandled record mode\n");
@@ -734,7 +923,17 @@ static void *recorder_main(void *args)
 
 int recorder_make_report(struct recorder *self)
     {
-    fprintf(g.out, "idjcsc: recorder%dreport=%d:%d\n", self->numeric_id, self->record_mode, self->recording_length_s);
+    unsigned wakeups = __atomic_exchange_n(&self->wakeups, 0, __ATOMIC_RELAXED);
+    unsigned latency_count = __atomic_exchange_n(&self->latency_count, 0, __ATOMIC_RELAXED);
+    long latency_us = __atomic_exchange_n(&self->latency_us_total, 0, __ATOMIC_RELAXED);
+
+    struct writebehind_stats *s = &self->wb_stats;
+    char depth[WRITEBEHIND_BUCKETS * 11], latency[WRITEBEHIND_BUCKETS * 11];
+
+    if (latency_count)
+        latency_us /= latency_count;
+    fprintf(g.out, "idjcsc: recorder%dreport=%d:%d:%ld:%u:%s:%s:%u\n", self->numeric_id, self->record_mode, self->recording_length_s, latency_us, wakeups,
+                recorder_histogram(depth, s->depth), recorder_histogram(latency, s->latency), s->stalls);
     fflush(g.out);
     return SUCCEEDED;
     }
@@ -883,7 +1082,7 @@ int recorder_start(struct threads_info *ti, struct universal_vars *uv, void *oth
     memcpy(self->cuepathname, self->pathname, base);
     memcpy(self->cuepathname + base, ".cue", 5);
 
-    if (!(self->fp = fopen(self->pathname, "w")))
+    if (!(self->wb = writebehind_open(self->pathname, &self->wb_stats)))
         {
         fprintf(stderr, "recorder_start: failed to open file %s\nuser should check file permissions on the particular directory\n", rv->record_folder);
         free(self->pathname);
@@ -892,6 +1091,14 @@ int recorder_start(struct threads_info *ti, struct universal_vars *uv, void *oth
             encoder_unregister_client(self->encoder_op);
         return FAILED;
         }
+    if (self->id3_mode && !recorder_reserve_tag_space(self))
+        {
+        free(self->pathname);
+        free(self->timestamp);
+        writebehind_close(self->wb);
+        encoder_unregister_client(self->encoder_op);
+        return FAILED;
+        }
     if (self->encoder_op)
         {
         self->initial_serial = encoder_client_set_flush(self->encoder_op) + 1;
@@ -905,7 +1112,7 @@ int recorder_start(struct threads_info *ti, struct universal_vars *uv, void *oth
             fprintf(stderr, "recorder_start: failed to open cue file for writing\n");
             free(self->pathname);
             free(self->timestamp);
-            fclose(self->fp);
+            writebehind_close(self->wb);
             return FAILED;
             }
         else
@@ -918,29 +1125,18 @@ int recorder_start(struct threads_info *ti, struct universal_vars *uv, void *oth
         self->sfinfo.samplerate = ti->audio_feed->sample_rate;
         self->sfinfo.channels = 2;
         self->sfinfo.format = SF_FORMAT_FLAC | SF_FORMAT_PCM_24;
-        if (!(self->sf = sf_open_fd(fileno(self->fp), SFM_WRITE, &self->sfinfo, 0)))
+        if (!(self->sf = sf_open_virtual(&recorder_sf_io, SFM_WRITE, &self->sfinfo, self->wb)))
             {
             free(self->pathname);
             free(self->timestamp);
-            fclose(self->fp);
+            writebehind_close(self->wb);
             fclose(self->fpcue);
             fprintf(stderr, "recorder_start: unable to initialise FLAC encoder\n");
             return FAILED;
             }
             
-        self->input_rb[0] = jack_ringbuffer_create(rb_n_samples * sizeof (sample_t));
-        self->input_rb[1] = jack_ringbuffer_create(rb_n_samples * sizeof (sample_t));
-        if (!(self->input_rb[0] && self->input_rb[1]))
-            {
-            fprintf(stderr, "encoder_start: jack ringbuffer creation failure\n");
-            free(self->pathname);
-            free(self->timestamp);
-            fclose(self->fp);
-            fclose(self->fpcue);
-            fprintf(stderr, "recorder_start: failed to create ringbuffers\n");
-            return FAILED;
-            }
-        self->jack_dataflow_control = JD_ON;  
+        self->performance_warning_indicator = PW_OK;
+        capture_reader_attach(&self->input, self->threads_info->audio_feed->capture_ring, self->threads_info->audio_feed->overflow_policy);
         self->initial_serial = -1;
         self->new_artist_title = TRUE; /* risk inheriting old metadata rather than start with empty */
         fprintf(stderr, "recorder_start: in FLAC mode\n");
@@ -952,7 +1148,7 @@ int recorder_start(struct threads_info *ti, struct universal_vars *uv, void *oth
         self->record_mode = RM_PAUSED;
     else 
         self->record_mode = RM_RECORDING;
-    pthread_cond_signal(&self->mode_cv);
+    pthread_cond_broadcast(&self->mode_cv);
     pthread_mutex_unlock(&self->mode_mutex);
     fprintf(stderr, "recorder_start: device %d activated\n", self->numeric_id);
     return SUCCEEDED;
@@ -961,7 +1157,6 @@ int recorder_start(struct threads_info *ti, struct universal_vars *uv, void *oth
 int recorder_stop(struct threads_info *ti, struct universal_vars *uv, void *other)
     {
     struct recorder *self = ti->recorder[uv->tab];
-    struct timespec ms10 = { 0, 10000000 };
 
     if (self->record_mode == RM_STOPPED)
         {
@@ -969,8 +1164,10 @@ int recorder_stop(struct threads_info *ti, struct universal_vars *uv, void *othe
         return FAILED;
         }
     self->stop_request = TRUE;
+    pthread_mutex_lock(&self->mode_mutex);
     while (self->record_mode != RM_STOPPED)
-        nanosleep(&ms10, NULL);
+        pthread_cond_wait(&self->mode_cv, &self->mode_mutex);
+    pthread_mutex_unlock(&self->mode_mutex);
     fprintf(stderr, "recorder_stop: device %d stopped\n", self->numeric_id);
     return SUCCEEDED;
     }
@@ -978,15 +1175,16 @@ int recorder_stop(struct threads_info *ti, struct universal_vars *uv, void *othe
 int recorder_pause(struct threads_info *ti, struct universal_vars *uv, void *other)
     {
     struct recorder *self = ti->recorder[uv->tab];
-    struct timespec ms10 = { 0, 10000000 };
 
     self->unpause_request = FALSE;
     self->pause_request = TRUE;
     if (self->record_mode == RM_RECORDING)
         {
         fprintf(stderr, "recorder_pause: waiting for pause mode to be entered\n");
+        pthread_mutex_lock(&self->mode_mutex);
         while (self->record_mode != RM_PAUSED)
-            nanosleep(&ms10, NULL);
+            pthread_cond_wait(&self->mode_cv, &self->mode_mutex);
+        pthread_mutex_unlock(&self->mode_mutex);
         fprintf(stderr, "recorder_pause: in pause mode\n");
         }
     else
@@ -1005,15 +1203,16 @@ int recorder_pause(struct threads_info *ti, struct universal_vars *uv, void *oth
 int recorder_unpause(struct threads_info *ti, struct universal_vars *uv, void *other)
     {
     struct recorder *self = ti->recorder[uv->tab];
-    struct timespec ms10 = { 0, 10000000 };
     
     self->pause_request = FALSE;
     self->unpause_request = TRUE;
     if (self->record_mode == RM_PAUSED)
         {
         fprintf(stderr, "recorder_unpause: waiting for pause mode to finish\n");
+        pthread_mutex_lock(&self->mode_mutex);
         while (self->record_mode == RM_PAUSED)
-            nanosleep(&ms10, NULL);
+            pthread_cond_wait(&self->mode_cv, &self->mode_mutex);
+        pthread_mutex_unlock(&self->mode_mutex);
         fprintf(stderr, "recorder_unpause: left pause mode\n");
         }
     else
@@ -1049,7 +1248,7 @@ void recorder_destroy(struct recorder *self)
     {
     pthread_mutex_lock(&self->mode_mutex);
     self->thread_terminate_f = TRUE;
-    pthread_cond_signal(&self->mode_cv);
+    pthread_cond_broadcast(&self->mode_cv);
     pthread_mutex_unlock(&self->mode_mutex);
     pthread_join(self->thread_h, NULL);
     pthread_cond_destroy(&self->mode_cv);
@@ -23,6 +23,7 @@
 #include <stdio.h>
 #include <sndfile.h>
 #include "sourceclient.h"
+#include "writebehind.h"
 
 enum record_mode { RM_STOPPED, RM_RECORDING, RM_PAUSED, RM_STOPPING };
 
@@ -78,9 +79,11 @@ struct recorder
     int recording_length_s;      /* time in whole seconds that are recorded */
     int recording_length_ms;
     double accumulated_time;     /* prior stream lengths are accumulated here */
-    int bytes_written;           /* logs the current file size */
+    int bytes_written;           /* logs the current file size less tag_reserve */
+    size_t tag_reserve;          /* space at the start of the file kept for tags */
     struct encoder_op *encoder_op;       /* handle for getting input data */
-    FILE *fp;
+    struct writebehind *wb;      /* output file */
+    struct writebehind_stats wb_stats;   /* its queue depth and write latency */
     char *pathname;              /* /path/to/filebeingsaved.[ogg/mp3] */
     char *cuepathname;            /* pathname of cue file */
     char *timestamp;             /* just the timestamp from the filename */
@@ -97,8 +100,7 @@ struct recorder
     char first_mp3_header[4];
     SNDFILE *sf;                 /* support for recording with libsndfile */
     SF_INFO sfinfo;
-    enum jack_dataflow jack_dataflow_control;    /* tells the jack callback routine what we want it to do */
-    jack_ringbuffer_t *input_rb[2];      /* circular buffer containing pcm audio data */
+    struct capture_reader input;         /* pcm audio data from the jack callback */
     enum performance_warning performance_warning_indicator; /* indicates ringbuffer overflow condition */
     char *left;
     char *right;
@@ -113,6 +115,9 @@ struct recorder
     int new_artist_title;
     pthread_mutex_t mode_mutex;
     pthread_cond_t mode_cv;
+    unsigned wakeups;            /* recorder thread wakeups since the last report */
+    long latency_us_total;       /* encoder to recorder packet delay since the last report */
+    unsigned latency_count;
     };
 
 struct recorder *recorder_init(struct threads_info *ti, int numeric_id);
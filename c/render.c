@@ -0,0 +1,429 @@
+/*
+#   render.c: offline rendering of a show without a JACK server
+#   Copyright (C) 2013 Stephen Fairchild (s-fairchild@users.sf.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Usage: idjc_render [-r rate] [-p frames] [-o file.wav] [script]
+ *
+ * Runs the backend with the JACK process callback driven from a clock that
+ * counts rendered frames rather than from a JACK server, as fast as the
+ * decoders, mixer and encoders allow. Each of those runs in its own thread as
+ * it would live so decoding and encoding is spread over the available cores.
+ *
+ * The script, or stdin, is what the user interface would send the backend:
+ * blocks of "mx", "mb" and "sc" commands for the mixer and the sourceclient.
+ * A line "@seconds" renders up to that point in the show before the commands
+ * that follow are acted on, so players, jingles and recorders can be started
+ * and stopped at the right moments. Backend replies go to stdout.
+ *
+ * The ports are connected as the user interface connects them by default
+ * and the stream mix feeds the encoders and recorders. -o also writes it to
+ * a 24 bit WAV file.
+ *
+ * The clock waits for any player whose decoder has not yet provided the next
+ * period and for any encoder or recorder that has fallen half a capture ring
+ * behind, so nothing is ever dropped for being late. A decoder or encoder
+ * making no progress for RENDER_STALL_S seconds is given up on.
+ */
+
+#include "../config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <locale.h>
+#include <unistd.h>
+#include <time.h>
+#include <sndfile.h>
+#include <jack/jack.h>
+#include <jack/midiport.h>
+
+#ifdef HAVE_LIBAV
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#endif
+
+#include "main.h"
+#include "mixer.h"
+#include "sourceclient.h"
+#include "telemetry.h"
+
+#define TRUE 1
+#define FALSE 0
+
+#define RENDER_STALL_S 10.0
+
+/* any jack_port_t pointer the backend holds is one of these */
+struct render_port
+    {
+    char *name;
+    int is_input;
+    float *buffer;
+    struct render_port *source[2];       /* the outputs connected to an input */
+    int n_sources;
+    struct render_port *next;
+    };
+
+/* the connections the user interface makes by default within the client */
+static const char *connections[][2] = {
+    { "pl_out_l", "pl_in_l" }, { "pl_out_r", "pl_in_r" },
+    { "pr_out_l", "pr_in_l" }, { "pr_out_r", "pr_in_r" },
+    { "pi_out_l", "pi_in_l" }, { "pi_out_r", "pi_in_r" },
+    { "pe01-12_out_l", "pe_in_l" }, { "pe01-12_out_r", "pe_in_r" },
+    { "pe13-24_out_l", "pe_in_l" }, { "pe13-24_out_r", "pe_in_r" },
+    { "str_out_l", "output_in_l" }, { "str_out_r", "output_in_r" },
+    { NULL, NULL }};
+
+static struct render_port *ports;
+static jack_nframes_t sample_rate = 44100;
+static jack_nframes_t period = 1024;
+static uint64_t frames_rendered;
+static double decoder_wait, encoder_wait;
+static unsigned stalls;
+static SNDFILE *sf;
+static float *interleaved;
+
+static double render_now()
+    {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+    }
+
+/* The backend modules call these by their libjack names and the definitions
+ * in the executable take precedence over those in the shared library.
+ */
+
+void *jack_port_get_buffer(jack_port_t *port, jack_nframes_t nframes)
+    {
+    struct render_port *self = (struct render_port *)port;
+    jack_nframes_t i;
+
+    switch (self->n_sources)
+        {
+        case 0:
+            return self->buffer;
+        case 1:
+            /* a single connection is read straight from the output as with JACK */
+            return self->source[0]->buffer;
+        default:
+            for (i = 0; i < nframes; ++i)
+                self->buffer[i] = self->source[0]->buffer[i] + self->source[1]->buffer[i];
+            return self->buffer;
+        }
+    }
+
+jack_nframes_t jack_get_sample_rate(jack_client_t *client)
+    {
+    return sample_rate;
+    }
+
+jack_port_t *jack_port_register(jack_client_t *client, const char *port_name,
+                const char *port_type, unsigned long flags, unsigned long buffer_size)
+    {
+    struct render_port *self;
+
+    if (!(self = calloc(1, sizeof (struct render_port))) || !(self->name = strdup(port_name)) ||
+                !(self->buffer = calloc(period, sizeof (float))))
+        {
+        fprintf(stderr, "jack_port_register: malloc failure\n");
+        exit(5);
+        }
+    self->is_input = (flags & JackPortIsInput) ? TRUE : FALSE;
+    self->next = ports;
+    ports = self;
+    return (jack_port_t *)self;
+    }
+
+jack_port_t *jack_port_by_name(jack_client_t *client, const char *port_name)
+    {
+    return NULL;
+    }
+
+const char **jack_port_get_all_connections(const jack_client_t *client, const jack_port_t *port)
+    {
+    return NULL;
+    }
+
+const char **jack_get_ports(jack_client_t *client, const char *port_name_pattern,
+                const char *type_name_pattern, unsigned long flags)
+    {
+    return NULL;
+    }
+
+int jack_port_flags(const jack_port_t *port)
+    {
+    return ((struct render_port *)port)->is_input ? JackPortIsInput : JackPortIsOutput;
+    }
+
+int jack_port_disconnect(jack_client_t *client, jack_port_t *port)
+    {
+    return 0;
+    }
+
+void jack_free(void *ptr)
+    {
+    free(ptr);
+    }
+
+int jack_set_port_connect_callback(jack_client_t *client, JackPortConnectCallback cb, void *arg)
+    {
+    return 0;
+    }
+
+/* rendering is freewheeling already */
+int jack_set_freewheel(jack_client_t *client, int onoff)
+    {
+    return 0;
+    }
+
+uint32_t jack_midi_get_event_count(void *port_buffer)
+    {
+    return 0;
+    }
+
+int jack_midi_event_get(jack_midi_event_t *event, void *port_buffer, uint32_t event_index)
+    {
+    return ENODATA;
+    }
+
+static struct render_port *render_port_find(const char *name)
+    {
+    struct render_port *port;
+
+    for (port = ports; port && strcmp(port->name, name); port = port->next);
+    return port;
+    }
+
+static void render_connect()
+    {
+    struct render_port *src, *dest;
+
+    for (int i = 0; connections[i][0]; ++i)
+        {
+        if (!(src = render_port_find(connections[i][0])) || !(dest = render_port_find(connections[i][1])))
+            {
+            fprintf(stderr, "render_connect: no port for %s -> %s\n", connections[i][0], connections[i][1]);
+            exit(5);
+            }
+        dest->source[dest->n_sources++] = src;
+        }
+    }
+
+/* render_wait: hold the clock until ready returns true, gives up after RENDER_STALL_S */
+static void render_wait(int (*ready)(jack_nframes_t), double *waited, const char *what)
+    {
+    struct timespec pause = { 0, 250000 };
+    double start;
+
+    if (ready(period))
+        return;
+    start = render_now();
+    while (!ready(period))
+        {
+        if (render_now() - start > RENDER_STALL_S)
+            {
+            fprintf(stderr, "render_wait: no progress from %s in %.0f seconds, carrying on\n", what, RENDER_STALL_S);
+            stalls++;
+            break;
+            }
+        nanosleep(&pause, NULL);
+        }
+    *waited += render_now() - start;
+    }
+
+static void render_period()
+    {
+    float *l, *r;
+
+    render_wait(mixer_render_ready, &decoder_wait, "a decoder");
+    render_wait(audio_feed_render_ready, &encoder_wait, "an encoder or recorder");
+
+    mixer_process_audio(period, NULL);
+    audio_feed_process_audio(period, NULL);
+
+    if (sf)
+        {
+        l = jack_port_get_buffer(g.port.str_out_l, period);
+        r = jack_port_get_buffer(g.port.str_out_r, period);
+        for (jack_nframes_t i = 0; i < period; ++i)
+            {
+            interleaved[i * 2] = l[i];
+            interleaved[i * 2 + 1] = r[i];
+            }
+        if (sf_writef_float(sf, interleaved, period) != period)
+            {
+            fprintf(stderr, "render_period: write failed: %s\n", sf_strerror(sf));
+            exit(5);
+            }
+        }
+    frames_rendered += period;
+    }
+
+static void render_until(double seconds)
+    {
+    uint64_t target = (uint64_t)(seconds * sample_rate);
+
+    while (frames_rendered < target)
+        render_period();
+    }
+
+/* render_drain: let the encoders and recorders consume what has been rendered */
+static void render_drain()
+    {
+    struct timespec pause = { 0, 1000000 };
+    size_t backlog, last = 0;
+    double progress = render_now();
+
+    /* the resampler holds back a little so draining down to under a period is as good as it gets */
+    while ((backlog = audio_feed_backlog()) > period)
+        {
+        if (backlog != last)
+            {
+            last = backlog;
+            progress = render_now();
+            }
+        else if (render_now() - progress > RENDER_STALL_S)
+            {
+            fprintf(stderr, "render_drain: gave up with %lu frames unread\n", (unsigned long)backlog);
+            stalls++;
+            break;
+            }
+        nanosleep(&pause, NULL);
+        }
+    }
+
+int main(int argc, char **argv)
+    {
+    SF_INFO sfinfo;
+    char *buffer = NULL, *wav_pathname = NULL;
+    size_t n = 10;
+    int keep_running = TRUE, opt;
+    double wall, seconds;
+
+    while ((opt = getopt(argc, argv, "r:p:o:")) != -1)
+        switch (opt)
+            {
+            case 'r':
+                sample_rate = atoi(optarg);
+                break;
+            case 'p':
+                period = atoi(optarg);
+                break;
+            case 'o':
+                wav_pathname = optarg;
+                break;
+            default:
+                goto usage;
+            }
+    if (optind < argc - 1 || sample_rate < 8000 || period < 256 || period > 16384)
+        goto usage;
+    if (optind == argc - 1)
+        {
+        if (!(g.in = fopen(argv[optind], "r")))
+            {
+            fprintf(stderr, "main: failed to open %s: %s\n", argv[optind], strerror(errno));
+            exit(5);
+            }
+        }
+    else
+        g.in = stdin;
+    g.out = stdout;
+
+    /* a recorder can be descheduled for a lot more audio than it would be live */
+    setenv("encoder_queue_ms", "30000", 0);
+    backend_defaults();
+    setenv("offline_render", "1", 1);
+    unsetenv("telemetry_file");
+    setlocale(LC_ALL, getenv("LC_ALL"));
+
+#ifdef HAVE_LIBAV
+    if (pthread_mutex_init(&g.avc_mutex, NULL))
+        {
+        fprintf(stderr, "pthread_mutex_init failed\n");
+        exit(5);
+        }
+    avcodec_register_all();
+    av_register_all();
+#endif /* HAVE_LIBAV */
+
+    backend_register_ports();
+    render_connect();
+    telemetry_init();
+    mixer_init();
+    sourceclient_init();
+    mixer_new_buffer_size(period);
+
+    if (wav_pathname)
+        {
+        memset(&sfinfo, 0, sizeof sfinfo);
+        sfinfo.samplerate = sample_rate;
+        sfinfo.channels = 2;
+        sfinfo.format = SF_FORMAT_WAV | SF_FORMAT_PCM_24;
+        if (!(interleaved = malloc(period * 2 * sizeof (float))) || !(sf = sf_open(wav_pathname, SFM_WRITE, &sfinfo)))
+            {
+            fprintf(stderr, "main: failed to open %s for writing\n", wav_pathname);
+            exit(5);
+            }
+        sf_command(sf, SFC_SET_CLIPPING, NULL, SF_TRUE);
+        }
+
+    wall = render_now();
+    while (keep_running && getline(&buffer, &n, g.in) > 0 && !g.app_shutdown)
+        {
+        if (buffer[0] == '@')
+            render_until(atof(buffer + 1));
+        else if (!strcmp(buffer, "mx\n"))
+            keep_running = mixer_main();
+        else if (!strcmp(buffer, "mb\n"))
+            keep_running = mixer_main_binary();
+        else if (!strcmp(buffer, "sc\n"))
+            {
+            /* so a recorder being stopped has everything up to now */
+            render_drain();
+            keep_running = sourceclient_main();
+            }
+        else if (buffer[0] != '#' && buffer[0] != '\n')
+            {
+            fprintf(stderr, "main: expected module name or @seconds, got: %s", buffer);
+            exit(5);
+            }
+        }
+    render_drain();
+    wall = render_now() - wall;
+
+    seconds = (double)frames_rendered / sample_rate;
+    fprintf(stderr, "render: %.1f seconds in %.1f, %.1fx realtime, waited %.1f s on decoders, %.1f s on encoders, %u stalls\n",
+                seconds, wall, wall > 0.0 ? seconds / wall : 0.0, decoder_wait, encoder_wait, stalls);
+
+    if (sf && sf_close(sf))
+        {
+        fprintf(stderr, "main: failed to close %s\n", wav_pathname);
+        exit(5);
+        }
+    free(interleaved);
+    free(buffer);
+    if (g.in != stdin)
+        fclose(g.in);
+    return 0;
+
+    usage:
+    fprintf(stderr, "usage: %s [-r rate] [-p frames] [-o file.wav] [script]\n", argv[0]);
+    return 5;
+    }
@@ -0,0 +1,203 @@
+/*
+#   resample_stage.c: sample rate conversion shared between encoders
+#   Copyright (C) 2013 Stephen Fairchild (s-fairchild@users.sourceforge.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include "sourceclient.h"
+#include "resample_stage.h"
+
+#define RS_INPUT_SAMPLES 512
+#define RS_OUTPUT_SAMPLES 2048
+
+typedef jack_default_audio_sample_t sample_t;
+
+/* the stages currently in use */
+static struct resample_stage *stages;
+static pthread_mutex_t stages_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* the resampler takes interleaved stereo, both channels are read as one span */
+static long resample_stage_get_data(void *cb_data, float **data)
+    {
+    struct resample_stage *self = cb_data;
+    size_t n, i;
+
+    n = capture_reader_read_stereo(&self->input, self->rs_planar, RS_INPUT_SAMPLES);
+    for (i = 0; i < n; ++i)
+        {
+        self->rs_input[i * 2] = self->rs_planar[0][i];
+        self->rs_input[i * 2 + 1] = self->rs_planar[1][i];
+        }
+    *data = self->rs_input;
+    return (long)n;
+    }
+
+static void resample_stage_free(struct resample_stage *self)
+    {
+    capture_reader_detach(&self->input);
+    if (self->src_state)
+        src_delete(self->src_state);
+    free(self->rs_input);
+    free(self->rs_interleaved);
+    for (int i = 0; i < 2; ++i)
+        {
+        free(self->rs_planar[i]);
+        free(self->rs_output[i]);
+        }
+    if (self->output)
+        capture_ring_destroy(self->output);
+    pthread_mutex_destroy(&self->mutex);
+    free(self);
+    }
+
+static struct resample_stage *resample_stage_new(struct audio_feed *af, long target_samplerate, int resample_mode)
+    {
+    struct resample_stage *self;
+    int error;
+
+    if (!(self = calloc(1, sizeof (struct resample_stage))))
+        {
+        fprintf(stderr, "resample_stage_new: malloc failure\n");
+        return NULL;
+        }
+
+    pthread_mutex_init(&self->mutex, NULL);
+    self->target_samplerate = target_samplerate;
+    self->resample_mode = resample_mode;
+    self->ratio = (double)target_samplerate / (double)af->sample_rate;
+
+    for (int i = 0; i < 2; ++i)
+        if (!(self->rs_planar[i] = malloc(RS_INPUT_SAMPLES * sizeof (sample_t))) ||
+                    !(self->rs_output[i] = malloc(RS_OUTPUT_SAMPLES * sizeof (sample_t))))
+            {
+            fprintf(stderr, "resample_stage_new: malloc failure\n");
+            goto failed;
+            }
+    if (!(self->rs_input = malloc(RS_INPUT_SAMPLES * 2 * sizeof (sample_t))) ||
+                !(self->rs_interleaved = malloc(RS_OUTPUT_SAMPLES * 2 * sizeof (sample_t))))
+        {
+        fprintf(stderr, "resample_stage_new: malloc failure\n");
+        goto failed;
+        }
+    if (!(self->src_state = src_callback_new(resample_stage_get_data, resample_mode, 2, &error, self)))
+        {
+        fprintf(stderr, "resample_stage_new: %s\n", src_strerror(error));
+        goto failed;
+        }
+    src_set_ratio(self->src_state, self->ratio);
+
+    if (!(self->output = capture_ring_create(target_samplerate * 2)))
+        goto failed;
+    self->output->backpressure = af->capture_ring->backpressure;
+
+    capture_reader_attach(&self->input, af->capture_ring, af->overflow_policy);
+    return self;
+
+    failed:
+    resample_stage_free(self);
+    return NULL;
+    }
+
+/* resample_stage_get: find or make a stage for the given conversion */
+struct resample_stage *resample_stage_get(struct audio_feed *af, long target_samplerate, int resample_mode)
+    {
+    struct resample_stage *self;
+
+    pthread_mutex_lock(&stages_mutex);
+    for (self = stages; self; self = self->next)
+        if (self->target_samplerate == target_samplerate && self->resample_mode == resample_mode)
+            break;
+
+    if (self)
+        fprintf(stderr, "resample_stage_get: sharing resampler to %ld Hz\n", target_samplerate);
+    else
+        {
+        if ((self = resample_stage_new(af, target_samplerate, resample_mode)))
+            {
+            self->next = stages;
+            stages = self;
+            fprintf(stderr, "resample_stage_get: new resampler to %ld Hz\n", target_samplerate);
+            }
+        }
+
+    if (self)
+        self->refcount++;
+    pthread_mutex_unlock(&stages_mutex);
+    return self;
+    }
+
+void resample_stage_release(struct resample_stage *self)
+    {
+    struct resample_stage **sp;
+
+    pthread_mutex_lock(&stages_mutex);
+    if (!--self->refcount)
+        {
+        for (sp = &stages; *sp != self; sp = &(*sp)->next);
+        *sp = self->next;
+        if (self->input.overflows)
+            fprintf(stderr, "resample_stage_release: input overflowed %u times, %llu frames dropped\n", self->input.overflows, (unsigned long long)self->input.frames_dropped);
+        resample_stage_free(self);
+        }
+    pthread_mutex_unlock(&stages_mutex);
+    }
+
+/* resample_stage_pump: convert whatever is waiting in the capture ring */
+void resample_stage_pump(struct resample_stage *self)
+    {
+    ssize_t n_samples, room;
+    long n, n_read, i;
+
+    /* another encoder is doing this already */
+    if (pthread_mutex_trylock(&self->mutex))
+        return;
+
+    /* note 128 samples are held back to allow for what the resampler keeps for itself */
+    n_samples = (ssize_t)(capture_reader_read_space(&self->input) * self->ratio) - 128;
+    if (self->output->backpressure)
+        {
+        /* leave the excess in the capture ring where the renderer will wait for it */
+        room = (ssize_t)(self->output->size >> 1) - (ssize_t)capture_ring_max_lag(self->output);
+        if (n_samples > room)
+            n_samples = room;
+        }
+    while (n_samples > 0)
+        {
+        n = (n_samples > RS_OUTPUT_SAMPLES) ? RS_OUTPUT_SAMPLES : n_samples;
+        if (!(n_read = src_callback_read(self->src_state, self->ratio, n, self->rs_interleaved)))
+            break;
+        for (i = 0; i < n_read; ++i)
+            {
+            self->rs_output[0][i] = self->rs_interleaved[i * 2];
+            self->rs_output[1][i] = self->rs_interleaved[i * 2 + 1];
+            }
+        capture_ring_write(self->output, self->rs_output, n_read);
+        n_samples -= n_read;
+        }
+    __atomic_store_n(&self->input_overflows, self->input.overflows, __ATOMIC_RELAXED);
+
+    pthread_mutex_unlock(&self->mutex);
+    }
+
+/* resample_stage_overflows: how many times the jack callback has lapped the
+ * stage, audio every attached encoder has lost */
+unsigned resample_stage_overflows(struct resample_stage *self)
+    {
+    return __atomic_load_n(&self->input_overflows, __ATOMIC_RELAXED);
+    }
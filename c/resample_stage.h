@@ -0,0 +1,57 @@
+/*
+#   resample_stage.h: sample rate conversion shared between encoders
+#   Copyright (C) 2013 Stephen Fairchild (s-fairchild@users.sourceforge.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef RESAMPLE_STAGE_H
+#define RESAMPLE_STAGE_H
+
+#include <pthread.h>
+#include <samplerate.h>
+#include "capture_ring.h"
+
+struct audio_feed;
+
+/* Encoders with the same target sample rate and resample quality share one
+ * of these. Whichever encoder wants data first converts everything that is
+ * waiting in the capture ring and writes it to the output ring where all of
+ * them read it from.
+ */
+struct resample_stage
+    {
+    struct resample_stage *next;
+    int refcount;
+    long target_samplerate;
+    int resample_mode;
+    double ratio;
+    SRC_STATE *src_state;        /* one stereo converter keeps the channels in step */
+    float *rs_planar[2];         /* the capture ring's span as read */
+    float *rs_input;             /* and interleaved for the resampler input callback */
+    float *rs_interleaved;       /* resampler output */
+    float *rs_output[2];         /* and split again for the output ring */
+    struct capture_reader input; /* from the jack callback */
+    unsigned input_overflows;    /* input.overflows for readers without the mutex */
+    struct capture_ring *output; /* the encoders attach their readers here */
+    pthread_mutex_t mutex;
+    };
+
+struct resample_stage *resample_stage_get(struct audio_feed *af, long target_samplerate, int resample_mode);
+void resample_stage_release(struct resample_stage *self);
+void resample_stage_pump(struct resample_stage *self);
+unsigned resample_stage_overflows(struct resample_stage *self);
+
+#endif
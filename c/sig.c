@@ -74,3 +74,9 @@ int sig_recent_usr1()
         }
     return 0;
     }
+
+/* sig_usr1_pending: like sig_recent_usr1 but leaves the signal unconsumed */
+int sig_usr1_pending()
+    {
+    return sigusr1count != sigusr1oldcount;
+    }
@@ -30,6 +30,39 @@
 
 static const sf_count_t sndfile_frameqty = 4096;
 
+/* libsndfile reads through the shared file source by way of its virtual I/O */
+
+static sf_count_t sndfiledecode_vio_get_filelen(void *user_data)
+    {
+    return filesource_size(user_data);
+    }
+
+static sf_count_t sndfiledecode_vio_seek(sf_count_t offset, int whence, void *user_data)
+    {
+    if (filesource_seek(user_data, offset, whence))
+        return -1;
+    return filesource_tell(user_data);
+    }
+
+static sf_count_t sndfiledecode_vio_read(void *ptr, sf_count_t count, void *user_data)
+    {
+    return filesource_read(user_data, ptr, count);
+    }
+
+static sf_count_t sndfiledecode_vio_write(const void *ptr, sf_count_t count, void *user_data)
+    {
+    return 0;
+    }
+
+static sf_count_t sndfiledecode_vio_tell(void *user_data)
+    {
+    return filesource_tell(user_data);
+    }
+
+static SF_VIRTUAL_IO sndfiledecode_vio = {
+    sndfiledecode_vio_get_filelen, sndfiledecode_vio_seek, sndfiledecode_vio_read,
+    sndfiledecode_vio_write, sndfiledecode_vio_tell };
+
 static void sndfiledecode_init(struct xlplayer *xlplayer)
     {
     struct sndfiledecode_vars *self = xlplayer->dec_data;
@@ -39,6 +72,7 @@ static void sndfiledecode_init(struct xlplayer *xlplayer)
         {
         fprintf(stderr, "sndfiledecode_init: unable to allocate sndfile frames buffer\n");
         sf_close(self->sndfile);
+        filesource_close(self->fs);
         xlplayer->playmode = PM_STOPPED;
         xlplayer->command = CMD_COMPLETE;
         return;
@@ -51,6 +85,7 @@ static void sndfiledecode_init(struct xlplayer *xlplayer)
             {
             fprintf(stderr, "sndfiledecode_init: %s src_new reports - %s\n", xlplayer->playername, src_strerror(src_error));
             sf_close(self->sndfile);
+            filesource_close(self->fs);
             xlplayer->playmode = PM_STOPPED;
             xlplayer->command = CMD_COMPLETE;
             return;
@@ -103,6 +138,7 @@ static void sndfiledecode_eject(struct xlplayer *xlplayer)
     struct sndfiledecode_vars *self = xlplayer->dec_data;
     
     sf_close(self->sndfile);
+    filesource_close(self->fs);
     if (self->resample)
         {
         if (xlplayer->src_data.data_out)
@@ -123,8 +159,14 @@ int sndfiledecode_reg(struct xlplayer *xlplayer)
         return REJECTED;
         }
     self->sf_info.format = 0;
-    if (!(self->sndfile = sf_open(xlplayer->pathname, SFM_READ, &(self->sf_info))))
+    if (!(self->fs = filesource_open(xlplayer->pathname)))
+        {
+        free(self);
+        return REJECTED;
+        }
+    if (!(self->sndfile = sf_open_virtual(&sndfiledecode_vio, SFM_READ, &(self->sf_info), self->fs)))
         {
+        filesource_close(self->fs);
         free(self);
         return REJECTED;
         }
@@ -18,12 +18,14 @@
 */
 
 #include "xlplayer.h"
+#include "filesource.h"
 
 struct sndfiledecode_vars
     {
     float *flbuf;
     int resample;
     SNDFILE *sndfile;
+    struct filesource *fs;
     SF_INFO sf_info;
     };
 
@@ -31,6 +31,8 @@
 #include "live_ogg_encoder.h"
 #include "avcodec_encoder.h"
 #include "sig.h"
+#include "telemetry.h"
+#include "phash.h"
 #include "main.h"
 
 static int threads_up;
@@ -120,13 +122,37 @@ static int get_report(struct threads_info *ti, struct universal_vars *uv, void *
 
 static int command_parse(struct commandmap *map, struct threads_info *ti, struct universal_vars *uv)
     {
-    for (; map->key; map++)
-        if (!(strcmp(uv->command, map->key)))
+    static struct phash hash;
+    static const char **keys;
+    int i, n;
+
+    /* built on first use, there is only the one command map */
+    if (!keys)
+        {
+        for (n = 0; map[n].key; n++);
+        if (!(keys = malloc(n * sizeof (char *))))
             {
-            if (uv->tab_id)
-                uv->tab = atoi(uv->tab_id);
-            return map->function(ti, uv, map->other_parameter);
+            fprintf(stderr, "command_parse: malloc failure\n");
+            exit(5);
             }
+        for (i = 0; i < n; i++)
+            keys[i] = map[i].key;
+        /* a duplicate key is a programming error */
+        if (!phash_init(&hash, keys, n))
+            exit(5);
+        }
+
+    if ((i = phash_lookup(&hash, uv->command)) >= 0)
+        map += i;
+    else
+        for (; map->key; map++);
+
+    if (map->key)
+        {
+        if (uv->tab_id)
+            uv->tab = atoi(uv->tab_id);
+        return map->function(ti, uv, map->other_parameter);
+        }
     fprintf(stderr, "command_parse: unhandled command %s\n", uv->command);
     return FAILED;
     }
@@ -210,6 +236,27 @@ static struct commandmap commandmap[] = {
     { "initiate_fade", encoder_initiate_fade, NULL },
     { NULL, NULL, NULL } }; 
 
+/* sourceclient_telemetry: runs in the telemetry thread at a fixed rate */
+static void sourceclient_telemetry(struct telemetry *t)
+    {
+    int i;
+
+    if (!threads_up)
+        return;
+    for (i = 0; i < ti.n_encoders; i++)
+        t->encoders[i].state = ti.encoder[i]->encoder_state;
+    for (i = 0; i < ti.n_streamers; i++)
+        {
+        t->streamers[i].mode = ti.streamer[i]->stream_mode;
+        t->streamers[i].buffer_fill_pc = streamer_buffer_fill_pc(ti.streamer[i]);
+        }
+    for (i = 0; i < ti.n_recorders; i++)
+        {
+        t->recorders[i].mode = ti.recorder[i]->record_mode;
+        t->recorders[i].seconds = ti.recorder[i]->recording_length_s;
+        }
+    }
+
 static void sourceclient_cleanup()
     {
     threads_shutdown(&ti);
@@ -225,6 +272,7 @@ void sourceclient_init()
     srand(time(NULL));
     
     threads_init(&ti);
+    telemetry_register(sourceclient_telemetry);
     atexit(sourceclient_cleanup);
     }
 
@@ -22,8 +22,13 @@
 #define _POSIX_C_SOURCE 200112L
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
+#include <errno.h>
+#include <unistd.h>
 #include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <shoutidjc/shout.h>
 #include "sourceclient.h"
 #include "sig.h"
@@ -36,163 +41,367 @@
 
 /* the number of seconds of audio to stockpile before packet dumping takes place */
 static const int shout_buffer_seconds = 9;
+/* the most epoll events taken in one go */
+#define NET_EVENTS 16
 
-static void *streamer_main(void *args)
+/* One thread drives every streamer. Each streamer has an eventfd that the
+ * encoder writes when packets arrive and that streamer_connect and friends
+ * write to get its attention. While there is a connection its nonblocking
+ * socket is watched for whatever libshout is waiting on. The epoll data for
+ * both is the streamer and the data for quit_fd is NULL.
+ */
+static struct
+    {
+    pthread_mutex_t mutex;
+    pthread_t thread_h;
+    int epoll_fd;
+    int quit_fd;
+    int users;
+    } net = { PTHREAD_MUTEX_INITIALIZER };
+
+/* libshout holds packets it has queued by reference through these */
+static void streamer_ref_packet(void *packet)
+    {
+    encoder_client_ref_packet(packet);
+    }
+
+static void streamer_unref_packet(void *packet)
+    {
+    encoder_client_free_packet(packet);
+    }
+
+static void streamer_kick(struct streamer *self)
+    {
+    eventfd_write(self->event_fd, 1);
+    }
+
+/* every change of stream_mode is made under mode_mutex for the threads that wait on it */
+static void streamer_set_mode(struct streamer *self, enum stream_mode mode)
+    {
+    pthread_mutex_lock(&self->mode_mutex);
+    self->stream_mode = mode;
+    pthread_cond_broadcast(&self->mode_cv);
+    pthread_mutex_unlock(&self->mode_mutex);
+    }
+
+/* keep the epoll registration of the socket in step with libshout */
+static void streamer_watch(struct streamer *self)
+    {
+    struct epoll_event ev;
+    int fd = -1, wants = 0;
+
+    if (self->stream_mode != SM_DISCONNECTED && self->shout)
+        {
+        fd = shout_get_socket(self->shout);
+        wants = shout_get_poll_events(self->shout);
+        }
+    ev.events = ((wants & SHOUT_POLLIN) ? EPOLLIN : 0) | ((wants & SHOUT_POLLOUT) ? EPOLLOUT : 0);
+    ev.data.ptr = self;
+    if (fd != self->watch_fd)
+        {
+        /* fails harmlessly when libshout has closed the socket already */
+        if (self->watch_fd >= 0)
+            epoll_ctl(net.epoll_fd, EPOLL_CTL_DEL, self->watch_fd, NULL);
+        if ((self->watch_fd = fd) >= 0 && epoll_ctl(net.epoll_fd, EPOLL_CTL_ADD, fd, &ev))
+            {
+            fprintf(stderr, "streamer_watch: failed to watch the socket\n");
+            self->watch_fd = -1;
+            }
+        }
+    else if (fd >= 0 && ev.events != self->watch_events)
+        epoll_ctl(net.epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+    self->watch_events = ev.events;
+    }
+
+/* refresh the figures streamer_make_report takes, it copies them under mode_mutex */
+static void streamer_update_stats(struct streamer *self)
+    {
+    struct encoder_op_stats op_stats;
+    unsigned long long write_calls, write_bytes;
+
+    encoder_client_get_stats(self->encoder_op, &op_stats);
+    shout_get_write_stats(self->shout, &write_calls, &write_bytes);
+    if (self->max_shout_queue)
+        __atomic_store_n(&self->buffer_fill_pc,
+                    (int)(shout_queuelen(self->shout) * 100 / self->max_shout_queue), __ATOMIC_RELAXED);
+    pthread_mutex_lock(&self->mode_mutex);
+    self->op_stats = op_stats;
+    self->write_calls = write_calls;
+    self->write_bytes = write_bytes;
+    pthread_mutex_unlock(&self->mode_mutex);
+    }
+
+static void streamer_close(struct streamer *self)
+    {
+    fprintf(stderr, "streamer_close: disconencting from server\n");
+    streamer_update_stats(self);
+    fprintf(stderr, "streamer_close: %llu bytes in %llu socket writes\n", self->write_bytes, self->write_calls);
+    shout_close(self->shout);
+    shout_free(self->shout);
+    shout_metadata_free(self->shout_meta);
+    encoder_unregister_client(self->encoder_op);
+    self->shout = NULL;
+    self->shout_meta = NULL;
+    self->encoder_op = NULL;
+    self->max_shout_queue = 0;
+    __atomic_store_n(&self->buffer_fill_pc, 0, __ATOMIC_RELAXED);
+    self->disconnect_request = FALSE;
+    self->disconnect_pending = FALSE;
+    streamer_set_mode(self, SM_DISCONNECTED);
+    fprintf(stderr, "streamer_close: disconnection complete\n");
+    }
+
+/* streamer_lost: the connection failed, whether and when to make it again
+ * is for the user interface to decide
+ */
+static void streamer_lost(struct streamer *self)
+    {
+    streamer_set_mode(self, SM_DISCONNECTING);
+    }
+
+/* pass on everything the encoder has queued since the encoder only notifies
+ * when its queue stops being empty */
+static void streamer_send(struct streamer *self)
     {
-    struct streamer *self = args;
-    struct timespec ms10 = { 0, 10000000 };
     struct encoder_op_packet *packet;
-    char buffer[10];
     size_t data_size;
-    
-    char *s_conv(unsigned long value)
+
+    /* check the connection is still on */
+    if ((self->shout_status = shout_get_connected(self->shout)) != SHOUTERR_CONNECTED)
         {
-        snprintf(buffer, 10, "%lu", value);
-        return buffer;
+        fprintf(stderr, "streamer_send: shout_get_error reports %ld %s\n", self->shout_status, shout_get_error(self->shout));
+        streamer_lost(self);
+        return;
         }
-        
-    sig_mask_thread();
-    while (!self->thread_terminate_f)
+    if (self->disconnect_request && (!self->disconnect_pending))
+        {
+        self->disconnect_pending = TRUE;
+        fprintf(stderr, "streamer_send: disconnect_pending is set\n");
+        self->final_serial = encoder_client_set_flush(self->encoder_op);
+        fprintf(stderr, "streamer_send: issued flush to mixer, disconnecting from server when final packet of serial=%d arrives\n", self->final_serial);
+        }
+    /* the socket became writable with data still queued */
+    if (shout_queuelen(self->shout) && shout_send(self->shout, NULL, 0) == SHOUTERR_SOCKET)
         {
-        nanosleep(&ms10, NULL);
+        fprintf(stderr, "streamer_send: failed writing to stream, shout_get_error reports: %s\n", shout_get_error(self->shout));
+        streamer_lost(self);
+        return;
+        }
 
-        switch (self->stream_mode)
+    while (self->stream_mode == SM_CONNECTED && (packet = encoder_client_get_packet(self->encoder_op)))
+        {
+        __atomic_add_fetch(&self->latency_us_total, encoder_packet_age_us(packet), __ATOMIC_RELAXED);
+        __atomic_add_fetch(&self->latency_count, 1, __ATOMIC_RELAXED);
+        if (packet->header.serial >= self->initial_serial)
             {
-            case SM_DISCONNECTED:
-                pthread_mutex_lock(&self->mode_mutex);
-                while (self->stream_mode == SM_DISCONNECTED && !self->thread_terminate_f)
-                    pthread_cond_wait(&self->mode_cv, &self->mode_mutex);
-                pthread_mutex_unlock(&self->mode_mutex);
-                continue;
-            case SM_CONNECTING:
-                switch(self->shout_status)
+            if (packet->header.flags & PF_INITIAL)
+                {
+                int br = packet->header.bit_rate;
+                
+                /* determine how much audio to hold in the send buffer */
+                self->max_shout_queue = (shout_buffer_seconds * ((br > 1000) ? br / 1000 : br)) << 7;
+                }
+            if (packet->header.flags & (PF_OGG | PF_MP3 | PF_MP2 | PF_AAC | PF_AACP2))
+                {
+                if ((packet->header.flags & (PF_HEADER | PF_FINAL)) || shout_queuelen(self->shout) < self->max_shout_queue)
+                    data_size = packet->header.data_size;
+                else
+                    {
+                    data_size = 0;
+                    fprintf(stderr, "streamer_send: **** packet dumped due to buffer being full ****\n");
+                    }
+                /* unsent audio stays in the packet rather than being copied */
+                switch(shout_send_ref(self->shout, (unsigned char *)packet->data, data_size,
+                            streamer_ref_packet, streamer_unref_packet, packet))
                     {
+                    case SHOUTERR_SUCCESS:
                     case SHOUTERR_BUSY:
-                        self->shout_status = shout_get_connected(self->shout);
-
-                        if (self->disconnect_request)
-                            self->stream_mode = SM_DISCONNECTING;
-                        break;
-                    case SHOUTERR_CONNECTED:
-                        /* lock the encoder, grab the serial number and issue encoder flush */
-                        /* this makes the encoder contemporaneous with the stream */
-                        self->initial_serial = encoder_client_set_flush(self->encoder_op) + 1;
-                        fprintf(stderr, "streamer_main: connected to server - awaiting serial %d\n", self->initial_serial);
-                        self->brand_new_connection = TRUE;
-                        self->stream_mode = SM_CONNECTED;
                         break;
                     default:
-                        fprintf(stderr, "streamer_main: connection failed, shout_get_error reports %ld %s\n", self->shout_status, shout_get_error(self->shout));
-                        self->stream_mode = SM_DISCONNECTING;
-                    }
-                break;
-            case SM_CONNECTED:
-                /* check the connection is still on */
-                if ((self->shout_status = shout_get_connected(self->shout)) != SHOUTERR_CONNECTED)
-                    {
-                    fprintf(stderr, "streamer_main: shout_get_error reports %ld %s\n", self->shout_status, shout_get_error(self->shout));
-                    self->stream_mode = SM_DISCONNECTING;
-                    }
-                if (self->disconnect_request && (!self->disconnect_pending))
-                    {
-                    self->disconnect_pending = TRUE;
-                    fprintf(stderr, "streamer_main: disconnect_pending is set\n");
-                    self->final_serial = encoder_client_set_flush(self->encoder_op);
-                    fprintf(stderr, "streamer_main: issued flush to mixer, disconnecting from server when final packet of serial=%d arrives\n", self->final_serial);
-                    }
-                if ((packet = encoder_client_get_packet(self->encoder_op)))
-                    {
-                    if (packet->header.serial >= self->initial_serial)
-                        {
-                        if (packet->header.flags & PF_INITIAL)
-                            {
-                            int br = packet->header.bit_rate;
-                            
-                            /* determine how much audio to hold in the send buffer */
-                            self->max_shout_queue = (shout_buffer_seconds * ((br > 1000) ? br / 1000 : br)) << 7;
-                            }
-                        if (packet->header.flags & (PF_OGG | PF_MP3 | PF_MP2 | PF_AAC | PF_AACP2))
-                            {
-                            if ((packet->header.flags & (PF_HEADER | PF_FINAL)) || shout_queuelen(self->shout) < self->max_shout_queue)
-                                data_size = packet->header.data_size;
-                            else
-                                {
-                                data_size = 0;
-                                fprintf(stderr, "streamer_main: **** packet dumped due to buffer being full ****\n");
-                                }
-#if 1                           
-                            switch(shout_send(self->shout, packet->data, data_size))
-                                {
-                                case SHOUTERR_SUCCESS:
-                                case SHOUTERR_BUSY:
-                                    break;
-                                default:
-                                    fprintf(stderr, "streamer_main: failed writing to stream, shout_get_error reports: %s\n", shout_get_error(self->shout));
-                                    self->stream_mode = SM_DISCONNECTING;
-                                }
-#else
-                            if (shout_send_raw(self->shout, packet->data, data_size) != data_size)
-                                {
-                                fprintf(stderr, "streamer_main: failed writing to stream, shout_get_error reports: %s\n", shout_get_error(self->shout));
-                                self->stream_mode = SM_DISCONNECTING;
-                                }
-#endif
-                            }
-                        if (packet->header.flags & PF_FINAL)
-                            fprintf(stderr, "streamer_main: final packet with serial %d\n", packet->header.serial);
-                        if (self->disconnect_pending && (packet->header.serial > self->final_serial || ((packet->header.flags & PF_FINAL) && self->final_serial == packet->header.serial)))
-                            {
-                            fprintf(stderr, "streamer_main: last packet wrote, disconnecting\n");
-                            self->stream_mode = SM_DISCONNECTING;
-                            }
-                        }
-                    if (packet->header.flags & PF_METADATA)  /* tell server about new metadata */
-                        {
-                        *strpbrk(packet->data, "\n") = '\0';
-                        fprintf(stderr, "streamer_main: packet is metadata: %s\n", (char *)packet->data);
-                        shout_metadata_add(self->shout_meta, "song", packet->data);
-                        switch (shout_set_metadata(self->shout, self->shout_meta))
-                            {
-                            case SHOUTERR_SUCCESS:
-                            case SHOUTERR_BUSY:
-                                break;
-                            default:
-                                fprintf(stderr, "streamer_main: failed writing metadata to stream, shout_get_error reports: %s\n", shout_get_error(self->shout));
-                                self->stream_mode = SM_DISCONNECTING;
-                            }
-                        }
-                    encoder_client_free_packet(packet);
+                        fprintf(stderr, "streamer_send: failed writing to stream, shout_get_error reports: %s\n", shout_get_error(self->shout));
+                        streamer_lost(self);
                     }
+                }
+            if (packet->header.flags & PF_FINAL)
+                fprintf(stderr, "streamer_send: final packet with serial %d\n", packet->header.serial);
+            if (self->disconnect_pending && (packet->header.serial > self->final_serial || ((packet->header.flags & PF_FINAL) && self->final_serial == packet->header.serial)))
+                {
+                fprintf(stderr, "streamer_send: last packet wrote, disconnecting\n");
+                streamer_set_mode(self, SM_DISCONNECTING);
+                }
+            }
+        if (packet->header.flags & PF_METADATA)  /* tell server about new metadata */
+            {
+            /* the packet is shared so the first line is copied out */
+            size_t len = strcspn(packet->data, "\n");
+            char *song;
+
+            if (!(song = malloc(len + 1)))
+                {
+                /* just this update is lost, the audio carries on */
+                fprintf(stderr, "streamer_send: malloc failure\n");
+                encoder_client_free_packet(packet);
+                continue;
+                }
+            memcpy(song, packet->data, len);
+            song[len] = '\0';
+            fprintf(stderr, "streamer_send: packet is metadata: %s\n", song);
+            shout_metadata_add(self->shout_meta, "song", song);
+            free(song);
+            switch (shout_set_metadata(self->shout, self->shout_meta))
+                {
+                case SHOUTERR_SUCCESS:
+                case SHOUTERR_BUSY:
+                    break;
+                default:
+                    fprintf(stderr, "streamer_send: failed writing metadata to stream, shout_get_error reports: %s\n", shout_get_error(self->shout));
+                    streamer_lost(self);
+                }
+            }
+        encoder_client_free_packet(packet);
+        }
+    streamer_update_stats(self);
+    }
+
+/* run the connection state machine for whatever woke the streamer */
+static void streamer_service(struct streamer *self)
+    {
+    __atomic_add_fetch(&self->wakeups, 1, __ATOMIC_RELAXED);
+
+    if (self->stream_mode == SM_CONNECTING)
+        {
+        if (self->shout_status == SHOUTERR_BUSY)
+            self->shout_status = shout_get_connected(self->shout);
+        switch(self->shout_status)
+            {
+            case SHOUTERR_BUSY:
+                if (self->disconnect_request)
+                    streamer_set_mode(self, SM_DISCONNECTING);
                 break;
-            case SM_DISCONNECTING:
-                fprintf(stderr, "streamer_main: disconencting from server\n");
-                shout_close(self->shout);
-                shout_free(self->shout);
-                shout_metadata_free(self->shout_meta);
-                encoder_unregister_client(self->encoder_op);
-                self->shout = NULL;
-                self->shout_meta = NULL;
-                self->encoder_op = NULL;
-                self->max_shout_queue = 0;
-                self->disconnect_request = FALSE;
-                self->disconnect_pending = FALSE;
-                self->stream_mode = SM_DISCONNECTED;
-                fprintf(stderr, "streamer_main: disconnection complete\n");
+            case SHOUTERR_CONNECTED:
+                /* lock the encoder, grab the serial number and issue encoder flush */
+                /* this makes the encoder contemporaneous with the stream */
+                self->initial_serial = encoder_client_set_flush(self->encoder_op) + 1;
+                fprintf(stderr, "streamer_service: connected to server - awaiting serial %d\n", self->initial_serial);
+                self->brand_new_connection = TRUE;
+                streamer_set_mode(self, SM_CONNECTED);
                 break;
+            default:
+                fprintf(stderr, "streamer_service: connection failed, shout_get_error reports %ld %s\n", self->shout_status, shout_get_error(self->shout));
+                streamer_lost(self);
+            }
+        }
+    /* straight on from connecting since packets queued meanwhile raise no further notification */
+    if (self->stream_mode == SM_CONNECTED)
+        streamer_send(self);
+    if (self->stream_mode == SM_DISCONNECTING)
+        streamer_close(self);
+    streamer_watch(self);
+    }
+
+/* streamer_hangup: the socket reported an error or hangup, libshout would
+ * only find out on its next write so the connection is closed now
+ */
+static void streamer_hangup(struct streamer *self)
+    {
+    if (self->stream_mode == SM_CONNECTING || self->stream_mode == SM_CONNECTED)
+        {
+        fprintf(stderr, "streamer_hangup: the connection to the server was lost\n");
+        streamer_lost(self);
+        }
+    }
+
+/* take the streamer out of the event loop for streamer_destroy */
+static void streamer_detach(struct streamer *self)
+    {
+    if (self->stream_mode != SM_DISCONNECTED)
+        streamer_close(self);
+    streamer_watch(self);
+    epoll_ctl(net.epoll_fd, EPOLL_CTL_DEL, self->event_fd, NULL);
+    close(self->event_fd);
+    self->event_fd = -1;
+    }
+
+static void *streamer_net_main(void *args)
+    {
+    struct epoll_event events[NET_EVENTS];
+    struct streamer *self, *detached[NET_EVENTS];
+    eventfd_t count;
+    int i, n, n_detached;
+
+    sig_mask_thread();
+    for (;;)
+        {
+        if ((n = epoll_wait(net.epoll_fd, events, NET_EVENTS, -1)) < 0)
+            {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "streamer_net_main: epoll_wait failed\n");
+            return NULL;
+            }
+
+        for (i = n_detached = 0; i < n; ++i)
+            {
+            if (!(self = events[i].data.ptr))
+                return NULL;
+            /* both its descriptors can come up in one batch */
+            if (self->event_fd < 0)
+                continue;
+            eventfd_read(self->event_fd, &count);
+            if (self->thread_terminate_f)
+                {
+                streamer_detach(self);
+                detached[n_detached++] = self;
+                }
+            else
+                {
+                /* of the two descriptors only the socket reports these */
+                if (events[i].events & (EPOLLERR | EPOLLHUP))
+                    streamer_hangup(self);
+                streamer_service(self);
+                }
+            }
+
+        /* only now can streamer_destroy free them */
+        for (i = 0; i < n_detached; ++i)
+            {
+            self = detached[i];
+            pthread_mutex_lock(&self->mode_mutex);
+            self->attached = FALSE;
+            pthread_cond_broadcast(&self->mode_cv);
+            pthread_mutex_unlock(&self->mode_mutex);
             }
         }
-    return NULL;
+    }
+
+/* the network thread keeps this up to date, the shout object is all its own */
+int streamer_buffer_fill_pc(struct streamer *self)
+    {
+    return __atomic_load_n(&self->buffer_fill_pc, __ATOMIC_RELAXED);
     }
 
 int streamer_make_report(struct streamer *self)
     {
-    int buffer_fill_pc = 0;
+    int buffer_fill_pc = streamer_buffer_fill_pc(self);
     int new_connection = self->brand_new_connection; /* for thread safety */
-    int max_shout_queue = self->max_shout_queue;
+    unsigned wakeups = __atomic_exchange_n(&self->wakeups, 0, __ATOMIC_RELAXED);
+    unsigned latency_count = __atomic_exchange_n(&self->latency_count, 0, __ATOMIC_RELAXED);
+    long latency_us = __atomic_exchange_n(&self->latency_us_total, 0, __ATOMIC_RELAXED);
+    struct encoder_op_stats op_stats;
+    unsigned long long write_calls, write_bytes;
 
-    if (self->stream_mode == SM_CONNECTED && max_shout_queue)
-        buffer_fill_pc = (int)(shout_queuelen(self->shout) * 100 / max_shout_queue);
-    fprintf(g.out, "idjcsc: streamer%dreport=%d:%d:%d\n", self->numeric_id, (int)self->stream_mode, buffer_fill_pc, new_connection);
+    pthread_mutex_lock(&self->mode_mutex);
+    op_stats = self->op_stats;
+    write_calls = self->write_calls;
+    write_bytes = self->write_bytes;
+    pthread_mutex_unlock(&self->mode_mutex);
+    if (latency_count)
+        latency_us /= latency_count;
+    fprintf(g.out, "idjcsc: streamer%dreport=%d:%d:%d:%ld:%u:%llu:%lu:%llu:%llu:%llu\n", self->numeric_id,
+                (int)self->stream_mode, buffer_fill_pc, new_connection, latency_us, wakeups,
+                (unsigned long long)op_stats.bytes_dropped, (unsigned long)op_stats.high_water,
+                (unsigned long long)(op_stats.full_us / 1000),
+                write_calls, write_calls ? write_bytes / write_calls : 0ULL);
     if (new_connection)
         self->brand_new_connection = FALSE;
     fflush(g.out);
@@ -218,6 +427,11 @@ int streamer_connect(struct threads_info *ti, struct universal_vars *uv, void *o
         fprintf(stderr, "streamer_start: failed to register with encoder\n");
         return FAILED;
         }
+    encoder_client_set_notify(self->encoder_op, self->event_fd);
+    pthread_mutex_lock(&self->mode_mutex);
+    memset(&self->op_stats, 0, sizeof self->op_stats);
+    self->write_calls = self->write_bytes = 0;
+    pthread_mutex_unlock(&self->mode_mutex);
     if (!self->encoder_op->encoder->run_request_f)
         {
         fprintf(stderr, "streamer_start: encoder is not running\n");
@@ -407,10 +621,8 @@ int streamer_connect(struct threads_info *ti, struct universal_vars *uv, void *o
             self->shout_status = SHOUTERR_CONNECTED;
         case SHOUTERR_BUSY:
         case SHOUTERR_CONNECTED:
-            pthread_mutex_lock(&self->mode_mutex);
-            self->stream_mode = SM_CONNECTING;
-            pthread_cond_signal(&self->mode_cv);
-            pthread_mutex_unlock(&self->mode_mutex);
+            streamer_set_mode(self, SM_CONNECTING);
+            streamer_kick(self);
             fprintf(stderr, "streamer_connect: established connection to the server\n");
             return SUCCEEDED;
         }
@@ -425,7 +637,6 @@ int streamer_connect(struct threads_info *ti, struct universal_vars *uv, void *o
 int streamer_disconnect(struct threads_info *ti, struct universal_vars *uv, void *other)
     {
     struct streamer *self = ti->streamer[uv->tab];
-    struct timespec ms10 = { 0, 10000000 };
 
     if (!self->shout)
         {
@@ -433,9 +644,12 @@ int streamer_disconnect(struct threads_info *ti, struct universal_vars *uv, void
         return FAILED;
         }
     self->disconnect_request = TRUE;
+    streamer_kick(self);
     fprintf(stderr, "streamer_disconnect: disconnection_request is set\n");
+    pthread_mutex_lock(&self->mode_mutex);
     while(self->stream_mode != SM_DISCONNECTED)
-        nanosleep(&ms10, NULL);
+        pthread_cond_wait(&self->mode_cv, &self->mode_mutex);
+    pthread_mutex_unlock(&self->mode_mutex);
     fprintf(stderr, "streamer_disconnect: disconnection complete\n");
     return SUCCEEDED;
     }
@@ -445,9 +659,53 @@ void shout_initialiser()
     shout_init();
     }
 
+/* the first streamer starts the network thread */
+static void streamer_net_up()
+    {
+    struct epoll_event ev;
+
+    pthread_mutex_lock(&net.mutex);
+    if (!net.users++)
+        {
+        if ((net.epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0 ||
+                    (net.quit_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+            {
+            fprintf(stderr, "streamer_net_up: failed to create the event descriptors\n");
+            exit(5);
+            }
+        ev.events = EPOLLIN;
+        ev.data.ptr = NULL;
+        epoll_ctl(net.epoll_fd, EPOLL_CTL_ADD, net.quit_fd, &ev);
+        if (pthread_create(&net.thread_h, NULL, streamer_net_main, NULL))
+            {
+            fprintf(stderr, "streamer_net_up: pthread_create call failed\n");
+            exit(5);
+            }
+        }
+    pthread_mutex_unlock(&net.mutex);
+    }
+
+/* and the last one stops it */
+static void streamer_net_down()
+    {
+    static pthread_once_t once_control = PTHREAD_ONCE_INIT;
+
+    pthread_mutex_lock(&net.mutex);
+    if (!--net.users)
+        {
+        eventfd_write(net.quit_fd, 1);
+        pthread_join(net.thread_h, NULL);
+        close(net.quit_fd);
+        close(net.epoll_fd);
+        pthread_once(&once_control, shout_shutdown);
+        }
+    pthread_mutex_unlock(&net.mutex);
+    }
+
 struct streamer *streamer_init(struct threads_info *ti, int numeric_id)
     {
     struct streamer *self;
+    struct epoll_event ev;
     static pthread_once_t once_control = PTHREAD_ONCE_INIT;
     
     pthread_once(&once_control, shout_initialiser);
@@ -458,23 +716,35 @@ struct streamer *streamer_init(struct threads_info *ti, int numeric_id)
         }
     self->threads_info = ti;
     self->numeric_id = numeric_id;
+    self->watch_fd = -1;
     pthread_mutex_init(&self->mode_mutex, NULL);
     pthread_cond_init(&self->mode_cv, NULL);
-    pthread_create(&self->thread_h, NULL, streamer_main, self);
+    if ((self->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+        {
+        fprintf(stderr, "streamer_init: eventfd call failed\n");
+        exit(5);
+        }
+    streamer_net_up();
+    ev.events = EPOLLIN;
+    ev.data.ptr = self;
+    if (epoll_ctl(net.epoll_fd, EPOLL_CTL_ADD, self->event_fd, &ev))
+        {
+        fprintf(stderr, "streamer_init: epoll_ctl call failed\n");
+        exit(5);
+        }
+    self->attached = TRUE;
     return self;
     }
 
 void streamer_destroy(struct streamer *self)
     {
-    static pthread_once_t once_control = PTHREAD_ONCE_INIT;
-    void *thread_ret;
-
-    pthread_once(&once_control, shout_shutdown);
     pthread_mutex_lock(&self->mode_mutex);
     self->thread_terminate_f = TRUE;
-    pthread_cond_signal(&self->mode_cv);
+    streamer_kick(self);
+    while (self->attached)
+        pthread_cond_wait(&self->mode_cv, &self->mode_mutex);
     pthread_mutex_unlock(&self->mode_mutex);
-    pthread_join(self->thread_h, &thread_ret);
+    streamer_net_down();
     pthread_cond_destroy(&self->mode_cv);
     pthread_mutex_destroy(&self->mode_mutex);
     free(self);
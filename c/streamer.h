@@ -51,8 +51,11 @@ struct streamer
     {
     struct threads_info *threads_info;
     int numeric_id;
-    pthread_t thread_h;
-    int thread_terminate_f;
+    int thread_terminate_f;      /* asks the network thread to let go of this streamer */
+    int attached;                /* the network thread is watching event_fd */
+    int event_fd;                /* eventfd for encoder packets and requests */
+    int watch_fd;                /* the socket being watched or -1 */
+    unsigned watch_events;       /* what it is being watched for */
     int disconnect_request;
     int disconnect_pending;
     struct encoder_op *encoder_op;
@@ -64,8 +67,15 @@ struct streamer
     int initial_serial;  /* the enocoder serial number we commence streaming from */
     int final_serial;    /* the serial number to cease streaming at the end of */
     ssize_t max_shout_queue;     /* how much audio data we are willing to stockpile */
+    int buffer_fill_pc;          /* send buffer fill published by the network thread */
     pthread_mutex_t mode_mutex;
     pthread_cond_t mode_cv;
+    unsigned wakeups;            /* network thread wakeups for this streamer since the last report */
+    long latency_us_total;       /* encoder to streamer packet delay since the last report */
+    unsigned latency_count;
+    struct encoder_op_stats op_stats;    /* encoder queue backpressure for this connection, these three under mode_mutex */
+    unsigned long long write_calls;      /* socket writes for this connection */
+    unsigned long long write_bytes;
     };
 
 struct streamer *streamer_init(struct threads_info *ti, int numeric_id);
@@ -73,5 +83,6 @@ void streamer_destroy(struct streamer *self);
 int streamer_connect(struct threads_info *ti, struct universal_vars *uv, void *other);
 int streamer_disconnect(struct threads_info *ti, struct universal_vars *uv, void *other);
 int streamer_make_report(struct streamer *self);
+int streamer_buffer_fill_pc(struct streamer *self);
 
 #endif
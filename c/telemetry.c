@@ -0,0 +1,192 @@
+/*
+#   telemetry.c: meter levels and status published in shared memory
+#   Copyright (C) 2013 Stephen Fairchild (s-fairchild@users.sf.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "sig.h"
+#include "telemetry.h"
+
+#define TRUE 1
+#define FALSE 0
+
+#define MAX_FILLS 4
+
+static struct telemetry t;
+static size_t block_size;
+static char *pathname;
+static telemetry_fill_t fills[MAX_FILLS];
+static int n_fills;
+static pthread_t thread_h;
+static int thread_up;
+static int quit;
+
+static int env_count(const char *name)
+    {
+    char *value = getenv(name);
+    int n = value ? atoi(value) : 0;
+
+    return n > 0 ? n : 0;
+    }
+
+static void telemetry_update()
+    {
+    struct telemetry_header *h = t.header;
+    int i;
+
+    /* there is only the one writer so a plain increment is fine */
+    __atomic_store_n(&h->seq, h->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    for (i = 0; i < n_fills; ++i)
+        fills[i](&t);
+    h->updates++;
+    __atomic_store_n(&h->seq, h->seq + 1, __ATOMIC_RELEASE);
+    }
+
+static void *telemetry_main(void *args)
+    {
+    struct timespec next;
+    long period_ns = t.header->period_ms * 1000000L;
+
+    sig_mask_thread();
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    while (!__atomic_load_n(&quit, __ATOMIC_RELAXED))
+        {
+        telemetry_update();
+        /* absolute deadlines so the update rate does not drift */
+        if ((next.tv_nsec += period_ns) >= 1000000000L)
+            {
+            next.tv_sec += next.tv_nsec / 1000000000L;
+            next.tv_nsec %= 1000000000L;
+            }
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL))
+            if (__atomic_load_n(&quit, __ATOMIC_RELAXED))
+                break;
+        }
+    return NULL;
+    }
+
+static void telemetry_cleanup()
+    {
+    if (thread_up)
+        {
+        __atomic_store_n(&quit, TRUE, __ATOMIC_RELAXED);
+        pthread_join(thread_h, NULL);
+        thread_up = FALSE;
+        }
+    if (t.header)
+        {
+        munmap(t.header, block_size);
+        t.header = NULL;
+        unlink(pathname);
+        }
+    }
+
+void telemetry_init()
+    {
+    struct telemetry_header *h;
+    int fd, n_effects, n_mics, n_encoders, n_streamers, n_recorders;
+    char *period;
+
+    /* without a user interface to read it there is nothing to do */
+    if (!(pathname = getenv("telemetry_file")) || !*pathname)
+        return;
+
+    n_effects = env_count("num_effects");
+    n_mics = env_count("mic_qty");
+    n_encoders = env_count("num_encoders");
+    n_streamers = env_count("num_streamers");
+    n_recorders = env_count("num_recorders");
+    block_size = sizeof (struct telemetry_header) +
+                (TELEMETRY_PLAYERS + n_effects) * sizeof (struct telemetry_player) +
+                n_mics * sizeof (struct telemetry_mic) +
+                n_encoders * sizeof (struct telemetry_encoder) +
+                n_streamers * sizeof (struct telemetry_streamer) +
+                n_recorders * sizeof (struct telemetry_recorder);
+
+    unlink(pathname);
+    if ((fd = open(pathname, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR)) < 0)
+        {
+        fprintf(stderr, "telemetry_init: failed to create %s\n", pathname);
+        return;
+        }
+    if (ftruncate(fd, block_size) ||
+                (h = mmap(NULL, block_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+        {
+        fprintf(stderr, "telemetry_init: failed to map %s\n", pathname);
+        close(fd);
+        unlink(pathname);
+        return;
+        }
+    close(fd);
+
+    t.header = h;
+    t.players = (struct telemetry_player *)(h + 1);
+    t.effects = t.players + TELEMETRY_PLAYERS;
+    t.mics = (struct telemetry_mic *)(t.effects + n_effects);
+    t.encoders = (struct telemetry_encoder *)(t.mics + n_mics);
+    t.streamers = (struct telemetry_streamer *)(t.encoders + n_encoders);
+    t.recorders = (struct telemetry_recorder *)(t.streamers + n_streamers);
+
+    h->version = TELEMETRY_VERSION;
+    h->size = block_size;
+    h->period_ms = (period = getenv("telemetry_ms")) && atoi(period) > 0 ? atoi(period) : 50;
+    h->n_players = TELEMETRY_PLAYERS;
+    h->n_effects = n_effects;
+    h->n_mics = n_mics;
+    h->n_encoders = n_encoders;
+    h->n_streamers = n_streamers;
+    h->n_recorders = n_recorders;
+    /* the magic number goes in last to say the layout fields are valid */
+    __atomic_store_n(&h->magic, TELEMETRY_MAGIC, __ATOMIC_RELEASE);
+    fprintf(stderr, "telemetry_init: %lu bytes at %s\n", (unsigned long)block_size, pathname);
+    }
+
+void telemetry_register(telemetry_fill_t fill)
+    {
+    if (n_fills == MAX_FILLS)
+        {
+        fprintf(stderr, "telemetry_register: too many fill functions\n");
+        exit(5);
+        }
+    fills[n_fills++] = fill;
+    }
+
+void telemetry_start()
+    {
+    if (!t.header || thread_up)
+        return;
+
+    if (pthread_create(&thread_h, NULL, telemetry_main, NULL))
+        {
+        fprintf(stderr, "telemetry_start: pthread_create call failed\n");
+        exit(5);
+        }
+    thread_up = TRUE;
+    /* registered after the submodules so it runs before their cleanup */
+    atexit(telemetry_cleanup);
+    }
@@ -0,0 +1,121 @@
+/*
+#   telemetry.h: meter levels and status published in shared memory
+#   Copyright (C) 2013 Stephen Fairchild (s-fairchild@users.sf.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+
+/* The block lives in the file named by the telemetry_file environment
+ * variable which both the backend and the user interface map. The backend
+ * rewrites it every period_ms under a sequence lock: seq is odd while an
+ * update is in progress so a reader takes a copy and keeps it only if seq
+ * was even and unchanged across the copy.
+ *
+ * The header is followed by arrays of records in this order: n_players
+ * players, n_effects effects players, n_mics mics, n_encoders encoders,
+ * n_streamers streamers, n_recorders recorders. Every field is four bytes
+ * so the layout has no padding. Change TELEMETRY_VERSION with the layout.
+ */
+
+#define TELEMETRY_MAGIC 0x4d4c4449      /* IDLM in little endian */
+#define TELEMETRY_VERSION 1
+#define TELEMETRY_PLAYERS 3             /* left, right, interlude */
+
+struct telemetry_header
+    {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;                      /* bytes in the whole block */
+    uint32_t seq;                       /* odd while being written */
+    uint32_t updates;
+    int32_t period_ms;
+    int32_t str_l_peak;                 /* stream meters in dB below full scale */
+    int32_t str_r_peak;
+    int32_t str_l_rms;
+    int32_t str_r_rms;
+    int32_t effects_playing;            /* bit mask, lsb = first effects player */
+    int32_t freewheel_mode;
+    int32_t events_pending;             /* ACTN=requestevents has something to say */
+    int32_t n_players;
+    int32_t n_effects;
+    int32_t n_mics;
+    int32_t n_encoders;
+    int32_t n_streamers;
+    int32_t n_recorders;
+    int32_t reserved;
+    };
+
+struct telemetry_player
+    {
+    int32_t elapsed;                    /* seconds */
+    int32_t playing;
+    int32_t signal;
+    int32_t cid;
+    int32_t audio_runout;
+    float silence;                      /* seconds */
+    int32_t buffered_ms;                /* playable audio in the ringbuffer */
+    };
+
+struct telemetry_mic
+    {
+    int32_t peak;
+    int32_t red;
+    int32_t yellow;
+    int32_t green;
+    };
+
+struct telemetry_encoder
+    {
+    int32_t state;                      /* enum encoder_state */
+    };
+
+struct telemetry_streamer
+    {
+    int32_t mode;                       /* enum stream_mode */
+    int32_t buffer_fill_pc;
+    };
+
+struct telemetry_recorder
+    {
+    int32_t mode;                       /* enum record_mode */
+    int32_t seconds;
+    };
+
+struct telemetry
+    {
+    struct telemetry_header *header;
+    struct telemetry_player *players;
+    struct telemetry_player *effects;
+    struct telemetry_mic *mics;
+    struct telemetry_encoder *encoders;
+    struct telemetry_streamer *streamers;
+    struct telemetry_recorder *recorders;
+    };
+
+/* fill functions are called from the telemetry thread inside the write lock */
+typedef void (*telemetry_fill_t)(struct telemetry *t);
+
+/* telemetry_init: the record counts are taken from the environment */
+void telemetry_init();
+void telemetry_register(telemetry_fill_t fill);
+/* telemetry_start: begins periodic updates, stopped automatically at exit */
+void telemetry_start();
+
+#endif /* TELEMETRY_H */
@@ -0,0 +1,397 @@
+/*
+#   writebehind.c: file output handed off to a dedicated I/O thread
+#   Copyright (C) 2013 Stephen Fairchild (s-fairchild@users.sf.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "gnusource.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "sig.h"
+#include "writebehind.h"
+
+#define TRUE 1
+#define FALSE 0
+
+/* the alignment O_DIRECT asks for on any likely device */
+#define ALIGNMENT 4096
+
+struct buffer
+    {
+    unsigned char *data;
+    size_t len;
+    off_t offset;                /* where in the file it goes */
+    };
+
+struct writebehind
+    {
+    int fd;
+    int direct_fd;               /* O_DIRECT descriptor or -1 */
+    struct buffer *buffers;      /* ring: count queued from head, then the one being filled */
+    unsigned n_buffers;
+    unsigned head;
+    unsigned count;
+    size_t buffer_size;
+    off_t pos;                   /* the writer's file position */
+    off_t size;                  /* the end of the furthest write */
+    off_t allocated;             /* reserved with fallocate as far as here */
+    off_t prealloc;
+    long sync_ms;
+    struct timespec last_sync;
+    int error;                   /* errno from the I/O thread */
+    int quit;
+    struct writebehind_stats *stats;
+    pthread_t thread_h;
+    pthread_mutex_t mutex;
+    pthread_cond_t cv;
+    };
+
+static long env_long(const char *name, long fallback)
+    {
+    char *value = getenv(name);
+
+    return value && *value ? atol(value) : fallback;
+    }
+
+static long elapsed_ms(struct timespec *since, struct timespec *now)
+    {
+    return (now->tv_sec - since->tv_sec) * 1000L + (now->tv_nsec - since->tv_nsec) / 1000000L;
+    }
+
+static int bucket(unsigned long value)
+    {
+    int n = 0;
+
+    while (value && n < WRITEBEHIND_BUCKETS - 1)
+        {
+        value >>= 1;
+        ++n;
+        }
+    return n;
+    }
+
+static int writebehind_pwrite(struct writebehind *self, struct buffer *b)
+    {
+    int fd = self->fd;
+    unsigned char *p = b->data;
+    size_t len = b->len;
+    off_t offset = b->offset;
+    ssize_t n;
+    struct timespec t0, t1;
+
+    /* whole aligned buffers only, the rest goes through the page cache */
+    if (self->direct_fd >= 0 && !(offset % ALIGNMENT) && !(len % ALIGNMENT))
+        fd = self->direct_fd;
+
+#ifdef FALLOC_FL_KEEP_SIZE
+    if (self->prealloc && offset + (off_t)len > self->allocated)
+        {
+        off_t want = (offset + len - self->allocated + self->prealloc - 1) / self->prealloc * self->prealloc;
+
+        if (fallocate(self->fd, FALLOC_FL_KEEP_SIZE, self->allocated, want))
+            {
+            fprintf(stderr, "writebehind: fallocate failed, preallocation is off\n");
+            self->prealloc = 0;
+            }
+        else
+            self->allocated += want;
+        }
+#endif
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    while (len)
+        {
+        if ((n = pwrite(fd, p, len, offset)) < 0)
+            {
+            if (errno == EINTR)
+                continue;
+            return errno;
+            }
+        p += n;
+        len -= n;
+        offset += n;
+        }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    __atomic_add_fetch(&self->stats->latency[bucket(elapsed_ms(&t0, &t1))], 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&self->stats->bytes, b->len, __ATOMIC_RELAXED);
+
+    if (self->sync_ms && elapsed_ms(&self->last_sync, &t1) >= self->sync_ms)
+        {
+        fdatasync(self->fd);
+        self->last_sync = t1;
+        }
+    return 0;
+    }
+
+static void *writebehind_main(void *args)
+    {
+    struct writebehind *self = args;
+    struct buffer *b;
+    int error;
+
+    sig_mask_thread();
+    pthread_mutex_lock(&self->mutex);
+    for (;;)
+        {
+        while (!self->count && !self->quit)
+            pthread_cond_wait(&self->cv, &self->mutex);
+        if (!self->count)
+            break;
+        b = &self->buffers[self->head];
+        pthread_mutex_unlock(&self->mutex);
+
+        error = self->error ? 0 : writebehind_pwrite(self, b);
+
+        pthread_mutex_lock(&self->mutex);
+        if (error)
+            {
+            fprintf(stderr, "writebehind: write failed: %s\n", strerror(error));
+            self->error = error;
+            }
+        self->head = (self->head + 1) % self->n_buffers;
+        self->count--;
+        pthread_cond_broadcast(&self->cv);
+        }
+    pthread_mutex_unlock(&self->mutex);
+    return NULL;
+    }
+
+/* queue the buffer being filled and wait for another to fill, called locked */
+static void writebehind_hand_over(struct writebehind *self)
+    {
+    struct buffer *b = &self->buffers[(self->head + self->count) % self->n_buffers];
+
+    if (!b->len)
+        return;
+    self->count++;
+    self->stats->depth[self->count > WRITEBEHIND_BUCKETS ? WRITEBEHIND_BUCKETS - 1 : self->count - 1]++;
+    pthread_cond_broadcast(&self->cv);
+    if (self->count == self->n_buffers)
+        {
+        self->stats->stalls++;
+        while (self->count == self->n_buffers)
+            pthread_cond_wait(&self->cv, &self->mutex);
+        }
+    b = &self->buffers[(self->head + self->count) % self->n_buffers];
+    b->len = 0;
+    }
+
+ssize_t writebehind_write(struct writebehind *self, const void *data, size_t len)
+    {
+    const unsigned char *p = data;
+    struct buffer *b;
+    size_t space, n;
+
+    pthread_mutex_lock(&self->mutex);
+    if (self->error)
+        {
+        pthread_mutex_unlock(&self->mutex);
+        return -1;
+        }
+    b = &self->buffers[(self->head + self->count) % self->n_buffers];
+    /* after a seek the data belongs somewhere else */
+    if (b->len && b->offset + (off_t)b->len != self->pos)
+        {
+        writebehind_hand_over(self);
+        b = &self->buffers[(self->head + self->count) % self->n_buffers];
+        }
+    for (n = len; n; )
+        {
+        if (!b->len)
+            b->offset = self->pos;
+        space = self->buffer_size - b->len;
+        if (space > n)
+            space = n;
+        memcpy(b->data + b->len, p, space);
+        b->len += space;
+        p += space;
+        n -= space;
+        self->pos += space;
+        if (b->len == self->buffer_size)
+            {
+            writebehind_hand_over(self);
+            b = &self->buffers[(self->head + self->count) % self->n_buffers];
+            }
+        }
+    if (self->pos > self->size)
+        self->size = self->pos;
+    pthread_mutex_unlock(&self->mutex);
+    return len;
+    }
+
+off_t writebehind_seek(struct writebehind *self, off_t offset, int whence)
+    {
+    off_t pos;
+
+    pthread_mutex_lock(&self->mutex);
+    switch (whence)
+        {
+        case SEEK_SET:
+            pos = offset;
+            break;
+        case SEEK_CUR:
+            pos = self->pos + offset;
+            break;
+        case SEEK_END:
+            pos = self->size + offset;
+            break;
+        default:
+            pos = -1;
+        }
+    if (pos >= 0)
+        self->pos = pos;
+    pthread_mutex_unlock(&self->mutex);
+    return pos;
+    }
+
+off_t writebehind_tell(struct writebehind *self)
+    {
+    return self->pos;
+    }
+
+off_t writebehind_size(struct writebehind *self)
+    {
+    return self->size;
+    }
+
+int writebehind_drain(struct writebehind *self)
+    {
+    int error;
+
+    pthread_mutex_lock(&self->mutex);
+    writebehind_hand_over(self);
+    while (self->count)
+        pthread_cond_wait(&self->cv, &self->mutex);
+    error = self->error;
+    pthread_mutex_unlock(&self->mutex);
+    return error ? -1 : 0;
+    }
+
+ssize_t writebehind_read(struct writebehind *self, void *data, size_t len)
+    {
+    ssize_t n;
+
+    if (writebehind_drain(self))
+        return -1;
+    if ((n = pread(self->fd, data, len, self->pos)) > 0)
+        self->pos += n;
+    return n;
+    }
+
+int writebehind_fd(struct writebehind *self)
+    {
+    return self->fd;
+    }
+
+static void writebehind_free(struct writebehind *self)
+    {
+    unsigned i;
+
+    for (i = 0; i < self->n_buffers; ++i)
+        free(self->buffers[i].data);
+    free(self->buffers);
+    if (self->direct_fd >= 0)
+        close(self->direct_fd);
+    pthread_cond_destroy(&self->cv);
+    pthread_mutex_destroy(&self->mutex);
+    free(self);
+    }
+
+int writebehind_close(struct writebehind *self)
+    {
+    int error = writebehind_drain(self);
+
+    pthread_mutex_lock(&self->mutex);
+    self->quit = TRUE;
+    pthread_cond_broadcast(&self->cv);
+    pthread_mutex_unlock(&self->mutex);
+    pthread_join(self->thread_h, NULL);
+
+    /* give back preallocated space */
+    if (self->allocated > self->size && ftruncate(self->fd, self->size))
+        error = -1;
+    if (close(self->fd))
+        error = -1;
+    writebehind_free(self);
+    return error;
+    }
+
+struct writebehind *writebehind_open(const char *pathname, struct writebehind_stats *stats)
+    {
+    struct writebehind *self;
+    unsigned i;
+
+    if (!(self = calloc(1, sizeof (struct writebehind))))
+        {
+        fprintf(stderr, "writebehind_open: malloc failure\n");
+        return NULL;
+        }
+    self->direct_fd = -1;
+    self->stats = stats;
+    memset(stats, 0, sizeof (struct writebehind_stats));
+    self->buffer_size = (env_long("record_buffer_kb", 1024) * 1024 + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    if (!self->buffer_size)
+        self->buffer_size = ALIGNMENT;
+    if ((self->n_buffers = env_long("record_buffers", 8)) < 2)
+        self->n_buffers = 2;
+    self->prealloc = (off_t)env_long("record_prealloc_mb", 64) << 20;
+    self->sync_ms = env_long("record_sync_ms", 0);
+    clock_gettime(CLOCK_MONOTONIC, &self->last_sync);
+    pthread_mutex_init(&self->mutex, NULL);
+    pthread_cond_init(&self->cv, NULL);
+
+    if (!(self->buffers = calloc(self->n_buffers, sizeof (struct buffer))))
+        {
+        fprintf(stderr, "writebehind_open: malloc failure\n");
+        writebehind_free(self);
+        return NULL;
+        }
+    for (i = 0; i < self->n_buffers; ++i)
+        if (posix_memalign((void **)&self->buffers[i].data, ALIGNMENT, self->buffer_size))
+            {
+            fprintf(stderr, "writebehind_open: malloc failure\n");
+            self->buffers[i].data = NULL;
+            writebehind_free(self);
+            return NULL;
+            }
+
+    if ((self->fd = open(pathname, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0666)) < 0)
+        {
+        fprintf(stderr, "writebehind_open: failed to open %s: %s\n", pathname, strerror(errno));
+        writebehind_free(self);
+        return NULL;
+        }
+#ifdef O_DIRECT
+    if (env_long("record_direct_io", 0) && (self->direct_fd = open(pathname, O_WRONLY | O_DIRECT | O_CLOEXEC)) < 0)
+        fprintf(stderr, "writebehind_open: O_DIRECT is not available for %s\n", pathname);
+#endif
+
+    if (pthread_create(&self->thread_h, NULL, writebehind_main, self))
+        {
+        fprintf(stderr, "writebehind_open: pthread_create call failed\n");
+        close(self->fd);
+        writebehind_free(self);
+        return NULL;
+        }
+    return self;
+    }
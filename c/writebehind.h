@@ -0,0 +1,64 @@
+/*
+#   writebehind.h: file output handed off to a dedicated I/O thread
+#   Copyright (C) 2013 Stephen Fairchild (s-fairchild@users.sf.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef WRITEBEHIND_H
+#define WRITEBEHIND_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/* Writes are copied into large page aligned buffers which an I/O thread
+ * writes out in the background, so a stalled disk holds up the writer
+ * only once every buffer is full. Tuned from the environment:
+ *
+ *   record_buffer_kb     size of each buffer
+ *   record_buffers       how many buffers
+ *   record_prealloc_mb   file space is reserved in steps this big, 0 for off
+ *   record_direct_io     1 to bypass the page cache for whole aligned buffers
+ *   record_sync_ms       fdatasync at most this often, 0 for never
+ */
+
+#define WRITEBEHIND_BUCKETS 12
+
+struct writebehind_stats
+    {
+    unsigned depth[WRITEBEHIND_BUCKETS];   /* buffers queued on each hand over, the last bucket includes more */
+    unsigned latency[WRITEBEHIND_BUCKETS]; /* write calls taking under 2^n ms in bucket n, the last bucket includes longer */
+    unsigned stalls;                       /* times the writer waited for a free buffer */
+    uint64_t bytes;
+    };
+
+struct writebehind;
+
+/* writebehind_open: creates or truncates the file, stats are cleared and then
+ * updated by the I/O thread for as long as the file is open */
+struct writebehind *writebehind_open(const char *pathname, struct writebehind_stats *stats);
+/* writebehind_write: returns len or -1 once a background write has failed */
+ssize_t writebehind_write(struct writebehind *self, const void *data, size_t len);
+off_t writebehind_seek(struct writebehind *self, off_t offset, int whence);
+off_t writebehind_tell(struct writebehind *self);
+off_t writebehind_size(struct writebehind *self);
+ssize_t writebehind_read(struct writebehind *self, void *data, size_t len);
+/* writebehind_drain: waits for everything so far to reach the file, after
+ * which the descriptor from writebehind_fd may be used directly */
+int writebehind_drain(struct writebehind *self);
+int writebehind_fd(struct writebehind *self);
+int writebehind_close(struct writebehind *self);
+
+#endif /* WRITEBEHIND_H */
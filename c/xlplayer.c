@@ -36,6 +36,8 @@
 #include "flacdecode.h"
 #include "sndfiledecode.h"
 #include "avcodecdecode.h"
+#include "pcmcache.h"
+#include "pcmconv.h"
 #include "bsdcompat.h"
 #include "sig.h"
 #include "main.h"
@@ -48,8 +50,14 @@
 
 typedef jack_default_audio_sample_t sample_t;
 
+#define LA_SWAP(a, b) do { __typeof__(a) la_swap_ = (a); (a) = (b); (b) = la_swap_; } while (0)
+
 int mpg123ok = FALSE;
 
+/* fade durations in seconds indexed by fade mode */
+static float fadeout_time[] = {1.0f, 5.0f, 10.0f, 0.1f, 0.05f};
+static float fadein_time[] = {0.05f, 5.0f, 10.0f, 0.0f, 0.05f};
+
 void xlplayer_mpg123_status()
     {
 #ifdef DYN_MPG123
@@ -61,54 +69,6 @@ void xlplayer_mpg123_status()
     fflush(g.out);
     }
 
-/* make_audio_to_float: convert the audio to the format used by jack and libsamplerate */
-float *xlplayer_make_audio_to_float(struct xlplayer *self, float *buffer, uint8_t *data, int num_samples, int bits_per_sample, int num_channels)
-    {
-    int num_bytes;
-    int i;
-    uint32_t msb_mask;
-    uint32_t neg_mask;
-    uint32_t holder;
-    uint32_t mult;
-    float *fptr = buffer;
-    float fscale;
-    const float half_randmax = (float)(RAND_MAX >> 1);
-    float dscale;
-
-    msb_mask = 1UL << (bits_per_sample - 1);             /* negative number detector */
-    neg_mask = (uint32_t)((~0UL) << (bits_per_sample));  /* negative number maker */
-    fscale = 1.0F/(float)msb_mask;                       /* multiplier to make the floating point range -1 to +1 */
-    dscale = 0.25F / half_randmax * fscale;
-
-    if (bits_per_sample > 32)
-        {
-        memset(buffer, 0, sizeof (sample_t) * num_samples * num_channels);
-        }
-    else
-        {
-        while (num_samples--)
-            {
-            for (i = 0; i < num_channels; i++)
-                {
-                for (num_bytes = (bits_per_sample + 7) >> 3, mult = 1, holder = 0; num_bytes--; mult <<=8)
-                    {
-                    holder |= ((uint32_t)*data++) * mult;
-                    }
-                if (holder & msb_mask)
-                    holder |= neg_mask;
-                if (self->dither && bits_per_sample < 20)
-                    /* adds triangular dither */
-                    *fptr++ = (((float)(int32_t)holder) * fscale) + 
-                    (((((float)rand_r(&self->seed)) - half_randmax) +
-                    (((float)rand_r(&self->seed)) - half_randmax)) * dscale); 
-                else
-                    *fptr++ = ((float)((int32_t)holder)) * fscale;
-                }
-            }
-        }
-    return buffer;
-    }
-
 /* get_next_gain: compute the gain of the next sample */
 /* used to fade in the audio when not starting from the beginning */
 sample_t xlplayer_get_next_gain(struct xlplayer *self)
@@ -190,6 +150,28 @@ void xlplayer_demux_channel_data(struct xlplayer *self, sample_t *buffer, int nu
         }
     }
 
+/* xlplayer_lookahead_append: audio of the track being readied is held back from the ringbuffer */
+static void xlplayer_lookahead_append(struct xlplayer *self)
+    {
+    struct xlplayer_lookahead *la = &self->lookahead;
+    size_t n = self->op_buffersize / sizeof (sample_t);
+
+    if (la->frames + n > la->capacity)
+        {
+        la->capacity = la->frames + n + la->limit;
+        if (!(la->left = realloc(la->left, la->capacity * sizeof (sample_t))) ||
+                    !(la->right = realloc(la->right, la->capacity * sizeof (sample_t))))
+            {
+            fprintf(stderr, "xlplayer: malloc failure\n");
+            exit(5);
+            }
+        }
+    memcpy(la->left + la->frames, self->leftbuffer, self->op_buffersize);
+    memcpy(la->right + la->frames, self->rightbuffer, self->op_buffersize);
+    la->frames += n;
+    self->write_deferred = FALSE;
+    }
+
 void xlplayer_write_channel_data(struct xlplayer *self)
     {
     u_int32_t samplecount;
@@ -197,7 +179,9 @@ void xlplayer_write_channel_data(struct xlplayer *self)
     float *lp, *rp;
     int sc;
     
-    if (self->op_buffersize > jack_ringbuffer_write_space(self->right_ch))
+    if (self->lookahead.staging)
+        xlplayer_lookahead_append(self);
+    else if (self->op_buffersize > jack_ringbuffer_write_space(self->right_ch))
         {
         self->write_deferred = TRUE;      /* prevent further accumulation of data that would clobber */
         usleep(20000);
@@ -209,6 +193,11 @@ void xlplayer_write_channel_data(struct xlplayer *self)
             jack_ringbuffer_write(self->left_ch, (char *)self->leftbuffer, self->op_buffersize);
             jack_ringbuffer_write(self->right_ch, (char *)self->rightbuffer, self->op_buffersize);
             samplecount = self->op_buffersize / sizeof (sample_t);
+            if (self->pcm_capture && !pcmcache_capture_append(self->pcm_capture, self->leftbuffer, self->rightbuffer, samplecount))
+                {
+                pcmcache_capture_abandon(self->pcm_capture);
+                self->pcm_capture = NULL;
+                }
             self->samples_written += samplecount;
             self->sleep_samples += samplecount;
             /* count cumulative silent samples */
@@ -225,7 +214,7 @@ void xlplayer_write_channel_data(struct xlplayer *self)
             self->silence += (float)sc / self->samplerate;
             }
         self->write_deferred = FALSE;
-        if (self->sleep_samples > 6000)
+        if (self->sleep_samples > 6000 && !self->unpaced)
             {
             if (self->sleep_samples > 12000)
                 usleep(20000);
@@ -243,7 +232,7 @@ static u_int32_t xlplayer_update_progress_time_ms(struct xlplayer *self)
     int32_t progress;
     
     rb_time_ms = (float)jack_ringbuffer_read_space(self->right_ch) / sizeof (sample_t) * 1000.0f / self->samplerate;
-    progress = self->samples_written * 1000.0f / self->samplerate - rb_time_ms + self->seek_s * 1000.0f;
+    progress = self->samples_written * 1000.0f / self->samplerate - rb_time_ms + self->progress_seek_s * 1000.0f;
 
     if (progress >= 0)
         return self->play_progress_ms = progress;
@@ -269,20 +258,264 @@ static char *get_extension(char *pathname)
     return extension;
     }
 
+/* xlplayer_register: find a decoder for self->pathname by its extension
+ * a complete play from the start is to be kept in the cache when that's in use
+ */
+static int xlplayer_register(struct xlplayer *self, struct pcmcache_entry **capture)
+    {
+    char *extension;
+    int accepted;
+
+    self->dec_rebind = NULL;
+    if (self->use_pcm_cache && pcmcache_reg(self))
+        return TRUE;
+
+    extension = get_extension(self->pathname);
+    accepted =
+          ((!strcmp(extension, "ogg") || !strcmp(extension, "oga")) && oggdecode_reg(self))
+#ifdef HAVE_SPEEX
+          || (!strcmp(extension, "spx") && oggdecode_reg(self))
+#endif
+#ifdef HAVE_OPUS
+          || (!strcmp(extension, "opus") && oggdecode_reg(self))
+#endif
+#ifdef HAVE_FLAC
+          || (!strcmp(extension, "flac") && flacdecode_reg(self))
+#endif
+          || ((!strcmp(extension, "wav") || !strcmp(extension, "au") || !strcmp(extension, "aiff")) && sndfiledecode_reg(self))
+#ifdef HAVE_LIBAV
+          || ((!strcmp(extension, "aac") || !strcmp(extension, "m4a") || !strcmp(extension, "mp4") || !strcmp(extension, "m4b") || !strcmp(extension, "m4p") || !strcmp(extension, "wma") || !strcmp(extension, "avi") || !strcmp(extension, "mpc") || !strcmp(extension, "ape")) && avcodecdecode_reg(self))
+#endif /* HAVE_LIBAV */
+          || ((!strcmp(extension, "mp3") || (!strcmp(extension, "mp2"))) && mpg123ok && mp3decode_reg(self));
+    free(extension);
+
+    /* keep a copy of a complete play for next time */
+    if (accepted && self->use_pcm_cache && !self->seek_s)
+        *capture = pcmcache_capture_begin(self->pathname, self->gain);
+    return accepted;
+    }
+
+/* The look-ahead slot: the next track is opened and its first second decoded
+ * while the player would otherwise sleep on a full ringbuffer. When the track
+ * is then started the decoder carries on from where it was and the audio it
+ * already made goes straight into the ringbuffer behind the previous track.
+ * The decoders know only struct xlplayer so the track being readied is given
+ * a shadow one of its own. Nothing the mixer reads is touched until the splice.
+ */
+
+/* xlplayer_lookahead_reset: the slot is emptied, the decoder has been dealt with */
+static void xlplayer_lookahead_reset(struct xlplayer *self)
+    {
+    struct xlplayer_lookahead *la = &self->lookahead;
+    struct xlplayer *shadow = la->shadow;
+    struct xlplayer_lookahead *held = &shadow->lookahead;
+
+    free(shadow->pathname);
+    shadow->pathname = NULL;
+    free(held->dm_artist);
+    free(held->dm_title);
+    free(held->dm_album);
+    held->dm_artist = held->dm_title = held->dm_album = NULL;
+    held->dm_type = DM_NONE_NEW;
+    held->frames = 0;
+    la->state = LA_IDLE;
+    }
+
+/* xlplayer_lookahead_discard: the track being readied is not wanted after all */
+static void xlplayer_lookahead_discard(struct xlplayer *self)
+    {
+    struct xlplayer_lookahead *la = &self->lookahead;
+    struct xlplayer *shadow = la->shadow;
+
+    if (la->state == LA_IDLE)
+        return;
+    if (la->state != LA_REQUESTED && shadow->playmode != PM_STOPPED)
+        shadow->dec_eject(shadow);
+    if (la->pcm_capture)
+        {
+        pcmcache_capture_abandon(la->pcm_capture);
+        la->pcm_capture = NULL;
+        }
+    xlplayer_lookahead_reset(self);
+    }
+
+/* xlplayer_lookahead_request: start readying a track in place of any other */
+static void xlplayer_lookahead_request(struct xlplayer *self, char *pathname, int seek_s, float gain)
+    {
+    struct xlplayer_lookahead *la = &self->lookahead;
+    struct xlplayer *shadow = la->shadow;
+
+    if (!self->use_lookahead)
+        return;
+    if (la->state != LA_IDLE && !strcmp(shadow->pathname, pathname) && shadow->seek_s == seek_s && shadow->gain == gain && la->fade_mode == self->fade_mode)
+        return;
+    xlplayer_lookahead_discard(self);
+    if (!(shadow->pathname = strdup(pathname)))
+        {
+        fprintf(stderr, "xlplayer: malloc failure\n");
+        exit(5);
+        }
+    shadow->seek_s = seek_s;
+    shadow->gain = gain;
+    la->fade_mode = self->fade_mode;
+    /* the settings the decoders read are taken as they are now */
+    shadow->rsqual = self->rsqual;
+    shadow->dither = self->dither;
+    shadow->use_pcm_cache = self->use_pcm_cache;
+    shadow->usedelay = FALSE;
+    shadow->playmode = PM_PLAYING;
+    shadow->write_deferred = FALSE;
+    la->state = LA_REQUESTED;
+    }
+
+/* xlplayer_lookahead_next: for the internal playlist the next track is known */
+static void xlplayer_lookahead_next(struct xlplayer *self)
+    {
+    int next = self->playlistindex + 1;
+
+    if (next == self->playlistsize && self->loop)
+        next = 0;
+    if (next < self->playlistsize)
+        xlplayer_lookahead_request(self, self->playlist[next], self->seek_s, self->gain);
+    }
+
+/* xlplayer_lookahead_step: do a little towards readying the next track
+ * returns TRUE if there was anything to do
+ */
+static int xlplayer_lookahead_step(struct xlplayer *self)
+    {
+    struct xlplayer_lookahead *la = &self->lookahead;
+    struct xlplayer *shadow = la->shadow;
+
+    switch (la->state)
+        {
+        case LA_REQUESTED:
+            if (xlplayer_register(shadow, &la->pcm_capture))
+                {
+                la->state = LA_DECODING;
+                fade_set(shadow->fadein, FADE_SET_SAME, fadein_time[la->fade_mode], FADE_DIRECTION_UNCHANGED);
+                fade_set(shadow->fadein, (shadow->seek_s || la->fade_mode) ? FADE_SET_LOW : FADE_SET_HIGH, -1.0f, FADE_IN);
+                shadow->dec_init(shadow);
+                }
+            break;
+        case LA_DECODING:
+            shadow->dec_play(shadow);
+            break;
+        default:
+            return FALSE;
+        }
+
+    /* on failure the track is left to be started the usual way which reports the problem */
+    if (la->state == LA_REQUESTED || (shadow->playmode != PM_PLAYING && shadow->playmode != PM_FLUSH))
+        xlplayer_lookahead_discard(self);
+    else if (shadow->playmode == PM_FLUSH || shadow->lookahead.frames >= shadow->lookahead.limit)
+        la->state = LA_READY;
+    return TRUE;
+    }
+
+/* xlplayer_lookahead_splice: take over the readied track if it is the one wanted
+ * returns TRUE with the player left as PM_INITIATE would leave it
+ */
+static int xlplayer_lookahead_splice(struct xlplayer *self)
+    {
+    struct xlplayer_lookahead *la = &self->lookahead;
+    struct xlplayer *shadow = la->shadow;
+    struct xlplayer_lookahead *held = &shadow->lookahead;
+
+    if (la->state == LA_IDLE)
+        return FALSE;
+    if (la->state == LA_REQUESTED || strcmp(shadow->pathname, self->pathname) || shadow->seek_s != self->seek_s ||
+                shadow->gain != self->gain || la->fade_mode != self->fade_mode)
+        {
+        xlplayer_lookahead_discard(self);
+        return FALSE;
+        }
+
+    self->dec_data = shadow->dec_data;
+    self->dec_init = shadow->dec_init;
+    self->dec_play = shadow->dec_play;
+    self->dec_eject = shadow->dec_eject;
+    self->dec_rebind = shadow->dec_rebind;
+    self->src_state = shadow->src_state;
+    self->src_data = shadow->src_data;
+    self->usedelay = shadow->usedelay;
+    LA_SWAP(self->fadein, shadow->fadein);
+    self->pcm_capture = la->pcm_capture;
+    shadow->dec_data = NULL;
+    shadow->src_state = NULL;
+    memset(&shadow->src_data, 0, sizeof shadow->src_data);
+    la->pcm_capture = NULL;
+    /* decoder callbacks that were handed the shadow must now reach the player */
+    if (self->dec_rebind)
+        self->dec_rebind(self);
+
+    /* what was decoded in advance is the first thing written */
+    self->op_buffersize = held->frames * sizeof (sample_t);
+    if (held->frames)
+        {
+        if (!(self->leftbuffer = realloc(self->leftbuffer, self->op_buffersize)) ||
+                    !(self->rightbuffer = realloc(self->rightbuffer, self->op_buffersize)))
+            {
+            fprintf(stderr, "xlplayer: malloc failure\n");
+            exit(5);
+            }
+        memcpy(self->leftbuffer, held->left, self->op_buffersize);
+        memcpy(self->rightbuffer, held->right, self->op_buffersize);
+        }
+    self->write_deferred = held->frames > 0;
+    self->playmode = shadow->playmode;
+    shadow->playmode = PM_STOPPED;
+    self->play_progress_ms = 0;
+    self->progress_seek_s = self->seek_s;
+    self->pause = 0;
+    self->samples_written = 0;
+    self->sleep_samples = 0;
+    self->silence = 0.0f;
+
+    /* the delay is now known exactly, it's whatever is ahead in the ringbuffer */
+    if (held->dm_type != DM_NONE_NEW)
+        xlplayer_set_dynamic_metadata(self, held->dm_type, held->dm_artist, held->dm_title, held->dm_album, xlplayer_calc_rbdelay(self));
+    xlplayer_lookahead_reset(self);
+    return TRUE;
+    }
+
+/* xlplayer_write_pending: retry a deferred write, time that would be spent
+ * waiting for room in the ringbuffer goes to readying the next track
+ */
+static void xlplayer_write_pending(struct xlplayer *self)
+    {
+    enum lookahead_t state = self->lookahead.state;
+
+    if ((state == LA_REQUESTED || state == LA_DECODING) && self->op_buffersize > jack_ringbuffer_write_space(self->right_ch))
+        xlplayer_lookahead_step(self);
+    else
+        xlplayer_write_channel_data(self);
+    }
+
 static void xlplayer_command(struct xlplayer *self, enum command_t new_command)
     {
     pthread_mutex_lock(&self->command_mutex);
     self->command = new_command;
     pthread_cond_signal(&self->command_cv);
+    while (self->command != CMD_COMPLETE)
+        pthread_cond_wait(&self->command_done_cv, &self->command_mutex);
+    pthread_mutex_unlock(&self->command_mutex);
+    }
+
+/* xlplayer_command_done: the player thread has finished acting on the command
+ * decoders that fail in dec_init clear the command too but there is always
+ * a call to this afterwards to wake the caller
+ */
+static void xlplayer_command_done(struct xlplayer *self)
+    {
+    pthread_mutex_lock(&self->command_mutex);
+    self->command = CMD_COMPLETE;
+    pthread_cond_broadcast(&self->command_done_cv);
     pthread_mutex_unlock(&self->command_mutex);
-    while (self->command)
-        usleep(10000);
     }
 
 static void *xlplayer_main(struct xlplayer *self)
     {
-    char *extension;
-    
     sig_mask_thread();
     for(self->up = TRUE; self->command != CMD_THREADEXIT; self->watchdog_timer = 0)
         {
@@ -304,13 +537,19 @@ static void *xlplayer_main(struct xlplayer *self)
                     {
                     xlplayer_set_fadesteps(self, self->fade_mode);
                     self->jack_flush = TRUE;
+                    /* the flush takes a JACK period so this is polled finely */
                     while (self->jack_is_flushed == 0 && *(self->jack_shutdown_f) == FALSE)
-                        usleep(10000);
+                        usleep(1000);
                     self->jack_is_flushed = 0;
-                    self->command = CMD_COMPLETE;
+                    xlplayer_command_done(self);
                     }
                 break;
+            case CMD_PRELOAD:
+                xlplayer_lookahead_request(self, self->lookahead.request, self->lookahead.request_seek_s, self->lookahead.request_gain);
+                xlplayer_command_done(self);
+                break;
             case CMD_CLEANUP:
+                xlplayer_lookahead_discard(self);
                 if (self->playlist)
                     free(self->playlist);
                 self->command = CMD_THREADEXIT;
@@ -320,6 +559,9 @@ static void *xlplayer_main(struct xlplayer *self)
         switch (self->playmode)
             {
             case PM_STOPPED:
+                /* idle time goes to readying the next track */
+                if (xlplayer_lookahead_step(self))
+                    continue;
                 pthread_mutex_lock(&self->command_mutex);
                 while (self->command == CMD_COMPLETE)
                     pthread_cond_wait(&self->command_cv, &self->command_mutex);
@@ -328,27 +570,17 @@ static void *xlplayer_main(struct xlplayer *self)
             case PM_INITIATE:
                 self->initial_audio_context = -1;   /* pre-select failure return code */
                 xlplayer_set_fadesteps(self, self->fade_mode);
-                extension = get_extension(self->pathname);
-                if (
-                          ((!strcmp(extension, "ogg") || !strcmp(extension, "oga")) && oggdecode_reg(self))
-#ifdef HAVE_SPEEX
-                          || (!strcmp(extension, "spx") && oggdecode_reg(self))
-#endif
-#ifdef HAVE_OPUS
-                          || (!strcmp(extension, "opus") && oggdecode_reg(self))
-#endif
-#ifdef HAVE_FLAC
-                          || (!strcmp(extension, "flac") && flacdecode_reg(self))
-#endif
-                          || ((!strcmp(extension, "wav") || !strcmp(extension, "au") || !strcmp(extension, "aiff")) && sndfiledecode_reg(self))
-#ifdef HAVE_LIBAV
-                          || ((!strcmp(extension, "aac") || !strcmp(extension, "m4a") || !strcmp(extension, "mp4") || !strcmp(extension, "m4b") || !strcmp(extension, "m4p") || !strcmp(extension, "wma") || !strcmp(extension, "avi") || !strcmp(extension, "mpc") || !strcmp(extension, "ape")) && avcodecdecode_reg(self))
-#endif /* HAVE_LIBAV */
-                          || ((!strcmp(extension, "mp3") || (!strcmp(extension, "mp2"))) && mpg123ok && mp3decode_reg(self))
-                    )
+                if (xlplayer_lookahead_splice(self))
+                    {
+                    if (self->command != CMD_COMPLETE)
+                        ++self->current_audio_context;
+                    self->initial_audio_context = self->current_audio_context;
+                    }
+                else if (xlplayer_register(self, &self->pcm_capture))
                     {
                     self->playmode = PM_PLAYING;
                     self->play_progress_ms = 0;
+                    self->progress_seek_s = self->seek_s;
                     self->write_deferred = 0;
                     self->pause = 0;
                     self->samples_written = 0;
@@ -356,28 +588,47 @@ static void *xlplayer_main(struct xlplayer *self)
                     fade_set(self->fadein, (self->seek_s || self->fade_mode) ? FADE_SET_LOW : FADE_SET_HIGH, -1.0f, FADE_IN);
                     self->silence = 0.0f;
                     self->dec_init(self);
+                    if (self->playmode != PM_PLAYING && self->pcm_capture)
+                        {
+                        pcmcache_capture_abandon(self->pcm_capture);
+                        self->pcm_capture = NULL;
+                        }
                     if (self->command != CMD_COMPLETE)
                         ++self->current_audio_context;
                     self->initial_audio_context = self->current_audio_context;
                     }
                 else
                     self->playmode = PM_STOPPED;
-                self->command = CMD_COMPLETE;
-                free(extension);
+                if (self->playlistmode && self->playmode != PM_STOPPED)
+                    xlplayer_lookahead_next(self);
+                xlplayer_command_done(self);
                 break;
             case PM_PLAYING:
                 if (self->write_deferred)
-                    xlplayer_write_channel_data(self);
+                    xlplayer_write_pending(self);
                 else
                     self->dec_play(self);
                 break;
             case PM_FLUSH:
                 if (self->write_deferred)
-                    xlplayer_write_channel_data(self);
+                    xlplayer_write_pending(self);
                 else
+                    {
+                    /* the whole file was played through */
+                    if (self->pcm_capture)
+                        {
+                        pcmcache_capture_commit(self->pcm_capture);
+                        self->pcm_capture = NULL;
+                        }
                     self->playmode = PM_EJECTING;
+                    }
                 break;
             case PM_EJECTING:
+                if (self->pcm_capture)
+                    {
+                    pcmcache_capture_abandon(self->pcm_capture);
+                    self->pcm_capture = NULL;
+                    }
                 xlplayer_set_fadesteps(self, self->fade_mode);
                 self->dec_eject(self);
                 if (self->playlistmode)
@@ -395,15 +646,18 @@ static void *xlplayer_main(struct xlplayer *self)
                             }
                         }
                     else
+                        {
+                        xlplayer_lookahead_discard(self);
                         while (self->playlistsize--)
                             free(self->playlist[self->playlistsize]);
+                        }
                     }
                 ++self->current_audio_context;
                 self->playmode = PM_STOPPED;
                 break;
             } 
         }
-    self->command = CMD_COMPLETE;
+    xlplayer_command_done(self);
     return 0;
     }
 
@@ -498,7 +752,7 @@ static long conv_rf_read(void *cb_data, float **audiodata)
 
 struct xlplayer *xlplayer_create(int samplerate, double duration, char *playername, sig_atomic_t *shutdown_f, int *vol_c, float vol_scale, int *strmute_c, int *audmute_c, float cutoff_s)
     {
-    struct xlplayer *self;
+    struct xlplayer *self, *shadow;
     int error;
     const float minlevel = 1.0f/10000.0f;
     
@@ -557,6 +811,20 @@ struct xlplayer *xlplayer_create(int samplerate, double duration, char *playerna
         }
     self->fadein = fade_init(samplerate, minlevel);
     self->fadeout = fade_init(samplerate, minlevel);
+    if (!(shadow = self->lookahead.shadow = calloc(1, sizeof (struct xlplayer))))
+        {
+        fprintf(stderr, "xlplayer: malloc failure");
+        exit(5);
+        }
+    shadow->fadein = fade_init(samplerate, minlevel);
+    shadow->playername = playername;
+    shadow->samplerate = samplerate;
+    shadow->playmode = PM_STOPPED;
+    pcmconv_noise_init(&shadow->noise, 27851);
+    shadow->lookahead.staging = TRUE;
+    /* up to a second of the next track is decoded ahead, less for a short ringbuffer */
+    if ((shadow->lookahead.limit = self->rbsize / sizeof (sample_t) / 2) > (size_t)samplerate)
+        shadow->lookahead.limit = samplerate;
     self->pbsrb_l = malloc(PBSPEED_INPUT_BUFFER_SIZE);
     self->pbsrb_r = malloc(PBSPEED_INPUT_BUFFER_SIZE);
     self->pbsrb_lf = malloc(PBSPEED_INPUT_BUFFER_SIZE);
@@ -568,7 +836,7 @@ struct xlplayer *xlplayer_create(int samplerate, double duration, char *playerna
         }
     self->playername = playername;
     self->cf_l_gain = self->cf_r_gain = 1.0f;
-    self->seed = 17234;
+    pcmconv_noise_init(&self->noise, 17234);
     self->samplerate = samplerate;
     self->jack_shutdown_f = shutdown_f;
     self->command = CMD_COMPLETE;
@@ -579,6 +847,7 @@ struct xlplayer *xlplayer_create(int samplerate, double duration, char *playerna
     smoothing_mute_init(&self->mute_aud, audmute_c);
     pthread_mutex_init(&self->command_mutex, NULL);
     pthread_cond_init(&self->command_cv, NULL);
+    pthread_cond_init(&self->command_done_cv, NULL);
     pthread_create(&self->thread, NULL, (void *(*)(void *)) xlplayer_main, self);
     while (self->up == FALSE)
         usleep(10000);
@@ -591,19 +860,35 @@ void xlplayer_destroy(struct xlplayer *self)
         {
         xlplayer_command(self, CMD_CLEANUP);
         pthread_join(self->thread, NULL);
+        if (self->pcm_capture)
+            pcmcache_capture_abandon(self->pcm_capture);
         pthread_cond_destroy(&self->command_cv);
+        pthread_cond_destroy(&self->command_done_cv);
         pthread_mutex_destroy(&self->command_mutex);
         pthread_mutex_destroy(&(self->dynamic_metadata.meta_mutex));
         ifree(self->lcb);
         ifree(self->rcb);
         ifree(self->lcfb);
         ifree(self->rcfb);
+        ifree(self->lsb);
+        ifree(self->rsb);
+        ifree(self->fadeb);
+        ifree(self->ls_audb);
+        ifree(self->rs_audb);
+        ifree(self->ls_strb);
+        ifree(self->rs_strb);
         free(self->pbsrb_l);
         free(self->pbsrb_r);
         free(self->pbsrb_lf);
         free(self->pbsrb_rf);
         fade_destroy(self->fadein);
         fade_destroy(self->fadeout);
+        fade_destroy(self->lookahead.shadow->fadein);
+        free(self->lookahead.shadow->lookahead.left);
+        free(self->lookahead.shadow->lookahead.right);
+        free(self->lookahead.shadow->leftbuffer);
+        free(self->lookahead.shadow->rightbuffer);
+        free(self->lookahead.shadow);
         src_delete(self->pbspeed_conv_l);
         src_delete(self->pbspeed_conv_r);
         src_delete(self->pbspeed_conv_lf);
@@ -691,6 +976,14 @@ int xlplayer_play_noflush(struct xlplayer *self, char *pathname, int seek_s, int
     return self->initial_audio_context;
     }
     
+void xlplayer_preload(struct xlplayer *self, char *pathname, int seek_s, float gain_db)
+    {
+    self->lookahead.request = pathname;
+    self->lookahead.request_seek_s = seek_s;
+    self->lookahead.request_gain = pow(10.0, gain_db / 20.0);
+    xlplayer_command(self, CMD_PRELOAD);
+    }
+
 void xlplayer_pause(struct xlplayer *self)
     {
     self->pause = TRUE;
@@ -715,10 +1008,8 @@ void xlplayer_eject(struct xlplayer *self)
 
 void xlplayer_set_fadesteps(struct xlplayer *self, int fade_mode)
     {
-    static float a[] = {1.0f, 5.0f, 10.0f, 0.1f, 0.05f};
-    static float b[] = {0.05f, 5.0f, 10.0f, 0.0f, 0.05f};
-    fade_set(self->fadeout, FADE_SET_SAME, a[fade_mode], FADE_DIRECTION_UNCHANGED);
-    fade_set(self->fadein, FADE_SET_SAME, b[fade_mode], FADE_DIRECTION_UNCHANGED);
+    fade_set(self->fadeout, FADE_SET_SAME, fadeout_time[fade_mode], FADE_DIRECTION_UNCHANGED);
+    fade_set(self->fadein, FADE_SET_SAME, fadein_time[fade_mode], FADE_DIRECTION_UNCHANGED);
     }
 
 /* version supporting playback speed variance */
@@ -880,13 +1171,52 @@ size_t read_from_player(struct xlplayer *self, sample_t *left_buf, sample_t *rig
 
 int xlplayer_calc_rbdelay(struct xlplayer *xlplayer)
     {
+    /* the track being readied is not in the ringbuffer yet */
+    if (xlplayer->lookahead.staging)
+        return 0;
     return jack_ringbuffer_read_space(xlplayer->left_ch) * 1000 / (sizeof (sample_t) * xlplayer->samplerate);
     }
 
+int xlplayer_render_ready(struct xlplayer *self, jack_nframes_t nframes)
+    {
+    size_t wanted = ((size_t)(nframes * (self->pbspeed > 1.0 ? self->pbspeed : 1.0)) + 1) * sizeof (sample_t);
+
+    if (wanted > self->rbsize / 2)
+        wanted = self->rbsize / 2;
+
+    switch (self->playmode)
+        {
+        case PM_INITIATE:
+        case PM_PLAYING:
+            break;
+        case PM_FLUSH:
+            if (self->write_deferred)
+                break;
+        default:
+            /* nothing more is coming */
+            return TRUE;
+        }
+    return self->pause || jack_ringbuffer_read_space(self->right_ch) >= wanted;
+    }
+
 void xlplayer_set_dynamic_metadata(struct xlplayer *xlplayer, enum metadata_t type, char *artist, char *title, char *album, int delay)
     {
     struct xlp_dynamic_metadata *dm = &(xlplayer->dynamic_metadata);
+    struct xlplayer_lookahead *la = &xlplayer->lookahead;
     
+    if (la->staging)
+        {
+        /* the track isn't playing yet, this is passed on when it is */
+        free(la->dm_artist);
+        free(la->dm_title);
+        free(la->dm_album);
+        la->dm_artist = strdup(artist);
+        la->dm_title = strdup(title);
+        la->dm_album = strdup(album);
+        la->dm_type = type;
+        return;
+        }
+
     pthread_mutex_lock(&(dm->meta_mutex));
     dm->data_type = type;
     if (dm->artist)
@@ -909,6 +1239,13 @@ void xlplayer_buffer_alloc(struct xlplayer *self, jack_nframes_t nframes)
     self->rcb = irealloc(self->rcb, nframes);
     self->lcfb = irealloc(self->lcfb, nframes);
     self->rcfb = irealloc(self->rcfb, nframes);
+    self->lsb = irealloc(self->lsb, nframes);
+    self->rsb = irealloc(self->rsb, nframes);
+    self->fadeb = irealloc(self->fadeb, nframes);
+    self->ls_audb = irealloc(self->ls_audb, nframes);
+    self->rs_audb = irealloc(self->rs_audb, nframes);
+    self->ls_strb = irealloc(self->ls_strb, nframes);
+    self->rs_strb = irealloc(self->rs_strb, nframes);
     }
 
 void xlplayer_buffer_alloc_all(struct xlplayer **list, jack_nframes_t nframes)
@@ -962,6 +1299,54 @@ void xlplayer_read_next_all(struct xlplayer **list)
         xlplayer_read_next(*list++);
     }
 
+/* xlplayer_read_block: the whole period in one go -- identical results to
+ * calling xlplayer_read_next nframes times but with the fade level and the
+ * peak level computed up front so the summing loop can be vectorized
+ */
+void xlplayer_read_block(struct xlplayer *self, jack_nframes_t nframes)
+    {
+    const float * restrict lcp = self->lcp, * restrict rcp = self->rcp;
+    const float * restrict lcfp = self->lcfp, * restrict rcfp = self->rcfp;
+    float * restrict ls = self->lsb, * restrict rs = self->rsb;
+    float * restrict fade = self->fadeb;
+    float peak = self->peak, abs;
+    jack_nframes_t i;
+
+    if (!nframes)
+        return;
+
+    for (i = 0; i < nframes; ++i)
+        fade[i] = fade_get(self->fadeout);
+
+    for (i = 0; i < nframes; ++i)
+        {
+        if ((abs = fabsf(lcp[i])) > peak)
+            peak = abs;
+        if ((abs = fabsf(rcp[i])) > peak)
+            peak = abs;
+        }
+    self->peak = peak;
+
+    for (i = 0; i < nframes; ++i)
+        {
+        ls[i] = lcp[i] + lcfp[i] * fade[i];
+        rs[i] = rcp[i] + rcfp[i] * fade[i];
+        }
+
+    self->lcp += nframes;
+    self->rcp += nframes;
+    self->lcfp += nframes;
+    self->rcfp += nframes;
+    self->ls = ls[nframes - 1];
+    self->rs = rs[nframes - 1];
+    }
+
+void xlplayer_read_block_all(struct xlplayer **list, jack_nframes_t nframes)
+    {
+    while (*list)
+        xlplayer_read_block(*list++, nframes);
+    }
+
 void xlplayer_levels(struct xlplayer *self)
     {
     self->ls_aud = self->ls * self->volume.level * self->mute_aud.level * (self->cf_aud ? self->cf_l_gain : 1.0f);
@@ -976,6 +1361,37 @@ void xlplayer_levels_all(struct xlplayer **list)
         xlplayer_levels(*list++);
     }
 
+/* xlplayer_levels_block: as xlplayer_levels over a run of samples for which
+ * the smoothed gain values are constant, the expressions are kept in the
+ * same order so that the rounding matches that of the per sample version
+ */
+void xlplayer_levels_block(struct xlplayer *self, jack_nframes_t offset, jack_nframes_t nframes)
+    {
+    const float * restrict ls = self->lsb + offset, * restrict rs = self->rsb + offset;
+    float * restrict ls_aud = self->ls_audb + offset, * restrict rs_aud = self->rs_audb + offset;
+    float * restrict ls_str = self->ls_strb + offset, * restrict rs_str = self->rs_strb + offset;
+    const float vol = self->volume.level;
+    const float mute_aud = self->mute_aud.level;
+    const float mute_str = self->mute_str.level;
+    const float cf_l_aud = self->cf_aud ? self->cf_l_gain : 1.0f;
+    const float cf_r_aud = self->cf_aud ? self->cf_r_gain : 1.0f;
+    const float cf_l = self->cf_l_gain, cf_r = self->cf_r_gain;
+
+    for (jack_nframes_t i = 0; i < nframes; ++i)
+        {
+        ls_aud[i] = ls[i] * vol * mute_aud * cf_l_aud;
+        rs_aud[i] = rs[i] * vol * mute_aud * cf_r_aud;
+        ls_str[i] = ls[i] * vol * mute_str * cf_l;
+        rs_str[i] = rs[i] * vol * mute_str * cf_r;
+        }
+    }
+
+void xlplayer_levels_block_all(struct xlplayer **list, jack_nframes_t offset, jack_nframes_t nframes)
+    {
+    while (*list)
+        xlplayer_levels_block(*list++, offset, nframes);
+    }
+
 void xlplayer_smoothing_process(struct xlplayer *self)
     {
     smoothing_volume_process(&self->volume);
@@ -989,28 +1405,36 @@ void xlplayer_smoothing_process_all(struct xlplayer **list)
         xlplayer_smoothing_process(*list++);
     }
 
-void xlplayer_stats(struct xlplayer *self)
+void xlplayer_telemetry(struct xlplayer *self, struct telemetry_player *tp)
     {
-    char prefix[20];
-    struct xlp_dynamic_metadata *dm = &self->dynamic_metadata;
-    
-    snprintf(prefix, 20, "%s_", self->playername);
-    #define PREFIX() fputs(prefix, g.out)
-
-    PREFIX();
-    fprintf(g.out, "elapsed=%d\n", self->play_progress_ms / 1000);
-    PREFIX();
-    fprintf(g.out, "playing=%d\n", self->have_data_f | (self->current_audio_context & 0x1));
-    PREFIX();
-    fprintf(g.out, "signal=%d\n", self->peak > 0.001F || self->peak < 0.0F || self->pause);
-    PREFIX();
-    fprintf(g.out, "cid=%d\n", self->current_audio_context);
-    PREFIX();
-    fprintf(g.out, "audio_runout=%d\n", self->avail < self->samples_cutoff && (!(self->current_audio_context & 0x1)));
-    PREFIX();
-    fprintf(g.out, "silence=%f\n", self->silence);
+    tp->elapsed = self->play_progress_ms / 1000;
+    tp->playing = self->have_data_f | (self->current_audio_context & 0x1);
+    tp->signal = self->peak > 0.001F || self->peak < 0.0F || self->pause;
+    tp->cid = self->current_audio_context;
+    tp->audio_runout = self->avail < self->samples_cutoff && (!(self->current_audio_context & 0x1));
+    tp->silence = self->silence;
+    tp->buffered_ms = self->samplerate ? (int32_t)((uint64_t)self->avail * 1000 / self->samplerate) : 0;
 
     self->peak = 0.0f;
+    }
+
+void xlplayer_telemetry_all(struct xlplayer **list, struct telemetry_player *tp)
+    {
+    while (*list)
+        xlplayer_telemetry(*list++, tp++);
+    }
+
+int xlplayer_new_metadata_pending(struct xlplayer **list)
+    {
+    while (*list)
+        if ((*list++)->dynamic_metadata.data_type)
+            return TRUE;
+    return FALSE;
+    }
+
+void xlplayer_new_metadata(struct xlplayer *self)
+    {
+    struct xlp_dynamic_metadata *dm = &self->dynamic_metadata;
 
     if (dm->data_type)
         {
@@ -1018,8 +1442,7 @@ void xlplayer_stats(struct xlplayer *self)
         fprintf(stderr, "new dynamic metadata\n");
         if (dm->data_type != DM_JOINED_UC)
             {
-            PREFIX();
-            fprintf(g.out, "new_metadata=d%d:%dd%d:%sd%d:%sd%d:%sd9:%09dd9:%09dx\n", (int)log10(dm->data_type) + 1, dm->data_type, (int)strlen(dm->artist), dm->artist, (int)strlen(dm->title), dm->title, (int)strlen(dm->album), dm->album, dm->current_audio_context, dm->rbdelay);
+            fprintf(g.out, "%s_new_metadata=d%d:%dd%d:%sd%d:%sd%d:%sd9:%09dd9:%09dx\n", self->playername, (int)log10(dm->data_type) + 1, dm->data_type, (int)strlen(dm->artist), dm->artist, (int)strlen(dm->title), dm->title, (int)strlen(dm->album), dm->album, dm->current_audio_context, dm->rbdelay);
             }
         else
             {
@@ -1028,12 +1451,10 @@ void xlplayer_stats(struct xlplayer *self)
         dm->data_type = DM_NONE_NEW;
         pthread_mutex_unlock(&(dm->meta_mutex));
         }
-    
-    #undef PREFIX
     }
 
-void xlplayer_stats_all(struct xlplayer **list)
+void xlplayer_new_metadata_all(struct xlplayer **list)
     {
     while (*list)
-        xlplayer_stats(*list++);
+        xlplayer_new_metadata(*list++);
     }
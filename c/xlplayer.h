@@ -35,8 +35,13 @@
 
 #include "fade.h"
 #include "smoothing.h"
+#include "telemetry.h"
+#include "pcmconv.h"
 
-enum command_t {CMD_COMPLETE, CMD_PLAY, CMD_EJECT, CMD_CLEANUP, CMD_THREADEXIT, CMD_PLAYMANY};
+struct pcmcache_entry;
+struct xlplayer;
+
+enum command_t {CMD_COMPLETE, CMD_PLAY, CMD_EJECT, CMD_CLEANUP, CMD_THREADEXIT, CMD_PLAYMANY, CMD_PRELOAD};
 
 enum playmode_t {PM_STOPPED, PM_INITIATE, PM_PLAYING, PM_FLUSH, PM_EJECTING };
 
@@ -53,6 +58,29 @@ struct xlp_dynamic_metadata     /* song titles can change mid-file */
     enum metadata_t data_type;
     };
 
+enum lookahead_t {LA_IDLE, LA_REQUESTED, LA_DECODING, LA_READY};
+
+/* the next track, opened and partly decoded while the current one plays out
+ * the decoder is driven on a shadow player of its own, on which the fields
+ * from staging on hold what it has made ready for the splice
+ */
+struct xlplayer_lookahead
+    {
+    enum lookahead_t state;
+    char *request;                      /* handed over with CMD_PRELOAD */
+    int request_seek_s;
+    float request_gain;
+    int fade_mode;                      /* at the time of the request */
+    struct pcmcache_entry *pcm_capture;
+    struct xlplayer *shadow;            /* decoder context of the track being readied */
+    int staging;                        /* set on the shadow, output is held back */
+    float *left, *right;                /* the audio decoded so far */
+    size_t frames, capacity;
+    size_t limit;                       /* decoding stops at this many frames */
+    enum metadata_t dm_type;            /* dynamic metadata held back until the splice */
+    char *dm_artist, *dm_title, *dm_album;
+    };
+
 struct xlplayer
     {
     struct fade *fadein;                /* fade level computation */
@@ -84,6 +112,7 @@ struct xlplayer
     int write_deferred;                 /* suppress further generation of audio data */
     u_int64_t samples_written;          /* number of samples written to the ringbuffer */
     int32_t play_progress_ms;           /* the playback progress in milliseconds */
+    int progress_seek_s;                /* seek_s of the track reaching the ringbuffer, for the above */
     char *playername;                   /* the name of this player e.g. "left", "right" etc. */
     enum playmode_t playmode;           /* indicates the player mode or state */
     enum command_t command;             /* the command mode */
@@ -92,9 +121,10 @@ struct xlplayer
     int current_audio_context;          /* bumps when started, bumps when stopped. Odd=playing */
     int initial_audio_context;          /* return code placeholder variable for above */
     int dither;                         /* whether to add dither to player output FLAC, MP4, WAV only */
-    unsigned int seed;                  /* used for dither */
+    struct pcmconv_noise noise;         /* used for dither */
     pthread_t thread;                   /* thread pointer for the player main loop */
     u_int32_t sleep_samples;            /* used to count off when it is appropriate to call sleep */
+    int unpaced;                        /* no sleeps between writes, the reader is faster than realtime */
     SRC_STATE *src_state;               /* used by resampler */
     SRC_DATA src_data;
     int rsqual;                         /* resample quality */   
@@ -119,6 +149,7 @@ struct xlplayer
     void (*dec_init)(struct xlplayer *);/* audio decoder init function */
     void (*dec_play)(struct xlplayer *);/* function that decodes one frame of audio data */
     void (*dec_eject)(struct xlplayer *);/* function that cleans up after the decoder */
+    void (*dec_rebind)(struct xlplayer *);/* optional, points a decoder that keeps the player at this one */
     struct xlp_dynamic_metadata dynamic_metadata;
     int usedelay;                       /* client to delay dynamic metadata display */
     float silence;                      /* the number of seconds of silence */
@@ -132,6 +163,11 @@ struct xlplayer
     float *rcfb;                        /* right channel fade buffer */
     
     float *lcp, *rcp, *lcfp, *rcfp;     /* pointers into the above buffers */
+
+    float *lsb, *rsb;                   /* block mixer: ls, rs for the whole period */
+    float *fadeb;                       /* block mixer: fadeout level for the whole period */
+    float *ls_audb, *rs_audb;           /* block mixer: gain adjusted samples */
+    float *ls_strb, *rs_strb;
     
     float ls, rs;                       /* the current audio sample stereo pair -- prior to gain adjustment */
     float peak;                         /* peak = MAX(peak, MAX(ABS(ls), ABS(rs))) */
@@ -147,6 +183,11 @@ struct xlplayer
     uint32_t id;                        /* player identity e.g. player 3 = 1 << 3 */
     pthread_mutex_t command_mutex;      /* lock for command varaible change */
     pthread_cond_t command_cv;          /* used to wake up idle worker thread */
+    pthread_cond_t command_done_cv;     /* used to wake whoever issued the command */
+    int use_pcm_cache;                  /* play from and add to the decoded audio cache */
+    struct pcmcache_entry *pcm_capture; /* cache entry being filled by the current play */
+    int use_lookahead;                  /* ready the next track while this one plays */
+    struct xlplayer_lookahead lookahead;
     };
 
 /* xlplayer_create: create an instance of the player */
@@ -167,6 +208,11 @@ int xlplayer_playmany(struct xlplayer *self, char *playlist, int loop_f);
 /* xlplayer_play_noflush: starts the player without flushing out old data from the ringbuffer */
 int xlplayer_play_noflush(struct xlplayer *self, char *pathname, int seek_s, int size, float gain_db, int id);
 
+/* xlplayer_preload: open and start decoding a track expected to be started
+* with xlplayer_play_noflush at the end of the current one, so that it can be
+* spliced on without delay, a different request simply discards it */
+void xlplayer_preload(struct xlplayer *self, char *pathname, int seek_s, float gain_db);
+
 /* xlplayer_cancelplaynext: cancels the automatic playing of the next track 
 * the current track is allowed to continue playing */
 void xlplayer_cancelplaynext(struct xlplayer *self);
@@ -193,9 +239,6 @@ size_t read_from_player_sv(struct xlplayer *self, jack_default_audio_sample_t *l
 /* calculate the gain for fading in - used when seeking to prevent clicks */
 jack_default_audio_sample_t xlplayer_get_next_gain(struct xlplayer *self);
 
-/* put audio data in format recognised by jack and libsamplerate */
-float *xlplayer_make_audio_to_float(struct xlplayer *self, float *buffer, uint8_t *data, int num_samples, int bits_per_sample, int num_channels);
-
 /* splits audio data into separate audio streams, ready for writing */
 void xlplayer_demux_channel_data(struct xlplayer *self, jack_default_audio_sample_t *buffer, int num_samples, int num_channels, float scale);
 
@@ -208,6 +251,8 @@ void xlplayer_set_dynamic_metadata(struct xlplayer *xlplayer, enum metadata_t ty
 /* return the delay caused by the ringbuffer */
 int xlplayer_calc_rbdelay(struct xlplayer *xlplayer);
 
+/* whether nframes can be read without getting ahead of the decoder, for offline rendering */
+int xlplayer_render_ready(struct xlplayer *self, jack_nframes_t nframes);
 /* this sets the speed of fading for a particular mode */
 void xlplayer_set_fadesteps(struct xlplayer *self, int fade_step);
 
@@ -217,18 +262,30 @@ size_t xlplayer_read_start(struct xlplayer *self, jack_nframes_t nframes);
 /* compute the next sample */
 void xlplayer_read_next(struct xlplayer *self);
 
+/* block mixer equivalents of the above, results go to lsb/rsb and the *_audb, *_strb buffers */
+void xlplayer_read_block(struct xlplayer *self, jack_nframes_t nframes);
+void xlplayer_levels_block(struct xlplayer *self, jack_nframes_t offset, jack_nframes_t nframes);
+
 /* volume control and mute toggle smoothing single iteration */
 void xlplayer_smoothing_process(struct xlplayer *self);
 
-void xlplayer_stats(struct xlplayer *self);
+/* meter and progress values for the telemetry block, resets the peak */
+void xlplayer_telemetry(struct xlplayer *self, struct telemetry_player *tp);
+
+/* report dynamic metadata not yet seen by the user interface */
+void xlplayer_new_metadata(struct xlplayer *self);
 
 /* group process all players from the list */
 void xlplayer_read_start_all(struct xlplayer **list, jack_nframes_t nframes, struct xlplayer **roster);
 void xlplayer_read_next_all(struct xlplayer **list);
 void xlplayer_levels_all(struct xlplayer **list);
+void xlplayer_read_block_all(struct xlplayer **list, jack_nframes_t nframes);
+void xlplayer_levels_block_all(struct xlplayer **list, jack_nframes_t offset, jack_nframes_t nframes);
 void xlplayer_buffer_alloc_all(struct xlplayer **list, jack_nframes_t nframes);
 void xlplayer_smoothing_process_all(struct xlplayer **list);
-void xlplayer_stats_all(struct xlplayer **list);
+void xlplayer_telemetry_all(struct xlplayer **list, struct telemetry_player *tp);
+int xlplayer_new_metadata_pending(struct xlplayer **list);
+void xlplayer_new_metadata_all(struct xlplayer **list);
 
 /* initialise mpg123 runtime linking (if falling back to runtime linking) and report the operational status */
 void xlplayer_mpg123_status();
@@ -51,6 +51,9 @@ static int queue_data(shout_queue_t *queue, const unsigned char *data, size_t le
 static int queue_str(shout_t *self, const char *str);
 static int queue_printf(shout_t *self, const char *fmt, ...);
 static inline void queue_free(shout_queue_t *queue);
+static int wqueue_add(shout_t *self, const unsigned char *data, size_t len);
+static void wqueue_consume(shout_wqueue_t *queue, size_t len);
+static void wqueue_free(shout_wqueue_t *queue);
 static int send_queue(shout_t *self);
 static int get_response(shout_t *self);
 static int try_connect (shout_t *self);
@@ -184,7 +187,7 @@ int shout_close(shout_t *self)
 	self->starttime = 0;
 	self->senttime = 0;
 	queue_free(&self->rqueue);
-	queue_free(&self->wqueue);
+	wqueue_free(&self->wqueue);
 
 	return self->error = SHOUTERR_SUCCESS;
 }
@@ -206,6 +209,25 @@ int shout_send(shout_t *self, const unsigned char *data, size_t len)
 	return self->send(self, data, len);
 }
 
+int shout_send_ref(shout_t *self, const unsigned char *data, size_t len,
+		void (*ref)(void *owner), void (*unref)(void *owner), void *owner)
+{
+	int ret;
+
+	if (!self)
+		return SHOUTERR_INSANE;
+
+	self->sending.data = data;
+	self->sending.len = len;
+	self->sending.owner = owner;
+	self->sending.ref = ref;
+	self->sending.unref = unref;
+	ret = shout_send(self, data, len);
+	memset(&self->sending, 0, sizeof(self->sending));
+
+	return ret;
+}
+
 ssize_t shout_send_raw(shout_t *self, const unsigned char *data, size_t len)
 {
 	ssize_t ret;
@@ -223,7 +245,7 @@ ssize_t shout_send_raw(shout_t *self, const unsigned char *data, size_t len)
 		if ((ret = try_write(self, data, len)) < 0)
 			return self->error;
 		if (ret < (ssize_t)len) {
-			self->error = queue_data(&self->wqueue, data + ret, len - ret);
+			self->error = wqueue_add(self, data + ret, len - ret);
 			if (self->error != SHOUTERR_SUCCESS)
 				return self->error;
 		}
@@ -231,7 +253,7 @@ ssize_t shout_send_raw(shout_t *self, const unsigned char *data, size_t len)
 		return len;
 	}
 
-	self->error = queue_data(&self->wqueue, data, len);
+	self->error = wqueue_add(self, data, len);
 	if (self->error != SHOUTERR_SUCCESS)
 		return self->error;
 
@@ -250,6 +272,43 @@ ssize_t shout_queuelen(shout_t *self)
 	return (ssize_t)self->wqueue.len;
 }
 
+int shout_get_socket(shout_t *self)
+{
+	if (!self || self->state == SHOUT_STATE_UNCONNECTED)
+		return -1;
+
+	return (int)self->socket;
+}
+
+int shout_get_poll_events(shout_t *self)
+{
+	if (!self)
+		return 0;
+
+	switch (self->state) {
+	case SHOUT_STATE_CONNECT_PENDING:
+	case SHOUT_STATE_REQ_PENDING:
+		return SHOUT_POLLOUT;
+	case SHOUT_STATE_RESP_PENDING:
+		return SHOUT_POLLIN;
+	case SHOUT_STATE_CONNECTED:
+		return self->wqueue.len ? SHOUT_POLLOUT : 0;
+	default:
+		return 0;
+	}
+}
+
+void shout_get_write_stats(shout_t *self, unsigned long long *calls, unsigned long long *bytes)
+{
+	if (!self) {
+		*calls = *bytes = 0;
+		return;
+	}
+
+	*calls = self->write_calls;
+	*bytes = self->write_bytes;
+}
+
 
 void shout_sync(shout_t *self)
 {
@@ -959,9 +1018,101 @@ static int queue_data(shout_queue_t *queue, const unsigned char *data, size_t le
 	return SHOUTERR_SUCCESS;
 }
 
+/* add to the write queue, by reference when the data is in the buffer
+ * passed to shout_send_ref, otherwise by copying */
+static int wqueue_add(shout_t *self, const unsigned char *data, size_t len)
+{
+	shout_wqueue_t *queue = &self->wqueue;
+	shout_owner_t *sending = &self->sending;
+	shout_seg_t *seg = queue->tail;
+	size_t plen;
+
+	if (!len)
+		return SHOUTERR_SUCCESS;
+
+	/* small pieces are cheaper to copy than to hold a reference for */
+	if (sending->owner && len >= SHOUT_MINREF && data >= sending->data &&
+			data + len <= sending->data + sending->len) {
+		if (!(seg = calloc(1, sizeof(shout_seg_t))))
+			return SHOUTERR_MALLOC;
+		seg->data = data;
+		seg->len = len;
+		seg->owner = sending->owner;
+		seg->unref = sending->unref;
+		sending->ref(sending->owner);
+	} else {
+		/* top up the last copy first */
+		if (seg && seg->cap > seg->len) {
+			plen = len > seg->cap - seg->len ? seg->cap - seg->len : len;
+			memcpy((unsigned char *)seg->data + seg->len, data, plen);
+			seg->len += plen;
+			queue->len += plen;
+			data += plen;
+			len -= plen;
+			if (!len)
+				return SHOUTERR_SUCCESS;
+		}
+
+		plen = len > SHOUT_BUFSIZE ? len : SHOUT_BUFSIZE;
+		if (!(seg = calloc(1, sizeof(shout_seg_t) + plen)))
+			return SHOUTERR_MALLOC;
+		seg->data = (unsigned char *)(seg + 1);
+		seg->cap = plen;
+		memcpy(seg + 1, data, len);
+		seg->len = len;
+	}
+
+	if (queue->tail)
+		queue->tail->next = seg;
+	else
+		queue->head = seg;
+	queue->tail = seg;
+	queue->len += len;
+
+	return SHOUTERR_SUCCESS;
+}
+
+/* drop len sent bytes from the front of the write queue */
+static void wqueue_consume(shout_wqueue_t *queue, size_t len)
+{
+	shout_seg_t *seg;
+	size_t plen;
+
+	queue->len -= len;
+	while (len) {
+		seg = queue->head;
+		plen = seg->len - seg->pos;
+		if (len < plen) {
+			seg->pos += len;
+			return;
+		}
+
+		len -= plen;
+		if (!(queue->head = seg->next))
+			queue->tail = NULL;
+		if (seg->owner)
+			seg->unref(seg->owner);
+		free(seg);
+	}
+}
+
+static void wqueue_free(shout_wqueue_t *queue)
+{
+	shout_seg_t *seg;
+
+	while ((seg = queue->head)) {
+		queue->head = seg->next;
+		if (seg->owner)
+			seg->unref(seg->owner);
+		free(seg);
+	}
+	queue->tail = NULL;
+	queue->len = 0;
+}
+
 static inline int queue_str(shout_t *self, const char *str)
 {
-	return queue_data(&self->wqueue, (const unsigned char*)str, strlen(str));
+	return wqueue_add(self, (const unsigned char*)str, strlen(str));
 }
 
 /* this should be shared with sock_write. Create libicecommon. */
@@ -982,12 +1133,12 @@ static int queue_printf(shout_t *self, const char *fmt, ...)
 	self->error = SHOUTERR_SUCCESS;
 	if (len > 0) {
 		if ((size_t)len < sizeof(buffer))
-			queue_data(&self->wqueue, (unsigned char*)buf, len);
+			wqueue_add(self, (unsigned char*)buf, len);
 		else {
 			buf = malloc(++len);
 			if (buf) {
 				len = vsnprintf(buf, len, fmt, ap_retry);
-				queue_data(&self->wqueue, (unsigned char*)buf, len);
+				wqueue_add(self, (unsigned char*)buf, len);
 				free(buf);
 			} else
 				self->error = SHOUTERR_MALLOC;
@@ -1164,8 +1315,11 @@ static int try_write (shout_t *self, const void *data_p, size_t len)
 	/* loop until whole buffer is written (unless it would block) */
 	do {
 		ret = sock_write_bytes (self->socket, data + pos, len - pos);
-		if (ret > 0)
+		self->write_calls++;
+		if (ret > 0) {
 			pos += ret;
+			self->write_bytes += ret;
+		}
 	} while (pos < len && ret >= 0);
 
 	if (ret < 0)
@@ -1203,30 +1357,34 @@ static int collect_queue(shout_buf_t *queue, char **buf)
 	return len;
 }
 
+/* write as much of the queue as will go, up to SHOUT_IOVMAX segments at a time */
 static int send_queue(shout_t *self)
 {
-	shout_buf_t *buf;
-	int ret;
+	struct iovec iov[SHOUT_IOVMAX];
+	shout_seg_t *seg;
+	size_t want;
+	ssize_t ret;
+	int n;
 
-	if (!self->wqueue.len)
-		return SHOUTERR_SUCCESS;
+	while (self->wqueue.len) {
+		for (n = 0, want = 0, seg = self->wqueue.head; seg && n < SHOUT_IOVMAX; seg = seg->next, n++) {
+			iov[n].iov_base = (void *)(seg->data + seg->pos);
+			want += iov[n].iov_len = seg->len - seg->pos;
+		}
 
-	buf = self->wqueue.head;
-	while (buf) {
-		ret = try_write (self, buf->data + buf->pos, buf->len - buf->pos);
-		if (ret < 0)
-			return self->error;
+		ret = sock_writev(self->socket, iov, n);
+		self->write_calls++;
+		if (ret < 0) {
+			if (sock_recoverable(sock_error()))
+				return self->error = SHOUTERR_BUSY;
+			return self->error = SHOUTERR_SOCKET;
+		}
 
-		buf->pos += ret;
-		self->wqueue.len -= ret;
-		if (buf->pos == buf->len) {
-			self->wqueue.head = buf->next;
-			free(buf);
-			buf = self->wqueue.head;
-			if (buf)
-				buf->prev = NULL;
-		} else /* incomplete write */
-			return SHOUTERR_BUSY;
+		self->write_bytes += ret;
+		wqueue_consume(&self->wqueue, ret);
+		/* the socket buffer is full, unless this was a signal */
+		if ((size_t)ret < want && self->nonblocking)
+			return self->error = SHOUTERR_BUSY;
 	}
 
 	return self->error = SHOUTERR_SUCCESS;
@@ -31,6 +31,10 @@
 #define LIBSHOUT_DEFAULT_USERAGENT "libshout/" VERSION
 
 #define SHOUT_BUFSIZE 4096
+/* queued pieces of caller data smaller than this are copied */
+#define SHOUT_MINREF 256
+/* most segments handed to a single writev */
+#define SHOUT_IOVMAX 64
 
 typedef struct _shout_buf {
 	unsigned char data[SHOUT_BUFSIZE];
@@ -46,6 +50,36 @@ typedef struct {
 	size_t len;
 } shout_queue_t;
 
+/* A write queue segment either refers to data in a caller owned buffer,
+ * in which case it holds a reference on the owner, or to a copy held in
+ * the space allocated after the segment. */
+typedef struct _shout_seg {
+	const unsigned char *data;
+	size_t len;
+	size_t pos;
+	/* capacity of a copy, zero for a reference */
+	size_t cap;
+	void *owner;
+	void (*unref)(void *owner);
+
+	struct _shout_seg *next;
+} shout_seg_t;
+
+typedef struct {
+	shout_seg_t *head;
+	shout_seg_t *tail;
+	size_t len;
+} shout_wqueue_t;
+
+/* the buffer passed to shout_send_ref while it is being processed */
+typedef struct {
+	const unsigned char *data;
+	size_t len;
+	void *owner;
+	void (*ref)(void *owner);
+	void (*unref)(void *owner);
+} shout_owner_t;
+
 typedef enum {
 	SHOUT_STATE_UNCONNECTED = 0,
 	SHOUT_STATE_CONNECT_PENDING,
@@ -105,7 +139,12 @@ struct shout {
 	void (*close)(shout_t* self);
 
 	shout_queue_t rqueue;
-	shout_queue_t wqueue;
+	shout_wqueue_t wqueue;
+	shout_owner_t sending;
+
+	/* write system calls made and the bytes they wrote */
+	uint64_t write_calls;
+	uint64_t write_bytes;
 
 	/* start of this period's timeclock */
 	uint64_t starttime;
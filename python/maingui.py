@@ -33,6 +33,8 @@ import collections
 import json
 import uuid
 import ctypes
+import mmap
+import struct
 
 import dbus
 import dbus.service
@@ -1849,6 +1851,124 @@ class RecordingPanel(Gtk.VBox):
             box[i%2].pack_start(ind, False)
             ind.show()
 
+class Telemetry(object):
+    """Reader for the meter and status block the backend keeps in a file.
+
+    The layout is described in c/telemetry.h. The backend rewrites the block
+    under a sequence lock so a copy is only kept when the sequence number was
+    even and did not change while the copy was being taken.
+
+    A restarted backend makes a new file in place of the old one so the map
+    is dropped whenever the header no longer matches it or the pathname has
+    moved on to a different inode.
+    """
+
+    MAGIC = 0x4d4c4449
+    VERSION = 1
+    HEADER = struct.Struct("=5I15i")
+    PLAYER = struct.Struct("=5ifi")
+    MIC = struct.Struct("=4i")
+    ENCODER = struct.Struct("=i")
+    STREAMER = struct.Struct("=2i")
+    RECORDER = struct.Struct("=2i")
+    HEADER_FIELDS = ("magic", "version", "size", "seq", "updates", "period_ms",
+            "str_l_peak", "str_r_peak", "str_l_rms", "str_r_rms",
+            "effects_playing", "freewheel_mode", "events_pending", "n_players",
+            "n_effects", "n_mics", "n_encoders", "n_streamers", "n_recorders",
+            "reserved")
+    PLAYER_FIELDS = ("elapsed", "playing", "signal", "cid", "audio_runout",
+            "silence", "buffered_ms")
+    # How many reads go by between checks on the inode.
+    INODE_CHECK = 20
+
+    def __init__(self, pathname):
+        self._pathname = pathname
+        self._map = None
+        self._inode = None
+        self._reads = 0
+
+    def _valid(self, m):
+        head = dict(zip(self.HEADER_FIELDS, self.HEADER.unpack_from(m, 0)))
+        return head["magic"] == self.MAGIC and \
+                head["version"] == self.VERSION and head["size"] == len(m)
+
+    def _open(self):
+        try:
+            with open(self._pathname, "rb") as f:
+                inode = os.fstat(f.fileno()).st_ino
+                m = mmap.mmap(f.fileno(), 0, mmap.MAP_SHARED, mmap.PROT_READ)
+        except (EnvironmentError, ValueError):
+            return False
+        if len(m) < self.HEADER.size or not self._valid(m):
+            m.close()
+            return False
+        self._map = m
+        self._inode = inode
+        return True
+
+    def _stale(self):
+        if not self._valid(self._map):
+            return True
+        self._reads += 1
+        if self._reads % self.INODE_CHECK == 0:
+            try:
+                return os.stat(self._pathname).st_ino != self._inode
+            except EnvironmentError:
+                return True
+        return False
+
+    def close(self):
+        """Drop the map. The next read opens the file afresh."""
+
+        if self._map is not None:
+            self._map.close()
+            self._map = None
+            self._inode = None
+
+    def _records(self, data, offset, rec, count):
+        return [rec.unpack_from(data, offset + i * rec.size)
+                                for i in xrange(count)], offset + rec.size * count
+
+    def read(self):
+        """A consistent snapshot as a dict or None when not available."""
+
+        if self._map is not None and self._stale():
+            self.close()
+        if self._map is None and not self._open():
+            return None
+
+        m = self._map
+        for attempt in xrange(10):
+            seq = struct.unpack_from("=I", m, 12)[0]
+            if seq & 1:
+                time.sleep(0.0002)
+                continue
+            data = m[:]
+            if seq == struct.unpack_from("=I", m, 12)[0]:
+                break
+        else:
+            return None
+
+        snap = dict(zip(self.HEADER_FIELDS, self.HEADER.unpack_from(data, 0)))
+        offset = self.HEADER.size
+        players, offset = self._records(data, offset, self.PLAYER,
+                                                        snap["n_players"])
+        effects, offset = self._records(data, offset, self.PLAYER,
+                                                        snap["n_effects"])
+        snap["players"] = [dict(zip(self.PLAYER_FIELDS, x)) for x in players]
+        snap["effects"] = [dict(zip(self.PLAYER_FIELDS, x)) for x in effects]
+        snap["mics"], offset = self._records(data, offset, self.MIC,
+                                                        snap["n_mics"])
+        encoders, offset = self._records(data, offset, self.ENCODER,
+                                                        snap["n_encoders"])
+        snap["encoders"] = [x[0] for x in encoders]
+        snap["streamers"], offset = self._records(data, offset, self.STREAMER,
+                                                        snap["n_streamers"])
+        snap["recorders"], offset = self._records(data, offset, self.RECORDER,
+                                                        snap["n_recorders"])
+        return snap
+
+
 # A dialog window to appear when shutdown is selected while still streaming.
 class idjc_shutdown_dialog:
     def window_attn(self, widget, event):
@@ -1908,15 +2028,20 @@ class idjc_shutdown_dialog:
 
 
 class MainWindow(dbus.service.Object):
+    # Fader moves are sent as binary frames, the text form is still accepted.
+    mixstats_binary = True
+    MF_MIXSTATS = 1
+    MIXSTATS_FRAME = struct.Struct("=26i2fif6ifif")
+    MIXSTATS_TYPES = (int,) * 26 + (float, float, int, float) + \
+                                    (int,) * 6 + (float, int, float)
+
     def send_new_mixer_stats(self):
 
         deckadj = deck2adj = self.deckadj.get_value()
         if self.prefs_window.dual_volume.get_active():
              deck2adj = self.deck2adj.get_value()
 
-        string_to_send = ":%03d:%03d:%03d:%03d:%03d:%03d:%03d:%03d:%03d:" \
-                        "%d:%d%d%d%d%d:%d%d:%d%d%d%d:%d:%d:%d:%d:%d:%f:%f:" \
-                        "%d:%f:%d:%d:%d:%d:%d:%d:%d:%03d:%f:" % (
+        values = (
                         deckadj,
                         deck2adj,
                         self.crossadj.get_value(),
@@ -1958,7 +2083,18 @@ class MainWindow(dbus.service.Object):
                         self.voipgainadj.get_value(),
                         1.0 / self.jingles.interlude.pbspeedfactor
                         )
-        self.mixer_write("MIXR=%s\nACTN=mixstats\nend\n" % string_to_send)
+
+        if self.mixstats_binary:
+            # Field types as struct mixer_stats_frame in c/mixer.h.
+            payload = self.MIXSTATS_FRAME.pack(*(t(v) for t, v in
+                                        zip(self.MIXSTATS_TYPES, values)))
+            self.mixer_write(struct.pack("=HH", self.MF_MIXSTATS,
+                                        len(payload)) + payload, "mb")
+        else:
+            string_to_send = ":%03d:%03d:%03d:%03d:%03d:%03d:%03d:%03d:" \
+                        "%03d:%d:%d%d%d%d%d:%d%d:%d%d%d%d:%d:%d:%d:%d:%d:%f:" \
+                        "%f:%d:%f:%d:%d:%d:%d:%d:%d:%d:%03d:%f:" % values
+            self.mixer_write("MIXR=%s\nACTN=mixstats\nend\n" % string_to_send)
 
         self.alarm = False
         iteration = 0
@@ -2657,6 +2793,8 @@ class MainWindow(dbus.service.Object):
                 if not self.backend.init_backend(ctypes.byref(read), ctypes.byref(write)):
                     print "call to init_backend failed"
                     continue
+                # The backend has made a new telemetry file.
+                self.telemetry.close()
                 
                 try:
                     self._mixer_ctrl = os.fdopen(write.value, "w")
@@ -2716,11 +2854,6 @@ class MainWindow(dbus.service.Object):
 
 
     def vu_update(self, locking=True, vu_update_counter=[0]):
-        session_ns = {}
-        player_metadata = []
-        session_cmd = midis = ''
-        cons_changed = False
-        
         with (gdklock if locking else nullcm)():
             if not Gtk.main_level():
                 return False
@@ -2728,92 +2861,108 @@ class MainWindow(dbus.service.Object):
             vu_update_counter[0] += 1
             if vu_update_counter[0] % 20 == 0:
                 self.heartbeat()
-           
-            try:
-                self.mixer_write("ACTN=requestlevels\nend\n")
-            except (ValueError, IOError):
-                return True
 
+            snap = self.telemetry.read()
+            if snap is not None:
+                self.telemetry_update(snap)
             
-            while 1:
-                line = self.mixer_read().rstrip()
-                if line == "":
-                    return True
+            # Text is only exchanged when the backend has events to pass on
+            # with a once a second poll as a backstop.
+            if snap is None or snap["events_pending"] or \
+                                            vu_update_counter[0] % 20 == 0:
+                self.events_update()
 
-                if line == "end":
-                    break
+        return True
 
-                if not line.count("="):
-                    print line
-                    continue
 
-                key, value = line.split("=", 1)
+    def telemetry_update(self, snap):
+        """Apply the meter levels and player status from the backend."""
 
-                if key == "midi":
-                    midis= value
-                    continue
-                    
-                if key.startswith("session_"):
-                    session_ns[key[8:]] = value
-                    continue
-                 
-                if key == "ports_connections_changed":
-                    cons_changed = value != "0"
-                    
-                if key.endswith("_silence"):
-                    try:
-                        value = float(value)
-                    except ValueError:
-                        pass
-                else:
-                    try:
-                        value = int(value)
-                    except ValueError:
-                        pass
+        values = [(key, snap[key]) for key in ("str_l_peak", "str_r_peak",
+                "str_l_rms", "str_r_rms", "freewheel_mode")]
+        for name, player in zip(("left", "right", "interlude"),
+                                                            snap["players"]):
+            values += [(name + "_" + k, v) for k, v in player.iteritems()]
+        # All the effects players report under the one name. Last one wins.
+        for player in snap["effects"]:
+            values += [("jingles_" + k, v) for k, v in player.iteritems()]
+        for i, mic in enumerate(snap["mics"]):
+            values.append(("mic_%d_levels" % (i + 1), "%d,%d,%d,%d" % mic))
 
-                if key.endswith("_new_metadata"):
-                    if not key.startswith("jingles"):
-                        if key.startswith("interlude"):
-                            target = self.jingles.interlude
-                        else:
-                            target = getattr(self, "player_" +
-                                                        key.split("_", 1)[0])
-                        player_metadata.append((target, value))
-                    continue
+        for key, value in values:
+            try:
+                self.vumap[key].set_meter_value(value)
+            except KeyError:
+                pass
 
-                try:
-                    self.vumap[key].set_meter_value(value)
-                except KeyError:
-                    pass
-                    #print "key value", key, "missing from vumap"
+        if self.jingles.playing == True and int(self.jingles_playing) == 0:
+            self.jingles.clear_indicators()
 
+        ep = snap["effects_playing"]
+        if ep != int(self.effects_playing):
+            self.effects_playing.set_meter_value(ep)
+            self.jingles.update_effect_leds(ep)
 
-            if self.jingles.playing == True and int(self.jingles_playing) == 0:
-                self.jingles.clear_indicators()
-            
-            for player, data in player_metadata:
-                self.update_songname(player, data)
 
-            if midis:
-                for midi in midis.split(','):
-                    input, _, value = midi.partition(':')
-                    self.controls.input(input, int(value, 16))
+    def events_update(self):
+        """Collect MIDI, session, port connection and metadata events."""
 
-            if session_ns["command"] == "save_L1" and pm.session_type == "L1":
-                self.jack.session_save()
-                self.save_session("L1")
-            if session_ns["command"].endswith("_JACK") and \
-                                                    pm.session_type == "JACK":
-                self.handle_jack_session(**session_ns)
+        session_ns = {}
+        player_metadata = []
+        midis = ''
+        cons_changed = False
+
+        try:
+            self.mixer_write("ACTN=requestevents\nend\n")
+        except (ValueError, IOError):
+            return
 
-            if cons_changed:
-                self.jack.standard_save()
+        while 1:
+            line = self.mixer_read().rstrip()
+            if line == "":
+                return
 
-            ep = int(self.effects_playing)
-            if ep != -1:
-                self.jingles.update_effect_leds(ep)
+            if line == "end":
+                break
 
-        return True
+            if not line.count("="):
+                print line
+                continue
+
+            key, value = line.split("=", 1)
+
+            if key == "midi":
+                midis= value
+            elif key.startswith("session_"):
+                session_ns[key[8:]] = value
+            elif key == "ports_connections_changed":
+                cons_changed = value != "0"
+            elif key.endswith("_new_metadata"):
+                if not key.startswith("jingles"):
+                    if key.startswith("interlude"):
+                        target = self.jingles.interlude
+                    else:
+                        target = getattr(self, "player_" +
+                                                    key.split("_", 1)[0])
+                    player_metadata.append((target, value))
+
+        for player, data in player_metadata:
+            self.update_songname(player, data)
+
+        if midis:
+            for midi in midis.split(','):
+                input, _, value = midi.partition(':')
+                self.controls.input(input, int(value, 16))
+
+        if session_ns["command"] == "save_L1" and pm.session_type == "L1":
+            self.jack.session_save()
+            self.save_session("L1")
+        if session_ns["command"].endswith("_JACK") and \
+                                                pm.session_type == "JACK":
+            self.handle_jack_session(**session_ns)
+
+        if cons_changed:
+            self.jack.standard_save()
 
 
     def handle_jack_session(self, command, event, directory, uuid):
@@ -3003,6 +3152,16 @@ class MainWindow(dbus.service.Object):
         # For IPC.
         os.environ["ui2be"] = pm.basedir / "ui2be"
         os.environ["be2ui"] = pm.basedir / "be2ui"
+        # Meter levels and status are read from here, preferably in RAM.
+        if os.access("/dev/shm", os.W_OK):
+            telemetry_file = "/dev/shm/%s-%d-telemetry" % (client_id,
+                                                                os.getpid())
+        else:
+            telemetry_file = pm.basedir / "telemetry"
+        os.environ["telemetry_file"] = telemetry_file
+        # Saves rescanning the structure of Ogg files on every open.
+        os.environ["ogg_index_dir"] = pm.basedir / "oggindex"
+        self.telemetry = Telemetry(telemetry_file)
 
         print "jack client ID:", client_id
 
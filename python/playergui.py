@@ -1640,30 +1640,7 @@ class IDJC_Media_Player:
             self.element = None
             self.cuesheet_track_title = self.cuesheet_track_performer = self.cuesheet_track_album = None
 
-        try:
-            sgain, self.gaintype = model.get_value(iter, 7).split()
-        except (AttributeError, ValueError):
-            # This column type changed to str from int. Handle the change.
-            row = self.get_media_metadata(model.get_value(iter, 1))
-            if row:
-                model.set_value(iter, 7, row[7])
-                sgain, self.gaintype = row[7].split()
-            else:
-                sgain, self.gaintype = RGDEF.split()
-        self.gain = float(sgain)
-        
-        if self.parent.prefs_window.rg_adjust.get_active():
-            if self.gaintype == "DEFAULT":
-                self.gain += self.parent.prefs_window.rg_defaultgain.get_value()
-            if self.gaintype == "RG":
-                self.gain += self.parent.prefs_window.rg_boost.get_value()
-            if self.gaintype == "R128":
-                self.gain += self.parent.prefs_window.r128_boost.get_value()
-            self.gain += self.parent.prefs_window.all_boost.get_value()
-            print "final gain value of %f dB" % self.gain
-        else:
-            self.gain = 0.0
-            print "not using replay gain"
+        self.gain, self.gaintype = self.row_gain(model, iter)
 
         if self.music_filename != "":
             self.parent.mixer_write(
@@ -1697,6 +1674,67 @@ class IDJC_Media_Player:
         self.parent.send_new_mixer_stats()
         return True
 
+    def row_gain(self, model, iter):
+        """The gain in dB to play a playlist row at, and the type of gain."""
+
+        try:
+            sgain, gaintype = model.get_value(iter, 7).split()
+        except (AttributeError, ValueError):
+            # This column type changed to str from int. Handle the change.
+            row = self.get_media_metadata(model.get_value(iter, 1))
+            if row:
+                model.set_value(iter, 7, row[7])
+                sgain, gaintype = row[7].split()
+            else:
+                sgain, gaintype = RGDEF.split()
+        gain = float(sgain)
+        
+        if self.parent.prefs_window.rg_adjust.get_active():
+            if gaintype == "DEFAULT":
+                gain += self.parent.prefs_window.rg_defaultgain.get_value()
+            if gaintype == "RG":
+                gain += self.parent.prefs_window.rg_boost.get_value()
+            if gaintype == "R128":
+                gain += self.parent.prefs_window.r128_boost.get_value()
+            gain += self.parent.prefs_window.all_boost.get_value()
+            print "final gain value of %f dB" % gain
+        else:
+            gain = 0.0
+            print "not using replay gain"
+        return gain, gaintype
+
+    def preload_next_track(self):
+        """Have the player ready the track that will follow this one.
+
+        Only where the playlist mode makes the next track certain. Should
+        the guess be wrong the player starts the other track as usual.
+        """
+
+        mode_text = self.pl_mode.get_active_text()
+        if self.cuesheet or mode_text not in (N_('Play All'), N_('Loop All')):
+            return
+
+        model = self.model_playing
+        if mode_text == N_('Play All'):
+            try:
+                iter = model.get_iter(model.get_path(self.iter_playing)[0] + 1)
+            except ValueError:
+                return
+        else:
+            iter = self.next_real_track(self.iter_playing)
+            if iter is None:
+                iter = self.first_real_track()
+            if iter is None:
+                return
+
+        filename = model.get_value(iter, 1)
+        if not filename or model.get_value(iter, 8) or \
+                                                not os.path.isfile(filename):
+            return
+        gain = self.row_gain(model, iter)[0]
+        self.parent.mixer_write("PLRP=%s\nSEEK=0\nRGDB=%f\nACTN=preload%s\nend\n"
+                                        % (filename, gain, self.playername))
+
     def player_shutdown(self):
         print "player shutdown code was called"
 
@@ -2166,6 +2204,12 @@ class IDJC_Media_Player:
         pl_mode = self.pl_mode.get_active()
 
         if self.progress_press == False:
+            # The decoder is done so the player is free to open the next one.
+            if self.mixer_cid.value > self.player_cid and \
+                                        self.preload_cid != self.player_cid:
+                self.preload_cid = self.player_cid
+                self.preload_next_track()
+
             if self.runout.value and self.is_paused == False and \
                                         self.mixer_cid.value > self.player_cid:
                 self.gapless = True
@@ -4622,6 +4666,7 @@ class IDJC_Media_Player:
         self.cuesheet_track_performer = None
         self.cuesheet_track_album = None
         self.gapless = False
+        self.preload_cid = -1
         self.seek_file_valid = False
         self.digiprogress_type = 0
         self.digiprogress_f = 0
@@ -1226,6 +1226,17 @@ class StreamTab(Tab):
             time.sleep(0.25)
             self.send(self.connection_string)
             self.receive()
+            self.mark_telemetry()
+
+    def mark_telemetry(self):
+        """Note the first telemetry update that reflects a new connection.
+
+        The update in progress may have read the streamer state before the
+        connect command so the one after that is the first to be trusted.
+        """
+
+        snap = self.scg.parent.telemetry.read()
+        self.telemetry_mark = snap["updates"] + 2 if snap is not None else 0
 
     def cb_server_connect(self, widget):
         if widget.get_active():
@@ -1267,6 +1278,7 @@ class StreamTab(Tab):
                 self.server_connect.set_active(False)
                 self.connection_string = None
             else:
+                self.mark_telemetry()
                 self.connection_pane.streaming_set(True)
         else:
             self.send("command=server_disconnect\n")
@@ -1409,6 +1421,7 @@ class StreamTab(Tab):
     def __init__(self, scg, numeric_id, indicator_lookup):
         Tab.__init__(self, scg, numeric_id, indicator_lookup)
         self.scg = scg
+        self.telemetry_mark = 0
         self.show_indicator("clear")
         self.tab_type = "streamer"
         self.set_spacing(10)
@@ -2137,22 +2150,19 @@ class SourceClientGui(dbus.service.Object):
     def monitor(self):
         self.led_alternate = not self.led_alternate
         streaming = recording = False
+        # Status comes from the backend's telemetry block. There is nothing
+        # to show until it is up.
+        snap = self.parent.telemetry.read()
+        recorders = snap["recorders"] if snap is not None else ()
+        streamers = snap["streamers"] if snap is not None else ()
         # update the recorder LED indicators 
-        for rectab in self.recordtabframe.tabs:
-            self.send("dev_type=recorder\ntab_id=%d\ncommand=get_report\n" %
-                                                            rectab.numeric_id)
-            while 1:
-                reply = self.receive()
-                if reply == "succeeded" or reply == "failed":
-                    break
-                if reply.startswith("recorder%dreport=" % rectab.numeric_id):
-                    recorder_state, recorded_seconds = reply.split("=")[
-                                                                1].split(":")
-                    rectab.show_indicator(("clear", "red", "amber", "clear")[
-                                                        int(recorder_state)])
-                    rectab.time_indicator.set_value(int(recorded_seconds))
-                    if recorder_state != "0":
-                        recording = True
+        for rectab, (recorder_state, recorded_seconds) in zip(
+                                        self.recordtabframe.tabs, recorders):
+            rectab.show_indicator(("clear", "red", "amber", "clear")[
+                                                            recorder_state])
+            rectab.time_indicator.set_value(recorded_seconds)
+            if recorder_state != 0:
+                recording = True
         update_listeners = False
         l_count = 0
         for streamtab in self.streamtabframe.tabs:
@@ -2162,58 +2172,49 @@ class SourceClientGui(dbus.service.Object):
                 update_listeners = True
                 l_count += cp.listeners
             
-            self.send("dev_type=streamer\ntab_id=%d\ncommand=get_report\n" % \
-                                                        streamtab.numeric_id)
-            reply = self.receive()
-            if reply != "failed":
-                self.receive()
-                if reply.startswith("streamer%dreport=" % streamtab.numeric_id):
-                    streamer_state, stream_sendbuffer_pc, brand_new = \
-                                                    reply.split("=")[1].split(":")
-                    state = int(streamer_state)
-                    self._handle_streamstate(streamtab.numeric_id,
-                                            int(state > 1), streamtab)
-                    streamtab.show_indicator(
-                                    ("clear", "amber", "green", "clear")[state])
-                    streamtab.ircpane.connections_controller.set_stream_active(
-                                                                    state > 1)
-                    mi = self.parent.stream_indicator[streamtab.numeric_id]
-                    if (streamer_state == "2"):
-                        mi.set_active(True)
-                        mi.set_value(int(stream_sendbuffer_pc))
-                        if int(stream_sendbuffer_pc
-                                                ) >= 100 and self.led_alternate:
-                            tshoot = streamtab.troubleshooting
-                            if tshoot.sbf_discard_audio.get_active():
-                                streamtab.show_indicator("amber")
-                                mi.set_flash(True)
-                            else:
-                                streamtab.server_connect.set_active(False)
-                                streamtab.server_connect.set_active(True)
-                                print "remade the connection because stream " \
-                                                            "buffer was full"
-                            del tshoot
+            if streamtab.numeric_id < len(streamers):
+                state, stream_sendbuffer_pc = streamers[streamtab.numeric_id]
+                # A connection is new when it is first seen connected.
+                brand_new = state == 2 and \
+                        self._stream_modes.get(streamtab.numeric_id, 0) != 2
+                self._stream_modes[streamtab.numeric_id] = state
+                self._handle_streamstate(streamtab.numeric_id,
+                                        int(state > 1), streamtab)
+                streamtab.show_indicator(
+                                ("clear", "amber", "green", "clear")[state])
+                streamtab.ircpane.connections_controller.set_stream_active(
+                                                                state > 1)
+                mi = self.parent.stream_indicator[streamtab.numeric_id]
+                if state == 2:
+                    mi.set_active(True)
+                    mi.set_value(stream_sendbuffer_pc)
+                    if stream_sendbuffer_pc >= 100 and self.led_alternate:
+                        tshoot = streamtab.troubleshooting
+                        if tshoot.sbf_discard_audio.get_active():
+                            streamtab.show_indicator("amber")
+                            mi.set_flash(True)
                         else:
-                            mi.set_flash(False)
+                            streamtab.server_connect.set_active(False)
+                            streamtab.server_connect.set_active(True)
+                            print "remade the connection because stream " \
+                                                        "buffer was full"
+                        del tshoot
                     else:
-                        mi.set_active(False)
                         mi.set_flash(False)
-                    if brand_new == "1":
-                        # Streamer connected triggers.
-                        streamtab.start_recorder_action.activate()
-                        streamtab.start_player_action.activate()
-                        streamtab.reconnection_dialog.deactivate()
-                    if streamer_state != "0":
-                        streaming = True
-                    elif streamtab.server_connect.get_active():
-                        streamtab.server_connect.set_active(False)
-                        streamtab.reconnection_dialog.activate()
                 else:
-                    print "sourceclientgui.monitor: bad reply for" \
-                                                    " streamer data:", reply
-            else:
-                print "sourceclientgui.monitor:" \
-                                    " failed to get a report from the streamer"
+                    mi.set_active(False)
+                    mi.set_flash(False)
+                if brand_new:
+                    # Streamer connected triggers.
+                    streamtab.start_recorder_action.activate()
+                    streamtab.start_player_action.activate()
+                    streamtab.reconnection_dialog.deactivate()
+                if state != 0:
+                    streaming = True
+                elif streamtab.server_connect.get_active() and \
+                                snap["updates"] >= streamtab.telemetry_mark:
+                    streamtab.server_connect.set_active(False)
+                    streamtab.reconnection_dialog.activate()
             # the connection start/stop timers are processed here
             if streamtab.start_timer.get_active():
                 diff = time.localtime(time.time() - \
@@ -2760,6 +2761,7 @@ class SourceClientGui(dbus.service.Object):
         self.connection_string = None
         self.is_shoutcast = False
         self._streamstate_cache = None
+        self._stream_modes = {}
         self.artist = self.title = self.album = self.songname = ""
 
         self.dialog_group = dialog_group()